@@ -21,7 +21,7 @@
 
 
 varying vec4 color;
-varying vec2 ambientOcclusionCoord;
+varying vec4 ambientOcclusionCoord;
 varying vec2 detailCoord;
 varying vec3 fogDensity;
 
@@ -40,7 +40,8 @@ void main() {
 	vec3 shading = vec3(color.w);
 	shading *= EvaluateSunLight();
 	
-	float ao = texture2D(ambientOcclusionTexture, ambientOcclusionCoord).x;
+	vec2 aoCoord = ambientOcclusionCoord.xy + .5 + fract(ambientOcclusionCoord.zw) * 15.;
+	float ao = texture2D(ambientOcclusionTexture, aoCoord * (1. / 256.)).x;
 	
 	shading += EvaluateAmbientLight(ao);
 	
@@ -30,7 +30,7 @@ uniform vec3 viewOriginVector;
 // [x, y, z]
 attribute vec3 positionAttribute;
 
-// [ax, ay]
+// [ax, ay] (the origin of the ambient occlusion tile)
 attribute vec2 ambientOcclusionCoordAttribute;
 
 // [R, G, B, diffuse]
@@ -39,15 +39,12 @@ attribute vec4 colorAttribute;
 // [nx, ny, nz]
 attribute vec3 normalAttribute;
 
-// [sx, sy, sz]
-attribute vec3 fixedPositionAttribute;
-
-varying vec2 ambientOcclusionCoord;
+varying vec4 ambientOcclusionCoord;
 varying vec4 color;
 varying vec3 fogDensity;
 varying vec2 detailCoord;
 
-void PrepareForShadowForMap(vec3 vertexCoord, vec3 fixedVertexCoord, vec3 normal);
+void PrepareForShadowForMap(vec3 vertexCoord, vec3 normal);
 vec4 FogDensity(float poweredLength);
 
 void main() {
@@ -61,19 +58,21 @@ void main() {
 	color = colorAttribute;
 	color.xyz *= color.xyz; // linearize
 
-	// ambient occlusion
-	ambientOcclusionCoord = (ambientOcclusionCoordAttribute + .5) * (1. / 256.);
+	// ambient occlusion. A quad may span several faces sharing the same tile, so the fragment
+	// shader wraps the position on the face (measured along the tile axes) into the tile.
+	vec3 normal = normalAttribute;
+	vec3 tileAxisX = normal.z != 0. ? vec3(-normal.z, 0., 0.) : vec3(0., 0., 1.);
+	vec3 tileAxisY = normal.z != 0. ? vec3(0., 1., 0.) : vec3(-normal.y, normal.x, 0.);
+	ambientOcclusionCoord.xy = ambientOcclusionCoordAttribute;
+	ambientOcclusionCoord.z = dot(positionAttribute, tileAxisX);
+	ambientOcclusionCoord.w = dot(positionAttribute, tileAxisY);
 
 	vec4 viewPos = viewMatrix * vertexPos;
 	vec2 horzRelativePos = vertexPos.xy - viewOriginVector.xy;
 	float horzDistance = dot(horzRelativePos, horzRelativePos);
 	fogDensity = FogDensity(horzDistance).xyz;
 
-	vec3 fixedPosition = chunkPosition;
-	fixedPosition += fixedPositionAttribute * 0.5;
-
-	vec3 normal = normalAttribute;
 	vec3 shadowVertexPos = vertexPos.xyz;
-	PrepareForShadowForMap(shadowVertexPos, fixedPosition, normal);
+	PrepareForShadowForMap(shadowVertexPos, normal);
 }
 
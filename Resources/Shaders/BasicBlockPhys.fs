@@ -21,7 +21,7 @@
 
 
 varying vec4 color;
-varying vec2 ambientOcclusionCoord;
+varying vec4 ambientOcclusionCoord;
 varying vec3 fogDensity;
 
 varying vec3 viewSpaceCoord;
@@ -51,7 +51,8 @@ void main() {
 	vec3 sunLight = EvaluateSunLight();
 	shading *= sunLight;
 
-	float ao = texture2D(ambientOcclusionTexture, ambientOcclusionCoord).x;
+	vec2 aoCoord = ambientOcclusionCoord.xy + .5 + fract(ambientOcclusionCoord.zw) * 15.;
+	float ao = texture2D(ambientOcclusionTexture, aoCoord * (1. / 256.)).x;
 
 	shading += EvaluateAmbientLight(ao);
 
@@ -30,7 +30,7 @@ uniform vec3 viewOriginVector;
 // [x, y, z]
 attribute vec3 positionAttribute;
 
-// [ax, ay]
+// [ax, ay] (the origin of the ambient occlusion tile)
 attribute vec2 ambientOcclusionCoordAttribute;
 
 // [R, G, B, diffuse]
@@ -39,10 +39,7 @@ attribute vec4 colorAttribute;
 // [nx, ny, nz]
 attribute vec3 normalAttribute;
 
-// [sx, sy, sz]
-attribute vec3 fixedPositionAttribute;
-
-varying vec2 ambientOcclusionCoord;
+varying vec4 ambientOcclusionCoord;
 varying vec4 color;
 varying vec3 fogDensity;
 
@@ -51,7 +48,7 @@ varying vec3 viewSpaceNormal;
 
 varying vec3 reflectionDir;
 
-void PrepareForShadowForMap(vec3 vertexCoord, vec3 fixedVertexCoord, vec3 normal);
+void PrepareForShadowForMap(vec3 vertexCoord, vec3 normal);
 vec4 FogDensity(float poweredLength);
 
 void main() {
@@ -70,20 +67,21 @@ void main() {
 	color.w = dot(sunDir, normalAttribute);
 
 
-	// ambient occlusion
-	ambientOcclusionCoord = (ambientOcclusionCoordAttribute + .5) * (1. / 256.);
+	// ambient occlusion (see BasicBlock.vs)
+	vec3 normal = normalAttribute;
+	vec3 tileAxisX = normal.z != 0. ? vec3(-normal.z, 0., 0.) : vec3(0., 0., 1.);
+	vec3 tileAxisY = normal.z != 0. ? vec3(0., 1., 0.) : vec3(-normal.y, normal.x, 0.);
+	ambientOcclusionCoord.xy = ambientOcclusionCoordAttribute;
+	ambientOcclusionCoord.z = dot(positionAttribute, tileAxisX);
+	ambientOcclusionCoord.w = dot(positionAttribute, tileAxisY);
 
 	vec4 viewPos = viewMatrix * vertexPos;
 	vec2 horzRelativePos = vertexPos.xy - viewOriginVector.xy;
 	float horzDistance = dot(horzRelativePos, horzRelativePos);
 	fogDensity = FogDensity(horzDistance).xyz;
 
-	vec3 fixedPosition = chunkPosition;
-	fixedPosition += fixedPositionAttribute * 0.5;
-
-	vec3 normal = normalAttribute;
 	vec3 shadowVertexPos = vertexPos.xyz;
-	PrepareForShadowForMap(shadowVertexPos, fixedPosition, normal);
+	PrepareForShadowForMap(shadowVertexPos, normal);
 
 	// reflection vector (used for specular lighting)
 	reflectionDir = reflect(vertexPos.xyz - viewOriginVector, normal);
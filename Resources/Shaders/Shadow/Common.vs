@@ -21,9 +21,10 @@
 
 
 void PrepareForShadow_Map(vec3 vertexCoord, vec3 normal) ;
+void PrepareForShadowForMap_Map(vec3 vertexCoord, vec3 normal);
 void PrepareForShadow_Model(vec3 vertexCoord, vec3 normal);
 void PrepareForRadiosity_Map(vec3 vertexCoord, vec3 normal);
-void PrepareForRadiosityForMap_Map(vec3 vertexCoord, vec3 centerCoord, vec3 normal);
+void PrepareForRadiosityForMap_Map(vec3 vertexCoord, vec3 normal);
 
 void PrepareForShadow(vec3 vertexCoord, vec3 normal) {
 	PrepareForShadow_Map(vertexCoord, normal);
@@ -31,9 +32,11 @@ void PrepareForShadow(vec3 vertexCoord, vec3 normal) {
 	PrepareForRadiosity_Map(vertexCoord, normal);
 }
 
-void PrepareForShadowForMap(vec3 vertexCoord, vec3 centerCoord, vec3 normal) {
-	// map uses specialized shadow coordinate calculation to avoid glitch
-	PrepareForShadow_Map(centerCoord + normal * 0.1, normal);
+void PrepareForShadowForMap(vec3 vertexCoord, vec3 normal) {
+	// map uses specialized shadow coordinate calculation to avoid glitch.
+	// a map quad may span several voxel faces, so the fragment shader finds
+	// the voxel face containing each fragment.
+	PrepareForShadowForMap_Map(vertexCoord, normal);
 	PrepareForShadow_Model(vertexCoord, normal);
-	PrepareForRadiosityForMap_Map(vertexCoord, centerCoord, normal);
+	PrepareForRadiosityForMap_Map(vertexCoord, normal);
 }
@@ -22,10 +22,32 @@
 uniform sampler2D mapShadowTexture;
 
 varying vec3 mapShadowCoord;
+// [nx, ny, nz, 1] for the map, zero for the others
+varying vec4 mapShadowFaceNormal;
+
+vec3 MapShadowCoord() {
+	// the map is sampled at the center of the voxel face to avoid glitch
+	vec3 coord = mapShadowCoord;
+	vec3 normal = mapShadowFaceNormal.xyz;
+	vec3 faceCenter = floor(coord - normal * 0.5) + 0.5 + normal * 0.5;
+	coord = mix(coord, faceCenter + normal * 0.1, mapShadowFaceNormal.w);
+
+	coord.y -= coord.z;
+
+	// texture value is normalized unsigned integer
+	coord.z /= 255.;
+
+	// texture coord is normalized
+	// FIXME: variable texture size
+	coord.xy /= 512.;
+
+	return coord;
+}
 
 float VisibilityOfSunLight_Map() {
-	float val = texture2D(mapShadowTexture, mapShadowCoord.xy).w;
-	if(val < mapShadowCoord.z - 0.0001)
+	vec3 shadowCoord = MapShadowCoord();
+	float val = texture2D(mapShadowTexture, shadowCoord.xy).w;
+	if(val < shadowCoord.z - 0.0001)
 		return 0.;
 	else
 		return 1.;
@@ -22,15 +22,15 @@
 
 
 varying vec3 mapShadowCoord;
+varying vec4 mapShadowFaceNormal;
 
 void PrepareForShadow_Map(vec3 vertexCoord, vec3 normal) {
 	mapShadowCoord = vertexCoord;
-	mapShadowCoord.y -= mapShadowCoord.z;
-	
-	// texture value is normalized unsigned integer
-	mapShadowCoord.z /= 255.;
-	
-	// texture coord is normalized
-	// FIXME: variable texture size
-	mapShadowCoord.xy /= 512.;
-}
\ No newline at end of file
+	mapShadowFaceNormal = vec4(0.);
+}
+
+void PrepareForShadowForMap_Map(vec3 vertexCoord, vec3 normal) {
+	// MapShadowCoord moves it to the center of the voxel face
+	mapShadowCoord = vertexCoord;
+	mapShadowFaceNormal = vec4(normal, 1.);
+}
@@ -28,6 +28,8 @@ uniform sampler3D radiosityTextureZ;
 varying vec3 radiosityTextureCoord;
 varying vec3 ambientShadowTextureCoord;
 varying vec3 normalVarying;
+// [x, y, z, 1] for the map, zero for the others
+varying vec4 radiosityMapCoord;
 uniform vec3 ambientColor;
 uniform vec3 fogColor;
 
@@ -42,27 +44,85 @@ vec3 DecodeRadiosityValue(vec3 val){
 	return val;
 }
 
+void RadiosityTextureCoords(out vec3 radiosityCoord, out vec3 ambientShadowCoord) {
+	radiosityCoord = radiosityTextureCoord;
+	ambientShadowCoord = ambientShadowTextureCoord;
+	if (radiosityMapCoord.w < 0.5)
+		return;
+
+	// find the voxel face containing the fragment
+	vec3 vertexCoord = radiosityMapCoord.xyz;
+	vec3 normal = normalVarying;
+	vec3 centerCoord = floor(vertexCoord - normal * 0.5) + 0.5 + normal * 0.5;
+	vec3 centerAST = (centerCoord + vec3(0., 0., 1.) + normal * 0.5) / vec3(512., 512., 65.);
+
+	vec3 axisA = normal.x != 0.0 ? vec3(0., 1., 0.) : vec3(1., 0., 0.);
+	vec3 axisB = normal.z != 0.0 ? vec3(0., 1., 0.) : vec3(0., 0., 1.);
+	vec3 stepA = axisA / vec3(512., 512., 65.);
+	vec3 stepB = axisB / vec3(512., 512., 65.);
+
+	// Detect the following pattern at each corner of the face:
+	//
+	//      +-----+-----+
+	//      |#####|     |
+	//      |#####|     |
+	//      |#####|     |
+	//      +-----+-----+
+	//      |    V|#####|
+	//      |  C  |#####|
+	//      |     |#####|
+	//      +-----+-----+
+	//
+	// C = centerCoord, V = the corner, # = covered by a solid voxel
+	//
+	// The corners are ordered as [+A+B, -A+B, +A-B, -A-B].
+	vec4 edges = vec4(texture3D(ambientShadowTexture, centerAST + stepA).y,
+	                  texture3D(ambientShadowTexture, centerAST - stepA).y,
+	                  texture3D(ambientShadowTexture, centerAST + stepB).y,
+	                  texture3D(ambientShadowTexture, centerAST - stepB).y);
+	vec4 diagonals = vec4(texture3D(ambientShadowTexture, centerAST + stepA + stepB).y,
+	                      texture3D(ambientShadowTexture, centerAST - stepA + stepB).y,
+	                      texture3D(ambientShadowTexture, centerAST + stepA - stepB).y,
+	                      texture3D(ambientShadowTexture, centerAST - stepA - stepB).y);
+	vec4 weightSums = edges.xyxy + edges.zzww - diagonals;
+
+	// Hide the light leaks by corners by moving the texture coordinates toward the center
+	// at such corners. The shift is interpolated bilinearly over the face.
+	vec3 rel = vertexCoord - centerCoord;
+	vec2 relA = vec2(0.5, 0.5) + vec2(1., -1.) * dot(rel, axisA);
+	vec2 relB = vec2(0.5, 0.5) + vec2(1., -1.) * dot(rel, axisB);
+	vec4 weights = relA.xyxy * relB.xxyy * vec4(lessThan(weightSums, vec4(-0.5)));
+	vertexCoord -= axisA * (0.5 * dot(weights, vec4(1., -1., 1., -1.)));
+	vertexCoord -= axisB * (0.5 * dot(weights, vec4(1., 1., -1., -1.)));
+
+	radiosityCoord = vertexCoord / vec3(512., 512., 64.);
+	ambientShadowCoord = (vertexCoord + vec3(0., 0., 1.) + normal * 0.5) / vec3(512., 512., 65.);
+}
+
 vec3 Radiosity_Map(float detailAmbientOcclusion, float ssao) {
+	vec3 radiosityCoord, ambientShadowCoord;
+	RadiosityTextureCoords(radiosityCoord, ambientShadowCoord);
+
 	vec3 col = DecodeRadiosityValue
 	(texture3D(radiosityTextureFlat,
-			   radiosityTextureCoord).xyz);
+			   radiosityCoord).xyz);
 	vec3 normal = normalize(normalVarying);
 	col += normal.x * DecodeRadiosityValue
 	(texture3D(radiosityTextureX,
-			   radiosityTextureCoord).xyz);
+			   radiosityCoord).xyz);
 	col += normal.y * DecodeRadiosityValue
 	(texture3D(radiosityTextureY,
-			   radiosityTextureCoord).xyz);
+			   radiosityCoord).xyz);
 	col += normal.z * DecodeRadiosityValue
 	(texture3D(radiosityTextureZ,
-			   radiosityTextureCoord).xyz);
+			   radiosityCoord).xyz);
 	col = max(col, 0.);
 	col *= 1.5 * ssao;
 
 	detailAmbientOcclusion *= ssao;
 
 	// ambient occlusion
-	vec2 ambTexVal = texture3D(ambientShadowTexture, ambientShadowTextureCoord).xy;
+	vec2 ambTexVal = texture3D(ambientShadowTexture, ambientShadowCoord).xy;
 	float amb = ambTexVal.x / max(ambTexVal.y, 0.25);
 	amb = max(amb, 0.); // for some reason, mainTexture value becomes negative
 
@@ -76,26 +136,29 @@ vec3 Radiosity_Map(float detailAmbientOcclusion, float ssao) {
 }
 
 vec3 BlurredReflection_Map(float detailAmbientOcclusion, vec3 direction, float ssao) {
+	vec3 radiosityCoord, ambientShadowCoord;
+	RadiosityTextureCoords(radiosityCoord, ambientShadowCoord);
+
 	vec3 col = DecodeRadiosityValue
 	(texture3D(radiosityTextureFlat,
-			   radiosityTextureCoord).xyz);
+			   radiosityCoord).xyz);
 	vec3 normal = normalize(normalVarying);
 	col += normal.x * DecodeRadiosityValue
 	(texture3D(radiosityTextureX,
-			   radiosityTextureCoord).xyz);
+			   radiosityCoord).xyz);
 	col += normal.y * DecodeRadiosityValue
 	(texture3D(radiosityTextureY,
-			   radiosityTextureCoord).xyz);
+			   radiosityCoord).xyz);
 	col += normal.z * DecodeRadiosityValue
 	(texture3D(radiosityTextureZ,
-			   radiosityTextureCoord).xyz);
+			   radiosityCoord).xyz);
 	col = max(col, 0.);
 	col *= 1.5 * ssao;
 
 	detailAmbientOcclusion *= ssao;
 
 	// ambient occlusion
-	float amb = texture3D(ambientShadowTexture, ambientShadowTextureCoord).x;
+	float amb = texture3D(ambientShadowTexture, ambientShadowCoord).x;
 	amb = max(amb, 0.); // for some reason, mainTexture value becomes negative
 	amb *= amb; // darken
 
@@ -20,61 +20,25 @@
 
 /**** CPU RADIOSITY (FASTER?) *****/
 
-uniform sampler3D ambientShadowTexture;
-
 varying vec3 radiosityTextureCoord;
 varying vec3 ambientShadowTextureCoord;
 varying vec3 normalVarying;
+varying vec4 radiosityMapCoord;
 
 void PrepareForRadiosity_Map(vec3 vertexCoord, vec3 normal) {
 	radiosityTextureCoord = (vertexCoord + vec3(0., 0., 0.)) / vec3(512., 512., 64.);
 	ambientShadowTextureCoord = (vertexCoord + vec3(0., 0., 1.)) / vec3(512., 512., 65.);
+	radiosityMapCoord = vec4(0.);
 
 	normalVarying = normal;
 }
 
-void PrepareForRadiosityForMap_Map(vec3 vertexCoord, vec3 centerCoord, vec3 normal) {
+void PrepareForRadiosityForMap_Map(vec3 vertexCoord, vec3 normal) {
 	radiosityTextureCoord = (vertexCoord + vec3(0., 0., 0.)) / vec3(512., 512., 64.);
 	ambientShadowTextureCoord = (vertexCoord + vec3(0., 0., 1.) + normal * 0.5) / vec3(512., 512., 65.);
 
-	vec3 centerAST = (centerCoord + vec3(0., 0., 1.) + normal * 0.5) / vec3(512., 512., 65.);
-	vec3 rel = vertexCoord - centerCoord;
-	vec3 relAST = rel * 2.0 / vec3(512., 512., 65.);
-
-	// Detect the following pattern:
-	//
-	//      +-----+-----+
-	//      |#####|     |
-	//      |#####|     |
-	//      |#####|     |
-	//      +-----+-----+
-	//      |    V|#####|
-	//      |  C  |#####|
-	//      |     |#####|
-	//      +-----+-----+
-	//
-	// C = centerCoord, V = vertexCoord, # = covered by a solid voxel
-	//
-	float weightSum;
-	if (normal.x != 0.0) {
-		weightSum = texture3D(ambientShadowTexture, centerAST + vec3(0.0, relAST.y, 0.0)).y +
-		          texture3D(ambientShadowTexture, centerAST + vec3(0.0, 0.0, relAST.z)).y -
-		          texture3D(ambientShadowTexture, centerAST + vec3(0.0, relAST.y, relAST.z)).y;
-	} else if (normal.y != 0.0) {
-		weightSum = texture3D(ambientShadowTexture, centerAST + vec3(relAST.x, 0.0, 0.0)).y +
-		          texture3D(ambientShadowTexture, centerAST + vec3(0.0, 0.0, relAST.z)).y -
-		          texture3D(ambientShadowTexture, centerAST + vec3(relAST.x, 0.0, relAST.z)).y;
-	} else {
-		weightSum = texture3D(ambientShadowTexture, centerAST + vec3(relAST.x, 0.0, 0.0)).y +
-		          texture3D(ambientShadowTexture, centerAST + vec3(0.0, relAST.y, 0.0)).y -
-		          texture3D(ambientShadowTexture, centerAST + vec3(relAST.x, relAST.y, 0.0)).y;
-	}
-
-	// Hide the light leaks by corners by modifying the AO texture coordinates
-	if (weightSum < -0.5) {
-		radiosityTextureCoord -= rel / vec3(512., 512., 64.);
-		ambientShadowTextureCoord = centerAST;
-	}
+	// the light leaks by corners are hidden in the fragment shader
+	radiosityMapCoord = vec4(vertexCoord, 1.);
 
 	normalVarying = normal;
-}
\ No newline at end of file
+}
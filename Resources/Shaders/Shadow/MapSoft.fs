@@ -28,6 +28,25 @@
 uniform sampler2D mapShadowTexture;
 
 varying vec3 mapShadowCoord;
+// [nx, ny, nz, 1] for the map, zero for the others
+varying vec4 mapShadowFaceNormal;
+
+vec3 MapShadowCoord() {
+	// the map is sampled at the center of the voxel face to avoid glitch
+	vec3 coord = mapShadowCoord;
+	vec3 normal = mapShadowFaceNormal.xyz;
+	vec3 faceCenter = floor(coord - normal * 0.5) + 0.5 + normal * 0.5;
+	coord = mix(coord, faceCenter + normal * 0.1, mapShadowFaceNormal.w);
+
+	coord.y -= coord.z;
+
+	// texture value is normalized unsigned integer
+	coord.z /= 255.;
+
+	// don't normalize texture coord here
+
+	return coord;
+}
 
 vec3 MapSoft_BlockSample(vec2 sample, float depth,
 						 float shiftedDepth) {
@@ -40,9 +59,10 @@ vec3 MapSoft_BlockSample(vec2 sample, float depth,
 }
 
 float VisibilityOfSunLight_Map() {
-	float depth = mapShadowCoord.z;
-	vec2 iPos = (floor(mapShadowCoord.xy));
-	vec2 fracPos = mapShadowCoord.xy - iPos.xy; // [0, 1]
+	vec3 shadowCoord = MapShadowCoord();
+	float depth = shadowCoord.z;
+	vec2 iPos = (floor(shadowCoord.xy));
+	vec2 fracPos = shadowCoord.xy - iPos.xy; // [0, 1]
 	vec2 fracPosHS = fracPos - .5;				// [-0.5, 0.5]
 	vec2 fracPosHSAbs = abs(fracPosHS);
 	
@@ -88,15 +108,15 @@ float VisibilityOfSunLight_Map() {
 	float val = 1. - mix(val1, val2, blurWeight.y);
 	
 	// --- sharp shadow
-	vec4 sharpCol = texture2D(mapShadowTexture, floor(mapShadowCoord.xy) / 512.);
+	vec4 sharpCol = texture2D(mapShadowTexture, floor(shadowCoord.xy) / 512.);
 	float sharpVal = sharpCol.w;
 	
 	// side shadow?
 	if(sharpCol.x > .499) {
-		sharpVal -= fract(mapShadowCoord.y) / 255.;
+		sharpVal -= fract(shadowCoord.y) / 255.;
 	}
 	
-	float dist = sharpVal - mapShadowCoord.z + 0.001;
+	float dist = sharpVal - shadowCoord.z + 0.001;
 	sharpVal = step(0., dist);
 	
 	float sharpWeight = clamp(4. + dist * 200., 0., 1.);
@@ -22,12 +22,34 @@
 uniform sampler2D mapShadowTexture;
 
 varying vec3 mapShadowCoord;
+// [nx, ny, nz, 1] for the map, zero for the others
+varying vec4 mapShadowFaceNormal;
+
+vec3 MapShadowCoord() {
+	// the map is sampled at the center of the voxel face to avoid glitch
+	vec3 coord = mapShadowCoord;
+	vec3 normal = mapShadowFaceNormal.xyz;
+	vec3 faceCenter = floor(coord - normal * 0.5) + 0.5 + normal * 0.5;
+	coord = mix(coord, faceCenter + normal * 0.1, mapShadowFaceNormal.w);
+
+	coord.y -= coord.z;
+
+	// texture value is normalized unsigned integer
+	coord.z /= 255.;
+
+	// texture coord is normalized
+	// FIXME: variable texture size
+	coord.xy /= 512.;
+
+	return coord;
+}
 
 float VisibilityOfSunLight_Map() {
+	vec3 shadowCoord = MapShadowCoord();
 	const vec2 mapSize = vec2(512.); // TODO: variable?
 	vec2 mapSizeInv = 1. / mapSize;
 	
-	vec2 shadowMapPixCoord = mapShadowCoord.xy * mapSize;
+	vec2 shadowMapPixCoord = shadowCoord.xy * mapSize;
 	vec2 shadowMapPixInt = floor(shadowMapPixCoord);
 	vec2 shadowMapPixFract = fract(shadowMapPixCoord);
 	vec2 shadowMapBlend = shadowMapPixFract - 0.5;
@@ -48,7 +70,7 @@ float VisibilityOfSunLight_Map() {
 	vec2 average1 = mix(samples.xz, samples.yw, shadowMapBlend.x);
 	float average = mix(average1.x, average1.y, shadowMapBlend.y);
 	
-	if(average > mapShadowCoord.z)
+	if(average > shadowCoord.z)
 		return 1.;
 	
 	vec4 samples2 = samples * samples;
@@ -58,7 +80,7 @@ float VisibilityOfSunLight_Map() {
 	float variance = averageP - average * average;
 	variance = max(variance, 0.000000001);
 	
-	float val = mapShadowCoord.z - average;
+	float val = shadowCoord.z - average;
 	val *= val;
 	val = variance / (variance + val);
 	
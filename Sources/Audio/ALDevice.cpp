@@ -20,12 +20,14 @@
 
 #include <cstring>
 #include <exception>
+#include <memory>
 #include <cstdlib>
 #include <vector>
 #include <utility>
 
 #include "ALDevice.h"
 #include "ALFuncs.h"
+#include "AudioOcclusion.h"
 #include <Client/GameMap.h>
 #include <Client/IAudioChunk.h>
 #include <Core/Debug.h>
@@ -34,6 +36,7 @@
 #include <Core/IAudioStream.h>
 #include <Core/Settings.h>
 #include <Core/AudioStream.h>
+#include <Core/TMPUtils.h>
 
 DEFINE_SPADES_SETTING(s_maxPolyphonics, "96");
 DEFINE_SPADES_SETTING(s_eax, "1");
@@ -155,15 +158,21 @@ namespace spades {
 
 			client::GameMap *map;
 
+			std::unique_ptr<AudioOcclusionService> occlusion;
+
 			struct ALSrc {
 				Internal *internal;
+				/** The index in `srcs`, also used by `occlusion`. */
+				std::size_t index;
 				ALuint handle;
 				bool eaxSource;
 				bool stereo;
 				bool local;
+				/** The position set by `Set3D` or `Set2D`. */
+				Vector3 position;
 				client::AudioParam param;
 
-				ALSrc(Internal *i) : internal(i) {
+				ALSrc(Internal *i, std::size_t index) : internal(i), index(index) {
 					SPADES_MARK_FUNCTION();
 
 					al::qalGenSources(1, &handle);
@@ -237,6 +246,7 @@ namespace spades {
 					}
 					eaxSource = true;
 					this->local = local;
+					position = v;
 					ALCheckError();
 				}
 
@@ -263,77 +273,54 @@ namespace spades {
 					ALCheckError();
 					eaxSource = false;
 					local = true;
+					position = MakeVector3(0, 0, 0);
+				}
+
+				// update stereo source's volume (not spatialized by AL)
+				void UpdateStereoGain() {
+					SPADES_MARK_FUNCTION();
+
+					if (!stereo || local)
+						return;
+
+					Vector3 eye = internal->occlusion->GetListenerPosition();
+					float dist = (position - eye).GetLength();
+					dist /= param.referenceDistance;
+					if (dist < 1.f)
+						dist = 1.f;
+					dist = 1.f / dist;
+					al::qalSourcef(handle, AL_GAIN, param.volume * dist);
+					ALCheckError();
 				}
 
 				// after calling Set2D/Set3D, must be called
 				void UpdateObstruction() {
 					SPADES_MARK_FUNCTION();
 
-					// update stereo source's volume (not spatialized by AL)
-					// FIXME: move to another function?
-					if (stereo && !local) {
-						ALfloat v3[3];
-						al::qalGetListenerfv(AL_POSITION, v3);
-						Vector3 eye = {v3[0], v3[1], v3[2]};
-						ALCheckErrorPrecise();
-						al::qalGetSourcefv(handle, AL_POSITION, v3);
-						Vector3 pos = {v3[0], v3[1], v3[2]};
-						ALCheckErrorPrecise();
-
-						float dist = (pos - eye).GetLength();
-						dist /= param.referenceDistance;
-						if (dist < 1.f)
-							dist = 1.f;
-						dist = 1.f / dist;
-						al::qalSourcef(handle, AL_GAIN, param.volume * dist);
-						ALCheckError();
-					}
+					UpdateStereoGain();
 
 					if (!internal->useEAX)
 						return;
 
-					ALint value;
-
-					al::qalGetSourcei(handle, AL_SOURCE_RELATIVE, &value);
-					ALCheckErrorPrecise();
-
-					bool enableObstruction = true;
-					if (value)
-						enableObstruction = false;
-
-					// raytrace
-					client::GameMap *map = internal->map;
-					if (map && enableObstruction) {
-						ALfloat v3[3];
-						al::qalGetListenerfv(AL_POSITION, v3);
-						Vector3 eye = {v3[0], v3[1], v3[2]};
-						ALCheckErrorPrecise();
-						al::qalGetSourcefv(handle, AL_POSITION, v3);
-						Vector3 pos = {v3[0], v3[1], v3[2]};
-						ALCheckErrorPrecise();
-						Vector3 checkPos;
-						eye = TransformVectorFromAL(eye);
-						pos = TransformVectorFromAL(pos);
-						for (int x = -1; x <= 1; x++)
-							for (int y = -1; y <= 1; y++)
-								for (int z = -1; z <= 1; z++) {
-									IntVector3 hitPos;
-									checkPos.x = pos.x + (float)x * .2f;
-									checkPos.y = pos.y + (float)y * .2f;
-									checkPos.z = pos.z + (float)z * .2f;
-									if (!map->CastRay(eye, (checkPos - eye).Normalize(),
-									                  (checkPos - eye).GetLength(), hitPos)) {
-										enableObstruction = false;
-									}
-								}
+					// The first estimate; refined by `AudioOcclusionService::Update`
+					bool obstructed = false;
+					if (local) {
+						internal->occlusion->RemoveSource(index);
 					} else {
-						enableObstruction = false;
+						obstructed =
+						  internal->occlusion->AddSource(index, TransformVectorFromAL(position));
 					}
 
+					ApplyObstruction(obstructed);
+				}
+
+				void ApplyObstruction(bool obstructed) {
+					SPADES_MARK_FUNCTION();
+
 					ALuint fx = AL_EFFECTSLOT_NULL;
 					ALuint flt = AL_FILTER_NULL;
 
-					if (enableObstruction)
+					if (obstructed)
 						flt = internal->obstructionFilter;
 
 					if (eaxSource)
@@ -496,8 +483,9 @@ namespace spades {
 				ALCheckError();
 
 				for (int i = 0; i < (int)s_maxPolyphonics; i++) {
-					srcs.push_back(new ALSrc(this));
+					srcs.push_back(new ALSrc(this, srcs.size()));
 				}
+				occlusion = stmp::make_unique<AudioOcclusionService>(srcs.size());
 
 				SPLog("%d source(s) initialized", (int)s_maxPolyphonics);
 
@@ -613,6 +601,8 @@ namespace spades {
 				al::qalListenerfv(AL_ORIENTATION, orient);
 				ALCheckError();
 
+				occlusion->SetListenerPosition(TransformVectorFromAL(eye));
+
 				// do reverb simulation
 				if (useEAX) {
 					float maxDistance = 40.f;
@@ -638,7 +628,7 @@ namespace spades {
 							rayTo = rayTo.Normalize();
 
 							IntVector3 hitPos;
-							bool hit = map->CastRay(rayFrom, rayTo, maxDistance, hitPos);
+							bool hit = occlusion->CastRay(rayFrom, rayTo, maxDistance, hitPos);
 							if (hit) {
 								Vector3 hitPosf = {(float)hitPos.x, (float)hitPos.y,
 								                   (float)hitPos.z};
@@ -648,7 +638,8 @@ namespace spades {
 							}
 
 							if (hit) {
-								bool hit2 = map->CastRay(rayFrom, -rayTo, maxDistance, hitPos);
+								bool hit2 =
+								  occlusion->CastRay(rayFrom, -rayTo, maxDistance, hitPos);
 								if (hit2)
 									roomFeedbackHistory[roomHistoryPos] = 1.f;
 								else
@@ -725,8 +716,21 @@ namespace spades {
 
 				for (size_t i = 0; i < srcs.size(); i++) {
 					ALSrc *s = srcs[i];
-					if ((SampleRandomInt(0, 7) == 0) && s->IsPlaying())
-						s->UpdateObstruction();
+					if (s->stereo && !s->local && s->IsPlaying())
+						s->UpdateStereoGain();
+				}
+
+				if (useEAX) {
+					// Stop tracking finished sources
+					for (size_t i = 0; i < srcs.size(); i++) {
+						if (occlusion->IsSourceActive(i) && !srcs[i]->IsPlaying())
+							occlusion->RemoveSource(i);
+					}
+
+					// Re-evaluate the obstruction of the sources in a batch
+					occlusion->Update();
+					for (std::size_t i : occlusion->GetChangedSources())
+						srcs[i]->ApplyObstruction(occlusion->IsSourceObstructed(i));
 				}
 			}
 		};
@@ -800,6 +804,20 @@ namespace spades {
 			return it->second;
 		}
 
+		client::IAudioChunk *ALDevice::RegisterPreloadedSound(const char *name,
+		                                                      IAudioStream &stream) {
+			SPADES_MARK_FUNCTION();
+
+			std::map<std::string, ALAudioChunk *>::iterator it = chunks.find(name);
+			if (it == chunks.end()) {
+				ALAudioChunk *c = new ALAudioChunk(&stream);
+				chunks[name] = c;
+				return c;
+			}
+			it->second->AddRef();
+			return it->second;
+		}
+
 		void ALDevice::ClearCache() {
 			SPADES_MARK_FUNCTION();
 
@@ -841,6 +859,7 @@ namespace spades {
 			SPADES_MARK_FUNCTION_DEBUG();
 			client::GameMap *oldMap = d->map;
 			d->map = mp;
+			d->occlusion->SetGameMap(mp);
 			if (mp)
 				mp->AddRef();
 			if (oldMap)
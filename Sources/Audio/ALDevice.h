@@ -44,6 +44,8 @@ namespace spades {
 			static bool TryLoad();
 
 			client::IAudioChunk *RegisterSound(const char *name) override;
+			client::IAudioChunk *RegisterPreloadedSound(const char *name,
+			                                            IAudioStream &) override;
 
 			static std::vector<std::string> DeviceList();
 
@@ -0,0 +1,274 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+
+#include "AudioOcclusion.h"
+#include <Client/GameMap.h>
+#include <Core/Debug.h>
+#include <Core/Settings.h>
+#include <Core/TMPUtils.h>
+#include <Core/ThreadPool.h>
+
+DEFINE_SPADES_SETTING(s_occlusionRayBudget, "256");
+DEFINE_SPADES_SETTING(s_occlusionAsync, "0");
+DEFINE_SPADES_SETTING(s_occlusionStats, "0");
+
+namespace spades {
+	namespace audio {
+		namespace {
+			/** The index of the center of the 3x3x3 grid. */
+			constexpr int CenterCell = 13;
+
+			/** The number of frames averaged by a `s_occlusionStats` report. */
+			constexpr std::size_t StatisticsInterval = 120;
+		} // namespace
+
+		class AudioOcclusionService::BatchJob : public ThreadPoolJob {
+		public:
+			explicit BatchJob(Batch &batch) : batch(batch) {}
+			~BatchJob() { Join(); }
+
+		protected:
+			void RunChunk(std::size_t) override { batch.Evaluate(); }
+
+		private:
+			Batch &batch;
+		};
+
+		AudioOcclusionService::AudioOcclusionService(std::size_t numSources)
+		    : sources(numSources),
+		      listenerPosition{0.f, 0.f, 0.f},
+		      cursor{0},
+		      batchRunning{false},
+		      numMainThreadRays{0},
+		      numStatFrames{0},
+		      statTotalRays{0},
+		      statMaxRays{0},
+		      statTotalQueries{0} {
+			for (Source &source : sources) {
+				source.generation = 0;
+				source.active = false;
+				source.pending = false;
+				source.obstructed = false;
+			}
+			batchJob = stmp::make_unique<BatchJob>(batch);
+		}
+
+		AudioOcclusionService::~AudioOcclusionService() {}
+
+		void AudioOcclusionService::SetGameMap(client::GameMap *newMap) {
+			map = Handle<client::GameMap>{newMap, true};
+		}
+
+		bool AudioOcclusionService::IsObstructed(const client::GameMap &map, const Vector3 &eye,
+		                                         const Vector3 &position, bool skipCenter,
+		                                         std::size_t &numRays) {
+			// Start from the center, which is the most likely to be unobstructed
+			for (int i = skipCenter ? 1 : 0; i < 27; ++i) {
+				int cell = (CenterCell + i) % 27;
+				Vector3 checkPos = position + MakeVector3((float)(cell / 9 - 1),
+				                                          (float)(cell / 3 % 3 - 1),
+				                                          (float)(cell % 3 - 1)) *
+				                                .2f;
+				IntVector3 hitPos;
+				++numRays;
+				if (!map.CastRay(eye, (checkPos - eye).Normalize(), (checkPos - eye).GetLength(),
+				                 hitPos)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool AudioOcclusionService::AddSource(std::size_t index, const Vector3 &position) {
+			SPAssert(index < sources.size());
+
+			Source &source = sources[index];
+			source.position = position;
+			source.generation++;
+			source.active = true;
+			source.pending = false;
+			source.obstructed = false;
+
+			if (map) {
+				// Most sources can be resolved by the center ray
+				Vector3 diff = position - listenerPosition;
+				IntVector3 hitPos;
+				++numMainThreadRays;
+				if (map->CastRay(listenerPosition, diff.Normalize(), diff.GetLength(), hitPos)) {
+					source.pending = true;
+					source.obstructed = true;
+				}
+			}
+
+			return source.obstructed;
+		}
+
+		void AudioOcclusionService::RemoveSource(std::size_t index) {
+			SPAssert(index < sources.size());
+
+			Source &source = sources[index];
+			source.active = false;
+			source.pending = false;
+			source.obstructed = false;
+		}
+
+		bool AudioOcclusionService::CastRay(const Vector3 &start, const Vector3 &dir,
+		                                    float length, IntVector3 &hitPos) {
+			if (!map) {
+				return false;
+			}
+			++numMainThreadRays;
+			return map->CastRay(start, dir, length, hitPos);
+		}
+
+		void AudioOcclusionService::Batch::Evaluate() {
+			SPADES_MARK_FUNCTION();
+
+			std::size_t numRefreshRays = 0;
+			for (std::size_t i = 0; i < queries.size(); ++i) {
+				if (i >= numRequiredQueries && numRefreshRays >= rayBudget) {
+					break;
+				}
+
+				Query &query = queries[i];
+				std::size_t numQueryRays = 0;
+				query.obstructed = IsObstructed(*map, listenerPosition, query.position,
+				                                query.skipCenter, numQueryRays);
+				numRays += numQueryRays;
+				if (i >= numRequiredQueries) {
+					numRefreshRays += numQueryRays;
+				}
+				numEvaluatedQueries = i + 1;
+			}
+		}
+
+		void AudioOcclusionService::BuildBatch() {
+			batch.map = map;
+			batch.listenerPosition = listenerPosition;
+			batch.queries.clear();
+			batch.numRequiredQueries = 0;
+			batch.rayBudget = static_cast<std::size_t>(std::max((int)s_occlusionRayBudget, 0));
+			batch.numEvaluatedQueries = 0;
+			batch.numRays = 0;
+
+			if (!map) {
+				return;
+			}
+
+			for (std::size_t i = 0; i < sources.size(); ++i) {
+				const Source &source = sources[i];
+				if (source.active && source.pending) {
+					batch.queries.push_back(
+					  Query{i, source.generation, source.position, true, false});
+				}
+			}
+			batch.numRequiredQueries = batch.queries.size();
+
+			for (std::size_t k = 0; k < sources.size(); ++k) {
+				std::size_t i = (cursor + k) % sources.size();
+				const Source &source = sources[i];
+				if (source.active && !source.pending) {
+					batch.queries.push_back(
+					  Query{i, source.generation, source.position, false, false});
+				}
+			}
+		}
+
+		void AudioOcclusionService::PublishBatch() {
+			for (std::size_t i = 0; i < batch.numEvaluatedQueries; ++i) {
+				const Query &query = batch.queries[i];
+				if (i >= batch.numRequiredQueries) {
+					cursor = (query.index + 1) % sources.size();
+				}
+
+				Source &source = sources[query.index];
+				if (!source.active || source.generation != query.generation) {
+					// Replaced while the batch was running
+					continue;
+				}
+
+				source.pending = false;
+				if (source.obstructed != query.obstructed) {
+					source.obstructed = query.obstructed;
+					changedSources.push_back(query.index);
+				}
+			}
+		}
+
+		void AudioOcclusionService::Update() {
+			SPADES_MARK_FUNCTION();
+
+			changedSources.clear();
+
+			std::size_t numRays = numMainThreadRays;
+			std::size_t numQueries = 0;
+			numMainThreadRays = 0;
+
+			if (batchRunning) {
+				batchJob->Join();
+				batchRunning = false;
+				PublishBatch();
+				numRays += batch.numRays;
+				numQueries += batch.numEvaluatedQueries;
+			}
+
+			BuildBatch();
+			if (!batch.queries.empty()) {
+				if (s_occlusionAsync) {
+					batchJob->Start(ThreadPool::GetGlobalPool(), 1);
+					batchRunning = true;
+				} else {
+					batch.Evaluate();
+					PublishBatch();
+					numRays += batch.numRays;
+					numQueries += batch.numEvaluatedQueries;
+				}
+			}
+
+			RecordStatistics(numRays, numQueries);
+		}
+
+		void AudioOcclusionService::RecordStatistics(std::size_t numRays, std::size_t numQueries) {
+			if (!s_occlusionStats) {
+				numStatFrames = 0;
+				statTotalRays = 0;
+				statMaxRays = 0;
+				statTotalQueries = 0;
+				return;
+			}
+
+			statTotalRays += numRays;
+			statMaxRays = std::max(statMaxRays, numRays);
+			statTotalQueries += numQueries;
+
+			if (++numStatFrames == StatisticsInterval) {
+				SPLog("Audio occlusion: %.1f rays/frame (max %d), %.1f queries/frame",
+				      (double)statTotalRays / numStatFrames, (int)statMaxRays,
+				      (double)statTotalQueries / numStatFrames);
+				numStatFrames = 0;
+				statTotalRays = 0;
+				statMaxRays = 0;
+				statTotalQueries = 0;
+			}
+		}
+	} // namespace audio
+} // namespace spades
@@ -0,0 +1,160 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <Core/Math.h>
+#include <Core/RefCountedObject.h>
+
+namespace spades {
+	namespace client {
+		class GameMap;
+	}
+	namespace audio {
+		/**
+		 * Tracks whether the audio sources are obstructed by the game map.
+		 *
+		 * A source is obstructed if all rays from the listener toward a 3x3x3 grid around the
+		 * source hit the map. A newly added source gets a provisional result from the ray
+		 * toward its center, and the rest of its rays are cast in the next batch. Each batch
+		 * (run by `Update`) evaluates all new sources and then re-evaluates the other sources
+		 * in a round-robin order until `s_occlusionRayBudget` rays are spent. With
+		 * `s_occlusionAsync`, a batch runs on the global thread pool, and its results are
+		 * published by the next `Update`.
+		 *
+		 * The listener and source positions are cached here, so the audio backend doesn't
+		 * have to read them back from the audio API.
+		 *
+		 * The sources are identified by indices in the range `[0, numSources)`.
+		 */
+		class AudioOcclusionService {
+		public:
+			explicit AudioOcclusionService(std::size_t numSources);
+			~AudioOcclusionService();
+
+			AudioOcclusionService(const AudioOcclusionService &) = delete;
+			void operator=(const AudioOcclusionService &) = delete;
+
+			void SetGameMap(client::GameMap *);
+
+			void SetListenerPosition(const Vector3 &position) { listenerPosition = position; }
+			const Vector3 &GetListenerPosition() const { return listenerPosition; }
+
+			/**
+			 * Starts tracking a source at the specified position, replacing the previous one
+			 * with the same index.
+			 *
+			 * @return The provisional obstruction state.
+			 */
+			bool AddSource(std::size_t index, const Vector3 &position);
+			void RemoveSource(std::size_t index);
+
+			bool IsSourceActive(std::size_t index) const { return sources[index].active; }
+			bool IsSourceObstructed(std::size_t index) const { return sources[index].obstructed; }
+
+			/**
+			 * Runs a batch, and publishes the results of the batch run by the last call if it
+			 * ran asynchronously.
+			 */
+			void Update();
+
+			/** Returns the indices of the sources whose state was changed by the last `Update`. */
+			const std::vector<std::size_t> &GetChangedSources() const { return changedSources; }
+
+			/** Casts a ray for other purposes (e.g., reverb estimation) and counts it. */
+			bool CastRay(const Vector3 &start, const Vector3 &dir, float length,
+			             IntVector3 &hitPos);
+
+			/**
+			 * Tests the obstruction between `eye` and `position`, stopping at the first ray
+			 * that doesn't hit the map.
+			 *
+			 * @param skipCenter Skips the ray toward the center, which is known to be blocked.
+			 * @param numRays Incremented by the number of cast rays.
+			 */
+			static bool IsObstructed(const client::GameMap &, const Vector3 &eye,
+			                         const Vector3 &position, bool skipCenter,
+			                         std::size_t &numRays);
+
+		private:
+			class BatchJob;
+
+			struct Source {
+				Vector3 position;
+				/** Incremented by `AddSource` to discard stale results. */
+				std::uint32_t generation;
+				bool active;
+				/** `true` if only the provisional result is available. */
+				bool pending;
+				bool obstructed;
+			};
+
+			struct Query {
+				std::size_t index;
+				std::uint32_t generation;
+				Vector3 position;
+				bool skipCenter;
+				bool obstructed;
+			};
+
+			struct Batch {
+				Handle<client::GameMap> map;
+				Vector3 listenerPosition;
+				std::vector<Query> queries;
+				/** The queries before this index are evaluated regardless of the budget. */
+				std::size_t numRequiredQueries;
+				std::size_t rayBudget;
+
+				// Outputs
+				std::size_t numEvaluatedQueries;
+				std::size_t numRays;
+
+				void Evaluate();
+			};
+
+			std::vector<Source> sources;
+			Handle<client::GameMap> map;
+			Vector3 listenerPosition;
+			/** The index of the source to re-evaluate next. */
+			std::size_t cursor;
+
+			Batch batch;
+			std::unique_ptr<BatchJob> batchJob;
+			bool batchRunning;
+
+			std::vector<std::size_t> changedSources;
+
+			// Statistics (`s_occlusionStats`)
+			std::size_t numMainThreadRays;
+			std::size_t numStatFrames;
+			std::size_t statTotalRays;
+			std::size_t statMaxRays;
+			std::size_t statTotalQueries;
+
+			void BuildBatch();
+			void PublishBatch();
+			void RecordStatistics(std::size_t numRays, std::size_t numQueries);
+		};
+	} // namespace audio
+} // namespace spades
@@ -20,6 +20,7 @@
 
 #include <Imports/SDL.h>
 
+#include "AudioOcclusion.h"
 #include "YsrDevice.h"
 #include <Client/GameMap.h>
 #include <Client/IAudioChunk.h>
@@ -393,22 +394,10 @@ namespace spades {
 
 			// check obstruction
 			if (gameMap) {
-				Vector3 eye = listenerPosition;
-				Vector3 pos = origin;
-				Vector3 checkPos;
-				result.directGain = 0.4f;
-				for (int x = -1; x <= 1; x++)
-					for (int y = -1; y <= 1; y++)
-						for (int z = -1; z <= 1; z++) {
-							IntVector3 hitPos;
-							checkPos.x = pos.x + (float)x * .2f;
-							checkPos.y = pos.y + (float)y * .2f;
-							checkPos.z = pos.z + (float)z * .2f;
-							if (!gameMap->CastRay(eye, (checkPos - eye).Normalize(),
-							                      (checkPos - eye).GetLength(), hitPos)) {
-								result.directGain = 1.f;
-							}
-						}
+				std::size_t numRays = 0;
+				bool obstructed = AudioOcclusionService::IsObstructed(
+				  *gameMap, listenerPosition, origin, false, numRays);
+				result.directGain = obstructed ? 0.4f : 1.f;
 			} else {
 				result.directGain = 1.f;
 			}
@@ -443,6 +432,21 @@ namespace spades {
 			return it->second;
 		}
 
+		client::IAudioChunk *YsrDevice::RegisterPreloadedSound(const char *name,
+		                                                       IAudioStream &stream) {
+			SPADES_MARK_FUNCTION();
+
+			auto it = chunks.find(name);
+			if (it == chunks.end()) {
+				auto *c = new YsrAudioChunk(driver, &stream);
+				chunks[name] = c;
+				c->AddRef();
+				return c;
+			}
+			it->second->AddRef();
+			return it->second;
+		}
+
 		void YsrDevice::ClearCache() {
 			SPADES_MARK_FUNCTION();
 
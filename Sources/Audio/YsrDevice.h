@@ -61,6 +61,8 @@ namespace spades {
 			static bool TryLoadYsr();
 
 			client::IAudioChunk *RegisterSound(const char *name) override;
+			client::IAudioChunk *RegisterPreloadedSound(const char *name,
+			                                            IAudioStream &) override;
 
 			void ClearCache() override;
 
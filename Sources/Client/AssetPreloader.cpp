@@ -0,0 +1,219 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <atomic>
+
+#include "AssetPreloader.h"
+#include "IAudioDevice.h"
+#include "IRenderer.h"
+#include <Core/AudioStream.h>
+#include <Core/Bitmap.h>
+#include <Core/Debug.h>
+#include <Core/IAudioStream.h>
+#include <Core/MemoryAudioStream.h>
+#include <Core/TMPUtils.h>
+#include <Core/ThreadPool.h>
+
+namespace spades {
+	namespace client {
+		namespace {
+			const char *GetAssetTypeName(AssetPreloader::AssetType type) {
+				switch (type) {
+					case AssetPreloader::AssetType::Image: return "image";
+					case AssetPreloader::AssetType::Model: return "model";
+					case AssetPreloader::AssetType::Sound: return "sound";
+				}
+				return "asset";
+			}
+		} // namespace
+
+		struct AssetPreloader::Asset {
+			ManifestEntry entry;
+
+			// The outputs of `Load`
+			Handle<Bitmap> bitmap;
+			std::unique_ptr<PreloadedModel> model;
+			std::unique_ptr<IAudioStream> sound;
+			std::string error;
+			/** The time spent by `Load`, in seconds. */
+			double loadTime = 0.0;
+
+			/** Set by a worker thread when the outputs of `Load` are ready. */
+			std::atomic<bool> loaded{false};
+			bool registered = false;
+		};
+
+		class AssetPreloader::Job : public ThreadPoolJob {
+		public:
+			Job(AssetPreloader &preloader) : preloader{preloader} {}
+			~Job() { Join(); }
+
+		protected:
+			void RunChunk(std::size_t index) override { preloader.Load(*preloader.assets[index]); }
+
+		private:
+			AssetPreloader &preloader;
+		};
+
+		AssetPreloader::AssetPreloader(IRenderer &renderer, IAudioDevice &audioDevice,
+		                               std::vector<ManifestEntry> manifest)
+		    : renderer{renderer}, audioDevice{audioDevice} {
+			SPADES_MARK_FUNCTION();
+
+			for (ManifestEntry &entry : manifest) {
+				auto asset = stmp::make_unique<Asset>();
+				asset->entry = std::move(entry);
+				assets.push_back(std::move(asset));
+			}
+
+			SPLog("Preloading %d assets", static_cast<int>(assets.size()));
+
+			job = stmp::make_unique<Job>(*this);
+			job->Start(ThreadPool::GetGlobalPool(), assets.size());
+		}
+
+		AssetPreloader::~AssetPreloader() {
+			SPADES_MARK_FUNCTION();
+
+			// Wait for the worker threads before destroying `assets`
+			job.reset();
+		}
+
+		void AssetPreloader::Load(Asset &asset) {
+			SPADES_MARK_FUNCTION();
+
+			Stopwatch sw;
+			const char *path = asset.entry.path.c_str();
+			try {
+				switch (asset.entry.type) {
+					case AssetType::Image: asset.bitmap = Bitmap::Load(path); break;
+					case AssetType::Model: asset.model = renderer.PreloadModel(path); break;
+					case AssetType::Sound: {
+						std::unique_ptr<IAudioStream> stream{OpenAudioStream(path)};
+						asset.sound = stmp::make_unique<MemoryAudioStream>(*stream);
+						break;
+					}
+				}
+			} catch (const std::exception &ex) {
+				asset.error = ex.what();
+			}
+			asset.loadTime = sw.GetTime();
+
+			asset.loaded.store(true, std::memory_order_release);
+		}
+
+		void AssetPreloader::Register(Asset &asset) {
+			SPADES_MARK_FUNCTION();
+
+			Stopwatch sw;
+			const char *path = asset.entry.path.c_str();
+			const char *typeName = GetAssetTypeName(asset.entry.type);
+			if (!asset.error.empty()) {
+				// The error will be reported again when the asset is actually used
+				SPLog("Failed to preload %s '%s': %s", typeName, path, asset.error.c_str());
+			} else {
+				try {
+					switch (asset.entry.type) {
+						case AssetType::Image:
+							renderer.RegisterPreloadedImage(path, *asset.bitmap);
+							break;
+						case AssetType::Model:
+							renderer.RegisterPreloadedModel(path, *asset.model);
+							break;
+						case AssetType::Sound:
+							audioDevice.RegisterPreloadedSound(path, *asset.sound);
+							break;
+					}
+					SPLog("Preloaded %s '%s' (load: %.2f ms, register: %.2f ms)", typeName, path,
+					      asset.loadTime * 1000.0, sw.GetTime() * 1000.0);
+				} catch (const std::exception &ex) {
+					SPLog("Failed to register %s '%s': %s", typeName, path, ex.what());
+				}
+			}
+
+			// The loaded data isn't needed anymore
+			asset.bitmap = nullptr;
+			asset.model.reset();
+			asset.sound.reset();
+
+			asset.registered = true;
+			++numRegistered;
+			registerTime += sw.GetTime();
+		}
+
+		bool AssetPreloader::Poll(double timeBudget) {
+			SPADES_MARK_FUNCTION();
+
+			if (numRegistered == assets.size()) {
+				return true;
+			}
+
+			Stopwatch sw;
+			for (const auto &asset : assets) {
+				if (asset->registered || !asset->loaded.load(std::memory_order_acquire)) {
+					continue;
+				}
+				Register(*asset);
+				if (sw.GetTime() >= timeBudget) {
+					break;
+				}
+			}
+
+			if (numRegistered < assets.size()) {
+				return false;
+			}
+
+			// Release the thread pool's job slot
+			job->Join();
+
+			ReportCompletion();
+			return true;
+		}
+
+		void AssetPreloader::Finish() {
+			SPADES_MARK_FUNCTION();
+
+			if (numRegistered == assets.size()) {
+				return;
+			}
+
+			job->Join();
+			for (const auto &asset : assets) {
+				if (!asset->registered) {
+					Register(*asset);
+				}
+			}
+
+			ReportCompletion();
+		}
+
+		void AssetPreloader::ReportCompletion() {
+			double loadTime = 0.0;
+			for (const auto &asset : assets) {
+				loadTime += asset->loadTime;
+			}
+
+			SPLog("Preloaded %d assets in %.1f ms (load: %.1f ms in total on %d threads, "
+			      "register: %.1f ms)",
+			      static_cast<int>(assets.size()), stopwatch.GetTime() * 1000.0, loadTime * 1000.0,
+			      ThreadPool::GetGlobalPool().GetNumParticipants(), registerTime * 1000.0);
+		}
+	} // namespace client
+} // namespace spades
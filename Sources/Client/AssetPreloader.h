@@ -0,0 +1,94 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Core/Stopwatch.h>
+
+namespace spades {
+	namespace client {
+		class IRenderer;
+		class IAudioDevice;
+
+		/**
+		 * Loads the assets listed in a manifest before they are used for the first time, so
+		 * that the first use doesn't stall the game.
+		 *
+		 * The CPU-bound part of loading an asset (decoding an image or a sound, parsing a KV6
+		 * file, and building a mesh) is done by the global thread pool. The loaded data is
+		 * then handed over to `IRenderer` and `IAudioDevice` by `Poll` or `Finish`, which must
+		 * be called by the thread owning them.
+		 */
+		class AssetPreloader {
+		public:
+			enum class AssetType { Image, Model, Sound };
+
+			struct ManifestEntry {
+				AssetType type;
+				std::string path;
+			};
+
+			/** Starts loading the assets in the background. */
+			AssetPreloader(IRenderer &, IAudioDevice &, std::vector<ManifestEntry> manifest);
+
+			/** Waits for the background tasks. Unregistered assets are discarded. */
+			~AssetPreloader();
+
+			AssetPreloader(const AssetPreloader &) = delete;
+			void operator=(const AssetPreloader &) = delete;
+
+			/**
+			 * Registers the assets loaded so far. Returns after approximately `timeBudget`
+			 * seconds even if there are more assets ready to register.
+			 *
+			 * @return `true` if all assets are registered.
+			 */
+			bool Poll(double timeBudget);
+
+			/** Waits until all assets are loaded and registers them. */
+			void Finish();
+
+		private:
+			struct Asset;
+			class Job;
+
+			IRenderer &renderer;
+			IAudioDevice &audioDevice;
+
+			std::vector<std::unique_ptr<Asset>> assets;
+			std::size_t numRegistered = 0;
+			std::unique_ptr<Job> job;
+
+			/** Measures the time since the construction. */
+			Stopwatch stopwatch;
+
+			/** The time spent by `Register`, in seconds. */
+			double registerTime = 0.0;
+
+			/** Called by worker threads. */
+			void Load(Asset &);
+			void Register(Asset &);
+			void ReportCompletion();
+		};
+	} // namespace client
+} // namespace spades
@@ -0,0 +1,111 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+namespace spades {
+	namespace client {
+		class GameMap;
+		class IRenderer;
+
+		/**
+		 * Benchmarks run by the client console commands. Each function works on a copy of the
+		 * given data and writes the results to the log.
+		 *
+		 * The implementations are grouped by the subsystem they measure: `BenchmarkCore.cpp`,
+		 * `BenchmarkMap.cpp`, `BenchmarkWorld.cpp`, and `BenchmarkDraw.cpp`.
+		 */
+		namespace benchmark {
+			/**
+			 * Compares the memory usage and the access latency of `GameMap::StorageMode::Dense`
+			 * and `GameMap::StorageMode::Sparse` using the contents of the given map.
+			 */
+			void RunMapStorageBenchmark(GameMap &);
+
+			/**
+			 * Measures the overhead of dispatching a parallel loop through `ThreadPool`,
+			 * compared to spawning one `ConcurrentDispatch` per thread.
+			 */
+			void RunDispatchBenchmark();
+
+			/**
+			 * Compares `GameMap::CastRay2` and `OBB3::RayCast` called for each ray with their
+			 * batched versions (`GameMap::CastRays` and `HitBoxSet`), and verifies that both
+			 * produce identical results.
+			 */
+			void RunRayCastBenchmark(GameMap &);
+
+			/**
+			 * Replays destruction patterns (grenade blasts, slab cuts, and collapses of
+			 * buildings) on a copy of the given map and measures the floating-block detection
+			 * of `GameMapWrapper`.
+			 */
+			void RunFloatingBlockBenchmark(GameMap &);
+
+			/**
+			 * Reads every file in the registered pak files through `ZipFileSystem` and
+			 * `MappedZipFileSystem` (also from multiple threads), and verifies that both
+			 * return identical contents.
+			 */
+			void RunPakBenchmark();
+
+			/**
+			 * Measures the per-call overhead of `SPADES_MARK_FUNCTION` and compares it with the
+			 * previous shadow call stack implementation (a TLS lookup and a `std::vector`).
+			 */
+			void RunBacktraceBenchmark();
+
+			/**
+			 * Replays a long synthetic sequence of RLE column reallocations (as done by
+			 * `SWMapRenderer::UpdateRle`) on `MiniHeap` and `SizeClassHeap`, and reports the
+			 * allocation latency and the heap growth over time.
+			 */
+			void RunRleHeapBenchmark();
+
+			/**
+			 * Simulates 10k-100k debris particles falling onto the given map with
+			 * `ParticleSystem` and with the per-object particles it replaced, and verifies that
+			 * both produce identical trajectories.
+			 */
+			void RunParticleBenchmark(GameMap &, IRenderer &);
+
+			/**
+			 * Simulates 16-256 corpses dropped on the given map with `CorpseSolver` and with the
+			 * per-corpse ragdoll update it replaced, and verifies that both produce identical
+			 * poses. Also measures `CorpseSolver` with a LOD budget.
+			 */
+			void RunCorpseBenchmark(GameMap &);
+
+			/**
+			 * Removes 1000 blocks at once from a copy of the given map, and compares notifying
+			 * the listeners of each voxel with the change journal of `GameMap` drained by
+			 * `GameMap::FlushChanges`. Also verifies that the latter invalidates every part of the
+			 * renderer caches invalidated by the former.
+			 */
+			void RunMapChangeBenchmark(GameMap &);
+
+			/**
+			 * Builds the meshes of all chunks of the map with `draw::MapChunkMesher`, and
+			 * reports the number of vertices per chunk and the build time with one thread and
+			 * with the global thread pool.
+			 */
+			void RunMapMeshBenchmark(GameMap &);
+		} // namespace benchmark
+	} // namespace client
+} // namespace spades
@@ -0,0 +1,219 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "Benchmark.h"
+#include <Core/ConcurrentDispatch.h>
+#include <Core/Debug.h>
+#include <Core/FileManager.h>
+#include <Core/IStream.h>
+#include <Core/MappedFile.h>
+#include <Core/MappedZipFileSystem.h>
+#include <Core/Stopwatch.h>
+#include <Core/ThreadLocalStorage.h>
+#include <Core/ThreadPool.h>
+#include <Core/ZipFileSystem.h>
+
+namespace spades {
+	namespace client {
+		namespace benchmark {
+			namespace {
+				void MeasurePak(const std::string &name) {
+					auto baseStream = FileManager::OpenForReading(name.c_str());
+					ZipFileSystem unzipFs{baseStream.get(), false};
+					MappedZipFileSystem mappedFs{FileManager::OpenMapped(name.c_str())};
+					std::vector<std::string> files = mappedFs.EnumAllFiles();
+
+					// Warm up the page cache so both see the same conditions
+					for (const std::string &file : files) {
+						mappedFs.OpenForReading(file.c_str())->ReadAllBytes();
+					}
+
+					Stopwatch sw;
+					std::size_t numBytes = 0;
+					for (const std::string &file : files) {
+						numBytes += unzipFs.OpenForReading(file.c_str())->ReadAllBytes().size();
+					}
+					double unzipTime = sw.GetTime();
+
+					sw.Reset();
+					for (const std::string &file : files) {
+						mappedFs.OpenForReading(file.c_str())->ReadAllBytes();
+					}
+					double mappedTime = sw.GetTime();
+
+					// `ZipFileSystem` can only read one file at a time
+					ThreadPool &pool = ThreadPool::GetGlobalPool();
+					sw.Reset();
+					pool.ParallelFor(0, files.size(), 1, [&](std::size_t i) {
+						mappedFs.OpenForReading(files[i].c_str())->ReadAllBytes();
+					});
+					double parallelTime = sw.GetTime();
+
+					int numMismatches = 0;
+					for (const std::string &file : files) {
+						std::string expected = unzipFs.OpenForReading(file.c_str())->ReadAllBytes();
+						auto actual = mappedFs.OpenMapped(file.c_str());
+						if (expected.size() != actual->GetSize() ||
+						    std::memcmp(expected.data(), actual->GetData(), expected.size()) != 0) {
+							numMismatches++;
+						}
+					}
+
+					double megabytes = (double)numBytes / (1024.0 * 1024.0);
+					SPLog("[%s] %d files, %.2f MiB, ZipFileSystem: %.1f ms (%.1f MiB/s), "
+					      "MappedZipFileSystem: %.1f ms (%.1f MiB/s), "
+					      "%d threads: %.1f ms (%.1f MiB/s), %d mismatch(es)",
+					      name.c_str(), (int)files.size(), megabytes, unzipTime * 1000.0,
+					      megabytes / unzipTime, mappedTime * 1000.0, megabytes / mappedTime,
+					      pool.GetNumParticipants(), parallelTime * 1000.0,
+					      megabytes / parallelTime, numMismatches);
+				}
+
+				void UnmarkedCall(unsigned int &counter) { ++counter; }
+
+				void MarkedCall(unsigned int &counter) {
+					SPADES_MARK_FUNCTION();
+					++counter;
+				}
+
+				// The shadow call stack before `Backtrace` became a ring buffer
+				ThreadLocalStorage<std::vector<reflection::Function const *>>
+				  legacyBacktraceTls("legacyBacktraceBenchmark");
+
+				void LegacyMarkedCall(unsigned int &counter) {
+					static constexpr reflection::Function thisFunction{__PRETTY_FUNCTION__,
+					                                                   __FILE__, __LINE__};
+					std::vector<reflection::Function const *> *stack = legacyBacktraceTls;
+					stack->push_back(&thisFunction);
+					++counter;
+					stack->pop_back();
+				}
+
+				/** Returns the best time per call in nanoseconds. */
+				double MeasureCalls(void (*fn)(unsigned int &), int numCalls,
+				                    unsigned int &counter) {
+					// Calling through a volatile pointer prevents inlining
+					void (*volatile target)(unsigned int &) = fn;
+					double best = 1.0e+10;
+					for (int k = 0; k < 5; ++k) {
+						Stopwatch sw;
+						for (int i = 0; i < numCalls; ++i) {
+							target(counter);
+						}
+						best = std::min(best, sw.GetTime());
+					}
+					return best * 1.0e9 / numCalls;
+				}
+			} // namespace
+
+			void RunDispatchBenchmark() {
+				SPADES_MARK_FUNCTION();
+
+				ThreadPool &pool = ThreadPool::GetGlobalPool();
+				// `r_swNumThreads` defaults to 4
+				const unsigned int numThreads =
+				  std::min(std::max(static_cast<unsigned int>(pool.GetNumParticipants()), 4U), 32U);
+				const int numIterations = 10000;
+				std::atomic<unsigned int> counter{0};
+
+				SPLog("Dispatch benchmark: %d iterations of a %u-way parallel loop",
+				      numIterations, numThreads);
+
+				// The previous implementation of `InvokeParallel2`
+				Stopwatch sw;
+				for (int k = 0; k < numIterations; ++k) {
+					std::array<std::unique_ptr<ConcurrentDispatch>, 32> disp;
+					for (auto i = 1U; i < numThreads; i++) {
+						auto ff = [&counter]() { counter.fetch_add(1); };
+						disp[i].reset(new FunctionDispatch<decltype(ff)>(ff));
+						disp[i]->Start();
+					}
+					counter.fetch_add(1);
+					for (auto i = 1U; i < numThreads; i++) {
+						disp[i]->Join();
+					}
+				}
+				double dispatchTime = sw.GetTime();
+
+				sw.Reset();
+				for (int k = 0; k < numIterations; ++k) {
+					pool.ParallelFor(0, numThreads, 1,
+					                 [&counter](std::size_t) { counter.fetch_add(1); });
+				}
+				double poolTime = sw.GetTime();
+
+				SPLog("ConcurrentDispatch: %.2f us/loop, ThreadPool: %.2f us/loop (counter %u)",
+				      dispatchTime * 1.0e6 / numIterations, poolTime * 1.0e6 / numIterations,
+				      counter.load());
+			}
+
+			void RunPakBenchmark() {
+				SPADES_MARK_FUNCTION();
+
+				SPLog("Pak benchmark");
+				int numPaks = 0;
+				for (const std::string &name : FileManager::EnumFiles("")) {
+					if (name.size() < 4 || (name.rfind(".pak") != name.size() - 4 &&
+					                        name.rfind(".zip") != name.size() - 4)) {
+						continue;
+					}
+					try {
+						MeasurePak(name);
+						numPaks++;
+					} catch (const std::exception &ex) {
+						SPLog("[%s] Failed: %s", name.c_str(), ex.what());
+					}
+				}
+				if (numPaks == 0) {
+					SPLog("No pak files found");
+				}
+			}
+
+			void RunBacktraceBenchmark() {
+				SPADES_MARK_FUNCTION();
+
+				const int numCalls = 10000000;
+				unsigned int counter = 0;
+				SPLog("Backtrace benchmark: %d calls, instrumentation level %d", numCalls,
+				      static_cast<int>(SPADES_BACKTRACE_LEVEL));
+
+				double unmarkedTime = MeasureCalls(UnmarkedCall, numCalls, counter);
+				double markedTime = MeasureCalls(MarkedCall, numCalls, counter);
+
+				std::vector<reflection::Function const *> legacyStack;
+				legacyBacktraceTls = &legacyStack;
+				double legacyTime = MeasureCalls(LegacyMarkedCall, numCalls, counter);
+				legacyBacktraceTls = nullptr;
+
+				SPLog("Unmarked: %.2f ns/call, ring buffer: %.2f ns/call (+%.2f ns), "
+				      "legacy: %.2f ns/call (+%.2f ns) (counter %u)",
+				      unmarkedTime, markedTime, markedTime - unmarkedTime, legacyTime,
+				      legacyTime - unmarkedTime, counter);
+			}
+		} // namespace benchmark
+	} // namespace client
+} // namespace spades
@@ -0,0 +1,246 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "Benchmark.h"
+#include "GameMap.h"
+#include <Core/Debug.h>
+#include <Core/MiniHeap.h>
+#include <Core/SizeClassHeap.h>
+#include <Core/Stopwatch.h>
+#include <Core/ThreadPool.h>
+#include <Draw/MapChunkMesher.h>
+
+namespace spades {
+	namespace client {
+		namespace benchmark {
+			namespace {
+				/** Simulates the RLE columns of `SWMapRenderer` stored in a heap. */
+				template <class Heap> class RleHeapSimulation {
+				public:
+					enum { MapSize = 512, NumColumns = MapSize * MapSize };
+
+					RleHeapSimulation(Heap &heap)
+					    : refs(NumColumns), sizes(NumColumns), heap(heap), numRuns(NumColumns) {
+						std::mt19937 rng{1};
+						std::uniform_int_distribution<int> initialRuns{1, 4};
+						for (std::size_t i = 0; i < NumColumns; ++i) {
+							numRuns[i] = initialRuns(rng);
+							sizes[i] = GetRleSize(numRuns[i]);
+							refs[i] = heap.Alloc(sizes[i]);
+						}
+					}
+
+					/** Changes the size of a column like a block placed or destroyed in it. */
+					void Edit(std::size_t column, bool grow) {
+						int runs = std::max(1, std::min(numRuns[column] + (grow ? 1 : -1), 40));
+						numRuns[column] = runs;
+
+						heap.Free(refs[column], sizes[column]);
+						sizes[column] = GetRleSize(runs);
+						refs[column] = heap.Alloc(sizes[column]);
+						std::memset(heap.template Dereference<char>(refs[column]), runs,
+						            sizes[column]);
+					}
+
+					std::size_t GetLiveSize() const {
+						std::size_t total = 0;
+						for (std::size_t size : sizes) {
+							total += size;
+						}
+						return total;
+					}
+
+					std::vector<typename Heap::Ref> refs;
+					std::vector<std::size_t> sizes;
+
+				private:
+					Heap &heap;
+					std::vector<int> numRuns;
+
+					// The header, the span lists of 6 faces, and the padding
+					static std::size_t GetRleSize(int numRuns) {
+						return (10 + numRuns * 6 + 6 + 3) & ~static_cast<std::size_t>(3);
+					}
+				};
+
+				bool CompactRleHeap(MiniHeap &, RleHeapSimulation<MiniHeap> &) { return false; }
+
+				bool CompactRleHeap(SizeClassHeap &heap, RleHeapSimulation<SizeClassHeap> &sim) {
+					if (!heap.ShouldCompact()) {
+						return false;
+					}
+					heap.Compact(sim.refs.data(), sim.sizes.data(), sim.refs.size());
+					return true;
+				}
+
+				template <class Heap>
+				void MeasureRleHeap(const char *name, Heap &heap, int numEditsPerRound,
+				                    bool compact) {
+					RleHeapSimulation<Heap> sim{heap};
+
+					const int numRounds = 5;
+					const int numEditsPerSite = 500;
+					const int siteRadius = 8;
+
+					std::mt19937 rng{42};
+					std::uniform_int_distribution<int> siteDist{0, 511};
+					std::uniform_int_distribution<int> offsetDist{-siteRadius, siteRadius};
+					std::bernoulli_distribution growDist{0.6};
+					int siteX = 0, siteY = 0;
+					double compactionTime = 0.0;
+					int numCompactions = 0;
+
+					for (int round = 0; round < numRounds; ++round) {
+						double worstBatchTime = 0.0;
+						Stopwatch roundSw;
+
+						for (int i = 0; i < numEditsPerRound; i += numEditsPerSite) {
+							// Players build and dig around a location for a while
+							siteX = siteDist(rng);
+							siteY = siteDist(rng);
+
+							Stopwatch batchSw;
+							for (int k = 0; k < numEditsPerSite; ++k) {
+								int x = (siteX + offsetDist(rng)) & 511;
+								int y = (siteY + offsetDist(rng)) & 511;
+								sim.Edit(static_cast<std::size_t>(x + y * 512), growDist(rng));
+							}
+							worstBatchTime = std::max(worstBatchTime, batchSw.GetTime());
+						}
+
+						double roundTime = roundSw.GetTime();
+
+						if (compact) {
+							Stopwatch sw;
+							if (CompactRleHeap(heap, sim)) {
+								compactionTime += sw.GetTime();
+								++numCompactions;
+							}
+						}
+
+						SPLog("[%s] round %d: %.3f us/edit (worst batch: %.3f us/edit), "
+						      "capacity: %.1f MB, live: %.1f MB",
+						      name, round + 1, roundTime * 1.0e6 / numEditsPerRound,
+						      worstBatchTime * 1.0e6 / numEditsPerSite,
+						      heap.GetCapacity() / 1048576.0, sim.GetLiveSize() / 1048576.0);
+					}
+
+					if (compact) {
+						SPLog("[%s] %d compaction(s), %.2f ms in total", name, numCompactions,
+						      compactionTime * 1000.0);
+					}
+				}
+			} // namespace
+
+			void RunRleHeapBenchmark() {
+				SPADES_MARK_FUNCTION();
+
+				// The initial capacity used by `SWMapRenderer`
+				const std::size_t initialCapacity = 512 * 512 * 64;
+				SPLog("RLE heap benchmark");
+				{
+					// `MiniHeap` slows down quickly, so it can only run a short sequence
+					MiniHeap heap{initialCapacity};
+					MeasureRleHeap("MiniHeap", heap, 4000, false);
+				}
+				{
+					SizeClassHeap heap{initialCapacity};
+					MeasureRleHeap("SizeClassHeap", heap, 200000, false);
+				}
+				{
+					SizeClassHeap heap{initialCapacity};
+					MeasureRleHeap("SizeClassHeap+compaction", heap, 200000, true);
+				}
+			}
+
+			void RunMapMeshBenchmark(GameMap &map) {
+				SPADES_MARK_FUNCTION();
+
+				using draw::MapChunkMesher;
+
+				const int numChunksX = map.Width() / MapChunkMesher::Size;
+				const int numChunksY = map.Height() / MapChunkMesher::Size;
+				const int numChunksZ = map.Depth() / MapChunkMesher::Size;
+				const std::size_t numChunks = numChunksX * numChunksY * numChunksZ;
+				MapChunkMesher mesher{map, true};
+				auto buildChunk = [&](std::size_t i, MapChunkMesher::Mesh &mesh) {
+					int cz = (int)(i % numChunksZ);
+					int cy = (int)(i / numChunksZ % numChunksY);
+					int cx = (int)(i / numChunksZ / numChunksY);
+					mesher.Build(cx, cy, cz, mesh);
+				};
+
+				// Build every chunk with one thread
+				std::vector<MapChunkMesher::Mesh> meshes(numChunks);
+				Stopwatch sw;
+				for (std::size_t i = 0; i < numChunks; i++) {
+					buildChunk(i, meshes[i]);
+				}
+				double serialTime = sw.GetTime();
+
+				std::size_t numNonEmptyChunks = 0, numVertices = 0, numFaces = 0;
+				for (const MapChunkMesher::Mesh &mesh : meshes) {
+					numNonEmptyChunks += !mesh.vertices.empty();
+					numVertices += mesh.vertices.size();
+					numFaces += mesh.numFaces;
+				}
+
+				// Build them again with the global thread pool. The result must not change.
+				ThreadPool &pool = ThreadPool::GetGlobalPool();
+				std::vector<MapChunkMesher::Mesh> parallelMeshes(numChunks);
+				sw.Reset();
+				pool.ParallelFor(0, numChunks, 4,
+				                 [&](std::size_t i) { buildChunk(i, parallelMeshes[i]); });
+				double parallelTime = sw.GetTime();
+
+				int numMismatches = 0;
+				auto isSameMesh = [](const MapChunkMesher::Mesh &a, const MapChunkMesher::Mesh &b) {
+					return a.numFaces == b.numFaces && a.vertices.size() == b.vertices.size() &&
+					       a.indices == b.indices &&
+					       std::memcmp(a.vertices.data(), b.vertices.data(),
+					                   a.vertices.size() * sizeof(MapChunkMesher::Vertex)) == 0;
+				};
+				for (std::size_t i = 0; i < numChunks; i++) {
+					numMismatches += !isSameMesh(meshes[i], parallelMeshes[i]);
+				}
+
+				SPLog("Map meshes: %d chunk(s) (%d non-empty), %.1f vertices per non-empty chunk",
+				      (int)numChunks, (int)numNonEmptyChunks,
+				      (double)numVertices / std::max<std::size_t>(numNonEmptyChunks, 1));
+				// Without merging, every exposed face would take 4 vertices
+				SPLog("Map meshes: %d face(s) merged into %d vertices (%d without merging, %.1f%% "
+				      "fewer)",
+				      (int)numFaces, (int)numVertices, (int)(numFaces * 4),
+				      100.0 - 100.0 * numVertices / std::max<std::size_t>(numFaces * 4, 1));
+				SPLog("Map meshes: 1 thread: %.1f us/chunk (%.1f ms total), %d thread(s): %.1f "
+				      "us/chunk (%.1fx), %d mismatched chunk(s)",
+				      serialTime * 1.0e6 / numChunks, serialTime * 1000.0,
+				      pool.GetNumParticipants(), parallelTime * 1.0e6 / numChunks,
+				      serialTime / parallelTime, numMismatches);
+			}
+		} // namespace benchmark
+	} // namespace client
+} // namespace spades
@@ -0,0 +1,576 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "Benchmark.h"
+#include "GameMap.h"
+#include "GameMapWrapper.h"
+#include "HitBoxSet.h"
+#include <Core/Debug.h>
+#include <Core/DynamicMemoryStream.h>
+#include <Core/Stopwatch.h>
+
+namespace spades {
+	namespace client {
+		namespace benchmark {
+			namespace {
+				const char *StorageModeName(GameMap::StorageMode mode) {
+					switch (mode) {
+						case GameMap::StorageMode::Dense: return "dense";
+						case GameMap::StorageMode::Sparse: return "sparse";
+					}
+					return "?";
+				}
+
+				void MeasureMapStorage(DynamicMemoryStream &vxl, GameMap::StorageMode mode,
+				                       const std::vector<IntVector3> &probes) {
+					Stopwatch sw;
+
+					vxl.SetPosition(0);
+					Handle<GameMap> map{GameMap::Load(&vxl, {}, mode), false};
+					double loadTime = sw.GetTime();
+					std::size_t storageSize = map->GetStorageSize();
+
+					sw.Reset();
+					uint32_t checksum = 0;
+					for (const IntVector3 &p : probes) {
+						if (map->IsSolid(p.x, p.y, p.z)) {
+							checksum += map->GetColor(p.x, p.y, p.z);
+						}
+					}
+					double readTime = sw.GetTime();
+
+					sw.Reset();
+					for (const IntVector3 &p : probes) {
+						map->Set(p.x, p.y, p.z, true, 0x64000000U | (uint32_t)(p.x ^ p.y), true);
+					}
+					double writeTime = sw.GetTime();
+
+					double numProbes = (double)probes.size();
+					SPLog("[%s] storage: %.2f MiB, load: %.1f ms, read: %.2f ns/voxel, "
+					      "write: %.2f ns/voxel (checksum %08x), storage after writes: %.2f MiB",
+					      StorageModeName(mode), (double)storageSize / (1024.0 * 1024.0),
+					      loadTime * 1000.0, readTime * 1.0e9 / numProbes,
+					      writeTime * 1.0e9 / numProbes, (unsigned int)checksum,
+					      (double)map->GetStorageSize() / (1024.0 * 1024.0));
+				}
+
+				const int NumRayCastRounds = 5;
+
+				Vector3 RandomDirection(std::mt19937 &rng) {
+					std::uniform_real_distribution<float> dist{-1.f, 1.f};
+					while (true) {
+						Vector3 v = MakeVector3(dist(rng), dist(rng), dist(rng));
+						float length = v.GetLength();
+						if (length > 0.01f && length <= 1.f) {
+							return v / length;
+						}
+					}
+				}
+
+				bool IsSameResult(const GameMap::RayCastResult &a,
+				                  const GameMap::RayCastResult &b) {
+					return a.hit == b.hit && a.startSolid == b.startSolid &&
+					       a.hitPos.x == b.hitPos.x && a.hitPos.y == b.hitPos.y &&
+					       a.hitPos.z == b.hitPos.z && a.hitBlock.x == b.hitBlock.x &&
+					       a.hitBlock.y == b.hitBlock.y && a.hitBlock.z == b.hitBlock.z &&
+					       a.normal.x == b.normal.x && a.normal.y == b.normal.y &&
+					       a.normal.z == b.normal.z;
+				}
+
+				void MeasureMapRayCast(GameMap &map, std::mt19937 &rng) {
+					// Cast rays from just above the surface like bullets do
+					const std::size_t numRays = 1 << 16;
+					const int maxSteps = 256;
+					std::vector<Vector3> origins, dirs;
+					origins.reserve(numRays);
+					dirs.reserve(numRays);
+					std::uniform_real_distribution<float> frac{0.f, 1.f};
+					while (origins.size() < numRays) {
+						int x = (int)(rng() % (uint32_t)map.Width());
+						int y = (int)(rng() % (uint32_t)map.Height());
+						uint64_t column = map.GetSolidMapWrapped(x, y);
+						int top = column ? CountTrailingZeros(column) : map.Depth() - 1;
+						float z = (float)std::max(top - 2, 0) + frac(rng);
+						origins.push_back(MakeVector3(x + frac(rng), y + frac(rng), z));
+						dirs.push_back(RandomDirection(rng));
+					}
+
+					std::vector<GameMap::RayCastResult> expected(numRays), actual(numRays);
+
+					// Take the best of a few rounds to reduce noise
+					double scalarTime = 1.0e9, batchTime = 1.0e9;
+					for (int round = 0; round < NumRayCastRounds; round++) {
+						Stopwatch sw;
+						for (std::size_t i = 0; i < numRays; i++) {
+							expected[i] = map.CastRay2(origins[i], dirs[i], maxSteps);
+						}
+						scalarTime = std::min(scalarTime, sw.GetTime());
+
+						sw.Reset();
+						map.CastRays(origins.data(), dirs.data(), numRays, maxSteps,
+						             actual.data());
+						batchTime = std::min(batchTime, sw.GetTime());
+					}
+
+					int numMismatches = 0, numHits = 0;
+					for (std::size_t i = 0; i < numRays; i++) {
+						numMismatches += IsSameResult(expected[i], actual[i]) ? 0 : 1;
+						numHits += expected[i].hit ? 1 : 0;
+					}
+
+					SPLog("[map] %d rays (%d hits), CastRay2: %.1f ns/ray, CastRays: %.1f ns/ray "
+					      "(%.2fx), %d mismatch(es)",
+					      (int)numRays, numHits, scalarTime * 1.0e9 / numRays,
+					      batchTime * 1.0e9 / numRays, scalarTime / batchTime, numMismatches);
+				}
+
+				void MeasureHitBoxRayCast(std::mt19937 &rng) {
+					// 32 players standing around in a 64x64 area
+					const int numPlayers = 32;
+					const std::size_t numRays = 1 << 15;
+					std::uniform_real_distribution<float> area{0.f, 64.f};
+					std::uniform_real_distribution<float> angle{-3.14f, 3.14f};
+					std::uniform_real_distribution<float> jitter{-0.5f, 0.5f};
+
+					HitBoxSet set;
+					std::vector<OBB3> boxes;
+					std::vector<Vector3> centers;
+					for (int i = 0; i < numPlayers; i++) {
+						Vector3 center = MakeVector3(area(rng), area(rng), 32.f + jitter(rng));
+						Matrix4 m = Matrix4::Translate(center) *
+						            Matrix4::Rotate(MakeVector3(0, 0, 1), angle(rng));
+						const AABB3 parts[] = {
+						  AABB3(-.3f, -.3f, -1.1f, .6f, .6f, .6f),
+						  AABB3(-.4f, -.25f, -.5f, .8f, .5f, 1.2f),
+						  AABB3(-.4f, -.25f, .7f, .3f, .5f, 1.5f),
+						  AABB3(.1f, -.25f, .7f, .3f, .5f, 1.5f),
+						  AABB3(-.6f, -.2f, -.4f, 1.2f, .9f, .3f)};
+						for (const AABB3 &part : parts) {
+							OBB3 box = m * OBB3(part);
+							set.AddBox(box, center);
+							boxes.push_back(box);
+							centers.push_back(center);
+						}
+					}
+
+					// Aim at random players from random positions
+					std::vector<Vector3> starts, dirs;
+					for (std::size_t i = 0; i < numRays; i++) {
+						Vector3 start = MakeVector3(area(rng), area(rng), 31.5f + jitter(rng));
+						Vector3 target = centers[rng() % centers.size()];
+						target += MakeVector3(jitter(rng), jitter(rng), jitter(rng) * 3.f);
+						starts.push_back(start);
+						dirs.push_back((target - start).Normalize());
+					}
+
+					std::vector<HitBoxSet::Hit> expected, actual;
+
+					double scalarTime = 1.0e9, batchTime = 1.0e9;
+					for (int round = 0; round < NumRayCastRounds; round++) {
+						expected.clear();
+						actual.clear();
+
+						Stopwatch sw;
+						for (std::size_t i = 0; i < numRays; i++) {
+							// `Player::RayCastApprox` followed by `OBB3::RayCast`
+							for (std::size_t j = 0; j < boxes.size(); j++) {
+								Vector3 diff = centers[j] - starts[i];
+								float c = Vector3::Dot(diff, dirs[i]);
+								if (!(sqrtf(diff.GetPoweredLength() - c * c) < 8.f)) {
+									continue;
+								}
+								HitBoxSet::Hit hit;
+								if (boxes[j].RayCast(starts[i], dirs[i], &hit.hitPos)) {
+									hit.box = j;
+									expected.push_back(hit);
+								}
+							}
+						}
+						scalarTime = std::min(scalarTime, sw.GetTime());
+
+						sw.Reset();
+						for (std::size_t i = 0; i < numRays; i++) {
+							set.RayCast(starts[i], dirs[i], actual);
+						}
+						batchTime = std::min(batchTime, sw.GetTime());
+					}
+
+					int numMismatches = std::abs((int)expected.size() - (int)actual.size());
+					for (std::size_t i = 0; i < std::min(expected.size(), actual.size()); i++) {
+						const HitBoxSet::Hit &a = expected[i], &b = actual[i];
+						if (a.box != b.box || a.hitPos.x != b.hitPos.x ||
+						    a.hitPos.y != b.hitPos.y || a.hitPos.z != b.hitPos.z) {
+							numMismatches++;
+						}
+					}
+
+					SPLog("[hit boxes] %d rays x %d boxes (%d hits), OBB3::RayCast: %.1f ns/ray, "
+					      "HitBoxSet: %.1f ns/ray (%.2fx), %d mismatch(es)",
+					      (int)numRays, (int)boxes.size(), (int)expected.size(),
+					      scalarTime * 1.0e9 / numRays, batchTime * 1.0e9 / numRays,
+					      scalarTime / batchTime, numMismatches);
+				}
+
+				struct DestructionStats {
+					const char *name;
+					int numEvents = 0;
+					std::size_t numRemoved = 0;
+					std::size_t numFloating = 0;
+					double totalTime = 0.0;
+					double maxTime = 0.0;
+
+					explicit DestructionStats(const char *name) : name{name} {}
+
+					void Log() const {
+						SPLog("[%s] %d events, %d blocks removed, %d floating, "
+						      "%.3f ms/event (max %.3f ms)",
+						      name, numEvents, (int)numRemoved, (int)numFloating,
+						      numEvents ? totalTime * 1000.0 / numEvents : 0.0,
+						      maxTime * 1000.0);
+					}
+				};
+
+				/** Removes `cells` in the same way as `World::ApplyBlockActions`. */
+				void ReplayDestruction(GameMap &map, GameMapWrapper &wrapper,
+				                       const std::vector<CellPos> &cells,
+				                       DestructionStats &stats) {
+					Stopwatch sw;
+					auto clusters = wrapper.RemoveBlocksClustered(cells);
+					double time = sw.GetTime();
+
+					for (const auto &cluster : clusters) {
+						for (const CellPos &p : cluster) {
+							map.Set(p.x, p.y, p.z, false, 0);
+						}
+						stats.numFloating += cluster.size();
+					}
+					stats.numEvents++;
+					stats.numRemoved += cells.size();
+					stats.totalTime += time;
+					stats.maxTime = std::max(stats.maxTime, time);
+				}
+
+				/** Collects the destructible solid blocks in a box. */
+				void CollectBlocks(GameMap &map, int x, int y, int z, int sizeX, int sizeY,
+				                   int sizeZ, std::vector<CellPos> &cells) {
+					for (int cx = std::max(x, 0); cx < std::min(x + sizeX, map.Width()); cx++) {
+						for (int cy = std::max(y, 0); cy < std::min(y + sizeY, map.Height());
+						     cy++) {
+							for (int cz = std::max(z, 0); cz < std::min(z + sizeZ, 62); cz++) {
+								if (map.IsSolid(cx, cy, cz)) {
+									cells.emplace_back(cx, cy, cz);
+								}
+							}
+						}
+					}
+				}
+
+				/**
+				 * Marks the caches invalidated by map changes in the same way as
+				 * `GLMapRenderer` (chunks) and `GLMapShadowRenderer` (pixels) do.
+				 */
+				class InvalidationRecorder : public IGameMapListener {
+				public:
+					enum {
+						ChunkBits = 4,
+						NumChunksX = GameMap::DefaultWidth >> ChunkBits,
+						NumChunksY = GameMap::DefaultHeight >> ChunkBits,
+						NumChunksZ = GameMap::DefaultDepth >> ChunkBits
+					};
+
+					std::vector<uint8_t> chunks;
+					std::vector<uint8_t> shadowPixels;
+					int numCalls = 0;
+
+					InvalidationRecorder()
+					    : chunks(NumChunksX * NumChunksY * NumChunksZ),
+					      shadowPixels(GameMap::DefaultWidth * GameMap::DefaultHeight) {}
+
+					void Clear() {
+						std::fill(chunks.begin(), chunks.end(), 0);
+						std::fill(shadowPixels.begin(), shadowPixels.end(), 0);
+						numCalls = 0;
+					}
+
+					/**
+					 * Compares the invalidated parts with `reference`.
+					 *
+					 * @param numMissing Incremented by the number of parts invalidated only by
+					 *                   `reference`.
+					 * @param numExtra Incremented by the number of parts invalidated only by
+					 *                 this.
+					 */
+					void Compare(const InvalidationRecorder &reference, int &numMissing,
+					             int &numExtra) const {
+						for (std::size_t i = 0; i < chunks.size(); i++) {
+							numMissing += reference.chunks[i] && !chunks[i];
+							numExtra += chunks[i] && !reference.chunks[i];
+						}
+						for (std::size_t i = 0; i < shadowPixels.size(); i++) {
+							numMissing += reference.shadowPixels[i] && !shadowPixels[i];
+							numExtra += shadowPixels[i] && !reference.shadowPixels[i];
+						}
+					}
+
+					void GameMapChanged(const IntVector3 &min, const IntVector3 &max,
+					                    GameMap *) override {
+						++numCalls;
+
+						int cx1 = (min.x - 1) >> ChunkBits;
+						int cy1 = (min.y - 1) >> ChunkBits;
+						int cz1 = std::max((min.z - 1) >> ChunkBits, 0);
+						int cx2 = (max.x + 1) >> ChunkBits;
+						int cy2 = (max.y + 1) >> ChunkBits;
+						int cz2 = std::min((max.z + 1) >> ChunkBits, NumChunksZ - 1);
+						for (int cx = cx1; cx <= cx2; cx++)
+							for (int cy = cy1; cy <= cy2; cy++)
+								for (int cz = cz1; cz <= cz2; cz++)
+									chunks[((cx & (NumChunksX - 1)) * NumChunksY +
+									        (cy & (NumChunksY - 1))) *
+									         NumChunksZ +
+									       cz] = 1;
+
+						for (int y = min.y - max.z - 1; y <= max.y - min.z; y++)
+							for (int x = min.x; x <= max.x; x++)
+								shadowPixels[(x & (GameMap::DefaultWidth - 1)) +
+								             (y & (GameMap::DefaultHeight - 1)) *
+								               GameMap::DefaultWidth] = 1;
+					}
+				};
+
+				void RestoreBlocks(GameMap &map, const std::vector<CellPos> &cells,
+				                   const std::vector<uint32_t> &colors) {
+					for (std::size_t i = 0; i < cells.size(); i++) {
+						map.Set(cells[i].x, cells[i].y, cells[i].z, true, colors[i], true);
+					}
+				}
+			} // namespace
+
+			void RunMapStorageBenchmark(GameMap &map) {
+				SPADES_MARK_FUNCTION();
+
+				DynamicMemoryStream vxl;
+				map.Save(&vxl);
+
+				// Probe around the surface because that's where most accesses happen
+				std::mt19937 rng{42};
+				const std::size_t numProbes = 1 << 22;
+				std::vector<IntVector3> probes;
+				probes.reserve(numProbes);
+				while (probes.size() < numProbes) {
+					int x = (int)(rng() % (uint32_t)map.Width());
+					int y = (int)(rng() % (uint32_t)map.Height());
+					uint64_t column = map.GetSolidMapWrapped(x, y);
+					int top = column ? CountTrailingZeros(column) : map.Depth() - 1;
+					int z = std::min(top + (int)(rng() % 4U), map.Depth() - 1);
+					probes.push_back(IntVector3::Make(x, y, z));
+				}
+
+				SPLog("Map storage benchmark: %d probes", (int)probes.size());
+				MeasureMapStorage(vxl, GameMap::StorageMode::Dense, probes);
+				MeasureMapStorage(vxl, GameMap::StorageMode::Sparse, probes);
+			}
+
+			void RunRayCastBenchmark(GameMap &map) {
+				SPADES_MARK_FUNCTION();
+
+				std::mt19937 rng{42};
+				SPLog("Ray cast benchmark");
+				MeasureMapRayCast(map, rng);
+				MeasureHitBoxRayCast(rng);
+			}
+
+			void RunFloatingBlockBenchmark(GameMap &originalMap) {
+				SPADES_MARK_FUNCTION();
+
+				DynamicMemoryStream vxl;
+				originalMap.Save(&vxl);
+				vxl.SetPosition(0);
+				Handle<GameMap> map{GameMap::Load(&vxl), false};
+
+				Stopwatch sw;
+				GameMapWrapper wrapper{*map};
+				SPLog("Floating block benchmark (setup: %.1f ms)", sw.GetTime() * 1000.0);
+
+				std::mt19937 rng{42};
+				auto surfaceAt = [&](int x, int y) {
+					uint64_t column = map->GetSolidMapWrapped(x, y);
+					return column ? CountTrailingZeros(column) : map->Depth() - 2;
+				};
+
+				DestructionStats grenades{"grenade"};
+				DestructionStats slabs{"slab cut"};
+				DestructionStats buildings{"building collapse"};
+				std::vector<CellPos> cells;
+
+				for (int i = 0; i < 2000; i++) {
+					// A 3x3x3 blast centered at the surface
+					int x = (int)(rng() % (uint32_t)map->Width());
+					int y = (int)(rng() % (uint32_t)map->Height());
+					cells.clear();
+					CollectBlocks(*map, x - 1, y - 1, surfaceAt(x, y) - 1, 3, 3, 3, cells);
+					ReplayDestruction(*map, wrapper, cells, grenades);
+				}
+
+				for (int i = 0; i < 200; i++) {
+					// Undermine a 24x24 area
+					int x = (int)(rng() % (uint32_t)map->Width());
+					int y = (int)(rng() % (uint32_t)map->Height());
+					cells.clear();
+					CollectBlocks(*map, x, y, surfaceAt(x, y) + 3, 24, 24, 2, cells);
+					ReplayDestruction(*map, wrapper, cells, slabs);
+				}
+
+				for (int i = 0; i < 200; i++) {
+					// Build a hollow building and cut all of its walls just above the ground
+					int size = 6 + (int)(rng() % 12U);
+					int numFloors = 8 + (int)(rng() % 10U);
+					int x = (int)(rng() % (uint32_t)(map->Width() - size));
+					int y = (int)(rng() % (uint32_t)(map->Height() - size));
+					int ground = surfaceAt(x, y) - 1;
+					if (ground - numFloors < 1) {
+						continue;
+					}
+					for (int dx = 0; dx < size; dx++) {
+						for (int dy = 0; dy < size; dy++) {
+							bool isWall = dx == 0 || dy == 0 || dx == size - 1 || dy == size - 1;
+							for (int dz = 0; dz < numFloors; dz++) {
+								if (isWall || dz == numFloors - 1) {
+									wrapper.AddBlock(x + dx, y + dy, ground - dz, 0x64808080U);
+								}
+							}
+						}
+					}
+					cells.clear();
+					CollectBlocks(*map, x, y, ground - 1, size, size, 1, cells);
+					ReplayDestruction(*map, wrapper, cells, buildings);
+				}
+
+				grenades.Log();
+				slabs.Log();
+				buildings.Log();
+			}
+
+			void RunMapChangeBenchmark(GameMap &originalMap) {
+				SPADES_MARK_FUNCTION();
+
+				DynamicMemoryStream vxl;
+				originalMap.Save(&vxl);
+				vxl.SetPosition(0);
+				Handle<GameMap> map{GameMap::Load(&vxl), false};
+
+				const int numEvents = 200;
+				const std::size_t eventSize = 1000;
+
+				// `perVoxel` is called for each voxel as `GameMap::Set` previously did
+				InvalidationRecorder perVoxel, journal;
+				std::list<IGameMapListener *> perVoxelListeners{&perVoxel};
+				std::mutex perVoxelMutex;
+				map->AddListener(&journal);
+
+				std::mt19937 rng{42};
+				std::vector<CellPos> cells;
+				std::vector<uint32_t> colors;
+				double perVoxelTime = 0.0, recordTime = 0.0, flushTime = 0.0;
+				int numPerVoxelCalls = 0, numJournalCalls = 0;
+				int numMissing = 0, numExtra = 0;
+
+				for (int i = 0; i < numEvents;) {
+					// Blast a crater into the surface
+					int x = (int)(rng() % (uint32_t)(map->Width() - 16));
+					int y = (int)(rng() % (uint32_t)(map->Height() - 16));
+					uint64_t column = map->GetSolidMapWrapped(x + 8, y + 8);
+					int top = column ? CountTrailingZeros(column) : map->Depth() - 2;
+					cells.clear();
+					CollectBlocks(*map, x, y, top, 16, 16, 16, cells);
+					if (cells.size() < eventSize) {
+						continue;
+					}
+					IntVector3 center = IntVector3::Make(x + 8, y + 8, top);
+					auto distance = [&](const CellPos &p) {
+						IntVector3 d = IntVector3::Make(p.x, p.y, p.z) - center;
+						return IntVector3::Dot(d, d);
+					};
+					std::sort(cells.begin(), cells.end(),
+					          [&](const CellPos &a, const CellPos &b) {
+						          return distance(a) < distance(b);
+					          });
+					cells.resize(eventSize);
+
+					colors.clear();
+					for (const CellPos &p : cells) {
+						colors.push_back(map->GetColor(p.x, p.y, p.z));
+					}
+
+					perVoxel.Clear();
+					Stopwatch sw;
+					for (const CellPos &p : cells) {
+						map->Set(p.x, p.y, p.z, false, 0, true);
+						std::lock_guard<std::mutex> guard{perVoxelMutex};
+						for (auto *l : perVoxelListeners) {
+							IntVector3 pos = IntVector3::Make(p.x, p.y, p.z);
+							l->GameMapChanged(pos, pos, map.GetPointerOrNull());
+						}
+					}
+					perVoxelTime += sw.GetTime();
+					RestoreBlocks(*map, cells, colors);
+
+					journal.Clear();
+					sw.Reset();
+					for (const CellPos &p : cells) {
+						map->Set(p.x, p.y, p.z, false, 0);
+					}
+					recordTime += sw.GetTime();
+					sw.Reset();
+					map->FlushChanges();
+					flushTime += sw.GetTime();
+					RestoreBlocks(*map, cells, colors);
+
+					numPerVoxelCalls += perVoxel.numCalls;
+					numJournalCalls += journal.numCalls;
+					journal.Compare(perVoxel, numMissing, numExtra);
+					++i;
+				}
+
+				map->RemoveListener(&journal);
+
+				SPLog("Map change benchmark: %d events of %d blocks", numEvents, (int)eventSize);
+				SPLog("[per voxel] %.1f us/event, %.1f listener calls/event",
+				      perVoxelTime * 1.0e6 / numEvents, (double)numPerVoxelCalls / numEvents);
+				SPLog("[journal] %.1f us/event (record: %.1f us, flush: %.1f us), "
+				      "%.1f listener calls/event",
+				      (recordTime + flushTime) * 1.0e6 / numEvents, recordTime * 1.0e6 / numEvents,
+				      flushTime * 1.0e6 / numEvents, (double)numJournalCalls / numEvents);
+
+				// Merging voxels into boxes may invalidate more, but must not invalidate less
+				SPLog("[journal] %d missed invalidation(s), %.1f extra chunk(s) and pixel(s)/event",
+				      numMissing, (double)numExtra / numEvents);
+			}
+		} // namespace benchmark
+	} // namespace client
+} // namespace spades
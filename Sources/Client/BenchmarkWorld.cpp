@@ -0,0 +1,592 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Corpse.h"
+#include "CorpseSolver.h"
+#include "GameMap.h"
+#include "IRenderer.h"
+#include "ParticleSystem.h"
+#include <Core/Debug.h>
+#include <Core/Stopwatch.h>
+#include <Core/ThreadPool.h>
+
+namespace spades {
+	namespace client {
+		namespace benchmark {
+			namespace {
+				/**
+				 * The previous implementation of particles (`ParticleSpriteEntity`), which were
+				 * updated one by one through a virtual call.
+				 */
+				class LegacyParticle {
+				public:
+					virtual ~LegacyParticle() {}
+
+					virtual bool Update(float dt, const GameMap &map) {
+						Vector3 lastPos = position;
+
+						time += dt;
+						if (time > lifetime)
+							return false;
+
+						position += velocity * dt;
+						velocity.z += 32.f * dt * gravityScale;
+
+						if (map.ClipWorld(position.x, position.y, position.z)) {
+							IntVector3 lp2 = lastPos.Floor();
+							IntVector3 lp = position.Floor();
+							if (lp.z != lp2.z && ((lp.x == lp2.x && lp.y == lp2.y) ||
+							                      !map.ClipWorld(lp.x, lp.y, lp2.z)))
+								velocity.z = -velocity.z;
+							else if (lp.x != lp2.x && ((lp.y == lp2.y && lp.z == lp2.z) ||
+							                           !map.ClipWorld(lp2.x, lp.y, lp.z)))
+								velocity.x = -velocity.x;
+							else if (lp.y != lp2.y && ((lp.x == lp2.x && lp.z == lp2.z) ||
+							                           !map.ClipWorld(lp.x, lp2.y, lp.z)))
+								velocity.y = -velocity.y;
+							velocity *= .36f;
+							position = lastPos;
+						}
+
+						if (rotationVelocity != 0.f)
+							angle += rotationVelocity * dt;
+
+						if (velocityDamp != 1.f)
+							velocity *= powf(velocityDamp, dt);
+
+						return true;
+					}
+
+					Vector3 position, velocity;
+					float angle, rotationVelocity;
+					float velocityDamp, gravityScale;
+					float lifetime, time;
+				};
+
+				/**
+				 * The previous implementation of ragdolls (`Corpse::Update`), which stepped each
+				 * corpse one by one with scalar code.
+				 */
+				class LegacyRagdoll {
+				public:
+					enum { NodeCount = Corpse::NodeCount };
+
+					struct Node {
+						Vector3 pos, vel, lastPos;
+					};
+
+					Node nodes[NodeCount];
+					Vector3 lastVelDiff[8];
+					bool momentumPrimed = false;
+
+					void Update(float dt, GameMap &map) {
+						float damp = 1.f;
+						float damp2 = 1.f;
+						if (dt > 0.f) {
+							damp = powf(.9f, dt);
+							damp2 = powf(.371f, dt);
+						}
+
+						for (Node &node : nodes) {
+							Vector3 oldPos = node.lastPos;
+							node.pos += node.vel * dt;
+
+							if (node.pos.z > 63.f) {
+								node.vel.z -= dt * 6.f; // buoyancy
+								node.vel *= damp;
+							} else {
+								node.vel.z += dt * 32.f; // gravity
+								node.vel.z *= damp2;
+							}
+
+							if (!map.ClipBox(oldPos.x, oldPos.y, oldPos.z)) {
+								if (map.ClipBox(node.pos.x, oldPos.y, oldPos.z)) {
+									node.vel.x = -node.vel.x * .2f;
+									if (fabsf(node.vel.x) < .3f)
+										node.vel.x = 0.f;
+									node.pos.x = oldPos.x;
+									node.vel.y *= .5f;
+									node.vel.z *= .5f;
+								}
+								if (map.ClipBox(node.pos.x, node.pos.y, oldPos.z)) {
+									node.vel.y = -node.vel.y * .2f;
+									if (fabsf(node.vel.y) < .3f)
+										node.vel.y = 0.f;
+									node.pos.y = oldPos.y;
+									node.vel.x *= .5f;
+									node.vel.z *= .5f;
+								}
+								if (map.ClipBox(node.pos.x, node.pos.y, node.pos.z)) {
+									node.vel.z = -node.vel.z * .2f;
+									if (fabsf(node.vel.z) < .3f)
+										node.vel.z = 0.f;
+									node.pos.z = oldPos.z;
+									node.vel.x *= .5f;
+									node.vel.y *= .5f;
+								}
+							}
+
+							node.lastPos = node.pos;
+						}
+
+						using C = Corpse;
+						AngularMomentum(0, C::Torso1, C::Torso2);
+						AngularMomentum(1, C::Torso2, C::Torso3);
+						AngularMomentum(2, C::Torso3, C::Torso4);
+						AngularMomentum(3, C::Torso4, C::Torso1);
+						AngularMomentum(4, C::Torso1, C::Arm1);
+						AngularMomentum(5, C::Torso2, C::Arm2);
+						AngularMomentum(6, C::Torso3, C::Leg1);
+						AngularMomentum(7, C::Torso4, C::Leg2);
+						momentumPrimed = true;
+
+						Spring(C::Torso1, C::Torso2, 0.8f, dt);
+						Spring(C::Torso3, C::Torso4, 0.8f, dt);
+						Spring(C::Torso1, C::Torso4, 0.9f, dt);
+						Spring(C::Torso2, C::Torso3, 0.9f, dt);
+						Spring(C::Torso1, C::Torso3, 1.204f, dt);
+						Spring(C::Torso2, C::Torso4, 1.204f, dt);
+						Spring(C::Arm1, C::Torso1, 1.f, dt);
+						Spring(C::Arm2, C::Torso2, 1.f, dt);
+						Spring(C::Leg1, C::Torso3, 1.f, dt);
+						Spring(C::Leg2, C::Torso4, 1.f, dt);
+
+						AngleSpring(C::Torso1, C::Arm1, C::Torso3, -1.f, 0.6f, dt);
+						AngleSpring(C::Torso2, C::Arm2, C::Torso4, -1.f, 0.6f, dt);
+						AngleSpring(C::Torso3, C::Leg1, C::Torso2, -1.f, -0.2f, dt);
+						AngleSpring(C::Torso4, C::Leg2, C::Torso1, -1.f, -0.2f, dt);
+
+						Spring(C::Torso1, C::Torso2, C::Head, .6f, dt);
+
+						LineCollision(map, C::Torso1, C::Torso2, dt);
+						LineCollision(map, C::Torso2, C::Torso3, dt);
+						LineCollision(map, C::Torso3, C::Torso4, dt);
+						LineCollision(map, C::Torso4, C::Torso1, dt);
+						LineCollision(map, C::Torso1, C::Torso3, dt);
+						LineCollision(map, C::Torso2, C::Torso4, dt);
+						LineCollision(map, C::Torso1, C::Arm1, dt);
+						LineCollision(map, C::Torso2, C::Arm2, dt);
+						LineCollision(map, C::Torso3, C::Leg1, dt);
+						LineCollision(map, C::Torso4, C::Leg2, dt);
+					}
+
+				private:
+					void AngularMomentum(int e, int a, int b) {
+						Vector3 velDiff = nodes[b].vel - nodes[a].vel;
+						if (momentumPrimed) {
+							Vector3 force = lastVelDiff[e] - velDiff;
+							force *= .5f;
+							nodes[b].vel += force;
+							nodes[a].vel -= force;
+						}
+						lastVelDiff[e] = velDiff;
+					}
+
+					void Spring(int n1, int n2, float distance, float dt) {
+						Node &a = nodes[n1];
+						Node &b = nodes[n2];
+						Vector3 diff = b.pos - a.pos;
+						float dist = diff.GetLength();
+						Vector3 force = diff.Normalize() * (distance - dist);
+						force *= dt * 50.f;
+
+						b.vel += force;
+						a.vel -= force;
+
+						b.pos += force / (dt * 50.f) * 0.5f;
+						a.pos -= force / (dt * 50.f) * 0.5f;
+
+						Vector3 velMid = (a.vel + b.vel) * .5f;
+						float dump = 1.f - powf(.1f, dt);
+						a.vel += (velMid - a.vel) * dump;
+						b.vel += (velMid - b.vel) * dump;
+					}
+
+					void Spring(int n1a, int n1b, int n2, float distance, float dt) {
+						Node &x = nodes[n1a];
+						Node &y = nodes[n1b];
+						Node &b = nodes[n2];
+						Vector3 diff = b.pos - (x.pos + y.pos) * .5f;
+						float dist = diff.GetLength();
+						Vector3 force = diff.Normalize() * (distance - dist);
+						force *= dt * 50.f;
+
+						b.vel += force;
+						force *= .5f;
+						x.vel -= force;
+						y.vel -= force;
+
+						Vector3 velMid = (x.vel + y.vel) * .25f + b.vel * .5f;
+						float dump = 1.f - powf(.05f, dt);
+						x.vel += (velMid - x.vel) * dump;
+						y.vel += (velMid - y.vel) * dump;
+						b.vel += (velMid - b.vel) * dump;
+					}
+
+					static float ACos(float v) {
+						if (v >= 1.f)
+							return 0.f;
+						if (v <= -1.f)
+							return static_cast<float>(M_PI);
+						float vv = acosf(v);
+						if (std::isnan(vv)) {
+							vv = acosf(v * .9999f);
+						}
+						return vv;
+					}
+
+					void AngleSpring(int base, int n1id, int n2id, float minDot, float maxDot,
+					                 float dt) {
+						Node &nBase = nodes[base];
+						Node &n1 = nodes[n1id];
+						Node &n2 = nodes[n2id];
+						Vector3 d1 = n1.pos - nBase.pos;
+						Vector3 d2 = n2.pos - nBase.pos;
+						float ln1 = d1.GetLength();
+						float ln2 = d2.GetLength();
+						float dot = Vector3::Dot(d1, d2) / (ln1 * ln2 + 0.0000001f);
+
+						if (dot >= minDot && dot <= maxDot)
+							return;
+
+						Vector3 diff = n2.pos - n1.pos;
+						float strength = 0.f;
+
+						Vector3 a1 = Vector3::Cross(d1, diff);
+						a1 = Vector3::Cross(d1, a1).Normalize();
+
+						if (dot > maxDot) {
+							strength = ACos(dot) - ACos(maxDot);
+						} else if (dot < minDot) {
+							strength = ACos(dot) - ACos(minDot);
+						}
+
+						strength *= 20.f;
+						strength *= dt;
+
+						a1 *= strength;
+
+						n2.vel += a1;
+						nBase.vel -= a1;
+					}
+
+					static float Fract(float v) { return v - floorf(v); }
+
+					static void CheckEscape(GameMap &map, IntVector3 hitBlock, IntVector3 a,
+					                        IntVector3 b, IntVector3 dir, float &bestDist,
+					                        IntVector3 &bestDir) {
+						hitBlock += dir;
+						IntVector3 aa = a + dir;
+						IntVector3 bb = b + dir;
+						if (map.IsSolidWrapped(hitBlock.x, hitBlock.y, hitBlock.z) ||
+						    map.IsSolidWrapped(aa.x, aa.y, aa.z) ||
+						    map.IsSolidWrapped(bb.x, bb.y, bb.z))
+							return;
+						float dist;
+						if (dir.x == 1) {
+							dist = 1.f - Fract(a.x) + (1.f - Fract(b.x));
+						} else if (dir.x == -1) {
+							dist = Fract(a.x) + Fract(b.x);
+						} else if (dir.y == 1) {
+							dist = 1.f - Fract(a.y) + (1.f - Fract(b.y));
+						} else if (dir.y == -1) {
+							dist = Fract(a.y) + Fract(b.y);
+						} else if (dir.z == 1) {
+							dist = 1.f - Fract(a.z) + (1.f - Fract(b.z));
+						} else {
+							dist = Fract(a.z) + Fract(b.z);
+						}
+						if (dist < bestDist) {
+							bestDist = dist;
+							bestDir = dir;
+						}
+					}
+
+					void LineCollision(GameMap &map, int a, int b, float dt) {
+						Node &n1 = nodes[a];
+						Node &n2 = nodes[b];
+
+						IntVector3 hitBlock;
+						if (!map.CastRay(n1.lastPos, n2.lastPos, 16.f, hitBlock))
+							return;
+
+						GameMap::RayCastResult res1 =
+						  map.CastRay2(n1.lastPos, n2.lastPos - n1.lastPos, 8);
+						GameMap::RayCastResult res2 =
+						  map.CastRay2(n2.lastPos, n1.lastPos - n2.lastPos, 8);
+						if (!res1.hit || !res2.hit || res1.startSolid || res2.startSolid)
+							return;
+
+						float length = (n2.pos - n1.pos).GetPoweredLength();
+						float proj1 =
+						  Vector3::Dot(res1.hitPos - n1.lastPos, n2.lastPos - n1.lastPos);
+						float proj2 =
+						  Vector3::Dot(res2.hitPos - n2.lastPos, n1.lastPos - n2.lastPos);
+						if (proj1 > length || proj1 < 0.f || proj2 > length || proj2 < 0.f)
+							return;
+
+						float inlen = (res1.hitPos - res2.hitPos).GetLength();
+						IntVector3 ivec = res1.normal + res2.normal;
+						if (ivec.x == 0 && ivec.y == 0 && ivec.z == 0) {
+							float bestDist = 1000.f;
+							IntVector3 bestDir;
+							for (IntVector3 dir :
+							     {IntVector3::Make(1, 0, 0), IntVector3::Make(-1, 0, 0),
+							      IntVector3::Make(0, 1, 0), IntVector3::Make(0, -1, 0),
+							      IntVector3::Make(0, 0, 1), IntVector3::Make(0, 0, -1)}) {
+								CheckEscape(map, hitBlock, n1.pos.Floor(), n2.pos.Floor(), dir,
+								            bestDist, bestDir);
+							}
+							if (bestDist > 10.f)
+								return;
+							ivec = bestDir;
+							inlen = bestDist + .1f;
+						}
+
+						Vector3 dir = MakeVector3(ivec.x, ivec.y, ivec.z);
+						Vector3 normDir = dir;
+
+						n1.vel -= normDir * std::min(Vector3::Dot(normDir, n1.vel), 0.f);
+						n2.vel -= normDir * std::min(Vector3::Dot(normDir, n2.vel), 0.f);
+
+						dir *= dt * inlen * 5.f;
+						n1.vel += dir;
+						n2.vel += dir;
+
+						n1.vel -= (n1.vel - normDir * Vector3::Dot(normDir, n1.vel)) * .2f;
+						n2.vel -= (n2.vel - normDir * Vector3::Dot(normDir, n2.vel)) * .2f;
+					}
+				};
+			} // namespace
+
+			void RunParticleBenchmark(GameMap &map, IRenderer &renderer) {
+				SPADES_MARK_FUNCTION();
+
+				const int numFrames = 120;
+				const float dt = 1.f / 60.f;
+				Handle<IImage> image = renderer.RegisterImage("Gfx/White.tga");
+
+				SPLog("Particle benchmark: %d frames, %d thread(s)", numFrames,
+				      ThreadPool::GetGlobalPool().GetNumParticipants());
+
+				for (int numParticles : {10000, 30000, 100000}) {
+					ParticleSystem particles{renderer};
+					std::list<std::unique_ptr<LegacyParticle>> legacyParticles;
+
+					// Fragments of grenade explosions above the ground
+					std::mt19937 rng{42};
+					std::uniform_real_distribution<float> unit{0.f, 1.f};
+					const int numParticlesPerExplosion = 50;
+					Vector3 origin;
+					for (int i = 0; i < numParticles; ++i) {
+						if (i % numParticlesPerExplosion == 0) {
+							int x = (int)(rng() % (uint32_t)map.Width());
+							int y = (int)(rng() % (uint32_t)map.Height());
+							uint64_t column = map.GetSolidMapWrapped(x, y);
+							int top = column ? CountTrailingZeros(column) : map.Depth() - 1;
+							origin = MakeVector3(x + .5f, y + .5f, std::max(top - 1.5f, 0.f));
+						}
+						Vector3 pos = origin;
+						Vector3 dir = MakeVector3(unit(rng) - unit(rng), unit(rng) - unit(rng),
+						                          unit(rng) - unit(rng));
+						float radius = 0.1f + unit(rng) * unit(rng) * 0.2f;
+						float angle = unit(rng) * (float)M_PI * 2.f;
+						float lifetime = 1.f + unit(rng) * 2.f;
+
+						ParticleParam param{*image, MakeVector4(0.01f, 0.03f, 0.f, 1.f)};
+						param.SetTrajectory(pos, dir * 20.f, .1f + radius * 3.f, 1.f);
+						param.SetRotation(angle);
+						param.SetRadius(radius);
+						param.SetLifeTime(lifetime, 0.f, 1.f);
+						param.SetBlockHitAction(BlockHitAction::BounceWeak);
+						particles.Spawn(param);
+
+						std::unique_ptr<LegacyParticle> legacy{new LegacyParticle()};
+						legacy->position = pos;
+						legacy->velocity = dir * 20.f;
+						legacy->angle = angle;
+						legacy->rotationVelocity = 0.f;
+						legacy->velocityDamp = .1f + radius * 3.f;
+						legacy->gravityScale = 1.f;
+						legacy->lifetime = lifetime;
+						legacy->time = 0.f;
+						legacyParticles.push_back(std::move(legacy));
+					}
+
+					double legacyTime = 0.0, soaTime = 0.0;
+					for (int frame = 0; frame < numFrames; ++frame) {
+						Stopwatch sw;
+						for (auto it = legacyParticles.begin(); it != legacyParticles.end();) {
+							if ((*it)->Update(dt, map)) {
+								++it;
+							} else {
+								it = legacyParticles.erase(it);
+							}
+						}
+						legacyTime += sw.GetTime();
+
+						sw.Reset();
+						particles.Update(dt, &map);
+						soaTime += sw.GetTime();
+					}
+
+					int numMismatches = 0;
+					particles.RemoveDeadParticles();
+					if (legacyParticles.size() != particles.GetNumParticles()) {
+						SPLog("[%d particles] The number of alive particles differs: %d vs. %d",
+						      numParticles, (int)legacyParticles.size(),
+						      (int)particles.GetNumParticles());
+					} else {
+						std::size_t i = 0;
+						for (const auto &legacy : legacyParticles) {
+							Vector3 pos = particles.GetParticlePosition(i++);
+							if (pos.x != legacy->position.x || pos.y != legacy->position.y ||
+							    pos.z != legacy->position.z) {
+								++numMismatches;
+							}
+						}
+					}
+
+					SPLog("[%d particles] per-object: %.3f ms/frame, SoA: %.3f ms/frame "
+					      "(%.2fx), %d alive, %d mismatch(es)",
+					      numParticles, legacyTime * 1000.0 / numFrames,
+					      soaTime * 1000.0 / numFrames, legacyTime / soaTime,
+					      (int)particles.GetNumParticles(), numMismatches);
+				}
+			}
+
+			void RunCorpseBenchmark(GameMap &map) {
+				SPADES_MARK_FUNCTION();
+
+				const int numFrames = 300;
+				const float dt = 1.f / 60.f;
+				const int numSubsteps = 4;
+				ThreadPool &pool = ThreadPool::GetGlobalPool();
+
+				SPLog("Corpse benchmark: %d frames, %d substeps, %d thread(s)", numFrames,
+				      numSubsteps, pool.GetNumParticipants());
+
+				for (int numCorpses : {16, 64, 256}) {
+					CorpseSolver solver;
+					std::vector<std::size_t> ids;
+					std::vector<LegacyRagdoll> legacyRagdolls(numCorpses);
+
+					// Players killed while standing on random spots
+					std::mt19937 rng{42};
+					std::uniform_real_distribution<float> unit{0.f, 1.f};
+					Vector3 eye;
+					for (int i = 0; i < numCorpses; ++i) {
+						int x = (int)(rng() % (uint32_t)map.Width());
+						int y = (int)(rng() % (uint32_t)map.Height());
+						uint64_t column = map.GetSolidMapWrapped(x, y);
+						int top = column ? CountTrailingZeros(column) : map.Depth() - 1;
+						Vector3 origin = MakeVector3(x + .5f, y + .5f, top - .1f);
+						if (i == 0) {
+							eye = origin - MakeVector3(0, 0, 2.f);
+						}
+
+						Matrix4 lower = Matrix4::Translate(origin) *
+						                Matrix4::Rotate(MakeVector3(0, 0, 1),
+						                                unit(rng) * (float)M_PI * 2.f);
+						Matrix4 torso = lower * Matrix4::Translate(0, 0, -1.1f);
+						Vector3 pose[Corpse::NodeCount] = {
+						  (torso * MakeVector3(0.4f, 0.f, 0.1f)).GetXYZ(),
+						  (torso * MakeVector3(-0.4f, 0.f, 0.1f)).GetXYZ(),
+						  (torso * MakeVector3(-0.4f, 0.f, 1.f)).GetXYZ(),
+						  (torso * MakeVector3(0.4f, 0.f, 1.f)).GetXYZ(),
+						  (torso * MakeVector3(0.2f, -.4f, .2f)).GetXYZ(),
+						  (torso * MakeVector3(-0.2f, -.4f, .2f)).GetXYZ(),
+						  (lower * MakeVector3(-0.4f, 0.f, 1.f)).GetXYZ(),
+						  (lower * MakeVector3(0.4f, 0.f, 1.f)).GetXYZ(),
+						  (torso * MakeVector3(0.f, 0.f, -0.5f)).GetXYZ()};
+						Vector3 impulse = MakeVector3(unit(rng) - .5f, unit(rng) - .5f, 0.f) * 8.f;
+
+						std::size_t id = solver.AddRagdoll(map);
+						CorpseSolver::Ragdoll &ragdoll = solver.GetRagdoll(id);
+						LegacyRagdoll &legacy = legacyRagdolls[i];
+						for (int j = 0; j < Corpse::NodeCount; ++j) {
+							Vector3 vel = MakeVector3((unit(rng) - unit(rng)) * 2.f,
+							                          (unit(rng) - unit(rng)) * 2.f, 0.f) +
+							              impulse;
+							ragdoll.pos[j] = ragdoll.lastPos[j] = pose[j];
+							ragdoll.vel[j] = vel;
+							legacy.nodes[j].pos = legacy.nodes[j].lastPos = pose[j];
+							legacy.nodes[j].vel = vel;
+						}
+						ids.push_back(id);
+					}
+
+					double legacyTime = 0.0, batchedTime = 0.0;
+					for (int frame = 0; frame < numFrames; ++frame) {
+						Stopwatch sw;
+						pool.ParallelFor(0, legacyRagdolls.size(), 1, [&](std::size_t i) {
+							for (int j = 0; j < numSubsteps; ++j) {
+								legacyRagdolls[i].Update(dt / numSubsteps, map);
+							}
+						});
+						legacyTime += sw.GetTime();
+
+						sw.Reset();
+						solver.StartUpdate(dt, eye, numSubsteps, SIZE_MAX);
+						solver.FinishUpdate();
+						batchedTime += sw.GetTime();
+					}
+
+					int numMismatches = 0;
+					for (int i = 0; i < numCorpses; ++i) {
+						const CorpseSolver::Ragdoll &ragdoll = solver.GetRagdoll(ids[i]);
+						for (int j = 0; j < Corpse::NodeCount; ++j) {
+							if (!(ragdoll.pos[j] == legacyRagdolls[i].nodes[j].pos)) {
+								++numMismatches;
+							}
+						}
+					}
+
+					// Only the nearest corpses are stepped with all substeps
+					const std::size_t lodBudget = 8;
+					double lodTime = 0.0;
+					for (int frame = 0; frame < numFrames; ++frame) {
+						Stopwatch sw;
+						solver.StartUpdate(dt, eye, numSubsteps, lodBudget);
+						solver.FinishUpdate();
+						lodTime += sw.GetTime();
+					}
+
+					SPLog("[%d corpses] per-corpse: %.3f ms/frame, batched: %.3f ms/frame "
+					      "(%.2fx), batched with a LOD budget of %d: %.3f ms/frame, "
+					      "%d mismatched node(s)",
+					      numCorpses, legacyTime * 1000.0 / numFrames,
+					      batchedTime * 1000.0 / numFrames, legacyTime / batchedTime,
+					      (int)lodBudget, lodTime * 1000.0 / numFrames, numMismatches);
+				}
+			}
+		} // namespace benchmark
+	} // namespace client
+} // namespace spades
@@ -23,6 +23,7 @@
 #include <cstdlib>
 #include <ctime>
 
+#include "AssetPreloader.h"
 #include "Client.h"
 #include "Fonts.h"
 #include <Core/FileManager.h>
@@ -45,8 +46,10 @@
 #include "TCProgressView.h"
 
 #include "Corpse.h"
+#include "CorpseSolver.h"
 #include "ILocalEntity.h"
-#include "SmokeSpriteEntity.h"
+#include "ParticleSystem.h"
+#include "PlayerPrediction.h"
 
 #include "GameMap.h"
 #include "GameMapWrapper.h"
@@ -62,10 +65,142 @@ DEFINE_SPADES_SETTING(cg_serverAlert, "1");
 
 DEFINE_SPADES_SETTING(cg_skipDeadPlayersWhenDead, "1");
 
+DEFINE_SPADES_SETTING(cg_preloadAssets, "1");
+
 SPADES_SETTING(cg_playerName);
 
 namespace spades {
 	namespace client {
+		namespace {
+			/**
+			 * Returns the assets loaded before entering a game. It includes the assets which are
+			 * used in the middle of a game and would cause a hitch when they are loaded on demand.
+			 */
+			std::vector<AssetPreloader::ManifestEntry> GetPreloadManifest() {
+				using AssetType = AssetPreloader::AssetType;
+				return {
+				  {AssetType::Image, "Textures/Fluid.png"},
+				  {AssetType::Image, "Textures/WaterExpl.png"},
+				  {AssetType::Image, "Gfx/White.tga"},
+				  {AssetType::Sound, "Sounds/Weapons/Block/Build.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/FleshLocal1.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/FleshLocal2.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/FleshLocal3.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/FleshLocal4.opus"},
+				  {AssetType::Sound, "Sounds/Misc/SwitchMapZoom.opus"},
+				  {AssetType::Sound, "Sounds/Misc/OpenMap.opus"},
+				  {AssetType::Sound, "Sounds/Misc/CloseMap.opus"},
+				  {AssetType::Sound, "Sounds/Player/Flashlight.opus"},
+				  {AssetType::Sound, "Sounds/Player/Footstep1.opus"},
+				  {AssetType::Sound, "Sounds/Player/Footstep2.opus"},
+				  {AssetType::Sound, "Sounds/Player/Footstep3.opus"},
+				  {AssetType::Sound, "Sounds/Player/Footstep4.opus"},
+				  {AssetType::Sound, "Sounds/Player/Footstep5.opus"},
+				  {AssetType::Sound, "Sounds/Player/Footstep6.opus"},
+				  {AssetType::Sound, "Sounds/Player/Footstep7.opus"},
+				  {AssetType::Sound, "Sounds/Player/Footstep8.opus"},
+				  {AssetType::Sound, "Sounds/Player/Wade1.opus"},
+				  {AssetType::Sound, "Sounds/Player/Wade2.opus"},
+				  {AssetType::Sound, "Sounds/Player/Wade3.opus"},
+				  {AssetType::Sound, "Sounds/Player/Wade4.opus"},
+				  {AssetType::Sound, "Sounds/Player/Wade5.opus"},
+				  {AssetType::Sound, "Sounds/Player/Wade6.opus"},
+				  {AssetType::Sound, "Sounds/Player/Wade7.opus"},
+				  {AssetType::Sound, "Sounds/Player/Wade8.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run1.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run2.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run3.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run4.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run5.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run6.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run7.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run8.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run9.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run10.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run11.opus"},
+				  {AssetType::Sound, "Sounds/Player/Run12.opus"},
+				  {AssetType::Sound, "Sounds/Player/Jump.opus"},
+				  {AssetType::Sound, "Sounds/Player/Land.opus"},
+				  {AssetType::Sound, "Sounds/Player/WaterJump.opus"},
+				  {AssetType::Sound, "Sounds/Player/WaterLand.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/SwitchLocal.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Switch.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Restock.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/RestockLocal.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/AimDownSightLocal.opus"},
+				  {AssetType::Image, "Gfx/Ball.png"},
+				  {AssetType::Model, "Models/Player/Dead.kv6"},
+				  {AssetType::Image, "Gfx/Spotlight.jpg"},
+				  {AssetType::Model, "Models/Weapons/Spade/Spade.kv6"},
+				  {AssetType::Model, "Models/Weapons/Block/Block2.kv6"},
+				  {AssetType::Model, "Models/Weapons/Grenade/Grenade.kv6"},
+				  {AssetType::Model, "Models/Weapons/SMG/Weapon.kv6"},
+				  {AssetType::Model, "Models/Weapons/SMG/WeaponNoMagazine.kv6"},
+				  {AssetType::Model, "Models/Weapons/SMG/Magazine.kv6"},
+				  {AssetType::Model, "Models/Weapons/Rifle/Weapon.kv6"},
+				  {AssetType::Model, "Models/Weapons/Rifle/WeaponNoMagazine.kv6"},
+				  {AssetType::Model, "Models/Weapons/Rifle/Magazine.kv6"},
+				  {AssetType::Model, "Models/Weapons/Shotgun/Weapon.kv6"},
+				  {AssetType::Model, "Models/Weapons/Shotgun/WeaponNoPump.kv6"},
+				  {AssetType::Model, "Models/Weapons/Shotgun/Pump.kv6"},
+				  {AssetType::Model, "Models/Player/Arm.kv6"},
+				  {AssetType::Model, "Models/Player/UpperArm.kv6"},
+				  {AssetType::Model, "Models/Player/LegCrouch.kv6"},
+				  {AssetType::Model, "Models/Player/TorsoCrouch.kv6"},
+				  {AssetType::Model, "Models/Player/Leg.kv6"},
+				  {AssetType::Model, "Models/Player/Torso.kv6"},
+				  {AssetType::Model, "Models/Player/Arms.kv6"},
+				  {AssetType::Model, "Models/Player/Head.kv6"},
+				  {AssetType::Model, "Models/MapObjects/Intel.kv6"},
+				  {AssetType::Model, "Models/MapObjects/CheckPoint.kv6"},
+				  {AssetType::Model, "Models/MapObjects/BlockCursorLine.kv6"},
+				  {AssetType::Model, "Models/MapObjects/BlockCursorSingle.kv6"},
+				  {AssetType::Image, "Gfx/Bullet/7.62mm.png"},
+				  {AssetType::Image, "Gfx/Bullet/9mm.png"},
+				  {AssetType::Image, "Gfx/Bullet/12gauge.png"},
+				  {AssetType::Image, "Gfx/CircleGradient.png"},
+				  {AssetType::Image, "Gfx/HurtSprite.png"},
+				  {AssetType::Image, "Gfx/HurtRing2.png"},
+				  {AssetType::Image, "Gfx/Intel.png"},
+				  {AssetType::Sound, "Sounds/Feedback/Chat.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/Throw.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/Fire.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/Bounce.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/DropWater.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/Explode1.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/Explode2.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/ExplodeFar.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/ExplodeFarStereo.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/WaterExplode.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/WaterExplodeFar.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/WaterExplodeStereo.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Grenade/Debris.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Block.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Flesh1.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Flesh2.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Flesh3.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Ricochet1.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Ricochet2.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Ricochet3.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Ricochet4.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Water1.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Water2.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Water3.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Impacts/Water4.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Spade/Miss.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Spade/HitBlock.opus"},
+				  {AssetType::Sound, "Sounds/Weapons/Spade/HitPlayer.opus"},
+				  {AssetType::Sound, "Sounds/Misc/BlockDestroy.opus"},
+				  {AssetType::Sound, "Sounds/Misc/BlockFall.opus"},
+				  {AssetType::Model, "Models/Weapons/Rifle/Casing.kv6"},
+				  {AssetType::Model, "Models/Weapons/SMG/Casing.kv6"},
+				  {AssetType::Model, "Models/Weapons/Shotgun/Casing.kv6"},
+				};
+			}
+
+			/** The time spent for registering preloaded assets per frame, in seconds. */
+			constexpr double PreloadTimeBudgetPerFrame = 0.004;
+		} // namespace
 
 		Client::Client(Handle<IRenderer> r, Handle<IAudioDevice> audioDev,
 		               const ServerAddress &host, Handle<FontManager> fontManager)
@@ -126,6 +261,9 @@ namespace spades {
 			limbo = stmp::make_unique<LimboView>(this);
 			paletteView = stmp::make_unique<PaletteView>(this);
 			tcView = stmp::make_unique<TCProgressView>(*this);
+
+			// Uses the same time step as `UpdateWorld`
+			playerPrediction = stmp::make_unique<PlayerPrediction>(1.f / 60.f);
 			scriptedUI =
 			  Handle<ClientUI>::New(renderer.GetPointerOrNull(), audioDev.GetPointerOrNull(),
 			                        fontManager.GetPointerOrNull(), this);
@@ -152,6 +290,7 @@ namespace spades {
 			flashlightOn = false;
 
 			clientPlayers.clear();
+			playerPrediction->Reset();
 
 			if (world) {
 				world->SetListener(nullptr);
@@ -164,6 +303,12 @@ namespace spades {
 			if (world) {
 				SPLog("World set");
 
+				if (assetPreloader) {
+					// The game is about to start; wait for the remaining assets
+					assetPreloader->Finish();
+					assetPreloader.reset();
+				}
+
 				// initialize player view objects
 				clientPlayers.resize(world->GetNumPlayerSlots());
 				for (size_t i = 0; i < world->GetNumPlayerSlots(); i++) {
@@ -239,92 +384,16 @@ namespace spades {
 		/** Initiate an initialization which likely to take some time */
 		void Client::DoInit() {
 			renderer->Init();
-			SmokeSpriteEntity::Preload(renderer.GetPointerOrNull());
-
-			renderer->RegisterImage("Textures/Fluid.png");
-			renderer->RegisterImage("Textures/WaterExpl.png");
-			renderer->RegisterImage("Gfx/White.tga");
-			audioDevice->RegisterSound("Sounds/Weapons/Block/Build.opus");
-			audioDevice->RegisterSound("Sounds/Weapons/Impacts/FleshLocal1.opus");
-			audioDevice->RegisterSound("Sounds/Weapons/Impacts/FleshLocal2.opus");
-			audioDevice->RegisterSound("Sounds/Weapons/Impacts/FleshLocal3.opus");
-			audioDevice->RegisterSound("Sounds/Weapons/Impacts/FleshLocal4.opus");
-			audioDevice->RegisterSound("Sounds/Misc/SwitchMapZoom.opus");
-			audioDevice->RegisterSound("Sounds/Misc/OpenMap.opus");
-			audioDevice->RegisterSound("Sounds/Misc/CloseMap.opus");
-			audioDevice->RegisterSound("Sounds/Player/Flashlight.opus");
-			audioDevice->RegisterSound("Sounds/Player/Footstep1.opus");
-			audioDevice->RegisterSound("Sounds/Player/Footstep2.opus");
-			audioDevice->RegisterSound("Sounds/Player/Footstep3.opus");
-			audioDevice->RegisterSound("Sounds/Player/Footstep4.opus");
-			audioDevice->RegisterSound("Sounds/Player/Footstep5.opus");
-			audioDevice->RegisterSound("Sounds/Player/Footstep6.opus");
-			audioDevice->RegisterSound("Sounds/Player/Footstep7.opus");
-			audioDevice->RegisterSound("Sounds/Player/Footstep8.opus");
-			audioDevice->RegisterSound("Sounds/Player/Wade1.opus");
-			audioDevice->RegisterSound("Sounds/Player/Wade2.opus");
-			audioDevice->RegisterSound("Sounds/Player/Wade3.opus");
-			audioDevice->RegisterSound("Sounds/Player/Wade4.opus");
-			audioDevice->RegisterSound("Sounds/Player/Wade5.opus");
-			audioDevice->RegisterSound("Sounds/Player/Wade6.opus");
-			audioDevice->RegisterSound("Sounds/Player/Wade7.opus");
-			audioDevice->RegisterSound("Sounds/Player/Wade8.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run1.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run2.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run3.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run4.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run5.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run6.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run7.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run8.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run9.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run10.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run11.opus");
-			audioDevice->RegisterSound("Sounds/Player/Run12.opus");
-			audioDevice->RegisterSound("Sounds/Player/Jump.opus");
-			audioDevice->RegisterSound("Sounds/Player/Land.opus");
-			audioDevice->RegisterSound("Sounds/Player/WaterJump.opus");
-			audioDevice->RegisterSound("Sounds/Player/WaterLand.opus");
-			audioDevice->RegisterSound("Sounds/Weapons/SwitchLocal.opus");
-			audioDevice->RegisterSound("Sounds/Weapons/Switch.opus");
-			audioDevice->RegisterSound("Sounds/Weapons/Restock.opus");
-			audioDevice->RegisterSound("Sounds/Weapons/RestockLocal.opus");
-			audioDevice->RegisterSound("Sounds/Weapons/AimDownSightLocal.opus");
-			renderer->RegisterImage("Gfx/Ball.png");
-			renderer->RegisterModel("Models/Player/Dead.kv6");
-			renderer->RegisterImage("Gfx/Spotlight.jpg");
-			renderer->RegisterModel("Models/Weapons/Spade/Spade.kv6");
-			renderer->RegisterModel("Models/Weapons/Block/Block2.kv6");
-			renderer->RegisterModel("Models/Weapons/Grenade/Grenade.kv6");
-			renderer->RegisterModel("Models/Weapons/SMG/Weapon.kv6");
-			renderer->RegisterModel("Models/Weapons/SMG/WeaponNoMagazine.kv6");
-			renderer->RegisterModel("Models/Weapons/SMG/Magazine.kv6");
-			renderer->RegisterModel("Models/Weapons/Rifle/Weapon.kv6");
-			renderer->RegisterModel("Models/Weapons/Rifle/WeaponNoMagazine.kv6");
-			renderer->RegisterModel("Models/Weapons/Rifle/Magazine.kv6");
-			renderer->RegisterModel("Models/Weapons/Shotgun/Weapon.kv6");
-			renderer->RegisterModel("Models/Weapons/Shotgun/WeaponNoPump.kv6");
-			renderer->RegisterModel("Models/Weapons/Shotgun/Pump.kv6");
-			renderer->RegisterModel("Models/Player/Arm.kv6");
-			renderer->RegisterModel("Models/Player/UpperArm.kv6");
-			renderer->RegisterModel("Models/Player/LegCrouch.kv6");
-			renderer->RegisterModel("Models/Player/TorsoCrouch.kv6");
-			renderer->RegisterModel("Models/Player/Leg.kv6");
-			renderer->RegisterModel("Models/Player/Torso.kv6");
-			renderer->RegisterModel("Models/Player/Arms.kv6");
-			renderer->RegisterModel("Models/Player/Head.kv6");
-			renderer->RegisterModel("Models/MapObjects/Intel.kv6");
-			renderer->RegisterModel("Models/MapObjects/CheckPoint.kv6");
-			renderer->RegisterModel("Models/MapObjects/BlockCursorLine.kv6");
-			renderer->RegisterModel("Models/MapObjects/BlockCursorSingle.kv6");
-			renderer->RegisterImage("Gfx/Bullet/7.62mm.png");
-			renderer->RegisterImage("Gfx/Bullet/9mm.png");
-			renderer->RegisterImage("Gfx/Bullet/12gauge.png");
-			renderer->RegisterImage("Gfx/CircleGradient.png");
-			renderer->RegisterImage("Gfx/HurtSprite.png");
-			renderer->RegisterImage("Gfx/HurtRing2.png");
-			renderer->RegisterImage("Gfx/Intel.png");
-			audioDevice->RegisterSound("Sounds/Feedback/Chat.opus");
+			particleSystem = stmp::make_unique<ParticleSystem>(*renderer);
+			corpseSolver = stmp::make_unique<CorpseSolver>();
+
+			assetPreloader = stmp::make_unique<AssetPreloader>(*renderer, *audioDevice,
+			                                                   GetPreloadManifest());
+			if (!cg_preloadAssets) {
+				// Block until all assets are loaded like older versions did
+				assetPreloader->Finish();
+				assetPreloader.reset();
+			}
 
 			if (mumbleLink.init())
 				SPLog("Mumble linked");
@@ -388,6 +457,10 @@ namespace spades {
 				}
 			}
 
+			if (assetPreloader && assetPreloader->Poll(PreloadTimeBudgetPerFrame)) {
+				assetPreloader.reset();
+			}
+
 			timeSinceInit += std::min(dt, .03f);
 
 			// update network
@@ -28,6 +28,7 @@
 
 #include "ClientCameraMode.h"
 #include "ILocalEntity.h"
+#include "INetClientListener.h"
 #include "IRenderer.h"
 #include "IWorldListener.h"
 #include "MumbleLink.h"
@@ -65,10 +66,14 @@ namespace spades {
 		class PaletteView;
 		class TCProgressView;
 		class ClientPlayer;
+		class AssetPreloader;
+		class ParticleSystem;
+		class CorpseSolver;
+		class PlayerPrediction;
 
 		class ClientUI;
 
-		class Client : public IWorldListener, public gui::View {
+		class Client : public IWorldListener, public INetClientListener, public gui::View {
 			friend class ScoreboardView;
 			friend class LimboView;
 			friend class MapView;
@@ -113,6 +118,8 @@ namespace spades {
 			std::unique_ptr<GameMapWrapper> mapWrapper;
 			Handle<IRenderer> renderer;
 			Handle<IAudioDevice> audioDevice;
+			/** Loads assets while connecting to a server. Must be destroyed before them. */
+			std::unique_ptr<AssetPreloader> assetPreloader;
 			float time;
 			bool readyToClose;
 			float worldSubFrame;
@@ -147,6 +154,7 @@ namespace spades {
 			bool hasLastTool;
 			Vector3 lastFront;
 			float lastPosSentTime;
+			std::unique_ptr<PlayerPrediction> playerPrediction;
 			int lastHealth;
 			float lastHurtTime;
 			float lastAliveTime;
@@ -320,6 +328,10 @@ namespace spades {
 			float mapReceivingProgressSmoothed = 0.0;
 
 			std::list<std::unique_ptr<ILocalEntity>> localEntities;
+			/** Created by `DoInit`. */
+			std::unique_ptr<ParticleSystem> particleSystem;
+			/** Must outlive `corpses`. */
+			std::unique_ptr<CorpseSolver> corpseSolver;
 			std::list<std::unique_ptr<Corpse>> corpses;
 			Corpse *lastMyCorpse;
 			float corpseSoftTimeLimit;
@@ -424,13 +436,14 @@ namespace spades {
 			Handle<gui::ConsoleCommandCandidateIterator>
 			AutocompleteCommandName(const std::string &name) override;
 
-			void SetWorld(World *);
-			World *GetWorld() const { return world.get(); }
+			void SetWorld(World *) override;
+			World *GetWorld() const override { return world.get(); }
 			void AddLocalEntity(std::unique_ptr<ILocalEntity> &&ent) {
 				localEntities.emplace_back(std::move(ent));
 			}
+			ParticleSystem &GetParticleSystem() { return *particleSystem; }
 
-			void MarkWorldUpdate();
+			void MarkWorldUpdate() override;
 
 			IRenderer &GetRenderer() { return *renderer; }
 			SceneDefinition GetLastSceneDef() { return lastSceneDef; }
@@ -439,23 +452,26 @@ namespace spades {
 			bool WantsToBeClosed() override;
 			bool IsMuted();
 
-			void PlayerSentChatMessage(Player &, bool global, const std::string &);
-			void ServerSentMessage(const std::string &);
-
-			void PlayerCapturedIntel(Player &);
-			void PlayerCreatedBlock(Player &);
-			void PlayerPickedIntel(Player &);
-			void PlayerDropIntel(Player &);
-			void TeamCapturedTerritory(int teamId, int territoryId);
-			void TeamWon(int);
-			void JoinedGame();
-			void LocalPlayerCreated();
-			void PlayerDestroyedBlockWithWeaponOrTool(IntVector3);
-			void PlayerDiggedBlock(IntVector3);
-			void GrenadeDestroyedBlock(IntVector3);
-			void PlayerLeaving(Player &);
-			void PlayerJoinedTeam(Player &);
-			void PlayerSpawned(Player &);
+			// INetClientListener begin
+			void PlayerSentChatMessage(Player &, bool global, const std::string &) override;
+			void ServerSentMessage(const std::string &) override;
+
+			void PlayerCapturedIntel(Player &) override;
+			void PlayerCreatedBlock(Player &) override;
+			void PlayerPickedIntel(Player &) override;
+			void PlayerDropIntel(Player &) override;
+			void TeamCapturedTerritory(int teamId, int territoryId) override;
+			void TeamWon(int) override;
+			void JoinedGame() override;
+			void LocalPlayerCreated() override;
+			void LocalPlayerPositionCorrected(const Vector3 &) override;
+			void PlayerDestroyedBlockWithWeaponOrTool(IntVector3) override;
+			void PlayerDiggedBlock(IntVector3) override;
+			void GrenadeDestroyedBlock(IntVector3) override;
+			void PlayerLeaving(Player &) override;
+			void PlayerJoinedTeam(Player &) override;
+			void PlayerSpawned(Player &) override;
+			// INetClientListener end
 
 			// IWorldListener begin
 			void PlayerObjectSet(int) override;
@@ -34,6 +34,7 @@
 #include "IModel.h"
 #include "IRenderer.h"
 #include "Player.h"
+#include "PlayerPrediction.h"
 #include "Weapon.h"
 #include "World.h"
 #include <Core/Bitmap.h>
@@ -533,6 +534,10 @@ namespace spades {
 
 		Matrix4 ClientPlayer::GetEyeMatrix() {
 			Vector3 eye = player.GetEye();
+			if (player.IsLocalPlayer()) {
+				// Hide the discontinuity caused by the server's corrections
+				eye += client.playerPrediction->GetVisualOffset();
+			}
 
 			if ((int)cg_shake >= 2) {
 				float sp = SmoothStep(GetSprintState());
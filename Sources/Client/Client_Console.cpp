@@ -16,7 +16,15 @@
  You should have received a copy of the GNU General Public License
  along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <cstdlib>
+
+#include "Benchmark.h"
 #include "Client.h"
+#include "GameMap.h"
+#include "World.h"
+#include <Core/FileManager.h>
+#include <Core/IStream.h>
+#include <Core/SamplingProfiler.h>
 
 #include <Gui/ConsoleCommand.h>
 
@@ -24,13 +32,84 @@ namespace spades {
 	namespace client {
 		namespace {
 			constexpr const char *CMD_SAVEMAP = "savemap";
+			constexpr const char *CMD_BENCH_FLOATINGBLOCKS = "bench_floatingblocks";
+			constexpr const char *CMD_PROFILER_START = "profiler_start";
+			constexpr const char *CMD_PROFILER_STOP = "profiler_stop";
+
+			/** The default sampling interval of `profiler_start` in milliseconds. */
+			constexpr double DefaultProfilerInterval = 1.0;
 
-			std::map<std::string, std::string> const g_clientCommands{
-			  {CMD_SAVEMAP, ": Save the current state of the map to the disk"},
+			/** A console command that runs a benchmark and takes no arguments. */
+			struct BenchmarkCommand {
+				const char *name;
+				const char *description;
+				/** `true` if the benchmark needs the map of the current world. */
+				bool needsMap;
+				/** Runs the benchmark. `map` is non-null if `needsMap` is `true`. */
+				void (*run)(Client &, GameMap *map);
 			};
+
+			const BenchmarkCommand g_benchmarkCommands[] = {
+			  {"bench_mapstorage", ": Compare the dense and sparse map storage modes", true,
+			   [](Client &, GameMap *map) { benchmark::RunMapStorageBenchmark(*map); }},
+			  {"bench_dispatch", ": Measure the overhead of parallel loop dispatch", false,
+			   [](Client &, GameMap *) { benchmark::RunDispatchBenchmark(); }},
+			  {"bench_raycast", ": Compare the per-ray and batched ray casting", true,
+			   [](Client &, GameMap *map) { benchmark::RunRayCastBenchmark(*map); }},
+			  {"bench_paks", ": Compare the pak file reading throughput of ZIP backends", false,
+			   [](Client &, GameMap *) { benchmark::RunPakBenchmark(); }},
+			  {"bench_backtrace", ": Measure the per-call overhead of the shadow call stack", false,
+			   [](Client &, GameMap *) { benchmark::RunBacktraceBenchmark(); }},
+			  {"bench_rleheap", ": Compare the RLE column allocators of the software renderer",
+			   false, [](Client &, GameMap *) { benchmark::RunRleHeapBenchmark(); }},
+			  {"bench_particles", ": Compare the SoA and per-object particle updates", true,
+			   [](Client &client, GameMap *map) {
+				   benchmark::RunParticleBenchmark(*map, client.GetRenderer());
+			   }},
+			  {"bench_corpses", ": Compare the batched and per-corpse ragdoll updates", true,
+			   [](Client &, GameMap *map) { benchmark::RunCorpseBenchmark(*map); }},
+			  {"bench_mapchanges", ": Measure the map change journal with 1000-block blasts", true,
+			   [](Client &, GameMap *map) { benchmark::RunMapChangeBenchmark(*map); }},
+			  {"bench_mapmesh", ": Measure building the map chunk meshes", true,
+			   [](Client &, GameMap *map) { benchmark::RunMapMeshBenchmark(*map); }},
+			};
+
+			std::map<std::string, std::string> MakeClientCommands() {
+				std::map<std::string, std::string> commands{
+				  {CMD_SAVEMAP, ": Save the current state of the map to the disk"},
+				  {CMD_BENCH_FLOATINGBLOCKS,
+				   " [MAP FILE]: Replay destruction patterns on the current or given map"},
+				  {CMD_PROFILER_START,
+				   " [INTERVAL MS]: Start sampling the call stacks of all threads"},
+				  {CMD_PROFILER_STOP, ": Stop the sampling profiler and save the profile"},
+				};
+				for (const BenchmarkCommand &command : g_benchmarkCommands) {
+					commands.emplace(command.name, command.description);
+				}
+				return commands;
+			}
+
+			std::map<std::string, std::string> const g_clientCommands = MakeClientCommands();
 		} // namespace
 
 		bool Client::ExecCommand(const Handle<gui::ConsoleCommand> &cmd) {
+			for (const BenchmarkCommand &command : g_benchmarkCommands) {
+				if (cmd->GetName() != command.name) {
+					continue;
+				}
+				if (cmd->GetNumArguments() != 0) {
+					SPLog("Usage: %s (no arguments)", command.name);
+					return true;
+				}
+				GameMap *map = GetWorld() ? GetWorld()->GetMap().GetPointerOrNull() : nullptr;
+				if (command.needsMap && !map) {
+					SPLog("No map loaded");
+					return true;
+				}
+				command.run(*this, map);
+				return true;
+			}
+
 			if (cmd->GetName() == CMD_SAVEMAP) {
 				if (cmd->GetNumArguments() != 0) {
 					SPLog("Usage: %s (no arguments)", CMD_SAVEMAP);
@@ -38,6 +117,65 @@ namespace spades {
 				}
 				TakeMapShot();
 				return true;
+			} else if (cmd->GetName() == CMD_BENCH_FLOATINGBLOCKS) {
+				if (cmd->GetNumArguments() > 1) {
+					SPLog("Usage: %s [MAP FILE]", CMD_BENCH_FLOATINGBLOCKS);
+					return true;
+				}
+				if (cmd->GetNumArguments() == 1) {
+					// e.g., "Maps/Title.vxl"
+					std::string path = cmd->GetArgument(0);
+					try {
+						auto stream = FileManager::OpenForReading(path.c_str());
+						Handle<GameMap> map{GameMap::Load(stream.get()), false};
+						benchmark::RunFloatingBlockBenchmark(*map);
+					} catch (const std::exception &ex) {
+						SPLog("Failed to load %s: %s", path.c_str(), ex.what());
+					}
+					return true;
+				}
+				if (!GetWorld() || !GetWorld()->GetMap()) {
+					SPLog("No map loaded");
+					return true;
+				}
+				benchmark::RunFloatingBlockBenchmark(*GetWorld()->GetMap());
+				return true;
+			} else if (cmd->GetName() == CMD_PROFILER_START) {
+				if (cmd->GetNumArguments() > 1) {
+					SPLog("Usage: %s [INTERVAL MS]", CMD_PROFILER_START);
+					return true;
+				}
+				double interval = DefaultProfilerInterval;
+				if (cmd->GetNumArguments() == 1) {
+					interval = std::atof(cmd->GetArgument(0).c_str());
+				}
+				if (!(interval > 0.0)) {
+					SPLog("Invalid sampling interval: %s", cmd->GetArgument(0).c_str());
+					return true;
+				}
+				SamplingProfiler &profiler = SamplingProfiler::GetInstance();
+				if (profiler.IsRunning()) {
+					SPLog("The profiler is already running");
+					return true;
+				}
+				profiler.Start(interval / 1000.0);
+				return true;
+			} else if (cmd->GetName() == CMD_PROFILER_STOP) {
+				if (cmd->GetNumArguments() != 0) {
+					SPLog("Usage: %s (no arguments)", CMD_PROFILER_STOP);
+					return true;
+				}
+				SamplingProfiler &profiler = SamplingProfiler::GetInstance();
+				if (!profiler.IsRunning()) {
+					SPLog("The profiler is not running");
+					return true;
+				}
+				try {
+					profiler.Stop();
+				} catch (const std::exception &ex) {
+					SPLog("Failed to stop the profiler: %s", ex.what());
+				}
+				return true;
 			} else {
 				return false;
 			}
@@ -47,9 +47,7 @@
 #include "LimboView.h"
 #include "MapView.h"
 #include "PaletteView.h"
-#include "ParticleSpriteEntity.h"
 #include "ScoreboardView.h"
-#include "SmokeSpriteEntity.h"
 #include "TCProgressView.h"
 #include "Tracer.h"
 
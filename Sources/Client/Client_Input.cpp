@@ -30,6 +30,7 @@
 #include "ChatWindow.h"
 #include "ClientUI.h"
 #include "Corpse.h"
+#include "CorpseSolver.h"
 #include "LimboView.h"
 #include "MapView.h"
 #include "PaletteView.h"
@@ -380,7 +381,8 @@ namespace spades {
 					if (cg_debugCorpse) {
 						if (name == "p" && down) {
 							Player &victim = world->GetLocalPlayer().value();
-							auto corp = stmp::make_unique<Corpse>(*renderer, *map, victim);
+							auto corp =
+							  stmp::make_unique<Corpse>(*renderer, *map, *corpseSolver, victim);
 							corp->AddImpulse(victim.GetFront() * 32.f);
 							corpses.emplace_back(std::move(corp));
 
@@ -43,8 +43,7 @@
 #include "LimboView.h"
 #include "MapView.h"
 #include "PaletteView.h"
-#include "ParticleSpriteEntity.h"
-#include "SmokeSpriteEntity.h"
+#include "ParticleSystem.h"
 
 #include "GameMap.h"
 #include "Grenade.h"
@@ -75,6 +74,9 @@ namespace spades {
 			SPADES_MARK_FUNCTION();
 
 			localEntities.clear();
+			if (particleSystem) {
+				particleSystem->Clear();
+			}
 		}
 
 		void Client::RemoveInvisibleCorpses() {
@@ -159,17 +161,17 @@ namespace spades {
 			Handle<IImage> img = renderer->RegisterImage("Gfx/White.tga");
 			Vector4 color = {0.5f, 0.02f, 0.04f, 1.f};
 			for (int i = 0; i < 10; i++) {
-				auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
-				ent->SetTrajectory(v,
-				                   MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat()) *
-				                     10.f,
-				                   1.f, 0.7f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(0.1f + SampleRandomFloat() * SampleRandomFloat() * 0.2f);
-				ent->SetLifeTime(3.f, 0.f, 1.f);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{*img, color};
+				ent.SetTrajectory(v,
+				                  MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat()) *
+				                    10.f,
+				                  1.f, 0.7f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(0.1f + SampleRandomFloat() * SampleRandomFloat() * 0.2f);
+				ent.SetLifeTime(3.f, 0.f, 1.f);
+				particleSystem->Spawn(ent);
 			}
 
 			if ((int)cg_particles < 2)
@@ -177,36 +179,34 @@ namespace spades {
 
 			color = MakeVector4(.7f, .35f, .37f, .6f);
 			for (int i = 0; i < 2; i++) {
-				auto ent = stmp::make_unique<SmokeSpriteEntity>(*this, color, 100.f,
-				                                                SmokeSpriteEntity::Type::Explosion);
-				ent->SetTrajectory(v,
-				                   MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat()) *
-				                     .7f,
-				                   .8f, 0.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(.5f + SampleRandomFloat() * SampleRandomFloat() * 0.2f, 2.f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
-				ent->SetLifeTime(.20f + SampleRandomFloat() * .2f, 0.06f, .20f);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{color, 100.f, ParticleParam::SmokeType::Explosion};
+				ent.SetTrajectory(v,
+				                  MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat()) *
+				                    .7f,
+				                  .8f, 0.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(.5f + SampleRandomFloat() * SampleRandomFloat() * 0.2f, 2.f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetLifeTime(.20f + SampleRandomFloat() * .2f, 0.06f, .20f);
+				particleSystem->Spawn(ent);
 			}
 
 			color.w *= .1f;
 			for (int i = 0; i < 1; i++) {
-				auto ent = stmp::make_unique<SmokeSpriteEntity>(*this, color, 40.f,
-				                                                SmokeSpriteEntity::Type::Steady);
-				ent->SetTrajectory(v,
-				                   MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat()) *
-				                     .7f,
-				                   .8f, 0.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(.7f + SampleRandomFloat() * SampleRandomFloat() * 0.2f, 2.f, 0.1f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
-				ent->SetLifeTime(.80f + SampleRandomFloat() * 0.4f, 0.06f, 1.0f);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{color, 40.f, ParticleParam::SmokeType::Steady};
+				ent.SetTrajectory(v,
+				                  MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat()) *
+				                    .7f,
+				                  .8f, 0.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(.7f + SampleRandomFloat() * SampleRandomFloat() * 0.2f, 2.f, 0.1f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetLifeTime(.80f + SampleRandomFloat() * 0.4f, 0.06f, 1.0f);
+				particleSystem->Spawn(ent);
 			}
 		}
 
@@ -224,19 +224,19 @@ namespace spades {
 			Handle<IImage> img = renderer->RegisterImage("Gfx/White.tga");
 			Vector4 color = {c.x / 255.f, c.y / 255.f, c.z / 255.f, 1.f};
 			for (int i = 0; i < 7; i++) {
-				auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
-				ent->SetTrajectory(origin,
-				                   MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat()) *
-				                     7.f,
-				                   1.f, .9f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(0.2f + SampleRandomFloat() * SampleRandomFloat() * 0.1f);
-				ent->SetLifeTime(2.f, 0.f, 1.f);
+				ParticleParam ent{*img, color};
+				ent.SetTrajectory(origin,
+				                  MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat()) *
+				                    7.f,
+				                  1.f, .9f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(0.2f + SampleRandomFloat() * SampleRandomFloat() * 0.1f);
+				ent.SetLifeTime(2.f, 0.f, 1.f);
 				if (distPowered < 16.f * 16.f)
-					ent->SetBlockHitAction(BlockHitAction::BounceWeak);
-				localEntities.emplace_back(std::move(ent));
+					ent.SetBlockHitAction(BlockHitAction::BounceWeak);
+				particleSystem->Spawn(ent);
 			}
 
 			if ((int)cg_particles < 2)
@@ -244,37 +244,37 @@ namespace spades {
 
 			if (distPowered < 32.f * 32.f) {
 				for (int i = 0; i < 16; i++) {
-					auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
-					ent->SetTrajectory(origin,
-					                   MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-					                               SampleRandomFloat() - SampleRandomFloat(),
-					                               SampleRandomFloat() - SampleRandomFloat()) *
-					                     12.f,
-					                   1.f, .9f);
-					ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-					ent->SetRadius(0.1f + SampleRandomFloat() * SampleRandomFloat() * 0.14f);
-					ent->SetLifeTime(2.f, 0.f, 1.f);
+					ParticleParam ent{*img, color};
+					ent.SetTrajectory(origin,
+					                  MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+					                              SampleRandomFloat() - SampleRandomFloat(),
+					                              SampleRandomFloat() - SampleRandomFloat()) *
+					                    12.f,
+					                  1.f, .9f);
+					ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+					ent.SetRadius(0.1f + SampleRandomFloat() * SampleRandomFloat() * 0.14f);
+					ent.SetLifeTime(2.f, 0.f, 1.f);
 					if (distPowered < 16.f * 16.f)
-						ent->SetBlockHitAction(BlockHitAction::BounceWeak);
-					localEntities.emplace_back(std::move(ent));
+						ent.SetBlockHitAction(BlockHitAction::BounceWeak);
+					particleSystem->Spawn(ent);
 				}
 			}
 
 			color += (MakeVector4(1, 1, 1, 1) - color) * .2f;
 			color.w *= .2f;
 			for (int i = 0; i < 2; i++) {
-				auto ent = stmp::make_unique<SmokeSpriteEntity>(*this, color, 100.f);
-				ent->SetTrajectory(origin,
-				                   MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat()) *
-				                     .7f,
-				                   1.f, 0.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(.6f + SampleRandomFloat() * SampleRandomFloat() * 0.2f, 0.8f);
-				ent->SetLifeTime(.3f + SampleRandomFloat() * .3f, 0.06f, .4f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{color, 100.f};
+				ent.SetTrajectory(origin,
+				                  MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat()) *
+				                    .7f,
+				                  1.f, 0.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(.6f + SampleRandomFloat() * SampleRandomFloat() * 0.2f, 0.8f);
+				ent.SetLifeTime(.3f + SampleRandomFloat() * .3f, 0.06f, .4f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
+				particleSystem->Spawn(ent);
 			}
 		}
 
@@ -293,18 +293,18 @@ namespace spades {
 			Handle<IImage> img = renderer->RegisterImage("Gfx/White.tga");
 			Vector4 color = {c.x / 255.f, c.y / 255.f, c.z / 255.f, 1.f};
 			for (int i = 0; i < 8; i++) {
-				auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
-				ent->SetTrajectory(origin,
-				                   MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat(),
-				                               SampleRandomFloat() - SampleRandomFloat()) *
-				                     7.f,
-				                   1.f, 1.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(0.3f + SampleRandomFloat() * SampleRandomFloat() * 0.2f);
-				ent->SetLifeTime(2.f, 0.f, 1.f);
-				ent->SetBlockHitAction(BlockHitAction::BounceWeak);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{*img, color};
+				ent.SetTrajectory(origin,
+				                  MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat(),
+				                              SampleRandomFloat() - SampleRandomFloat()) *
+				                    7.f,
+				                  1.f, 1.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(0.3f + SampleRandomFloat() * SampleRandomFloat() * 0.2f);
+				ent.SetLifeTime(2.f, 0.f, 1.f);
+				ent.SetBlockHitAction(BlockHitAction::BounceWeak);
+				particleSystem->Spawn(ent);
 			}
 		}
 
@@ -325,20 +325,19 @@ namespace spades {
 
 			// rapid smoke
 			for (int i = 0; i < 2; i++) {
-				auto ent = stmp::make_unique<SmokeSpriteEntity>(*this, color, 120.f,
-				                                                SmokeSpriteEntity::Type::Explosion);
-				ent->SetTrajectory(origin,
-				                   (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                                SampleRandomFloat() - SampleRandomFloat(),
-				                                SampleRandomFloat() - SampleRandomFloat()) +
-				                    velBias * .5f) *
-				                     0.3f,
-				                   1.f, 0.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(.4f, 3.f, 0.0000005f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
-				ent->SetLifeTime(0.2f + SampleRandomFloat() * 0.1f, 0.f, .30f);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{color, 120.f, ParticleParam::SmokeType::Explosion};
+				ent.SetTrajectory(origin,
+				                  (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                               SampleRandomFloat() - SampleRandomFloat(),
+				                               SampleRandomFloat() - SampleRandomFloat()) +
+				                   velBias * .5f) *
+				                    0.3f,
+				                  1.f, 0.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(.4f, 3.f, 0.0000005f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetLifeTime(0.2f + SampleRandomFloat() * 0.1f, 0.f, .30f);
+				particleSystem->Spawn(ent);
 			}
 		}
 
@@ -390,81 +389,79 @@ namespace spades {
 			color = MakeVector4(.6f, .6f, .6f, 1.f);
 			// rapid smoke
 			for (int i = 0; i < 4; i++) {
-				auto ent = stmp::make_unique<SmokeSpriteEntity>(*this, color, 60.f,
-				                                                SmokeSpriteEntity::Type::Explosion);
-				ent->SetTrajectory(origin,
-				                   (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                                SampleRandomFloat() - SampleRandomFloat(),
-				                                SampleRandomFloat() - SampleRandomFloat()) +
-				                    velBias * .5f) *
-				                     2.f,
-				                   1.f, 0.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(.6f + SampleRandomFloat() * SampleRandomFloat() * 0.4f, 2.f, .2f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
-				ent->SetLifeTime(1.8f + SampleRandomFloat() * 0.1f, 0.f, .20f);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{color, 60.f, ParticleParam::SmokeType::Explosion};
+				ent.SetTrajectory(origin,
+				                  (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                               SampleRandomFloat() - SampleRandomFloat(),
+				                               SampleRandomFloat() - SampleRandomFloat()) +
+				                   velBias * .5f) *
+				                    2.f,
+				                  1.f, 0.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(.6f + SampleRandomFloat() * SampleRandomFloat() * 0.4f, 2.f, .2f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetLifeTime(1.8f + SampleRandomFloat() * 0.1f, 0.f, .20f);
+				particleSystem->Spawn(ent);
 			}
 
 			// slow smoke
 			color.w = .25f;
 			for (int i = 0; i < 8; i++) {
-				auto ent = stmp::make_unique<SmokeSpriteEntity>(*this, color, 20.f);
-				ent->SetTrajectory(
+				ParticleParam ent{color, 20.f};
+				ent.SetTrajectory(
 				  origin,
 				  (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
 				               SampleRandomFloat() - SampleRandomFloat(),
 				               (SampleRandomFloat() - SampleRandomFloat()) * .2f)) *
 				    2.f,
 				  1.f, 0.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(1.5f + SampleRandomFloat() * SampleRandomFloat() * 0.8f, 0.2f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(1.5f + SampleRandomFloat() * SampleRandomFloat() * 0.8f, 0.2f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
 				switch ((int)cg_particles) {
-					case 1: ent->SetLifeTime(0.8f + SampleRandomFloat() * 1.f, 0.1f, 8.f); break;
-					case 2: ent->SetLifeTime(1.5f + SampleRandomFloat() * 2.f, 0.1f, 8.f); break;
+					case 1: ent.SetLifeTime(0.8f + SampleRandomFloat() * 1.f, 0.1f, 8.f); break;
+					case 2: ent.SetLifeTime(1.5f + SampleRandomFloat() * 2.f, 0.1f, 8.f); break;
 					case 3:
-					default: ent->SetLifeTime(2.f + SampleRandomFloat() * 5.f, 0.1f, 8.f); break;
+					default: ent.SetLifeTime(2.f + SampleRandomFloat() * 5.f, 0.1f, 8.f); break;
 				}
-				localEntities.emplace_back(std::move(ent));
+				particleSystem->Spawn(ent);
 			}
 
 			// fragments
 			Handle<IImage> img = renderer->RegisterImage("Gfx/White.tga");
 			color = MakeVector4(0.01, 0.03, 0, 1.f);
 			for (int i = 0; i < 42; i++) {
-				auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
+				ParticleParam ent{*img, color};
 				Vector3 dir = MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
 				                          SampleRandomFloat() - SampleRandomFloat(),
 				                          SampleRandomFloat() - SampleRandomFloat());
 				dir += velBias * .5f;
 				float radius = 0.1f + SampleRandomFloat() * SampleRandomFloat() * 0.2f;
-				ent->SetTrajectory(origin + dir * .2f, dir * 20.f, .1f + radius * 3.f, 1.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(radius);
-				ent->SetLifeTime(3.5f + SampleRandomFloat() * 2.f, 0.f, 1.f);
-				ent->SetBlockHitAction(BlockHitAction::BounceWeak);
-				localEntities.emplace_back(std::move(ent));
+				ent.SetTrajectory(origin + dir * .2f, dir * 20.f, .1f + radius * 3.f, 1.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(radius);
+				ent.SetLifeTime(3.5f + SampleRandomFloat() * 2.f, 0.f, 1.f);
+				ent.SetBlockHitAction(BlockHitAction::BounceWeak);
+				particleSystem->Spawn(ent);
 			}
 
 			// fire smoke
 			color = MakeVector4(1.f, .7f, .4f, .2f) * 5.f;
 			for (int i = 0; i < 4; i++) {
-				auto ent = stmp::make_unique<SmokeSpriteEntity>(*this, color, 120.f,
-				                                                SmokeSpriteEntity::Type::Explosion);
-				ent->SetTrajectory(origin,
-				                   (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                                SampleRandomFloat() - SampleRandomFloat(),
-				                                SampleRandomFloat() - SampleRandomFloat()) +
-				                    velBias) *
-				                     6.f,
-				                   1.f, 0.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(.3f + SampleRandomFloat() * SampleRandomFloat() * 0.4f, 3.f, .1f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
-				ent->SetLifeTime(.18f + SampleRandomFloat() * 0.03f, 0.f, .10f);
-				// ent->SetAdditive(true);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{color, 120.f, ParticleParam::SmokeType::Explosion};
+				ent.SetTrajectory(origin,
+				                  (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                               SampleRandomFloat() - SampleRandomFloat(),
+				                               SampleRandomFloat() - SampleRandomFloat()) +
+				                   velBias) *
+				                    6.f,
+				                  1.f, 0.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(.3f + SampleRandomFloat() * SampleRandomFloat() * 0.4f, 3.f, .1f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetLifeTime(.18f + SampleRandomFloat() * 0.03f, 0.f, .10f);
+				// ent.SetAdditive(true);
+				particleSystem->Spawn(ent);
 			}
 		}
 
@@ -486,18 +483,18 @@ namespace spades {
 			if ((int)cg_particles < 2)
 				color.w = .3f;
 			for (int i = 0; i < 7; i++) {
-				auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
-				ent->SetTrajectory(origin,
-				                   (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                                SampleRandomFloat() - SampleRandomFloat(),
-				                                -SampleRandomFloat() * 7.f)) *
-				                     2.5f,
-				                   .3f, .6f);
-				ent->SetRotation(0.f);
-				ent->SetRadius(1.5f + SampleRandomFloat() * SampleRandomFloat() * 0.4f, 1.3f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
-				ent->SetLifeTime(3.f + SampleRandomFloat() * 0.3f, 0.f, .60f);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{*img, color};
+				ent.SetTrajectory(origin,
+				                  (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                               SampleRandomFloat() - SampleRandomFloat(),
+				                               -SampleRandomFloat() * 7.f)) *
+				                    2.5f,
+				                  .3f, .6f);
+				ent.SetRotation(0.f);
+				ent.SetRadius(1.5f + SampleRandomFloat() * SampleRandomFloat() * 0.4f, 1.3f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetLifeTime(3.f + SampleRandomFloat() * 0.3f, 0.f, .60f);
+				particleSystem->Spawn(ent);
 			}
 
 			// water2
@@ -506,18 +503,18 @@ namespace spades {
 			if ((int)cg_particles < 2)
 				color.w = .4f;
 			for (int i = 0; i < 16; i++) {
-				auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
-				ent->SetTrajectory(origin,
-				                   (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                                SampleRandomFloat() - SampleRandomFloat(),
-				                                -SampleRandomFloat() * 10.f)) *
-				                     3.5f,
-				                   1.f, 1.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(0.9f + SampleRandomFloat() * SampleRandomFloat() * 0.4f, 0.7f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
-				ent->SetLifeTime(3.f + SampleRandomFloat() * 0.3f, .7f, .60f);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{*img, color};
+				ent.SetTrajectory(origin,
+				                  (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                               SampleRandomFloat() - SampleRandomFloat(),
+				                               -SampleRandomFloat() * 10.f)) *
+				                    3.5f,
+				                  1.f, 1.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(0.9f + SampleRandomFloat() * SampleRandomFloat() * 0.4f, 0.7f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetLifeTime(3.f + SampleRandomFloat() * 0.3f, .7f, .60f);
+				particleSystem->Spawn(ent);
 			}
 
 			// slow smoke
@@ -525,43 +522,43 @@ namespace spades {
 			if ((int)cg_particles < 2)
 				color.w = .2f;
 			for (int i = 0; i < 8; i++) {
-				auto ent = stmp::make_unique<SmokeSpriteEntity>(*this, color, 20.f);
-				ent->SetTrajectory(
+				ParticleParam ent{color, 20.f};
+				ent.SetTrajectory(
 				  origin,
 				  (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
 				               SampleRandomFloat() - SampleRandomFloat(),
 				               (SampleRandomFloat() - SampleRandomFloat()) * .2f)) *
 				    2.f,
 				  1.f, 0.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(1.4f + SampleRandomFloat() * SampleRandomFloat() * 0.8f, 0.2f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(1.4f + SampleRandomFloat() * SampleRandomFloat() * 0.8f, 0.2f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
 				switch ((int)cg_particles) {
-					case 1: ent->SetLifeTime(3.f + SampleRandomFloat() * 5.f, 0.1f, 8.f); break;
+					case 1: ent.SetLifeTime(3.f + SampleRandomFloat() * 5.f, 0.1f, 8.f); break;
 					case 2:
 					case 3:
-					default: ent->SetLifeTime(6.f + SampleRandomFloat() * 5.f, 0.1f, 8.f); break;
+					default: ent.SetLifeTime(6.f + SampleRandomFloat() * 5.f, 0.1f, 8.f); break;
 				}
-				localEntities.emplace_back(std::move(ent));
+				particleSystem->Spawn(ent);
 			}
 
 			// fragments
 			img = renderer->RegisterImage("Gfx/White.tga");
 			color = MakeVector4(1, 1, 1, 0.7f);
 			for (int i = 0; i < 42; i++) {
-				auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
+				ParticleParam ent{*img, color};
 				Vector3 dir = MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
 				                          SampleRandomFloat() - SampleRandomFloat(),
 				                          -SampleRandomFloat() * 3.f);
 				dir += velBias * .5f;
 				float radius = 0.1f + SampleRandomFloat() * SampleRandomFloat() * 0.2f;
-				ent->SetTrajectory(origin + dir * .2f + MakeVector3(0, 0, -1.2f), dir * 13.f,
-				                   .1f + radius * 3.f, 1.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(radius);
-				ent->SetLifeTime(3.5f + SampleRandomFloat() * 2.f, 0.f, 1.f);
-				ent->SetBlockHitAction(BlockHitAction::Delete);
-				localEntities.emplace_back(std::move(ent));
+				ent.SetTrajectory(origin + dir * .2f + MakeVector3(0, 0, -1.2f), dir * 13.f,
+				                  .1f + radius * 3.f, 1.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(radius);
+				ent.SetLifeTime(3.5f + SampleRandomFloat() * 2.f, 0.f, 1.f);
+				ent.SetBlockHitAction(BlockHitAction::Delete);
+				particleSystem->Spawn(ent);
 			}
 
 			// TODO: wave?
@@ -584,18 +581,18 @@ namespace spades {
 			if ((int)cg_particles < 2)
 				color.w = .2f;
 			for (int i = 0; i < 2; i++) {
-				auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
-				ent->SetTrajectory(origin,
-				                   (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                                SampleRandomFloat() - SampleRandomFloat(),
-				                                -SampleRandomFloat() * 7.f)) *
-				                     1.f,
-				                   .3f, .6f);
-				ent->SetRotation(0.f);
-				ent->SetRadius(0.6f + SampleRandomFloat() * SampleRandomFloat() * 0.4f, .7f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
-				ent->SetLifeTime(3.f + SampleRandomFloat() * 0.3f, 0.1f, .60f);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{*img, color};
+				ent.SetTrajectory(origin,
+				                  (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                               SampleRandomFloat() - SampleRandomFloat(),
+				                               -SampleRandomFloat() * 7.f)) *
+				                    1.f,
+				                  .3f, .6f);
+				ent.SetRotation(0.f);
+				ent.SetRadius(0.6f + SampleRandomFloat() * SampleRandomFloat() * 0.4f, .7f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetLifeTime(3.f + SampleRandomFloat() * 0.3f, 0.1f, .60f);
+				particleSystem->Spawn(ent);
 			}
 
 			// water2
@@ -604,37 +601,37 @@ namespace spades {
 			if ((int)cg_particles < 2)
 				color.w = .4f;
 			for (int i = 0; i < 6; i++) {
-				auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
-				ent->SetTrajectory(origin,
-				                   (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
-				                                SampleRandomFloat() - SampleRandomFloat(),
-				                                -SampleRandomFloat() * 10.f)) *
-				                     2.f,
-				                   1.f, 1.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(0.6f + SampleRandomFloat() * SampleRandomFloat() * 0.6f, 0.6f);
-				ent->SetBlockHitAction(BlockHitAction::Ignore);
-				ent->SetLifeTime(3.f + SampleRandomFloat() * 0.3f, SampleRandomFloat() * 0.3f,
-				                 .60f);
-				localEntities.emplace_back(std::move(ent));
+				ParticleParam ent{*img, color};
+				ent.SetTrajectory(origin,
+				                  (MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
+				                               SampleRandomFloat() - SampleRandomFloat(),
+				                               -SampleRandomFloat() * 10.f)) *
+				                    2.f,
+				                  1.f, 1.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(0.6f + SampleRandomFloat() * SampleRandomFloat() * 0.6f, 0.6f);
+				ent.SetBlockHitAction(BlockHitAction::Ignore);
+				ent.SetLifeTime(3.f + SampleRandomFloat() * 0.3f, SampleRandomFloat() * 0.3f,
+				                .60f);
+				particleSystem->Spawn(ent);
 			}
 
 			// fragments
 			img = renderer->RegisterImage("Gfx/White.tga");
 			color = MakeVector4(1, 1, 1, 0.7f);
 			for (int i = 0; i < 10; i++) {
-				auto ent = stmp::make_unique<ParticleSpriteEntity>(*this, img, color);
+				ParticleParam ent{*img, color};
 				Vector3 dir = MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
 				                          SampleRandomFloat() - SampleRandomFloat(),
 				                          -SampleRandomFloat() * 3.f);
 				float radius = 0.03f + SampleRandomFloat() * SampleRandomFloat() * 0.05f;
-				ent->SetTrajectory(origin + dir * .2f + MakeVector3(0, 0, -1.2f), dir * 5.f,
-				                   .1f + radius * 3.f, 1.f);
-				ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-				ent->SetRadius(radius);
-				ent->SetLifeTime(3.5f + SampleRandomFloat() * 2.f, 0.f, 1.f);
-				ent->SetBlockHitAction(BlockHitAction::Delete);
-				localEntities.emplace_back(std::move(ent));
+				ent.SetTrajectory(origin + dir * .2f + MakeVector3(0, 0, -1.2f), dir * 5.f,
+				                  .1f + radius * 3.f, 1.f);
+				ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+				ent.SetRadius(radius);
+				ent.SetLifeTime(3.5f + SampleRandomFloat() * 2.f, 0.f, 1.f);
+				ent.SetBlockHitAction(BlockHitAction::Delete);
+				particleSystem->Spawn(ent);
 			}
 
 			// TODO: wave?
@@ -33,6 +33,7 @@
 #include "GameMap.h"
 #include "GameProperties.h"
 #include "IGameMode.h"
+#include "PlayerPrediction.h"
 #include "TCGameMode.h"
 #include "World.h"
 
@@ -58,6 +59,15 @@ namespace spades {
 			toolRaiseState = .0f;
 		}
 
+		void Client::LocalPlayerPositionCorrected(const Vector3 &pos) {
+			stmp::optional<Player &> p = world->GetLocalPlayer();
+			SPAssert(p);
+
+			// The position reflects the input we sent about a round trip ago
+			int ping = net->GetPing();
+			playerPrediction->ApplyCorrection(*p, pos, ping > 0 ? ping / 1000.f : 0.f);
+		}
+
 		void Client::JoinedGame() {
 			// Note: A local player doesn't exist yet
 
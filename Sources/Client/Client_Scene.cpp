@@ -37,6 +37,7 @@
 
 #include "ClientPlayer.h"
 #include "ILocalEntity.h"
+#include "ParticleSystem.h"
 
 #include "NetClient.h"
 
@@ -633,6 +634,7 @@ namespace spades {
 					for (auto &ent : localEntities) {
 						ent->Render3D();
 					}
+					particleSystem->Render3D();
 				}
 
 				// Draw block cursor
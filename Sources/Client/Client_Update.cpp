@@ -21,7 +21,6 @@
 
 #include "Client.h"
 
-#include <Core/ConcurrentDispatch.h>
 #include <Core/Settings.h>
 #include <Core/Strings.h>
 
@@ -33,12 +32,15 @@
 #include "ClientPlayer.h"
 #include "ClientUI.h"
 #include "Corpse.h"
+#include "CorpseSolver.h"
 #include "FallingBlock.h"
 #include "HurtRingView.h"
 #include "ILocalEntity.h"
 #include "LimboView.h"
 #include "MapView.h"
 #include "PaletteView.h"
+#include "ParticleSystem.h"
+#include "PlayerPrediction.h"
 #include "Tracer.h"
 
 #include "GameMap.h"
@@ -196,10 +198,18 @@ namespace spades {
 
 			float frameStep = 1.f / 60.f;
 			while (worldSubFrame >= frameStep) {
+				float tickTime = world->GetTime();
 				world->Advance(frameStep);
 				worldSubFrame -= frameStep;
+
+				// Record the tick for rolling back on the server's corrections
+				stmp::optional<Player &> localPlayer = world->GetLocalPlayer();
+				if (localPlayer) {
+					playerPrediction->RecordTick(*localPlayer, tickTime);
+				}
 			}
 #endif
+			playerPrediction->Update(dt);
 
 			// update player view (doesn't affect physics/game logics)
 			for (auto &clientPlayer : clientPlayers) {
@@ -209,22 +219,8 @@ namespace spades {
 			}
 
 			// corpse never accesses audio nor renderer, so
-			// we can do it in the separate thread
-			class CorpseUpdateDispatch : public ConcurrentDispatch {
-				Client &client;
-				float dt;
-
-			public:
-				CorpseUpdateDispatch(Client &c, float dt) : client{c}, dt{dt} {}
-				void Run() override {
-					for (auto &c : client.corpses) {
-						for (int i = 0; i < 4; i++)
-							c->Update(dt / 4.f);
-					}
-				}
-			};
-			CorpseUpdateDispatch corpseDispatch{*this, dt};
-			corpseDispatch.Start();
+			// we can do it in the worker threads
+			corpseSolver->StartUpdate(dt, lastSceneDef.viewOrigin);
 
 			// local entities should be done in the client thread
 			{
@@ -239,7 +235,10 @@ namespace spades {
 				}
 			}
 
-			corpseDispatch.Join();
+			// Particles are updated in batches by the thread pool
+			particleSystem->Update(dt, map.GetPointerOrNull());
+
+			corpseSolver->FinishUpdate();
 
 			if (grenadeVibration > 0.f) {
 				grenadeVibration -= dt;
@@ -831,7 +830,7 @@ namespace spades {
 
 			// create ragdoll corpse
 			if (cg_ragdoll && victim.GetTeamId() < 2) {
-				auto corp = stmp::make_unique<Corpse>(*renderer, *map, victim);
+				auto corp = stmp::make_unique<Corpse>(*renderer, *map, *corpseSolver, victim);
 
 				if (&victim == world->GetLocalPlayer())
 					lastMyCorpse = corp.get();
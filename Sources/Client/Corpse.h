@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include <Core/Math.h>
 
 namespace spades {
@@ -28,8 +30,10 @@ namespace spades {
 		class GameMap;
 		class Player;
 		class IModel;
+		class CorpseSolver;
 
 		class Corpse {
+		public:
 			enum NodeType {
 				// torso in CW seen from front
 				Torso1,
@@ -47,57 +51,32 @@ namespace spades {
 				NodeCount
 			};
 
-			struct Node {
-				Vector3 pos, vel;
-				Vector3 lastPos;
-
-				Vector3 lastForce;
-			};
-
-			struct Edge {
-				NodeType node1, node2;
-				Vector3 lastVelDiff;
-				Vector3 velDiff;
-				Edge() { node1 = node2 = NodeCount; }
-			};
-
+		private:
 			IRenderer &renderer;
 			GameMap &map;
+			CorpseSolver &solver;
 			Vector3 color;
 			int playerId;
 
-			Node nodes[NodeCount];
-			Edge edges[8];
+			/** The ID of the ragdoll in `solver`. */
+			std::size_t ragdollId;
 
 			void SetNode(NodeType n, Vector3);
 			void SetNode(NodeType n, Vector4);
 
-			void Spring(NodeType n1, NodeType n2, float distance, float dt);
-			void Spring(NodeType n1a, NodeType n1b, NodeType n2, float distance, float dt);
-			void AngleSpring(NodeType base, NodeType a, NodeType b, float minDot, float maxDot,
-			                 float dt);
-			void AngleSpring(NodeType a, NodeType b, Vector3 dir, float minDot, float maxDot,
-			                 float dt);
-			void AngularMomentum(int eId, NodeType a, NodeType b);
-
-			void ApplyConstraint(float dt);
-
-			void LineCollision(NodeType a, NodeType b, float dt);
-
 		public:
 			/**
 			 * Construct a "corpse" client object.
 			 *
 			 * @param renderer The renderer. Must outlive `Corpse`.
 			 * @param map The game map, used for physics. Must outlive `Corpse`.
+			 * @param solver The solver simulating the ragdoll. Must outlive `Corpse`.
 			 * @param p The player to create a corpse from. Can be destroyed
 			 *			after `Corpse` is constructed.
 			 */
-			Corpse(IRenderer &renderer, GameMap &map, Player &p);
+			Corpse(IRenderer &renderer, GameMap &map, CorpseSolver &solver, Player &p);
 			~Corpse();
 
-			void Update(float dt);
-
 			int GetPlayerId() { return playerId; }
 
 			void AddToScene();
@@ -0,0 +1,777 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "CorpseSolver.h"
+#include "GameMap.h"
+#include <Core/Debug.h>
+#include <Core/Settings.h>
+#include <Core/SIMD.h>
+#include <Core/TMPUtils.h>
+#include <Core/ThreadPool.h>
+
+DEFINE_SPADES_SETTING(r_corpseLineCollision, "1");
+DEFINE_SPADES_SETTING(cg_corpseSubsteps, "4");
+DEFINE_SPADES_SETTING(cg_corpseLODBudget, "8");
+
+namespace spades {
+	namespace client {
+		namespace {
+			enum { LaneCount = CorpseSolver::LaneCount };
+
+			/**
+			 * The maximum rate of substeps for the corpses out of the LOD budget. The springs
+			 * overshoot if a substep is much longer than this.
+			 */
+			constexpr float MinLODSubstepRate = 60.f;
+
+#if SPADES_ENABLE_SSE2
+			struct Mask4 {
+				__m128 v;
+			};
+
+			struct Float4 {
+				__m128 v;
+
+				Float4() = default;
+				Float4(float s) : v{_mm_set1_ps(s)} {}
+				explicit Float4(__m128 v) : v{v} {}
+
+				static Float4 Load(const float *p) { return Float4{_mm_loadu_ps(p)}; }
+				void Store(float *p) const { _mm_storeu_ps(p, v); }
+			};
+
+			inline Float4 operator+(Float4 a, Float4 b) { return Float4{_mm_add_ps(a.v, b.v)}; }
+			inline Float4 operator-(Float4 a, Float4 b) { return Float4{_mm_sub_ps(a.v, b.v)}; }
+			inline Float4 operator*(Float4 a, Float4 b) { return Float4{_mm_mul_ps(a.v, b.v)}; }
+			inline Float4 operator/(Float4 a, Float4 b) { return Float4{_mm_div_ps(a.v, b.v)}; }
+			inline Float4 Sqrt(Float4 a) { return Float4{_mm_sqrt_ps(a.v)}; }
+
+			inline Mask4 operator>(Float4 a, Float4 b) { return Mask4{_mm_cmpgt_ps(a.v, b.v)}; }
+			inline Mask4 operator<(Float4 a, Float4 b) { return Mask4{_mm_cmplt_ps(a.v, b.v)}; }
+			inline Mask4 operator!=(Float4 a, Float4 b) { return Mask4{_mm_cmpneq_ps(a.v, b.v)}; }
+			inline Mask4 operator|(Mask4 a, Mask4 b) { return Mask4{_mm_or_ps(a.v, b.v)}; }
+
+			/** Returns `m ? a : b` for each lane. */
+			inline Float4 Select(Mask4 m, Float4 a, Float4 b) {
+				return Float4{_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))};
+			}
+
+			inline bool Any(Mask4 m) { return _mm_movemask_ps(m.v) != 0; }
+			inline bool GetLane(Mask4 m, int lane) { return (_mm_movemask_ps(m.v) >> lane) & 1; }
+
+			inline Mask4 MakeMask(const bool *lanes) {
+				return Mask4{_mm_castsi128_ps(_mm_sub_epi32(
+				  _mm_setzero_si128(), _mm_setr_epi32(lanes[0], lanes[1], lanes[2], lanes[3])))};
+			}
+#else
+			struct Mask4 {
+				bool v[LaneCount];
+			};
+
+			struct Float4 {
+				float v[LaneCount];
+
+				Float4() = default;
+				Float4(float s) {
+					for (float &e : v) {
+						e = s;
+					}
+				}
+
+				static Float4 Load(const float *p) {
+					Float4 r;
+					std::copy(p, p + LaneCount, r.v);
+					return r;
+				}
+				void Store(float *p) const { std::copy(v, v + LaneCount, p); }
+			};
+
+#define SPADES_FLOAT4_LANEWISE(type, expr)                                                         \
+	type r;                                                                                        \
+	for (int i = 0; i < LaneCount; ++i) {                                                          \
+		r.v[i] = (expr);                                                                           \
+	}                                                                                              \
+	return r
+
+			inline Float4 operator+(Float4 a, Float4 b) {
+				SPADES_FLOAT4_LANEWISE(Float4, a.v[i] + b.v[i]);
+			}
+			inline Float4 operator-(Float4 a, Float4 b) {
+				SPADES_FLOAT4_LANEWISE(Float4, a.v[i] - b.v[i]);
+			}
+			inline Float4 operator*(Float4 a, Float4 b) {
+				SPADES_FLOAT4_LANEWISE(Float4, a.v[i] * b.v[i]);
+			}
+			inline Float4 operator/(Float4 a, Float4 b) {
+				SPADES_FLOAT4_LANEWISE(Float4, a.v[i] / b.v[i]);
+			}
+			inline Float4 Sqrt(Float4 a) { SPADES_FLOAT4_LANEWISE(Float4, sqrtf(a.v[i])); }
+
+			inline Mask4 operator>(Float4 a, Float4 b) {
+				SPADES_FLOAT4_LANEWISE(Mask4, a.v[i] > b.v[i]);
+			}
+			inline Mask4 operator<(Float4 a, Float4 b) {
+				SPADES_FLOAT4_LANEWISE(Mask4, a.v[i] < b.v[i]);
+			}
+			inline Mask4 operator!=(Float4 a, Float4 b) {
+				SPADES_FLOAT4_LANEWISE(Mask4, a.v[i] != b.v[i]);
+			}
+			inline Mask4 operator|(Mask4 a, Mask4 b) {
+				SPADES_FLOAT4_LANEWISE(Mask4, a.v[i] || b.v[i]);
+			}
+
+			/** Returns `m ? a : b` for each lane. */
+			inline Float4 Select(Mask4 m, Float4 a, Float4 b) {
+				SPADES_FLOAT4_LANEWISE(Float4, m.v[i] ? a.v[i] : b.v[i]);
+			}
+
+#undef SPADES_FLOAT4_LANEWISE
+
+			inline bool Any(Mask4 m) {
+				return std::find(m.v, m.v + LaneCount, true) != m.v + LaneCount;
+			}
+			inline bool GetLane(Mask4 m, int lane) { return m.v[lane]; }
+
+			inline Mask4 MakeMask(const bool *lanes) {
+				Mask4 m;
+				std::copy(lanes, lanes + LaneCount, m.v);
+				return m;
+			}
+#endif
+
+			/**
+			 * `Vector3` of `LaneCount` lanes. The operations are performed in the same order as
+			 * `Vector3`'s, so each lane produces the bit-exact result of the scalar code.
+			 */
+			struct Vector3x4 {
+				Float4 x, y, z;
+
+				Float4 GetLength() const { return Sqrt(x * x + y * y + z * z); }
+
+				Vector3x4 Normalize() const {
+					Float4 scale = GetLength();
+					scale = Select(scale != Float4(0.f), Float4(1.f) / scale, scale);
+					return {x * scale, y * scale, z * scale};
+				}
+			};
+
+			inline Vector3x4 operator+(const Vector3x4 &a, const Vector3x4 &b) {
+				return {a.x + b.x, a.y + b.y, a.z + b.z};
+			}
+			inline Vector3x4 operator-(const Vector3x4 &a, const Vector3x4 &b) {
+				return {a.x - b.x, a.y - b.y, a.z - b.z};
+			}
+			inline Vector3x4 operator*(const Vector3x4 &a, Float4 s) {
+				return {a.x * s, a.y * s, a.z * s};
+			}
+			inline Vector3x4 operator/(const Vector3x4 &a, Float4 s) {
+				return {a.x / s, a.y / s, a.z / s};
+			}
+			inline Vector3x4 Select(Mask4 m, const Vector3x4 &a, const Vector3x4 &b) {
+				return {Select(m, a.x, b.x), Select(m, a.y, b.y), Select(m, a.z, b.z)};
+			}
+			inline Float4 Dot(const Vector3x4 &a, const Vector3x4 &b) {
+				return a.x * b.x + a.y * b.y + a.z * b.z;
+			}
+			inline Vector3x4 Cross(const Vector3x4 &a, const Vector3x4 &b) {
+				return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+			}
+
+			/** `N` vectors of each lane in the structure-of-arrays layout. */
+			template <std::size_t N> struct Vector3Lanes {
+				float x[N][LaneCount];
+				float y[N][LaneCount];
+				float z[N][LaneCount];
+
+				Vector3x4 Get(int i) const {
+					return {Float4::Load(x[i]), Float4::Load(y[i]), Float4::Load(z[i])};
+				}
+				void Set(int i, const Vector3x4 &v) {
+					v.x.Store(x[i]);
+					v.y.Store(y[i]);
+					v.z.Store(z[i]);
+				}
+
+				Vector3 GetLane(int i, int lane) const {
+					return MakeVector3(x[i][lane], y[i][lane], z[i][lane]);
+				}
+				void SetLane(int i, int lane, const Vector3 &v) {
+					x[i][lane] = v.x;
+					y[i][lane] = v.y;
+					z[i][lane] = v.z;
+				}
+			};
+
+			using NodeLanes = Vector3Lanes<Corpse::NodeCount>;
+
+			float MyACos(float v) {
+				SPAssert(!std::isnan(v));
+				if (v >= 1.f)
+					return 0.f;
+				if (v <= -1.f)
+					return static_cast<float>(M_PI);
+				float vv = acosf(v);
+				if (std::isnan(vv)) {
+					vv = acosf(v * .9999f);
+				}
+				SPAssert(!std::isnan(vv));
+				return vv;
+			}
+
+			/** Pulls two nodes toward the specified distance. `dump = 1 - 0.1^dt` */
+			void Spring(NodeLanes &pos, NodeLanes &vel, int n1, int n2, float distance,
+			            float dt, float dump) {
+				Vector3x4 a = pos.Get(n1), b = pos.Get(n2);
+				Vector3x4 aVel = vel.Get(n1), bVel = vel.Get(n2);
+				Float4 k = dt * 50.f;
+
+				Vector3x4 diff = b - a;
+				Float4 dist = diff.GetLength();
+				Vector3x4 force = diff.Normalize() * (Float4(distance) - dist);
+				force = force * k;
+
+				bVel = bVel + force;
+				aVel = aVel - force;
+
+				b = b + force / k * .5f;
+				a = a - force / k * .5f;
+
+				Vector3x4 velMid = (aVel + bVel) * .5f;
+				aVel = aVel + (velMid - aVel) * dump;
+				bVel = bVel + (velMid - bVel) * dump;
+
+				pos.Set(n1, a);
+				pos.Set(n2, b);
+				vel.Set(n1, aVel);
+				vel.Set(n2, bVel);
+			}
+
+			/**
+			 * Pulls a node toward the specified distance from the midpoint of two nodes.
+			 * `dump = 1 - 0.05^dt`
+			 */
+			void Spring(NodeLanes &pos, NodeLanes &vel, int n1a, int n1b, int n2,
+			            float distance, float dt, float dump) {
+				Vector3x4 xVel = vel.Get(n1a), yVel = vel.Get(n1b), bVel = vel.Get(n2);
+				Float4 k = dt * 50.f;
+
+				Vector3x4 diff = pos.Get(n2) - (pos.Get(n1a) + pos.Get(n1b)) * .5f;
+				Float4 dist = diff.GetLength();
+				Vector3x4 force = diff.Normalize() * (Float4(distance) - dist);
+				force = force * k;
+
+				bVel = bVel + force;
+				force = force * .5f;
+				xVel = xVel - force;
+				yVel = yVel - force;
+
+				Vector3x4 velMid = (xVel + yVel) * .25f + bVel * .5f;
+				xVel = xVel + (velMid - xVel) * dump;
+				yVel = yVel + (velMid - yVel) * dump;
+				bVel = bVel + (velMid - bVel) * dump;
+
+				vel.Set(n1a, xVel);
+				vel.Set(n1b, yVel);
+				vel.Set(n2, bVel);
+			}
+
+			/** Keeps the angle between two bones sharing `base` within a range. */
+			void AngleSpring(NodeLanes &pos, NodeLanes &vel, int base, int n1, int n2,
+			                 float minDot, float maxDot, float dt) {
+				Vector3x4 basePos = pos.Get(base), pos1 = pos.Get(n1), pos2 = pos.Get(n2);
+				Vector3x4 d1 = pos1 - basePos;
+				Vector3x4 d2 = pos2 - basePos;
+				Float4 ln1 = d1.GetLength();
+				Float4 ln2 = d2.GetLength();
+				Float4 dot = Dot(d1, d2) / (ln1 * ln2 + 0.0000001f);
+
+				Mask4 tooLarge = dot > Float4(maxDot);
+				Mask4 tooSmall = dot < Float4(minDot);
+				Mask4 active = tooLarge | tooSmall;
+				if (!Any(active)) {
+					return;
+				}
+
+				// `acosf` has no SIMD counterpart, but it's only needed by the violating lanes
+				float dots[LaneCount], strengths[LaneCount];
+				dot.Store(dots);
+				for (int lane = 0; lane < LaneCount; ++lane) {
+					float strength = 0.f;
+					if (GetLane(tooLarge, lane)) {
+						strength = MyACos(dots[lane]) - MyACos(maxDot);
+					} else if (GetLane(tooSmall, lane)) {
+						strength = MyACos(dots[lane]) - MyACos(minDot);
+					}
+					strength *= 20.f;
+					strength *= dt;
+					strengths[lane] = strength;
+				}
+
+				Vector3x4 diff = pos2 - pos1;
+				Vector3x4 a1 = Cross(d1, diff);
+				a1 = Cross(d1, a1).Normalize();
+				a1 = a1 * Float4::Load(strengths);
+
+				// The impulse on the other bone used to be scaled by zero, so it's omitted
+				Vector3x4 vel2 = vel.Get(n2), baseVel = vel.Get(base);
+				vel.Set(n2, Select(active, vel2 + a1, vel2));
+				vel.Set(base, Select(active, baseVel - a1, baseVel));
+			}
+
+			float fractf(float v) { return v - floorf(v); }
+
+			void CheckEscape(GameMap &map, IntVector3 hitBlock, IntVector3 a, IntVector3 b,
+			                 IntVector3 dir, float &bestDist, IntVector3 &bestDir) {
+				hitBlock += dir;
+				IntVector3 aa = a + dir;
+				IntVector3 bb = b + dir;
+				if (map.IsSolidWrapped(hitBlock.x, hitBlock.y, hitBlock.z))
+					return;
+				if (map.IsSolidWrapped(aa.x, aa.y, aa.z))
+					return;
+				if (map.IsSolidWrapped(bb.x, bb.y, bb.z))
+					return;
+				float dist;
+				if (dir.x == 1) {
+					dist = 1.f - fractf(a.x);
+					dist += 1.f - fractf(b.x);
+				} else if (dir.x == -1) {
+					dist = fractf(a.x);
+					dist += fractf(b.x);
+				} else if (dir.y == 1) {
+					dist = 1.f - fractf(a.y);
+					dist += 1.f - fractf(b.y);
+				} else if (dir.y == -1) {
+					dist = fractf(a.y);
+					dist += fractf(b.y);
+				} else if (dir.z == 1) {
+					dist = 1.f - fractf(a.z);
+					dist += 1.f - fractf(b.z);
+				} else if (dir.z == -1) {
+					dist = fractf(a.z);
+					dist += fractf(b.z);
+				} else {
+					SPAssert(false);
+					return;
+				}
+
+				if (dist < bestDist) {
+					bestDist = dist;
+					bestDir = dir;
+				}
+			}
+		} // namespace
+
+		/** The working set of a `Group`. Unused lanes hold a copy of the first lane. */
+		struct CorpseSolver::Pack {
+			NodeLanes pos;
+			NodeLanes vel;
+			NodeLanes lastPos;
+			Vector3Lanes<EdgeCount> lastVelDiff;
+			bool momentumPrimed[LaneCount];
+			GameMap *maps[LaneCount];
+			int numLanes;
+		};
+
+		class CorpseSolver::UpdateJob : public ThreadPoolJob {
+		public:
+			UpdateJob(CorpseSolver &solver) : solver(solver) {}
+			~UpdateJob() { Join(); }
+
+		protected:
+			void RunChunk(std::size_t index) override { solver.StepGroup(solver.groups[index]); }
+
+		private:
+			CorpseSolver &solver;
+		};
+
+		CorpseSolver::CorpseSolver()
+		    : groupDt{0.f}, updating{false}, updateJob{stmp::make_unique<UpdateJob>(*this)} {}
+
+		CorpseSolver::~CorpseSolver() { updateJob->Join(); }
+
+		std::size_t CorpseSolver::AddRagdoll(GameMap &map) {
+			SPAssert(!updating);
+
+			std::size_t id;
+			if (freeIds.empty()) {
+				id = ragdolls.size();
+				ragdolls.emplace_back();
+			} else {
+				id = freeIds.back();
+				freeIds.pop_back();
+			}
+
+			Ragdoll &ragdoll = ragdolls[id];
+			ragdoll.map = &map;
+			std::fill(std::begin(ragdoll.pos), std::end(ragdoll.pos), MakeVector3(0, 0, 0));
+			std::fill(std::begin(ragdoll.vel), std::end(ragdoll.vel), MakeVector3(0, 0, 0));
+			std::fill(std::begin(ragdoll.lastPos), std::end(ragdoll.lastPos),
+			          MakeVector3(0, 0, 0));
+			std::fill(std::begin(ragdoll.lastVelDiff), std::end(ragdoll.lastVelDiff),
+			          MakeVector3(0, 0, 0));
+			ragdoll.momentumPrimed = false;
+			return id;
+		}
+
+		void CorpseSolver::RemoveRagdoll(std::size_t id) {
+			SPAssert(!updating);
+			SPAssert(id < ragdolls.size());
+			SPAssert(ragdolls[id].map);
+
+			ragdolls[id].map = nullptr;
+			freeIds.push_back(id);
+
+			if (freeIds.size() == ragdolls.size()) {
+				ragdolls.clear();
+				freeIds.clear();
+			}
+		}
+
+		void CorpseSolver::StartUpdate(float dt, Vector3 eye) {
+			int numSubsteps = std::min(std::max((int)cg_corpseSubsteps, 1), 16);
+			int lodBudget = std::max((int)cg_corpseLODBudget, 0);
+			StartUpdate(dt, eye, numSubsteps, static_cast<std::size_t>(lodBudget));
+		}
+
+		void CorpseSolver::StartUpdate(float dt, Vector3 eye, int numSubsteps,
+		                               std::size_t lodBudget) {
+			SPADES_MARK_FUNCTION();
+			SPAssert(!updating);
+			SPAssert(numSubsteps >= 1);
+
+			bool needsLod = GetNumRagdolls() > lodBudget;
+			order.clear();
+			for (std::size_t id = 0; id < ragdolls.size(); ++id) {
+				const Ragdoll &ragdoll = ragdolls[id];
+				if (!ragdoll.map) {
+					continue;
+				}
+				float distance = 0.f;
+				if (needsLod) {
+					distance = (ragdoll.pos[Corpse::Torso1] - eye).GetPoweredLength();
+				}
+				order.emplace_back(distance, id);
+			}
+
+			// The nearest corpses come first, so each group has a uniform substep count
+			if (needsLod) {
+				std::sort(order.begin(), order.end());
+			}
+
+			int lodSubsteps = static_cast<int>(std::ceil(dt * MinLODSubstepRate));
+			lodSubsteps = std::min(std::max(lodSubsteps, 1), numSubsteps);
+
+			groups.clear();
+			for (std::size_t i = 0; i < order.size(); ++i) {
+				int substeps = i < lodBudget ? numSubsteps : lodSubsteps;
+				if (groups.empty() || groups.back().numLanes == LaneCount ||
+				    groups.back().numSubsteps != substeps) {
+					Group group;
+					group.numLanes = 0;
+					group.numSubsteps = substeps;
+					groups.push_back(group);
+				}
+				Group &group = groups.back();
+				group.ids[group.numLanes++] = order[i].second;
+			}
+
+			groupDt = dt;
+			updating = true;
+			updateJob->Start(ThreadPool::GetGlobalPool(), groups.size());
+		}
+
+		void CorpseSolver::FinishUpdate() {
+			SPADES_MARK_FUNCTION();
+
+			updateJob->Join();
+			updating = false;
+		}
+
+		void CorpseSolver::StepGroup(const Group &group) {
+			SPADES_MARK_FUNCTION();
+
+			Pack pack;
+			pack.numLanes = group.numLanes;
+			for (int lane = 0; lane < LaneCount; ++lane) {
+				const Ragdoll &ragdoll = ragdolls[group.ids[lane < group.numLanes ? lane : 0]];
+				for (int i = 0; i < Corpse::NodeCount; ++i) {
+					pack.pos.SetLane(i, lane, ragdoll.pos[i]);
+					pack.vel.SetLane(i, lane, ragdoll.vel[i]);
+					pack.lastPos.SetLane(i, lane, ragdoll.lastPos[i]);
+				}
+				for (int i = 0; i < EdgeCount; ++i) {
+					pack.lastVelDiff.SetLane(i, lane, ragdoll.lastVelDiff[i]);
+				}
+				pack.momentumPrimed[lane] = ragdoll.momentumPrimed;
+				pack.maps[lane] = ragdoll.map;
+			}
+
+			float dt = groupDt / static_cast<float>(group.numSubsteps);
+			for (int i = 0; i < group.numSubsteps; ++i) {
+				StepPack(pack, dt);
+			}
+
+			for (int lane = 0; lane < group.numLanes; ++lane) {
+				Ragdoll &ragdoll = ragdolls[group.ids[lane]];
+				for (int i = 0; i < Corpse::NodeCount; ++i) {
+					ragdoll.pos[i] = pack.pos.GetLane(i, lane);
+					ragdoll.vel[i] = pack.vel.GetLane(i, lane);
+					ragdoll.lastPos[i] = pack.lastPos.GetLane(i, lane);
+				}
+				for (int i = 0; i < EdgeCount; ++i) {
+					ragdoll.lastVelDiff[i] = pack.lastVelDiff.GetLane(i, lane);
+				}
+				ragdoll.momentumPrimed = pack.momentumPrimed[lane];
+			}
+		}
+
+		void CorpseSolver::StepPack(Pack &pack, float dt) {
+			float damp = 1.f;
+			float damp2 = 1.f;
+			if (dt > 0.f) {
+				damp = powf(.9f, dt);
+				damp2 = powf(.371f, dt);
+			}
+
+			for (int i = 0; i < Corpse::NodeCount; ++i) {
+				Vector3x4 pos = pack.pos.Get(i);
+				Vector3x4 vel = pack.vel.Get(i);
+				pos = pos + vel * dt;
+
+				Mask4 inWater = pos.z > Float4(63.f);
+				Float4 buoyantVelZ = (vel.z - dt * 6.f) * damp;
+				Float4 fallingVelZ = (vel.z + dt * 32.f) * damp2;
+				vel = Select(inWater, vel * damp, vel);
+				vel.z = Select(inWater, buoyantVelZ, fallingVelZ);
+
+				pack.pos.Set(i, pos);
+				pack.vel.Set(i, vel);
+			}
+
+			// Block collision is too branchy for SIMD
+			for (int lane = 0; lane < pack.numLanes; ++lane) {
+				GameMap &map = *pack.maps[lane];
+				for (int i = 0; i < Corpse::NodeCount; ++i) {
+					Vector3 oldPos = pack.lastPos.GetLane(i, lane);
+					Vector3 pos = pack.pos.GetLane(i, lane);
+					Vector3 vel = pack.vel.GetLane(i, lane);
+
+					SPAssert(!std::isnan(pos.x));
+					SPAssert(!std::isnan(pos.y));
+					SPAssert(!std::isnan(pos.z));
+
+					if (!map.ClipBox(oldPos.x, oldPos.y, oldPos.z)) {
+						if (map.ClipBox(pos.x, oldPos.y, oldPos.z)) {
+							vel.x = -vel.x * .2f;
+							if (fabsf(vel.x) < .3f)
+								vel.x = 0.f;
+							pos.x = oldPos.x;
+
+							vel.y *= .5f;
+							vel.z *= .5f;
+						}
+
+						if (map.ClipBox(pos.x, pos.y, oldPos.z)) {
+							vel.y = -vel.y * .2f;
+							if (fabsf(vel.y) < .3f)
+								vel.y = 0.f;
+							pos.y = oldPos.y;
+
+							vel.x *= .5f;
+							vel.z *= .5f;
+						}
+
+						if (map.ClipBox(pos.x, pos.y, pos.z)) {
+							vel.z = -vel.z * .2f;
+							if (fabsf(vel.z) < .3f)
+								vel.z = 0.f;
+							pos.z = oldPos.z;
+
+							vel.x *= .5f;
+							vel.y *= .5f;
+						}
+					}
+
+					pack.pos.SetLane(i, lane, pos);
+					pack.vel.SetLane(i, lane, vel);
+					pack.lastPos.SetLane(i, lane, pos);
+				}
+			}
+
+			ApplyConstraints(pack, dt);
+		}
+
+		void CorpseSolver::ApplyConstraints(Pack &pack, float dt) {
+			using C = Corpse;
+			NodeLanes &pos = pack.pos;
+			NodeLanes &vel = pack.vel;
+
+			// Preserve the angular momentum of the bones
+			Mask4 primed = MakeMask(pack.momentumPrimed);
+			auto angularMomentum = [&](int edge, int a, int b) {
+				Vector3x4 aVel = vel.Get(a), bVel = vel.Get(b);
+				Vector3x4 velDiff = bVel - aVel;
+				Vector3x4 force = (pack.lastVelDiff.Get(edge) - velDiff) * .5f;
+				vel.Set(b, Select(primed, bVel + force, bVel));
+				vel.Set(a, Select(primed, aVel - force, aVel));
+				pack.lastVelDiff.Set(edge, velDiff);
+			};
+			angularMomentum(0, C::Torso1, C::Torso2);
+			angularMomentum(1, C::Torso2, C::Torso3);
+			angularMomentum(2, C::Torso3, C::Torso4);
+			angularMomentum(3, C::Torso4, C::Torso1);
+			angularMomentum(4, C::Torso1, C::Arm1);
+			angularMomentum(5, C::Torso2, C::Arm2);
+			angularMomentum(6, C::Torso3, C::Leg1);
+			angularMomentum(7, C::Torso4, C::Leg2);
+			std::fill(std::begin(pack.momentumPrimed), std::end(pack.momentumPrimed), true);
+
+			float dump = 1.f - powf(.1f, dt);
+			Spring(pos, vel, C::Torso1, C::Torso2, 0.8f, dt, dump);
+			Spring(pos, vel, C::Torso3, C::Torso4, 0.8f, dt, dump);
+
+			Spring(pos, vel, C::Torso1, C::Torso4, 0.9f, dt, dump);
+			Spring(pos, vel, C::Torso2, C::Torso3, 0.9f, dt, dump);
+
+			Spring(pos, vel, C::Torso1, C::Torso3, 1.204f, dt, dump);
+			Spring(pos, vel, C::Torso2, C::Torso4, 1.204f, dt, dump);
+
+			Spring(pos, vel, C::Arm1, C::Torso1, 1.f, dt, dump);
+			Spring(pos, vel, C::Arm2, C::Torso2, 1.f, dt, dump);
+			Spring(pos, vel, C::Leg1, C::Torso3, 1.f, dt, dump);
+			Spring(pos, vel, C::Leg2, C::Torso4, 1.f, dt, dump);
+
+			AngleSpring(pos, vel, C::Torso1, C::Arm1, C::Torso3, -1.f, 0.6f, dt);
+			AngleSpring(pos, vel, C::Torso2, C::Arm2, C::Torso4, -1.f, 0.6f, dt);
+
+			AngleSpring(pos, vel, C::Torso3, C::Leg1, C::Torso2, -1.f, -0.2f, dt);
+			AngleSpring(pos, vel, C::Torso4, C::Leg2, C::Torso1, -1.f, -0.2f, dt);
+
+			Spring(pos, vel, C::Torso1, C::Torso2, C::Head, .6f, dt, 1.f - powf(.05f, dt));
+
+			if (!r_corpseLineCollision) {
+				return;
+			}
+
+			LineCollision(pack, C::Torso1, C::Torso2, dt);
+			LineCollision(pack, C::Torso2, C::Torso3, dt);
+			LineCollision(pack, C::Torso3, C::Torso4, dt);
+			LineCollision(pack, C::Torso4, C::Torso1, dt);
+			LineCollision(pack, C::Torso1, C::Torso3, dt);
+			LineCollision(pack, C::Torso2, C::Torso4, dt);
+			LineCollision(pack, C::Torso1, C::Arm1, dt);
+			LineCollision(pack, C::Torso2, C::Arm2, dt);
+			LineCollision(pack, C::Torso3, C::Leg1, dt);
+			LineCollision(pack, C::Torso4, C::Leg2, dt);
+		}
+
+		void CorpseSolver::LineCollision(Pack &pack, Corpse::NodeType a, Corpse::NodeType b,
+		                                 float dt) {
+			for (int lane = 0; lane < pack.numLanes; ++lane) {
+				GameMap &map = *pack.maps[lane];
+				Vector3 pos1 = pack.pos.GetLane(a, lane);
+				Vector3 pos2 = pack.pos.GetLane(b, lane);
+				Vector3 lastPos1 = pack.lastPos.GetLane(a, lane);
+				Vector3 lastPos2 = pack.lastPos.GetLane(b, lane);
+
+				IntVector3 hitBlock;
+				if (!map.CastRay(lastPos1, lastPos2, 16.f, hitBlock)) {
+					continue;
+				}
+
+				GameMap::RayCastResult res1 = map.CastRay2(lastPos1, lastPos2 - lastPos1, 8);
+				GameMap::RayCastResult res2 = map.CastRay2(lastPos2, lastPos1 - lastPos2, 8);
+
+				if (!res1.hit || !res2.hit)
+					continue;
+				if (res1.startSolid || res2.startSolid)
+					continue;
+
+				// really hit?
+				float length = (pos2 - pos1).GetPoweredLength();
+				float proj1 = Vector3::Dot(res1.hitPos - lastPos1, lastPos2 - lastPos1);
+				float proj2 = Vector3::Dot(res2.hitPos - lastPos2, lastPos1 - lastPos2);
+				if (proj1 > length || proj1 < 0.f || proj2 > length || proj2 < 0.f)
+					continue;
+
+				float inlen = (res1.hitPos - res2.hitPos).GetLength();
+
+				IntVector3 ivec = {0, 0, 0};
+
+				ivec.x += res1.normal.x;
+				ivec.y += res1.normal.y;
+				ivec.z += res1.normal.z;
+				ivec.x += res2.normal.x;
+				ivec.y += res2.normal.y;
+				ivec.z += res2.normal.z;
+
+				if (ivec.x == 0 && ivec.y == 0 && ivec.z == 0) {
+					// hanging. which direction to escape?
+					float bestDist = 1000.f;
+					IntVector3 bestDir;
+					IntVector3 floor1 = pos1.Floor(), floor2 = pos2.Floor();
+					CheckEscape(map, hitBlock, floor1, floor2, IntVector3::Make(1, 0, 0),
+					            bestDist, bestDir);
+					CheckEscape(map, hitBlock, floor1, floor2, IntVector3::Make(-1, 0, 0),
+					            bestDist, bestDir);
+					CheckEscape(map, hitBlock, floor1, floor2, IntVector3::Make(0, 1, 0),
+					            bestDist, bestDir);
+					CheckEscape(map, hitBlock, floor1, floor2, IntVector3::Make(0, -1, 0),
+					            bestDist, bestDir);
+					CheckEscape(map, hitBlock, floor1, floor2, IntVector3::Make(0, 0, 1),
+					            bestDist, bestDir);
+					CheckEscape(map, hitBlock, floor1, floor2, IntVector3::Make(0, 0, -1),
+					            bestDist, bestDir);
+					if (bestDist > 10.f) {
+						// failed to find appropriate direction.
+						continue;
+					}
+					ivec = bestDir;
+					inlen = bestDist + .1f;
+				}
+
+				Vector3 dir = MakeVector3(ivec.x, ivec.y, ivec.z);
+				Vector3 normDir = dir; // |D|
+
+				Vector3 vel1 = pack.vel.GetLane(a, lane);
+				Vector3 vel2 = pack.vel.GetLane(b, lane);
+
+				vel1 -= normDir * std::min(Vector3::Dot(normDir, vel1), 0.f);
+				vel2 -= normDir * std::min(Vector3::Dot(normDir, vel2), 0.f);
+
+				dir *= dt * inlen * 5.f;
+
+				vel1 += dir;
+				vel2 += dir;
+
+				// friction
+				vel1 -= (vel1 - normDir * Vector3::Dot(normDir, vel1)) * .2f;
+				vel2 -= (vel2 - normDir * Vector3::Dot(normDir, vel2)) * .2f;
+
+				pack.vel.SetLane(a, lane, vel1);
+				pack.vel.SetLane(b, lane, vel2);
+			}
+		}
+	} // namespace client
+} // namespace spades
@@ -0,0 +1,131 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Corpse.h"
+#include <Core/Debug.h>
+#include <Core/Math.h>
+
+namespace spades {
+	namespace client {
+		class GameMap;
+
+		/**
+		 * Simulates the ragdolls of all `Corpse`s in batches.
+		 *
+		 * The state of every ragdoll is stored in a single array. An update gathers groups of
+		 * up to `LaneCount` ragdolls into structure-of-arrays packs, so the springs of a group
+		 * are relaxed in SIMD lanes, and the groups are processed in parallel by the global
+		 * thread pool. A frame is divided into `cg_corpseSubsteps` substeps. Only the
+		 * `cg_corpseLODBudget` corpses nearest to the camera get all substeps; the others are
+		 * stepped as coarsely as the simulation stays stable.
+		 */
+		class CorpseSolver {
+		public:
+			enum {
+				/** The number of ragdolls stepped together by SIMD instructions. */
+				LaneCount = 4,
+				/** The number of the bones whose angular momentum is preserved. */
+				EdgeCount = 8
+			};
+
+			struct Ragdoll {
+				/** The game map to collide with. `nullptr` if this entry is unused. */
+				GameMap *map;
+
+				Vector3 pos[Corpse::NodeCount];
+				Vector3 vel[Corpse::NodeCount];
+				/** The positions after the integration of the last substep. */
+				Vector3 lastPos[Corpse::NodeCount];
+
+				/** The relative velocities of the bones' ends, observed in the last substep. */
+				Vector3 lastVelDiff[EdgeCount];
+				/** `false` until `lastVelDiff` is valid. */
+				bool momentumPrimed;
+			};
+
+			CorpseSolver();
+			~CorpseSolver();
+
+			CorpseSolver(const CorpseSolver &) = delete;
+			void operator=(const CorpseSolver &) = delete;
+
+			/** Adds a ragdoll at rest at the origin and returns its ID. */
+			std::size_t AddRagdoll(GameMap &);
+			void RemoveRagdoll(std::size_t id);
+
+			/** The returned reference is invalidated by `AddRagdoll`. */
+			Ragdoll &GetRagdoll(std::size_t id) {
+				SPAssert(id < ragdolls.size());
+				return ragdolls[id];
+			}
+
+			std::size_t GetNumRagdolls() const { return ragdolls.size() - freeIds.size(); }
+
+			/**
+			 * Starts stepping all ragdolls by `dt` on the global thread pool, using the
+			 * settings for the substep count and the LOD. `eye` is the position of the
+			 * camera. Ragdolls must not be accessed until `FinishUpdate` is called.
+			 */
+			void StartUpdate(float dt, Vector3 eye);
+
+			/**
+			 * Same as above, but the ragdolls beyond the `lodBudget` nearest ones are stepped
+			 * with fewer substeps than `numSubsteps`.
+			 */
+			void StartUpdate(float dt, Vector3 eye, int numSubsteps, std::size_t lodBudget);
+
+			/** Waits for the completion of the update started by `StartUpdate`. */
+			void FinishUpdate();
+
+		private:
+			class UpdateJob;
+			struct Pack;
+
+			/** Ragdolls stepped together with the same number of substeps. */
+			struct Group {
+				std::size_t ids[LaneCount];
+				int numLanes;
+				int numSubsteps;
+			};
+
+			std::vector<Ragdoll> ragdolls;
+			std::vector<std::size_t> freeIds;
+
+			std::vector<Group> groups;
+			/** A scratch buffer for sorting the ragdolls by distance. */
+			std::vector<std::pair<float, std::size_t>> order;
+			float groupDt;
+			bool updating;
+
+			std::unique_ptr<UpdateJob> updateJob;
+
+			void StepGroup(const Group &);
+			void StepPack(Pack &, float dt);
+			void ApplyConstraints(Pack &, float dt);
+			void LineCollision(Pack &, Corpse::NodeType a, Corpse::NodeType b, float dt);
+		};
+	} // namespace client
+} // namespace spades
@@ -18,22 +18,60 @@
 
  */
 
+#include <algorithm>
+
 #include "FallingBlock.h"
 #include "Client.h"
 #include "GameMap.h"
 #include "IModel.h"
 #include "IRenderer.h"
-#include "ParticleSpriteEntity.h"
-#include "SmokeSpriteEntity.h"
+#include "ParticleSystem.h"
 #include "World.h"
 #include <Core/Debug.h>
 #include <Core/Exception.h>
+#include <Core/TMPUtils.h>
+#include <Core/ThreadPool.h>
 #include <limits.h>
 
 namespace spades {
 	namespace client {
+		namespace {
+			/**
+			 * Packs a block position relative to the minimum corner. Sorting the keys orders
+			 * the blocks by X, Y, and then Z.
+			 */
+			std::uint64_t PackPosition(int x, int y, int z) {
+				return static_cast<std::uint64_t>(z) | (static_cast<std::uint64_t>(y) << 21) |
+				       (static_cast<std::uint64_t>(x) << 42);
+			}
+			IntVector3 UnpackPosition(std::uint64_t key) {
+				return IntVector3::Make(static_cast<int>(key >> 42),
+				                        static_cast<int>((key >> 21) & 0x1fffff),
+				                        static_cast<int>(key & 0x1fffff));
+			}
+		} // namespace
+
+		class FallingBlock::MeshJob : public ThreadPoolJob {
+		public:
+			MeshJob(IRenderer &renderer, std::vector<Chunk> &chunks)
+			    : renderer(renderer), chunks(chunks) {}
+			~MeshJob() { Join(); }
+
+		protected:
+			void RunChunk(std::size_t index) override {
+				Chunk &chunk = chunks[index];
+				chunk.preloaded = renderer.PreloadVoxelModel(*chunk.voxelModel);
+			}
+
+		private:
+			IRenderer &renderer;
+			std::vector<Chunk> &chunks;
+		};
+
 		FallingBlock::FallingBlock(Client *client, std::vector<IntVector3> blocks)
-		    : client(client) {
+		    : client(client), modelsCreated(false) {
+			SPADES_MARK_FUNCTION();
+
 			if (blocks.empty())
 				SPRaise("No block given");
 
@@ -64,39 +102,118 @@ namespace spades {
 			const Handle<GameMap> &map = client->GetWorld()->GetMap();
 			SPAssert(map);
 
-			// build voxel model
-			vmodel = new VoxelModel(maxX - minX + 1, maxY - minY + 1, maxZ - minZ + 1);
-			for (size_t i = 0; i < blocks.size(); i++) {
-				IntVector3 v = blocks[i];
-				uint32_t col = map->GetColor(v.x, v.y, v.z);
+			std::vector<std::uint64_t> keys;
+			keys.reserve(blocks.size());
+			for (const IntVector3 &v : blocks) {
+				keys.push_back(PackPosition(v.x - minX, v.y - minY, v.z - minZ));
+			}
+			std::sort(keys.begin(), keys.end());
+			keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+			auto isSolid = [&](int x, int y, int z) {
+				return x >= 0 && y >= 0 && z >= 0 &&
+				       std::binary_search(keys.begin(), keys.end(), PackPosition(x, y, z));
+			};
+
+			std::vector<std::uint32_t> colors;
+			colors.reserve(keys.size());
+			for (std::uint64_t key : keys) {
+				IntVector3 v = UnpackPosition(key);
+				uint32_t col = map->GetColor(v.x + minX, v.y + minY, v.z + minZ);
 
 				// Use the default material
 				col &= 0xffffff;
-
-				vmodel->SetSolid(v.x - minX, v.y - minY, v.z - minZ, col);
+				colors.push_back(col);
+
+				// Only the surface produces debris
+				if (isSolid(v.x - 1, v.y, v.z) && isSolid(v.x + 1, v.y, v.z) &&
+				    isSolid(v.x, v.y - 1, v.z) && isSolid(v.x, v.y + 1, v.z) &&
+				    isSolid(v.x, v.y, v.z - 1) && isSolid(v.x, v.y, v.z + 1))
+					continue;
+				surfaceBlocks.push_back(SurfaceBlock{v, col});
 			}
 
 			// center of gravity
-			Vector3 origin;
 			origin.x = (float)minX - (float)xSum / (float)blocks.size();
 			origin.y = (float)minY - (float)ySum / (float)blocks.size();
 			origin.z = (float)minZ - (float)zSum / (float)blocks.size();
-			vmodel->SetOrigin(origin);
+
+			// build voxel models of the non-empty chunks
+			auto getChunkIndex = [&](std::uint64_t key) {
+				IntVector3 v = UnpackPosition(key);
+				return std::make_pair(v.x / ChunkSize, v.y / ChunkSize);
+			};
+			std::vector<std::size_t> order(keys.size());
+			for (std::size_t i = 0; i < order.size(); ++i) {
+				order[i] = i;
+			}
+			std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+				return getChunkIndex(keys[a]) < getChunkIndex(keys[b]);
+			});
+
+			for (std::size_t begin = 0; begin < order.size();) {
+				auto chunkIndex = getChunkIndex(keys[order[begin]]);
+				std::size_t end = begin;
+				IntVector3 chunkMin = UnpackPosition(keys[order[begin]]);
+				IntVector3 chunkMax = chunkMin;
+				for (; end < order.size() && getChunkIndex(keys[order[end]]) == chunkIndex;
+				     ++end) {
+					IntVector3 v = UnpackPosition(keys[order[end]]);
+					chunkMin.x = std::min(chunkMin.x, v.x);
+					chunkMin.y = std::min(chunkMin.y, v.y);
+					chunkMin.z = std::min(chunkMin.z, v.z);
+					chunkMax.x = std::max(chunkMax.x, v.x);
+					chunkMax.y = std::max(chunkMax.y, v.y);
+					chunkMax.z = std::max(chunkMax.z, v.z);
+				}
+
+				IntVector3 size = chunkMax - chunkMin + 1;
+				auto voxelModel = Handle<VoxelModel>::New(size.x, size.y, size.z);
+				for (std::size_t i = begin; i < end; ++i) {
+					IntVector3 v = UnpackPosition(keys[order[i]]) - chunkMin;
+					voxelModel->SetSolid(v.x, v.y, v.z, colors[order[i]]);
+				}
+
+				// All chunks share the transform of the whole structure
+				voxelModel->SetOrigin(origin + MakeVector3(chunkMin.x, chunkMin.y, chunkMin.z));
+
+				Chunk chunk;
+				chunk.voxelModel = std::move(voxelModel);
+				chunks.push_back(std::move(chunk));
+				begin = end;
+			}
 
 			Vector3 matTrans = MakeVector3((float)minX, (float)minY, (float)minZ);
 			matTrans += .5f;    // voxelmodel's (0,0,0) origins on block center
 			matTrans -= origin; // cancel origin
 			matrix = Matrix4::Translate(matTrans);
+			lastMatrix = matrix;
 
-			// build renderer model
-			model = client->GetRenderer().CreateModel(*vmodel).Unmanage();
+			// build the meshes in the background until the structure is first drawn
+			meshJob = stmp::make_unique<MeshJob>(client->GetRenderer(), chunks);
+			meshJob->Start(ThreadPool::GetGlobalPool(), chunks.size());
 
 			time = 0.f;
 		}
 
-		FallingBlock::~FallingBlock() {
-			model->Release();
-			vmodel->Release();
+		FallingBlock::~FallingBlock() {}
+
+		void FallingBlock::CreateModels() {
+			SPADES_MARK_FUNCTION();
+
+			// The blocks are already removed from the map, so the structure must be drawn
+			// from the first frame. This thread helps building the remaining meshes, if any.
+			// Rethrows an exception from the mesh generation, if any.
+			meshJob->Join();
+
+			// Like `CreateModel`, this makes `GLVoxelModel` if `r_optimizedVoxelModel` is
+			// disabled
+			IRenderer &renderer = client->GetRenderer();
+			for (Chunk &chunk : chunks) {
+				chunk.model = renderer.CreatePreloadedModel(*chunk.preloaded);
+				chunk.preloaded.reset();
+			}
+			modelsCreated = true;
 		}
 
 		bool FallingBlock::Update(float dt) {
@@ -109,12 +226,8 @@ namespace spades {
 
 			if (time > 1.f || map->ClipBox(orig.x, orig.y, orig.z)) {
 				// destroy
-				int w = vmodel->GetWidth();
-				int h = vmodel->GetHeight();
-				int d = vmodel->GetDepth();
-
 				Matrix4 vmat = lastMatrix;
-				vmat = vmat * Matrix4::Translate(vmodel->GetOrigin());
+				vmat = vmat * Matrix4::Translate(origin);
 
 				// block center
 				Vector3 vmOrigin = vmat.GetOrigin();
@@ -145,62 +258,48 @@ namespace spades {
 
 				auto *getRandom = SampleRandomFloat;
 
-				for (int x = 0; x < w; x++) {
-					Vector3 p1 = vmOrigin + vmAxis1 * (float)x;
-					for (int y = 0; y < h; y++) {
-						Vector3 p2 = p1 + vmAxis2 * (float)y;
-						for (int z = 0; z < d; z++) {
-							if (!vmodel->IsSolid(x, y, z))
-								continue;
-
-							// inner voxel?
-							if (x > 0 && y > 0 && z > 0 && x < w - 1 && y < h - 1 && z < d - 1 &&
-							    vmodel->IsSolid(x - 1, y, z) && vmodel->IsSolid(x + 1, y, z) &&
-							    vmodel->IsSolid(x, y - 1, z) && vmodel->IsSolid(x, y + 1, z) &&
-							    vmodel->IsSolid(x, y, z - 1) && vmodel->IsSolid(x, y, z + 1))
-								continue;
-							uint32_t c = vmodel->GetColor(x, y, z);
-							Vector4 col;
-							col.x = (float)((uint8_t)(c)) / 255.f;
-							col.y = (float)((uint8_t)(c >> 8)) / 255.f;
-							col.z = (float)((uint8_t)(c >> 16)) / 255.f;
-							col.w = 1.;
-
-							Vector3 p3 = p2 + vmAxis3 * (float)z;
-
-							{
-								auto ent = stmp::make_unique<SmokeSpriteEntity>(*client, col, 70.f);
-								ent->SetTrajectory(
-								  p3,
-								  (MakeVector3(getRandom() - getRandom(), getRandom() - getRandom(),
-								               getRandom() - getRandom())) *
-								    0.2f,
-								  1.f, 0.f);
-								ent->SetRotation(getRandom() * (float)M_PI * 2.f);
-								ent->SetRadius(1.0f, 0.5f);
-								ent->SetBlockHitAction(BlockHitAction::Ignore);
-								ent->SetLifeTime(1.0f + getRandom() * 0.5f, 0.f, 1.0f);
-								client->AddLocalEntity(std::move(ent));
-							}
-
-							col.w = 1.f;
-							for (int i = 0; i < 6; i++) {
-								auto ent = stmp::make_unique<ParticleSpriteEntity>(
-								  *client, img.GetPointerOrNull(), col);
-								ent->SetTrajectory(p3,
-								                   MakeVector3(getRandom() - getRandom(),
-								                               getRandom() - getRandom(),
-								                               getRandom() - getRandom()) *
-								                     13.f,
-								                   1.f, .6f);
-								ent->SetRotation(getRandom() * (float)M_PI * 2.f);
-								ent->SetRadius(0.35f + getRandom() * getRandom() * 0.1f);
-								ent->SetLifeTime(2.f, 0.f, 1.f);
-								if (usePrecisePhysics)
-									ent->SetBlockHitAction(BlockHitAction::BounceWeak);
-								client->AddLocalEntity(std::move(ent));
-							}
-						}
+				for (const SurfaceBlock &block : surfaceBlocks) {
+					uint32_t c = block.color;
+					Vector4 col;
+					col.x = (float)((uint8_t)(c)) / 255.f;
+					col.y = (float)((uint8_t)(c >> 8)) / 255.f;
+					col.z = (float)((uint8_t)(c >> 16)) / 255.f;
+					col.w = 1.;
+
+					Vector3 p3 = vmOrigin + vmAxis1 * (float)block.pos.x;
+					p3 += vmAxis2 * (float)block.pos.y;
+					p3 += vmAxis3 * (float)block.pos.z;
+
+					{
+						ParticleParam ent{col, 70.f};
+						ent.SetTrajectory(
+						  p3,
+						  (MakeVector3(getRandom() - getRandom(), getRandom() - getRandom(),
+						               getRandom() - getRandom())) *
+						    0.2f,
+						  1.f, 0.f);
+						ent.SetRotation(getRandom() * (float)M_PI * 2.f);
+						ent.SetRadius(1.0f, 0.5f);
+						ent.SetBlockHitAction(BlockHitAction::Ignore);
+						ent.SetLifeTime(1.0f + getRandom() * 0.5f, 0.f, 1.0f);
+						client->GetParticleSystem().Spawn(ent);
+					}
+
+					col.w = 1.f;
+					for (int i = 0; i < 6; i++) {
+						ParticleParam ent{*img, col};
+						ent.SetTrajectory(p3,
+						                  MakeVector3(getRandom() - getRandom(),
+						                              getRandom() - getRandom(),
+						                              getRandom() - getRandom()) *
+						                    13.f,
+						                  1.f, .6f);
+						ent.SetRotation(getRandom() * (float)M_PI * 2.f);
+						ent.SetRadius(0.35f + getRandom() * getRandom() * 0.1f);
+						ent.SetLifeTime(2.f, 0.f, 1.f);
+						if (usePrecisePhysics)
+							ent.SetBlockHitAction(BlockHitAction::BounceWeak);
+						client->GetParticleSystem().Spawn(ent);
 					}
 				}
 				return false;
@@ -220,9 +319,15 @@ namespace spades {
 		}
 
 		void FallingBlock::Render3D() {
+			if (!modelsCreated) {
+				CreateModels();
+			}
+
 			ModelRenderParam param;
 			param.matrix = matrix;
-			client->GetRenderer().RenderModel(*model, param);
+			for (const Chunk &chunk : chunks) {
+				client->GetRenderer().RenderModel(*chunk.model, param);
+			}
 		}
 	} // namespace client
 } // namespace spades
@@ -20,32 +20,73 @@
 
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 #include "ILocalEntity.h"
 #include <Core/Math.h>
+#include <Core/RefCountedObject.h>
 #include <Core/VoxelModel.h>
 
 namespace spades {
 	namespace client {
 		class Client;
 		class IModel;
+		class PreloadedModel;
 
+		/**
+		 * A structure falling after losing its support.
+		 *
+		 * The structure is split into chunks of `ChunkSize`x`ChunkSize` columns, each of which
+		 * has a voxel model covering only its own blocks, so a sparse structure (e.g., a long
+		 * diagonal bridge) doesn't need a huge voxel model. The meshes of the chunks are built
+		 * by the global thread pool, and the renderer models are created when the structure is
+		 * first drawn.
+		 */
 		class FallingBlock : public ILocalEntity {
-			Client *client;
-			IModel *model;
-			VoxelModel *vmodel;
-			Matrix4 matrix;
-			Matrix4 lastMatrix;
-			float time;
-			int numBlocks;
-
 		public:
+			enum { ChunkSize = 16 };
+
 			FallingBlock(Client *, std::vector<IntVector3> blocks);
 			~FallingBlock();
 
 			bool Update(float dt) override;
 			void Render3D() override;
+
+		private:
+			struct Chunk {
+				Handle<VoxelModel> voxelModel;
+				/** The result of the mesh generation. Consumed by `CreateModels`. */
+				std::unique_ptr<PreloadedModel> preloaded;
+				Handle<IModel> model;
+			};
+
+			/** A block not surrounded by other blocks, which turns into debris. */
+			struct SurfaceBlock {
+				/** Relative to the minimum corner of the structure. */
+				IntVector3 pos;
+				std::uint32_t color;
+			};
+
+			class MeshJob;
+
+			Client *client;
+			std::vector<Chunk> chunks;
+			std::vector<SurfaceBlock> surfaceBlocks;
+			/** Must be destroyed before `chunks`. */
+			std::unique_ptr<MeshJob> meshJob;
+			bool modelsCreated;
+
+			/** The minimum corner relative to the center of gravity. */
+			Vector3 origin;
+			Matrix4 matrix;
+			Matrix4 lastMatrix;
+			float time;
+			int numBlocks;
+
+			/** Waits for the meshes and creates the renderer models. */
+			void CreateModels();
 		};
 	} // namespace client
-} // namespace spades
\ No newline at end of file
+} // namespace spades
@@ -22,6 +22,8 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <iterator>
 #include <vector>
 
 #include "GameMap.h"
@@ -30,28 +32,161 @@
 #include <Core/FileManager.h>
 #include <Core/IStream.h>
 #include <Core/RandomAccessAdaptor.h>
+#include <Core/SIMD.h>
+#include <Core/Settings.h>
+#include <Core/ThreadPool.h>
+
+DEFINE_SPADES_SETTING(cg_sparseMapStorage, "0");
 
 namespace spades {
 	namespace client {
 
-		GameMap::GameMap() {
+		GameMap::StorageMode GameMap::GetDefaultStorageMode() {
+			return cg_sparseMapStorage ? StorageMode::Sparse : StorageMode::Dense;
+		}
+
+		GameMap::GameMap(StorageMode mode) {
 			SPADES_MARK_FUNCTION();
 
+			switch (mode) {
+				case StorageMode::Dense:
+					denseColors.reset(new uint32_t[DefaultWidth * DefaultHeight * DefaultDepth]);
+					break;
+				case StorageMode::Sparse:
+					// Every voxel starts without a color slot
+					sparseColumns.reset(new SparseColumn[DefaultWidth * DefaultHeight]);
+					break;
+			}
+
 			for (int x = 0; x < DefaultWidth; x++)
 				for (int y = 0; y < DefaultHeight; y++) {
 					solidMap[x][y] = 1; // ground only
+					if (!denseColors) {
+						continue;
+					}
 					for (int z = 0; z < DefaultDepth; z++) {
 						uint32_t col = 0x00284067;
 						col ^= 0x070707 & static_cast<uint32_t>(SampleRandom());
-						colorMap[x][y][z] = col + (100UL * 0x1000000UL);
+						denseColors[DenseColorIndex(x, y, z)] = col + (100UL * 0x1000000UL);
 					}
 				}
 		}
 		GameMap::~GameMap() { SPADES_MARK_FUNCTION(); }
 
+		std::size_t GameMap::GetStorageSize() const {
+			std::size_t size = sizeof(solidMap);
+			if (denseColors) {
+				size += sizeof(uint32_t) * DefaultWidth * DefaultHeight * DefaultDepth;
+			} else {
+				size += sizeof(SparseColumn) * DefaultWidth * DefaultHeight;
+				for (int i = 0; i < DefaultWidth * DefaultHeight; i++) {
+					const SparseColumn &column = sparseColumns[i];
+					if (column.colorMask) {
+						size += sizeof(uint32_t) * SparseCapacity(CountBits(column.colorMask));
+					}
+				}
+			}
+			return size;
+		}
+
+		int GameMap::SparseCapacity(int numColors) {
+			SPAssert(numColors > 0);
+			int capacity = 4;
+			while (capacity < numColors) {
+				capacity <<= 1;
+			}
+			return capacity;
+		}
+
+		bool GameMap::SetSparseColor(int x, int y, int z, uint32_t color) {
+			SparseColumn &column = sparseColumns[ColumnIndex(x, y)];
+			uint64_t bit = 1ULL << z;
+			int index = CountBits(column.colorMask & (bit - 1));
+
+			if (column.colorMask & bit) {
+				uint32_t &slot = column.colors[index];
+				if (slot == color) {
+					return false;
+				}
+				slot = color;
+				return true;
+			}
+
+			if (color == DefaultColor(x, y, z)) {
+				// No need to allocate a slot
+				return false;
+			}
+
+			int count = CountBits(column.colorMask);
+			if (count == 0 || (count >= 4 && (count & (count - 1)) == 0)) {
+				// The current array is full (or missing); grow it
+				std::unique_ptr<uint32_t[]> newColors{new uint32_t[SparseCapacity(count + 1)]};
+				std::copy(column.colors.get(), column.colors.get() + index, newColors.get());
+				std::copy(column.colors.get() + index, column.colors.get() + count,
+				          newColors.get() + index + 1);
+				column.colors = std::move(newColors);
+			} else {
+				std::copy_backward(column.colors.get() + index, column.colors.get() + count,
+				                   column.colors.get() + count + 1);
+			}
+			column.colors[index] = color;
+			column.colorMask |= bit;
+			return true;
+		}
+
+		void GameMap::RecordSparseRemoval(int x, int y, int z) {
+			uint32_t index = static_cast<uint32_t>(ColumnIndex(x, y));
+			const SparseColumn &column = sparseColumns[index];
+			uint64_t bit = 1ULL << z;
+			if (!(column.colorMask & bit)) {
+				return;
+			}
+			if ((column.colorMask & ~solidMap[x][y]) != bit) {
+				// The column already has a dead slot, so it's already in the list
+				return;
+			}
+			std::lock_guard<std::mutex> _guard{listenersMutex};
+			deadSlotColumns.push_back(index);
+		}
+
+		void GameMap::CompactSparseColumns() {
+			for (uint32_t index : deadSlotColumns) {
+				SparseColumn &column = sparseColumns[index];
+				uint64_t solid = solidMap[index / DefaultHeight][index % DefaultHeight];
+				uint64_t liveMask = column.colorMask & solid;
+				if (liveMask == column.colorMask) {
+					// A duplicate entry, or the voxels were placed again
+					continue;
+				}
+
+				if (!liveMask) {
+					column.colors.reset();
+					column.colorMask = 0;
+					continue;
+				}
+
+				std::unique_ptr<uint32_t[]> newColors{
+				  new uint32_t[SparseCapacity(CountBits(liveMask))]};
+				int count = 0;
+				int oldIndex = 0;
+				for (uint64_t bits = column.colorMask; bits; bits &= bits - 1, oldIndex++) {
+					if (liveMask & bits & (0 - bits)) {
+						newColors[count++] = column.colors[oldIndex];
+					}
+				}
+				column.colors = std::move(newColors);
+				column.colorMask = liveMask;
+			}
+			deadSlotColumns.clear();
+		}
+
 		void GameMap::AddListener(spades::client::IGameMapListener *l) {
 			std::lock_guard<std::mutex> _guard{listenersMutex};
 			listeners.push_back(l);
+			if (!changeCells) {
+				changeCells.reset(
+				  new ChangeCell[NumChangeCellsX * NumChangeCellsY * NumChangeCellsZ]());
+			}
 		}
 
 		void GameMap::RemoveListener(spades::client::IGameMapListener *l) {
@@ -60,6 +195,70 @@ namespace spades {
 			if (it != listeners.end()) {
 				listeners.erase(it);
 			}
+			if (listeners.empty()) {
+				// Nobody will drain the journal
+				for (uint32_t index : dirtyChangeCells) {
+					changeCells[index].dirty = false;
+				}
+				dirtyChangeCells.clear();
+			}
+		}
+
+		void GameMap::RecordChange(int x, int y, int z) {
+			std::lock_guard<std::mutex> _guard{listenersMutex};
+			if (listeners.empty()) {
+				return;
+			}
+
+			uint32_t index = static_cast<uint32_t>(
+			  ((x >> ChangeCellBits) * NumChangeCellsY + (y >> ChangeCellBits)) * NumChangeCellsZ +
+			  (z >> ChangeCellBits));
+			uint8_t localX = static_cast<uint8_t>(x & (ChangeCellSize - 1));
+			uint8_t localY = static_cast<uint8_t>(y & (ChangeCellSize - 1));
+			uint8_t localZ = static_cast<uint8_t>(z & (ChangeCellSize - 1));
+
+			ChangeCell &cell = changeCells[index];
+			if (!cell.dirty) {
+				cell.minX = cell.maxX = localX;
+				cell.minY = cell.maxY = localY;
+				cell.minZ = cell.maxZ = localZ;
+				cell.dirty = true;
+				dirtyChangeCells.push_back(index);
+				return;
+			}
+			cell.minX = std::min(cell.minX, localX);
+			cell.minY = std::min(cell.minY, localY);
+			cell.minZ = std::min(cell.minZ, localZ);
+			cell.maxX = std::max(cell.maxX, localX);
+			cell.maxY = std::max(cell.maxY, localY);
+			cell.maxZ = std::max(cell.maxZ, localZ);
+		}
+
+		void GameMap::FlushChanges() {
+			SPADES_MARK_FUNCTION();
+			AssertNoConcurrentReader();
+
+			std::lock_guard<std::mutex> _guard{listenersMutex};
+			for (uint32_t index : dirtyChangeCells) {
+				ChangeCell &cell = changeCells[index];
+				cell.dirty = false;
+
+				int cellZ = static_cast<int>(index % NumChangeCellsZ);
+				int cellY = static_cast<int>(index / NumChangeCellsZ % NumChangeCellsY);
+				int cellX = static_cast<int>(index / NumChangeCellsZ / NumChangeCellsY);
+				IntVector3 origin = IntVector3::Make(cellX, cellY, cellZ) * ChangeCellSize;
+				IntVector3 min = origin + IntVector3::Make(cell.minX, cell.minY, cell.minZ);
+				IntVector3 max = origin + IntVector3::Make(cell.maxX, cell.maxY, cell.maxZ);
+				for (auto *l : listeners) {
+					l->GameMapChanged(min, max, this);
+				}
+			}
+			dirtyChangeCells.clear();
+
+			// The consumers of the removed voxels' colors have run by now
+			if (sparseColumns) {
+				CompactSparseColumns();
+			}
 		}
 
 		bool GameMap::IsSurface(int x, int y, int z) const {
@@ -159,6 +358,164 @@ namespace spades {
 			stream->Write(buffer.data(), buffer.size());
 		}
 
+		uint64_t GameMap::GetSurfaceMask(int x, int y) const {
+			uint64_t solid = solidMap[x][y];
+
+			// `z == 0` and voxels below an empty voxel (the shift fills bit 0 with zero)
+			uint64_t exposed = ~(solid << 1);
+			// Voxels above an empty voxel. The bottommost voxel has nothing below it.
+			exposed |= ~(solid >> 1) & ~(1ULL << (DefaultDepth - 1));
+
+			if (x > 0)
+				exposed |= ~solidMap[x - 1][y];
+			if (x < Width() - 1)
+				exposed |= ~solidMap[x + 1][y];
+			if (y > 0)
+				exposed |= ~solidMap[x][y - 1];
+			if (y < Height() - 1)
+				exposed |= ~solidMap[x][y + 1];
+
+			return solid & exposed;
+		}
+
+		namespace {
+			/** The header of a snapshot created by `GameMap::SaveSnapshot`. */
+			struct SnapshotHeader {
+				char magic[8];
+				/** `SnapshotByteOrderMark` in the host byte order. */
+				uint32_t byteOrderMark;
+				uint32_t version;
+				uint32_t width, height, depth;
+				/** The number of elements in the color array. */
+				uint32_t numColors;
+			};
+
+			const char SnapshotMagic[8] = {'O', 'S', 'M', 'A', 'P', 'S', 'N', 'P'};
+			constexpr uint32_t SnapshotByteOrderMark = 0x01020304;
+			constexpr uint32_t SnapshotVersion = 1;
+		} // namespace
+
+		// The snapshot consists of the following parts:
+		//
+		//  - `SnapshotHeader`
+		//  - `uint64_t solidMap[width * height]` (the same layout as `GameMap::solidMap`)
+		//  - `uint64_t colorMask[width * height]`, indicating which voxels have colors
+		//  - `uint32_t colors[numColors]`, ordered by (x, y, z)
+		void GameMap::SaveSnapshot(spades::IStream *stream) {
+			SPADES_MARK_FUNCTION();
+
+			const int numColumns = Width() * Height();
+			std::vector<uint64_t> colorMasks(numColumns);
+			std::vector<uint32_t> colors;
+			colors.reserve(numColumns * 8);
+
+			for (int x = 0; x < Width(); x++) {
+				for (int y = 0; y < Height(); y++) {
+					uint64_t mask;
+					if (denseColors) {
+						// Only the surface voxels have meaningful colors
+						mask = GetSurfaceMask(x, y);
+					} else {
+						mask = sparseColumns[ColumnIndex(x, y)].colorMask & solidMap[x][y];
+					}
+					colorMasks[ColumnIndex(x, y)] = mask;
+
+					for (uint64_t bits = mask; bits; bits &= bits - 1) {
+						colors.push_back(GetColor(x, y, CountTrailingZeros(bits)));
+					}
+				}
+			}
+
+			SnapshotHeader header;
+			std::copy(std::begin(SnapshotMagic), std::end(SnapshotMagic), header.magic);
+			header.byteOrderMark = SnapshotByteOrderMark;
+			header.version = SnapshotVersion;
+			header.width = Width();
+			header.height = Height();
+			header.depth = Depth();
+			header.numColors = static_cast<uint32_t>(colors.size());
+
+			stream->Write(&header, sizeof(header));
+			stream->Write(solidMap, sizeof(solidMap));
+			stream->Write(colorMasks.data(), colorMasks.size() * sizeof(uint64_t));
+			stream->Write(colors.data(), colors.size() * sizeof(uint32_t));
+		}
+
+		GameMap *GameMap::LoadSnapshot(const char *data, std::size_t size, StorageMode mode) {
+			SPADES_MARK_FUNCTION();
+
+			const int numColumns = DefaultWidth * DefaultHeight;
+
+			SnapshotHeader header;
+			if (size < sizeof(header)) {
+				SPRaise("Map snapshot truncated");
+			}
+			std::memcpy(&header, data, sizeof(header));
+			if (!std::equal(std::begin(SnapshotMagic), std::end(SnapshotMagic), header.magic)) {
+				SPRaise("Not a map snapshot");
+			}
+			if (header.byteOrderMark != SnapshotByteOrderMark ||
+			    header.version != SnapshotVersion) {
+				SPRaise("Unsupported map snapshot version");
+			}
+			if (header.width != DefaultWidth || header.height != DefaultHeight ||
+			    header.depth != DefaultDepth) {
+				SPRaise("Unsupported map snapshot dimensions: %dx%dx%d", (int)header.width,
+				        (int)header.height, (int)header.depth);
+			}
+
+			const std::size_t solidMapOffset = sizeof(header);
+			const std::size_t colorMaskOffset = solidMapOffset + numColumns * sizeof(uint64_t);
+			const std::size_t colorOffset = colorMaskOffset + numColumns * sizeof(uint64_t);
+			if (size != colorOffset + std::size_t{header.numColors} * sizeof(uint32_t)) {
+				SPRaise("Map snapshot has an invalid size");
+			}
+
+			std::vector<uint64_t> colorMasks(numColumns);
+			std::memcpy(colorMasks.data(), data + colorMaskOffset,
+			            numColumns * sizeof(uint64_t));
+
+			// Find where each column's colors start
+			std::vector<uint32_t> columnColorOffsets(numColumns);
+			std::size_t numColors = 0;
+			for (int i = 0; i < numColumns; i++) {
+				columnColorOffsets[i] = static_cast<uint32_t>(numColors);
+				numColors += CountBits(colorMasks[i]);
+			}
+			if (numColors != header.numColors) {
+				SPRaise("Map snapshot has an inconsistent color count");
+			}
+
+			auto map = Handle<GameMap>::New(mode);
+			std::memcpy(map->solidMap, data + solidMapOffset, sizeof(map->solidMap));
+
+			const char *colors = data + colorOffset;
+			for (int i = 0; i < numColumns; i++) {
+				uint64_t mask = colorMasks[i];
+				if (!mask) {
+					continue;
+				}
+
+				const char *columnColors = colors + columnColorOffsets[i] * sizeof(uint32_t);
+				int count = CountBits(mask);
+
+				if (map->denseColors) {
+					uint32_t *column = &map->denseColors[i * DefaultDepth];
+					for (int k = 0; mask; mask &= mask - 1, k++) {
+						std::memcpy(&column[CountTrailingZeros(mask)],
+						            columnColors + k * sizeof(uint32_t), sizeof(uint32_t));
+					}
+				} else {
+					SparseColumn &column = map->sparseColumns[i];
+					column.colorMask = mask;
+					column.colors.reset(new uint32_t[SparseCapacity(count)]);
+					std::memcpy(column.colors.get(), columnColors, count * sizeof(uint32_t));
+				}
+			}
+
+			return std::move(map).Unmanage();
+		}
+
 		bool GameMap::ClipBox(int x, int y, int z) const {
 			int sz;
 
@@ -205,6 +562,44 @@ namespace spades {
 			return ClipWorld((int)floorf(x), (int)floorf(y), (int)floorf(z));
 		}
 
+		void GameMap::ClipWorld(const float *x, const float *y, const float *z, std::uint8_t *out,
+		                        std::size_t count) const {
+			// Same as the scalar `ClipWorld`, but the lookup is done with clamped coordinates
+			// and then masked instead of returning early
+			auto clip = [this](int ix, int iy, int iz) {
+				bool inside = (unsigned)ix < 512u && (unsigned)iy < 512u && iz >= 0;
+				int sz = std::max(std::min(iz, 62), 0);
+				bool solid = iz > 63 || ((solidMap[ix & 511][iy & 511] >> (uint64_t)sz) & 1ULL);
+				return static_cast<std::uint8_t>(inside && solid);
+			};
+
+			std::size_t i = 0;
+#if SPADES_ENABLE_SSE2
+			// `floorf` is a library call unless SSE4.1 is available, so round toward zero and
+			// then subtract one where it rounded up
+			auto floorToInt = [](__m128 v) {
+				__m128i t = _mm_cvttps_epi32(v);
+				__m128 roundedUp = _mm_cmpgt_ps(_mm_cvtepi32_ps(t), v);
+				return _mm_add_epi32(t, _mm_castps_si128(roundedUp));
+			};
+			for (; i + 4 <= count; i += 4) {
+				alignas(16) std::int32_t ix[4], iy[4], iz[4];
+				_mm_store_si128(reinterpret_cast<__m128i *>(ix), floorToInt(_mm_loadu_ps(x + i)));
+				_mm_store_si128(reinterpret_cast<__m128i *>(iy), floorToInt(_mm_loadu_ps(y + i)));
+				_mm_store_si128(reinterpret_cast<__m128i *>(iz), floorToInt(_mm_loadu_ps(z + i)));
+				for (int k = 0; k < 4; ++k) {
+					out[i + k] = clip(ix[k], iy[k], iz[k]);
+				}
+			}
+#endif
+			for (; i < count; ++i) {
+				SPAssert(!std::isnan(x[i]));
+				SPAssert(!std::isnan(y[i]));
+				SPAssert(!std::isnan(z[i]));
+				out[i] = clip((int)floorf(x[i]), (int)floorf(y[i]), (int)floorf(z[i]));
+			}
+		}
+
 		bool GameMap::CastRay(spades::Vector3 v0, spades::Vector3 v1, float length,
 		                      spades::IntVector3 &vOut) const {
 			SPADES_MARK_FUNCTION_DEBUG();
@@ -506,6 +901,240 @@ namespace spades {
 			return result;
 		}
 
+#if SPADES_ENABLE_SSE2
+		// Each lane performs exactly the same floating-point operations as `CastRay2`, so the
+		// results are bit-identical as long as scalar math is also done in SSE registers.
+		// A lane is refilled with the next ray as soon as its ray terminates so that all
+		// lanes are kept busy even if the rays travel different distances.
+		void GameMap::CastRays(const Vector3 *origins, const Vector3 *dirs, std::size_t count,
+		                       int maxSteps, RayCastResult *results) const {
+			SPADES_MARK_FUNCTION_DEBUG();
+
+			alignas(16) float fv[3][4];
+			alignas(16) float inv[3][4];
+			alignas(16) float absDir[3][4];
+			alignas(16) int32_t iv[3][4];
+			alignas(16) int32_t lastIv[3][4];
+			alignas(16) int32_t step[3][4];
+			alignas(16) int32_t stepsLeft[4];
+			std::size_t laneRays[4];
+			std::size_t nextRay = 0;
+			int activeLanes = 0;
+
+			// Assigns the next ray that needs traversal to the lane `k`
+			auto fillLane = [&](int k) {
+				for (int axis = 0; axis < 3; axis++) {
+					fv[axis][k] = 0.f;
+					inv[axis][k] = 0.f;
+					absDir[axis][k] = 0.f;
+					iv[axis][k] = 0;
+					lastIv[axis][k] = 0;
+					step[axis][k] = 0;
+				}
+				stepsLeft[k] = -1;
+				activeLanes &= ~(1 << k);
+
+				while (nextRay < count) {
+					std::size_t index = nextRay++;
+					const Vector3 &v0 = origins[index];
+					SPAssert(!std::isnan(v0.x));
+					SPAssert(!std::isnan(v0.y));
+					SPAssert(!std::isnan(v0.z));
+					SPAssert(!std::isnan(dirs[index].x));
+					SPAssert(!std::isnan(dirs[index].y));
+					SPAssert(!std::isnan(dirs[index].z));
+
+					Vector3 dir = dirs[index].Normalize();
+					IntVector3 start = v0.Floor();
+					RayCastResult &result = results[index];
+					result.hitPos = v0;
+					result.hitBlock = start;
+					result.normal = IntVector3::Make(0, 0, 0);
+					result.startSolid = false;
+					result.hit = false;
+					if (IsSolidWrapped(start.x, start.y, start.z)) {
+						result.hit = true;
+						result.startSolid = true;
+						continue;
+					}
+					if (maxSteps <= 0) {
+						continue;
+					}
+
+					const float d[3] = {dir.x, dir.y, dir.z};
+					const float o[3] = {v0.x, v0.y, v0.z};
+					const int s[3] = {start.x, start.y, start.z};
+					for (int axis = 0; axis < 3; axis++) {
+						if (d[axis] > 0.f) {
+							fv[axis][k] = (float)(s[axis] + 1) - o[axis];
+							step[axis][k] = 1;
+						} else {
+							fv[axis][k] = o[axis] - (float)s[axis];
+							step[axis][k] = -1;
+						}
+						if (d[axis] != 0.f) {
+							inv[axis][k] = 1.f / fabsf(d[axis]);
+						}
+						absDir[axis][k] = fabsf(d[axis]);
+						iv[axis][k] = s[axis];
+					}
+					stepsLeft[k] = maxSteps;
+					laneRays[k] = index;
+					activeLanes |= 1 << k;
+					return;
+				}
+			};
+
+			for (int k = 0; k < 4; k++) {
+				fillLane(k);
+			}
+
+			auto loadInt = [](const int32_t *p) {
+				return _mm_load_si128(reinterpret_cast<const __m128i *>(p));
+			};
+			auto storeInt = [](int32_t *p, __m128i v) {
+				_mm_store_si128(reinterpret_cast<__m128i *>(p), v);
+			};
+
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.f);
+			const __m128i zeroInt = _mm_setzero_si128();
+			const __m128i oneInt = _mm_set1_epi32(1);
+			const __m128i widthMask = _mm_set1_epi32(Width() - 1);
+			const __m128i heightMask = _mm_set1_epi32(Height() - 1);
+			const int heightShift = CountTrailingZeros((uint32_t)Height());
+			// `solidMap` viewed as a flat array indexed by `(x << log2(height)) | y`
+			const uint64_t *columns = solidMap[0];
+			alignas(16) int32_t lookup[2][4];
+
+			while (activeLanes) {
+				const __m128 invX = _mm_load_ps(inv[0]);
+				const __m128 invY = _mm_load_ps(inv[1]);
+				const __m128 invZ = _mm_load_ps(inv[2]);
+				const __m128 absX = _mm_load_ps(absDir[0]);
+				const __m128 absY = _mm_load_ps(absDir[1]);
+				const __m128 absZ = _mm_load_ps(absDir[2]);
+				const __m128 hasX = _mm_cmpneq_ps(invX, zero);
+				const __m128 hasY = _mm_cmpneq_ps(invY, zero);
+				const __m128 hasZ = _mm_cmpneq_ps(invZ, zero);
+				const __m128 noneX = _mm_cmpeq_ps(invX, zero);
+				const __m128 noneXY = _mm_andnot_ps(hasY, noneX);
+				const __m128i stepX = loadInt(step[0]);
+				const __m128i stepY = loadInt(step[1]);
+				const __m128i stepZ = loadInt(step[2]);
+
+				__m128 fvX = _mm_load_ps(fv[0]);
+				__m128 fvY = _mm_load_ps(fv[1]);
+				__m128 fvZ = _mm_load_ps(fv[2]);
+				__m128i ivX = loadInt(iv[0]);
+				__m128i ivY = loadInt(iv[1]);
+				__m128i ivZ = loadInt(iv[2]);
+				__m128i lastIvX, lastIvY, lastIvZ;
+				__m128i steps = loadInt(stepsLeft);
+
+				// Advance all lanes until one of them terminates
+				int doneLanes;
+				do {
+					// Find the nearest plane in the same order as `CastRay2` so that ties
+					// are broken in the same way
+					__m128 t = _mm_mul_ps(fvX, invX);
+					__m128 tY = _mm_mul_ps(fvY, invY);
+					__m128 tZ = _mm_mul_ps(fvZ, invZ);
+					__m128 isY = _mm_and_ps(hasY, _mm_or_ps(noneX, _mm_cmplt_ps(tY, t)));
+					t = _mm_or_ps(_mm_and_ps(isY, tY), _mm_andnot_ps(isY, t));
+					__m128 isZ = _mm_and_ps(hasZ, _mm_or_ps(noneXY, _mm_cmplt_ps(tZ, t)));
+					t = _mm_or_ps(_mm_and_ps(isZ, tZ), _mm_andnot_ps(isZ, t));
+					isY = _mm_andnot_ps(isZ, isY);
+					__m128 isX = _mm_andnot_ps(_mm_or_ps(isY, isZ), hasX);
+
+					fvX = _mm_sub_ps(fvX, _mm_mul_ps(absX, t));
+					fvY = _mm_sub_ps(fvY, _mm_mul_ps(absY, t));
+					fvZ = _mm_sub_ps(fvZ, _mm_mul_ps(absZ, t));
+					fvX = _mm_or_ps(_mm_and_ps(isX, one), _mm_andnot_ps(isX, fvX));
+					fvY = _mm_or_ps(_mm_and_ps(isY, one), _mm_andnot_ps(isY, fvY));
+					fvZ = _mm_or_ps(_mm_and_ps(isZ, one), _mm_andnot_ps(isZ, fvZ));
+
+					lastIvX = ivX;
+					lastIvY = ivY;
+					lastIvZ = ivZ;
+					ivX = _mm_add_epi32(ivX, _mm_and_si128(_mm_castps_si128(isX), stepX));
+					ivY = _mm_add_epi32(ivY, _mm_and_si128(_mm_castps_si128(isY), stepY));
+					ivZ = _mm_add_epi32(ivZ, _mm_and_si128(_mm_castps_si128(isZ), stepZ));
+
+					// SSE2 lacks gathers and per-lane 64-bit shifts, so the solid map is
+					// looked up by scalar code (without branches)
+					__m128i columnIndex = _mm_or_si128(
+					  _mm_slli_epi32(_mm_and_si128(ivX, widthMask), heightShift),
+					  _mm_and_si128(ivY, heightMask));
+					storeInt(lookup[0], columnIndex);
+					storeInt(lookup[1], ivZ);
+					int hitLanes = 0;
+					for (int k = 0; k < 4; k++) {
+						int z = lookup[1][k];
+						unsigned int inRange = (unsigned int)z < (unsigned int)Depth();
+						unsigned int bit = (unsigned int)(columns[lookup[0][k]] >>
+						                                  (uint64_t)(z & (Depth() - 1))) &
+						                   1U;
+						hitLanes |= (int)((bit & inRange) | (unsigned int)(z >= Depth())) << k;
+					}
+
+					steps = _mm_sub_epi32(steps, oneInt);
+					int exhaustedLanes =
+					  _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(steps, zeroInt)));
+					doneLanes = (hitLanes | exhaustedLanes) & activeLanes;
+
+					if (doneLanes) {
+						_mm_store_ps(fv[0], fvX);
+						_mm_store_ps(fv[1], fvY);
+						_mm_store_ps(fv[2], fvZ);
+						storeInt(iv[0], ivX);
+						storeInt(iv[1], ivY);
+						storeInt(iv[2], ivZ);
+						storeInt(lastIv[0], lastIvX);
+						storeInt(lastIv[1], lastIvY);
+						storeInt(lastIv[2], lastIvZ);
+						storeInt(stepsLeft, steps);
+
+						for (int lanes = doneLanes; lanes; lanes &= lanes - 1) {
+							int k = CountTrailingZeros((uint32_t)lanes);
+							RayCastResult &result = results[laneRays[k]];
+							IntVector3 block = IntVector3::Make(iv[0][k], iv[1][k], iv[2][k]);
+							result.hitBlock = block;
+							result.normal =
+							  IntVector3::Make(lastIv[0][k], lastIv[1][k], lastIv[2][k]) -
+							  block;
+
+							if (hitLanes & (1 << k)) {
+								float hitPos[3];
+								for (int axis = 0; axis < 3; axis++) {
+									if (step[axis][k] > 0) {
+										hitPos[axis] = (float)(iv[axis][k] + 1) - fv[axis][k];
+									} else {
+										hitPos[axis] = (float)iv[axis][k] + fv[axis][k];
+									}
+								}
+								result.hit = true;
+								result.hitPos = MakeVector3(hitPos[0], hitPos[1], hitPos[2]);
+							}
+
+							fillLane(k);
+						}
+					}
+				} while (!doneLanes);
+			}
+		}
+#else
+		void GameMap::CastRays(const Vector3 *origins, const Vector3 *dirs, std::size_t count,
+		                       int maxSteps, RayCastResult *results) const {
+			SPADES_MARK_FUNCTION_DEBUG();
+
+			for (std::size_t i = 0; i < count; i++) {
+				results[i] = CastRay2(origins[i], dirs[i], maxSteps);
+			}
+		}
+#endif
+
+
 		static uint32_t swapColor(uint32_t col) {
 			union {
 				uint8_t bytes[4];
@@ -516,80 +1145,139 @@ namespace spades {
 			return (u.c & 0xffffff) | (100UL * 0x1000000);
 		}
 
-		GameMap *GameMap::Load(spades::IStream *stream, std::function<void(int)> onProgress) {
+		namespace {
+			/** Reads a value from VOXLAP5 terrain data, checking the bounds. */
+			template <class T> T ReadVxl(const char *data, std::size_t size, std::size_t offset) {
+				if (offset + sizeof(T) > size) {
+					SPRaise("Unexpected EOF");
+				}
+				T value;
+				std::memcpy(&value, data + offset, sizeof(T));
+				return value;
+			}
+		} // namespace
+
+		void GameMap::LoadColumn(int x, int y, const char *data, std::size_t size,
+		                         std::size_t pos) {
+			solidMap[x][y] = 0xffffffffffffffffULL;
+
+			int z = 0;
+			for (;;) {
+				int i;
+				int number_4byte_chunks = ReadVxl<int8_t>(data, size, pos);
+				int top_color_start = ReadVxl<int8_t>(data, size, pos + 1);
+				int top_color_end = ReadVxl<int8_t>(data, size, pos + 2);
+				int bottom_color_start;
+				int bottom_color_end;
+				int len_top;
+				int len_bottom;
+
+				for (i = z; i < top_color_start; i++)
+					Set(x, y, i, false, 0, true);
+
+				size_t colorOffset = pos + 4;
+				for (z = top_color_start; z <= top_color_end; z++) {
+					uint32_t col = swapColor(ReadVxl<uint32_t>(data, size, colorOffset));
+					Set(x, y, z, true, col, true);
+					colorOffset += 4;
+				}
+
+				if (top_color_end == 62) {
+					Set(x, y, 63, true, GetColor(x, y, 62), true);
+				}
+
+				len_bottom = top_color_end - top_color_start + 1;
+
+				if (number_4byte_chunks == 0) {
+					break;
+				}
+
+				len_top = (number_4byte_chunks - 1) - len_bottom;
+
+				pos += number_4byte_chunks * 4;
+
+				bottom_color_end = ReadVxl<int8_t>(data, size, pos + 3);
+				bottom_color_start = bottom_color_end - len_top;
+
+				for (z = bottom_color_start; z < bottom_color_end; z++) {
+					uint32_t col = swapColor(ReadVxl<uint32_t>(data, size, colorOffset));
+					Set(x, y, z, true, col, true);
+					colorOffset += 4;
+				}
+				if (bottom_color_end == 63) {
+					Set(x, y, 63, true, GetColor(x, y, 62), true);
+				}
+			}
+		}
+
+		GameMap *GameMap::Load(spades::IStream *stream, std::function<void(int)> onProgress,
+		                       StorageMode mode) {
 			SPADES_MARK_FUNCTION();
 
 			RandomAccessAdaptor view{*stream};
 
-			size_t pos = 0;
-
-			auto map = Handle<GameMap>::New();
+			const int numColumns = DefaultWidth * DefaultHeight;
 
 			if (onProgress) {
 				onProgress(0);
 			}
 
-			for (int y = 0; y < 512; y++) {
-				for (int x = 0; x < 512; x++) {
-					map->solidMap[x][y] = 0xffffffffffffffffULL;
-
-					int z = 0;
-					for (;;) {
-						// Read a block ahead in attempt to minimize the number of calls to
-						// `IStream::Read`
-						view.Prefetch(pos + 512);
-
-						int i;
-						int number_4byte_chunks = view.Read<int8_t>(pos);
-						int top_color_start = view.Read<int8_t>(pos + 1);
-						int top_color_end = view.Read<int8_t>(pos + 2);
-						int bottom_color_start;
-						int bottom_color_end;
-						int len_top;
-						int len_bottom;
-
-						for (i = z; i < top_color_start; i++)
-							map->Set(x, y, i, false, 0, true);
-
-						size_t colorOffset = pos + 4;
-						for (z = top_color_start; z <= top_color_end; z++) {
-							uint32_t col = swapColor(view.Read<uint32_t>(colorOffset));
-							map->Set(x, y, z, true, col, true);
-							colorOffset += 4;
-						}
+			// The first pass reads the whole stream and finds where each column starts. Only
+			// the span headers are examined, so this pass is mostly bound by the speed of
+			// the inner stream.
+			std::vector<std::size_t> columnOffsets(numColumns);
+			size_t pos = 0;
+			for (int i = 0; i < numColumns; i++) {
+				columnOffsets[i] = pos;
 
-						if (top_color_end == 62) {
-							map->Set(x, y, 63, true, map->GetColor(x, y, 62), true);
-						}
+				for (;;) {
+					// Read a block ahead in attempt to minimize the number of calls to
+					// `IStream::Read`
+					view.Prefetch(pos + 512);
 
-						len_bottom = top_color_end - top_color_start + 1;
+					int number_4byte_chunks = view.Read<int8_t>(pos);
+					int top_color_start = view.Read<int8_t>(pos + 1);
+					int top_color_end = view.Read<int8_t>(pos + 2);
 
-						if (number_4byte_chunks == 0) {
-							pos += 4 * (len_bottom + 1);
-							break;
-						}
+					if (number_4byte_chunks == 0) {
+						pos += 4 * (top_color_end - top_color_start + 2);
+						break;
+					}
+					if (number_4byte_chunks < 0) {
+						SPRaise("Malformed map data: invalid span length");
+					}
+					pos += number_4byte_chunks * 4;
+				}
 
-						len_top = (number_4byte_chunks - 1) - len_bottom;
+				// A column is reported as loaded when the next one is found. The last column
+				// is reported after the second pass.
+				if (onProgress && i > 0) {
+					onProgress(i);
+				}
+			}
 
-						pos += (int)view.Read<int8_t>(pos) * 4;
+			// Make sure the last span is complete
+			view.Prefetch(pos);
+			if (view.GetBufferedSize() < pos) {
+				SPRaise("Unexpected EOF");
+			}
 
-						bottom_color_end = view.Read<int8_t>(pos + 3);
-						bottom_color_start = bottom_color_end - len_top;
+			auto map = Handle<GameMap>::New(mode);
 
-						for (z = bottom_color_start; z < bottom_color_end; z++) {
-							uint32_t col = swapColor(view.Read<uint32_t>(colorOffset));
-							map->Set(x, y, z, true, col, true);
-							colorOffset += 4;
-						}
-						if (bottom_color_end == 63) {
-							map->Set(x, y, 63, true, map->GetColor(x, y, 62), true);
-						}
-					}
+			// The second pass decodes the columns in parallel. Columns don't share any state
+			// (even in `StorageMode::Sparse`), so they can be decoded independently.
+			const char *data = view.GetBufferedData();
+			std::size_t size = view.GetBufferedSize();
+			ThreadPool::GetGlobalPool().ParallelFor(
+			  0, DefaultHeight, 4, [&](std::size_t y) {
+				  for (int x = 0; x < DefaultWidth; x++) {
+					  std::size_t i = x + y * DefaultWidth;
+					  map->LoadColumn(x, static_cast<int>(y), data, size, columnOffsets[i]);
+				  }
+			  });
 
-					if (onProgress) {
-						onProgress(x + y * 512 + 1);
-					}
-				}
+			if (onProgress) {
+				onProgress(numColumns);
 			}
 
 			return std::move(map).Unmanage();
@@ -21,10 +21,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 #include <Core/Debug.h>
 #include <Core/Math.h>
@@ -46,23 +50,71 @@ namespace spades {
 				DefaultHeight = 512,
 				DefaultDepth = 64 // should be <= 64
 			};
-			GameMap();
+
+			/** Specifies how voxel colors are stored. */
+			enum class StorageMode {
+				/**
+				 * Every voxel has a color slot, whether it's solid or not. Uses 64 MiB
+				 * regardless of the map contents.
+				 */
+				Dense,
+				/**
+				 * Only voxels which were explicitly given a color have a color slot. Each
+				 * column stores its colors as a packed array indexed by the number of preceding
+				 * colored voxels in the column. Voxels without a color slot (e.g., hidden voxels
+				 * inside a solid region) return a pseudo-random dirt color.
+				 */
+				Sparse
+			};
+
+			/** Returns the storage mode specified by `cg_sparseMapStorage`. */
+			static StorageMode GetDefaultStorageMode();
+
+			GameMap(StorageMode mode = GetDefaultStorageMode());
 
 			/**
 			 * Construct a `GameMap` from VOXLAP5 terrain data supplied by the specified stream.
 			 *
+			 * The stream is read and indexed first, and then the columns are decoded in parallel
+			 * by the global `ThreadPool`.
+			 *
 			 * @param onProgress Called whenever a new column (a set of voxels with the same X and Y
 			 *                   coordinates) is loaded from the stream. The parameter indicates
 			 *					 the number of columns loaded
-			 *					 (up to `DefaultWidth * DefaultHeight`).
+			 *					 (up to `DefaultWidth * DefaultHeight`). The final call is made
+			 *					 after all columns are decoded.
 			 */
-			static GameMap *Load(IStream *, std::function<void(int)> onProgress = {});
+			static GameMap *Load(IStream *, std::function<void(int)> onProgress = {},
+			                     StorageMode mode = GetDefaultStorageMode());
 
 			void Save(IStream *);
 
+			/**
+			 * Writes the map in a native snapshot format, which `LoadSnapshot` can load much
+			 * faster than VOXLAP5 terrain data. The format depends on the host byte order, so
+			 * it's only suitable for a local cache.
+			 */
+			void SaveSnapshot(IStream *);
+
+			/**
+			 * Construct a `GameMap` from a snapshot created by `SaveSnapshot`. The snapshot is
+			 * read directly from memory (e.g., a memory-mapped file).
+			 *
+			 * Throws an exception if the snapshot is malformed.
+			 */
+			static GameMap *LoadSnapshot(const char *data, std::size_t size,
+			                             StorageMode mode = GetDefaultStorageMode());
+
 			int Width() const { return DefaultWidth; }
 			int Height() const { return DefaultHeight; }
 			int Depth() const { return DefaultDepth; }
+
+			StorageMode GetStorageMode() const {
+				return denseColors ? StorageMode::Dense : StorageMode::Sparse;
+			}
+
+			/** @return The number of bytes used to store the voxel data. */
+			std::size_t GetStorageSize() const;
 			inline bool IsSolid(int x, int y, int z) const {
 				SPAssert(x >= 0);
 				SPAssert(x < Width());
@@ -73,7 +125,16 @@ namespace spades {
 				return ((solidMap[x][y] >> (uint64_t)z) & 1ULL) != 0;
 			}
 
-			/** @return 0xHHBBGGRR where HH is health (up to 100) */
+			/**
+			 * @return 0xHHBBGGRR where HH is health (up to 100)
+			 *
+			 * This can be called by other threads, but not while the map is being modified.
+			 * In `StorageMode::Sparse`, `Set` and `FlushChanges` may reallocate the color array
+			 * of a column, so a concurrent read can access freed memory. A reader running on
+			 * another thread (e.g., `MapChunkMesher` via `GLMapRenderer`) must be joined before
+			 * the map is modified again. Such a reader should be enclosed by
+			 * `BeginConcurrentRead` and `EndConcurrentRead` so that debug builds can check this.
+			 */
 			inline uint32_t GetColor(int x, int y, int z) const {
 				SPAssert(x >= 0);
 				SPAssert(x < Width());
@@ -81,7 +142,15 @@ namespace spades {
 				SPAssert(y < Height());
 				SPAssert(z >= 0);
 				SPAssert(z < Depth());
-				return colorMap[x][y][z];
+				if (denseColors) {
+					return denseColors[DenseColorIndex(x, y, z)];
+				}
+				const SparseColumn &column = sparseColumns[ColumnIndex(x, y)];
+				uint64_t bit = 1ULL << z;
+				if (column.colorMask & bit) {
+					return column.colors[CountBits(column.colorMask & (bit - 1))];
+				}
+				return DefaultColor(x, y, z);
 			}
 
 			inline uint64_t GetSolidMapWrapped(int x, int y) const {
@@ -98,10 +167,11 @@ namespace spades {
 			}
 
 			inline uint32_t GetColorWrapped(int x, int y, int z) const {
-				return colorMap[x & (Width() - 1)][y & (Height() - 1)][z & (Depth() - 1)];
+				return GetColor(x & (Width() - 1), y & (Height() - 1), z & (Depth() - 1));
 			}
 
 			inline void Set(int x, int y, int z, bool solid, uint32_t color, bool unsafe = false) {
+				AssertNoConcurrentReader();
 				SPAssert(x >= 0);
 				SPAssert(x < Width());
 				SPAssert(y >= 0);
@@ -119,17 +189,21 @@ namespace spades {
 					solidMap[x][y] = value;
 				}
 				if (solid) {
-					if (color != colorMap[x][y][z]) {
+					if (denseColors) {
+						uint32_t &slot = denseColors[DenseColorIndex(x, y, z)];
+						if (color != slot) {
+							changed = true;
+							slot = color;
+						}
+					} else if (SetSparseColor(x, y, z, color)) {
 						changed = true;
-						colorMap[x][y][z] = color;
 					}
+				} else if (changed && sparseColumns) {
+					RecordSparseRemoval(x, y, z);
 				}
 				if (!unsafe) {
 					if (changed) {
-						std::lock_guard<std::mutex> guard{listenersMutex};
-						for (auto *l : listeners) {
-							l->GameMapChanged(x, y, z, this);
-						}
+						RecordChange(x, y, z);
 					}
 				}
 			}
@@ -137,12 +211,52 @@ namespace spades {
 			void AddListener(IGameMapListener *);
 			void RemoveListener(IGameMapListener *);
 
+			/**
+			 * Notifies the listeners of the voxels modified by `Set` since the last call.
+			 *
+			 * `Set` doesn't call the listeners by itself. It records the modified voxels to a
+			 * journal, which keeps one bounding box per `ChangeCellSize`-sized cube. This
+			 * function drains the journal and calls `IGameMapListener::GameMapChanged` once for
+			 * each box. Renderers call this once per frame before updating their caches.
+			 *
+			 * In `StorageMode::Sparse`, this also releases the color slots of the voxels
+			 * removed since the last call. Their colors can be read until then.
+			 */
+			void FlushChanges();
+
+			/**
+			 * Marks the start of a read by another thread, which lasts until the matching
+			 * `EndConcurrentRead`. Modifying the map in the meantime raises an assertion
+			 * failure in a debug build. Does nothing in a release build.
+			 */
+			inline void BeginConcurrentRead() const {
+#if !NDEBUG
+				numConcurrentReaders++;
+#endif
+			}
+
+			inline void EndConcurrentRead() const {
+#if !NDEBUG
+				SPAssert(numConcurrentReaders > 0);
+				numConcurrentReaders--;
+#endif
+			}
+
 			bool ClipBox(int x, int y, int z) const;
 			bool ClipWorld(int x, int y, int z) const;
 
 			bool ClipBox(float x, float y, float z) const;
 			bool ClipWorld(float x, float y, float z) const;
 
+			/**
+			 * Evaluates `ClipWorld(x[i], y[i], z[i])` for each `i` in `[0, count)` and stores
+			 * the results (`0` or `1`) to `out[i]`. The coordinates are given as separate arrays
+			 * so that the callers with the structure-of-arrays layout can test many points
+			 * without a branch per point.
+			 */
+			void ClipWorld(const float *x, const float *y, const float *z, std::uint8_t *out,
+			               std::size_t count) const;
+
 			// vanila compat
 			bool CastRay(Vector3 v0, Vector3 v1, float length, IntVector3 &vOut) const;
 
@@ -156,13 +270,115 @@ namespace spades {
 			};
 			RayCastResult CastRay2(Vector3 v0, Vector3 dir, int maxSteps) const;
 
+			/**
+			 * Casts `count` rays at once. `results[i]` is identical to the result of
+			 * `CastRay2(origins[i], dirs[i], maxSteps)`, but four rays are traversed at once
+			 * using SIMD instructions when available.
+			 */
+			void CastRays(const Vector3 *origins, const Vector3 *dirs, std::size_t count,
+			              int maxSteps, RayCastResult *results) const;
+
 		private:
+			/**
+			 * A column of `StorageMode::Sparse`. The colors of a column are stored in `colors`
+			 * in the ascending order of Z coordinates. `colorMask` indicates which voxels have
+			 * an entry in `colors`. The capacity of `colors` is the number of entries rounded
+			 * up to a power of two (see `SparseCapacity`).
+			 *
+			 * A color slot is retained until the next `FlushChanges` after its voxel is removed
+			 * because some consumers (e.g., `FallingBlock`) read colors of the voxels that were
+			 * just removed.
+			 */
+			struct SparseColumn {
+				uint64_t colorMask = 0;
+				std::unique_ptr<uint32_t[]> colors;
+			};
+
 			uint64_t solidMap[DefaultWidth][DefaultHeight];
-			uint32_t colorMap[DefaultWidth][DefaultHeight][DefaultDepth];
+			/** `[x][y][z]` array used by `StorageMode::Dense`. `nullptr` otherwise. */
+			std::unique_ptr<uint32_t[]> denseColors;
+			/** `[x][y]` array used by `StorageMode::Sparse`. `nullptr` otherwise. */
+			std::unique_ptr<SparseColumn[]> sparseColumns;
+			/**
+			 * The indices of the sparse columns that have color slots of removed voxels. May
+			 * contain duplicates. Drained by `FlushChanges`.
+			 */
+			std::vector<uint32_t> deadSlotColumns;
 			std::list<IGameMapListener *> listeners;
+
+			enum {
+				ChangeCellBits = 3,
+				ChangeCellSize = 1 << ChangeCellBits,
+				NumChangeCellsX = DefaultWidth >> ChangeCellBits,
+				NumChangeCellsY = DefaultHeight >> ChangeCellBits,
+				NumChangeCellsZ = DefaultDepth >> ChangeCellBits
+			};
+
+			/** The bounding box of the modified voxels in a cell, relative to the cell. */
+			struct ChangeCell {
+				uint8_t minX, minY, minZ, maxX, maxY, maxZ;
+				bool dirty;
+			};
+
+			/**
+			 * The journal drained by `FlushChanges`. `changeCells` is allocated when the first
+			 * listener is added. `dirtyChangeCells` lists the indices of the cells with
+			 * `dirty` set, in the order they were first modified.
+			 */
+			std::unique_ptr<ChangeCell[]> changeCells;
+			std::vector<uint32_t> dirtyChangeCells;
+
+			/** Protects `listeners`, the journal, and `deadSlotColumns`. */
 			std::mutex listenersMutex;
 
+#if !NDEBUG
+			/** See `BeginConcurrentRead`. */
+			mutable std::atomic<int> numConcurrentReaders{0};
+#endif
+
+			inline void AssertNoConcurrentReader() const {
+#if !NDEBUG
+				SPAssert(numConcurrentReaders == 0);
+#endif
+			}
+
+			void RecordChange(int x, int y, int z);
+
 			bool IsSurface(int x, int y, int z) const;
+			/** @return A bit mask indicating which voxels of a column satisfy `IsSurface`. */
+			uint64_t GetSurfaceMask(int x, int y) const;
+
+			static inline int ColumnIndex(int x, int y) { return x * DefaultHeight + y; }
+			static inline int DenseColorIndex(int x, int y, int z) {
+				return ColumnIndex(x, y) * DefaultDepth + z;
+			}
+			static int SparseCapacity(int numColors);
+
+			/**
+			 * Decodes a column of VOXLAP5 terrain data starting at `data[pos]`. Safe to call
+			 * concurrently for distinct columns.
+			 */
+			void LoadColumn(int x, int y, const char *data, std::size_t size, std::size_t pos);
+
+			/** The color of a voxel without a color slot. Deterministic, unlike the dirt color
+			 * the dense storage is initialized with. */
+			static inline uint32_t DefaultColor(int x, int y, int z) {
+				uint32_t h = static_cast<uint32_t>(DenseColorIndex(x, y, z)) * 0x9e3779b1U;
+				h ^= h >> 15;
+				return (0x00284067U ^ (0x070707U & h)) + (100UL * 0x1000000UL);
+			}
+
+			/**
+			 * Stores a color to a sparse column, inserting a new slot if there isn't one.
+			 * @return `true` if the stored color has changed.
+			 */
+			bool SetSparseColor(int x, int y, int z, uint32_t color);
+
+			/** Called by `Set` when a voxel of a sparse column is removed. */
+			void RecordSparseRemoval(int x, int y, int z);
+
+			/** Releases the color slots of the removed voxels in `deadSlotColumns`. */
+			void CompactSparseColumns();
 		};
 	} // namespace client
 } // namespace spades
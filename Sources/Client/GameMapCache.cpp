@@ -0,0 +1,352 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#include <zlib.h>
+
+#include "GameMap.h"
+#include "GameMapCache.h"
+#include <Core/ConcurrentDispatch.h>
+#include <Core/Debug.h>
+#include <Core/DynamicMemoryStream.h>
+#include <Core/Exception.h>
+#include <Core/FileManager.h>
+#include <Core/IStream.h>
+#include <Core/MappedFile.h>
+#include <Core/Math.h>
+#include <Core/Settings.h>
+#include <Core/Stopwatch.h>
+
+DEFINE_SPADES_SETTING(cg_mapCache, "1");
+DEFINE_SPADES_SETTING(cg_mapCacheSize, "256");
+
+namespace spades {
+	namespace client {
+		namespace {
+			const char *const IndexPath = "MapCache/Index.txt";
+
+			// 64-bit FNV-1a
+			constexpr std::uint64_t HashInitialValue = 0xcbf29ce484222325ULL;
+			constexpr std::uint64_t HashPrime = 0x100000001b3ULL;
+		} // namespace
+
+		class GameMapCache::WriteDispatch : public ConcurrentDispatch {
+			std::string path;
+			std::unique_ptr<DynamicMemoryStream> snapshot;
+
+		public:
+			WriteDispatch(std::string path, std::unique_ptr<DynamicMemoryStream> snapshot)
+			    : path(std::move(path)), snapshot(std::move(snapshot)) {}
+			void Run() override {
+				SPADES_MARK_FUNCTION();
+
+				Stopwatch sw;
+				try {
+					snapshot->SetPosition(0);
+					FileManager::OpenForWriting(path.c_str())->Write(snapshot->ReadAllBytes());
+				} catch (const std::exception &ex) {
+					// `Load` removes the entry if the snapshot turns out to be broken
+					SPLog("Failed to write the map cache snapshot (%s): %s", path.c_str(),
+					      ex.what());
+					return;
+				}
+				SPLog("Wrote the map cache snapshot (%s) in %.1f ms", path.c_str(),
+				      sw.GetTime() * 1000.0);
+			}
+		};
+
+		GameMapCache::StreamHasher::StreamHasher()
+		    : hash{HashInitialValue},
+		      crc{static_cast<std::uint32_t>(crc32(0L, Z_NULL, 0))},
+		      prefixHash{HashInitialValue},
+		      length{0} {}
+
+		void GameMapCache::StreamHasher::Update(const char *bytes, std::size_t numBytes) {
+			std::uint64_t h = hash;
+			std::size_t i = 0;
+			if (length < PrefixLength) {
+				std::size_t prefixEnd =
+				  std::min<std::size_t>(numBytes, static_cast<std::size_t>(PrefixLength - length));
+				for (; i < prefixEnd; ++i) {
+					h = (h ^ static_cast<std::uint8_t>(bytes[i])) * HashPrime;
+				}
+				prefixHash = h;
+			}
+			for (; i < numBytes; ++i) {
+				h = (h ^ static_cast<std::uint8_t>(bytes[i])) * HashPrime;
+			}
+			hash = h;
+			crc = static_cast<std::uint32_t>(
+			  crc32(crc, reinterpret_cast<const Bytef *>(bytes), static_cast<uInt>(numBytes)));
+			length += numBytes;
+		}
+
+		GameMapCache::StreamDigest GameMapCache::StreamHasher::GetDigest() const {
+			StreamDigest digest;
+			digest.hash = hash;
+			digest.crc = crc;
+			digest.prefixHash = prefixHash;
+			digest.length = length;
+			return digest;
+		}
+
+		GameMapCache *GameMapCache::GetInstance() {
+			static std::unique_ptr<GameMapCache> instance;
+			if (!cg_mapCache) {
+				return nullptr;
+			}
+			if (!instance) {
+				instance.reset(new GameMapCache());
+			}
+			return instance.get();
+		}
+
+		GameMapCache::GameMapCache() : lastUseCounter{0} {
+			SPADES_MARK_FUNCTION();
+			try {
+				LoadIndex();
+			} catch (const std::exception &ex) {
+				SPLog("Failed to read the map cache index: %s", ex.what());
+				entries.clear();
+			}
+		}
+
+		GameMapCache::~GameMapCache() { FinishPendingWrite(); }
+
+		void GameMapCache::FinishPendingWrite() {
+			if (pendingWrite) {
+				pendingWrite->Join();
+				pendingWrite.reset();
+			}
+		}
+
+		std::string GameMapCache::GetSnapshotPath(std::uint64_t hash) {
+			char buf[64];
+			std::snprintf(buf, sizeof(buf), "MapCache/%016" PRIx64 ".snapshot", hash);
+			return buf;
+		}
+
+		GameMapCache::Entry *GameMapCache::FindEntry(std::uint64_t hash) {
+			for (Entry &entry : entries) {
+				if (entry.digest.hash == hash) {
+					return &entry;
+				}
+			}
+			return nullptr;
+		}
+
+		stmp::optional<GameMapCache::StreamDigest>
+		GameMapCache::FindByPrefix(std::uint64_t prefixHash, std::uint64_t length) {
+			for (const Entry &entry : entries) {
+				if (entry.digest.prefixHash == prefixHash && entry.digest.length == length) {
+					return entry.digest;
+				}
+			}
+			return {};
+		}
+
+		stmp::optional<GameMapCache::StreamDigest>
+		GameMapCache::FindByChecksum(std::uint32_t checksum, std::uint64_t length) {
+			for (const Entry &entry : entries) {
+				if (entry.hasChecksum && entry.checksum == checksum &&
+				    entry.digest.length == length) {
+					return entry.digest;
+				}
+			}
+			return {};
+		}
+
+		Handle<GameMap> GameMapCache::Load(const StreamDigest &digest) {
+			SPADES_MARK_FUNCTION();
+
+			// The snapshot of the entry might still be being written
+			FinishPendingWrite();
+
+			Entry *entry = FindEntry(digest.hash);
+			if (!entry || !entry->digest.Matches(digest)) {
+				return {};
+			}
+
+			std::string path = GetSnapshotPath(digest.hash);
+			Stopwatch sw;
+			Handle<GameMap> map;
+			try {
+				auto file = FileManager::OpenMapped(path.c_str());
+				map = Handle<GameMap>{GameMap::LoadSnapshot(file->GetData(), file->GetSize()),
+				                      false};
+			} catch (const std::exception &ex) {
+				SPLog("Removing a broken map cache entry (%s): %s", path.c_str(), ex.what());
+				RemoveEntry(digest.hash);
+				SaveIndex();
+				return {};
+			}
+
+			SPLog("Loaded the game map from the map cache (%s) in %.1f ms", path.c_str(),
+			      sw.GetTime() * 1000.0);
+
+			entry->lastUsed = ++lastUseCounter;
+			SaveIndex();
+			return map;
+		}
+
+		void GameMapCache::Store(const StreamDigest &digest,
+		                         stmp::optional<std::uint32_t> checksum, GameMap &map) {
+			SPADES_MARK_FUNCTION();
+
+			FinishPendingWrite();
+
+			if (FindEntry(digest.hash)) {
+				// Replace the existing entry
+				RemoveEntry(digest.hash);
+			}
+
+			std::string path = GetSnapshotPath(digest.hash);
+			Stopwatch sw;
+
+			Entry entry;
+			entry.digest = digest;
+			entry.hasChecksum = static_cast<bool>(checksum);
+			entry.checksum = checksum ? *checksum : 0;
+			entry.lastUsed = ++lastUseCounter;
+
+			// `map` will be modified by the game, so the snapshot must be created here. Only
+			// writing it to the disk is deferred.
+			auto snapshot = stmp::make_unique<DynamicMemoryStream>();
+			map.SaveSnapshot(snapshot.get());
+			entry.snapshotSize = snapshot->GetLength();
+			entries.push_back(entry);
+
+			EvictEntries(static_cast<std::uint64_t>(std::max((int)cg_mapCacheSize, 0)) << 20);
+			SaveIndex();
+
+			SPLog("Created a snapshot of the game map for the map cache (%s, %.1f MB) in %.1f ms",
+			      path.c_str(), entry.snapshotSize / 1048576.0, sw.GetTime() * 1000.0);
+
+			if (!FindEntry(digest.hash)) {
+				// The snapshot alone exceeds `cg_mapCacheSize`
+				return;
+			}
+			pendingWrite = stmp::make_unique<WriteDispatch>(path, std::move(snapshot));
+			pendingWrite->Start();
+		}
+
+		void GameMapCache::RemoveEntry(std::uint64_t hash) {
+			auto it = std::find_if(entries.begin(), entries.end(),
+			                       [=](const Entry &e) { return e.digest.hash == hash; });
+			if (it == entries.end()) {
+				return;
+			}
+			entries.erase(it);
+
+			std::string path = GetSnapshotPath(hash);
+			if (!FileManager::RemoveFile(path.c_str())) {
+				SPLog("Failed to delete %s", path.c_str());
+			}
+		}
+
+		void GameMapCache::EvictEntries(std::uint64_t maxTotalSize) {
+			std::uint64_t totalSize = 0;
+			for (const Entry &entry : entries) {
+				totalSize += entry.snapshotSize;
+			}
+
+			while (totalSize > maxTotalSize && !entries.empty()) {
+				auto it = std::min_element(
+				  entries.begin(), entries.end(),
+				  [](const Entry &a, const Entry &b) { return a.lastUsed < b.lastUsed; });
+				SPLog("Evicting a map cache entry (%016" PRIx64 ")", it->digest.hash);
+				totalSize -= it->snapshotSize;
+				RemoveEntry(it->digest.hash);
+			}
+		}
+
+		// Each line of the index describes an entry with the following fields separated by
+		// spaces:
+		//
+		//     <hash> <prefix hash> <stream length> <checksum or "-"> <snapshot size>
+		//     <last used> <CRC>
+		void GameMapCache::LoadIndex() {
+			SPADES_MARK_FUNCTION();
+
+			if (!FileManager::FileExists(IndexPath)) {
+				return;
+			}
+
+			for (const std::string &line : SplitIntoLines(FileManager::ReadAllBytes(IndexPath))) {
+				Entry entry;
+				char checksum[16];
+				int numFields = std::sscanf(
+				  line.c_str(),
+				  "%" SCNx64 " %" SCNx64 " %" SCNu64 " %15s %" SCNu64 " %" SCNu64 " %" SCNx32,
+				  &entry.digest.hash, &entry.digest.prefixHash, &entry.digest.length, checksum,
+				  &entry.snapshotSize, &entry.lastUsed, &entry.digest.crc);
+				if (numFields != 7) {
+					// Corrupt
+					continue;
+				}
+
+				entry.hasChecksum = checksum[0] != '-';
+				entry.checksum = 0;
+				if (entry.hasChecksum) {
+					entry.checksum =
+					  static_cast<std::uint32_t>(std::strtoul(checksum, nullptr, 16));
+				}
+
+				if (FindEntry(entry.digest.hash)) {
+					continue;
+				}
+				entries.push_back(entry);
+				lastUseCounter = std::max(lastUseCounter, entry.lastUsed);
+			}
+
+			SPLog("Map cache has %d entries", static_cast<int>(entries.size()));
+		}
+
+		void GameMapCache::SaveIndex() {
+			SPADES_MARK_FUNCTION();
+
+			std::string text;
+			for (const Entry &entry : entries) {
+				char checksum[16] = "-";
+				if (entry.hasChecksum) {
+					std::snprintf(checksum, sizeof(checksum), "%08" PRIx32, entry.checksum);
+				}
+
+				char buf[256];
+				std::snprintf(buf, sizeof(buf),
+				              "%016" PRIx64 " %016" PRIx64 " %" PRIu64 " %s %" PRIu64 " %" PRIu64
+				              " %08" PRIx32 "\n",
+				              entry.digest.hash, entry.digest.prefixHash, entry.digest.length,
+				              checksum, entry.snapshotSize, entry.lastUsed, entry.digest.crc);
+				text += buf;
+			}
+
+			try {
+				FileManager::OpenForWriting(IndexPath)->Write(text);
+			} catch (const std::exception &ex) {
+				SPLog("Failed to write the map cache index: %s", ex.what());
+			}
+		}
+	} // namespace client
+} // namespace spades
@@ -0,0 +1,167 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Core/RefCountedObject.h>
+#include <Core/TMPUtils.h>
+
+namespace spades {
+	namespace client {
+		class GameMap;
+
+		/**
+		 * An on-disk cache of decoded game maps, located in the user resource directory.
+		 *
+		 * Each entry is keyed by a digest of the compressed map stream sent by a server and
+		 * holds a native snapshot of the decoded map (see `GameMap::SaveSnapshot`), so a cached
+		 * map can be loaded without inflating and parsing the VOXLAP5 data. The total size of
+		 * the snapshots is capped by `cg_mapCacheSize` (in megabytes), and the least recently
+		 * used entries are evicted first.
+		 *
+		 * This class is not thread-safe. It's only used by the thread running `NetClient`.
+		 * Snapshots are written to the disk by a background thread, which this class waits for
+		 * before accessing the snapshot files again.
+		 */
+		class GameMapCache {
+		public:
+			enum {
+				/** The number of leading bytes of a stream used to find a candidate entry. */
+				PrefixLength = 64 * 1024
+			};
+
+			/** Identifies a compressed map stream. */
+			struct StreamDigest {
+				/** The FNV-1a hash of the whole stream. */
+				std::uint64_t hash;
+				/**
+				 * The CRC-32 of the whole stream. Two streams are only considered identical if
+				 * they also match in this independent checksum.
+				 */
+				std::uint32_t crc;
+				/** The hash of the first `PrefixLength` bytes (or the whole stream if shorter). */
+				std::uint64_t prefixHash;
+				std::uint64_t length;
+
+				/** Returns `true` if both digests identify the same stream. */
+				bool Matches(const StreamDigest &other) const {
+					return hash == other.hash && crc == other.crc && length == other.length;
+				}
+			};
+
+			/** Computes a `StreamDigest` incrementally as the stream is received. */
+			class StreamHasher {
+			public:
+				StreamHasher();
+
+				void Update(const char *bytes, std::size_t numBytes);
+
+				/** Returns `true` if the prefix hash will not change anymore. */
+				bool IsPrefixComplete() const { return length >= PrefixLength; }
+
+				/** Returns the digest of the bytes received so far. */
+				StreamDigest GetDigest() const;
+
+			private:
+				std::uint64_t hash;
+				std::uint32_t crc;
+				std::uint64_t prefixHash;
+				std::uint64_t length;
+			};
+
+			/**
+			 * Returns the global instance, or `nullptr` if the cache is disabled by
+			 * `cg_mapCache`.
+			 */
+			static GameMapCache *GetInstance();
+
+			~GameMapCache();
+
+			/**
+			 * Finds an entry of a stream that starts with the specified prefix and has the
+			 * specified length. The whole stream must be compared with the returned digest
+			 * before using the entry.
+			 */
+			stmp::optional<StreamDigest> FindByPrefix(std::uint64_t prefixHash,
+			                                          std::uint64_t length);
+
+			/**
+			 * Finds an entry stored with the specified map checksum, which is provided by
+			 * servers supporting AoS 0.76's map cache protocol.
+			 */
+			stmp::optional<StreamDigest> FindByChecksum(std::uint32_t checksum,
+			                                            std::uint64_t length);
+
+			/**
+			 * Loads the map of an entry and marks the entry as the most recently used one.
+			 * Returns `nullptr` (and removes the entry) if the entry is unusable.
+			 */
+			Handle<GameMap> Load(const StreamDigest &);
+
+			/**
+			 * Stores a map decoded from the specified stream. The least recently used entries
+			 * are evicted to make room for it.
+			 *
+			 * The snapshot is created by this method, but it's written to the disk in the
+			 * background, so `map` can be modified as soon as this method returns.
+			 *
+			 * @param checksum The map checksum provided by the server, if any.
+			 */
+			void Store(const StreamDigest &, stmp::optional<std::uint32_t> checksum, GameMap &);
+
+		private:
+			struct Entry {
+				StreamDigest digest;
+				bool hasChecksum;
+				std::uint32_t checksum;
+				std::uint64_t snapshotSize;
+				/** Larger values indicate more recent uses. */
+				std::uint64_t lastUsed;
+			};
+
+			class WriteDispatch;
+
+			std::vector<Entry> entries;
+			std::uint64_t lastUseCounter;
+
+			/** Writes the snapshot of the last stored entry, or `nullptr`. */
+			std::unique_ptr<WriteDispatch> pendingWrite;
+
+			GameMapCache();
+
+			/** Waits until the snapshot being written by `pendingWrite` is complete. */
+			void FinishPendingWrite();
+
+			Entry *FindEntry(std::uint64_t hash);
+			void RemoveEntry(std::uint64_t hash);
+			void EvictEntries(std::uint64_t maxTotalSize);
+
+			void LoadIndex();
+			void SaveIndex();
+
+			static std::string GetSnapshotPath(std::uint64_t hash);
+		};
+	} // namespace client
+} // namespace spades
@@ -17,6 +17,7 @@
  along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
 
  */
+#include <algorithm>
 #include <exception>
 
 #include "GameMap.h"
@@ -73,6 +74,41 @@ namespace spades {
 		GameMapLoader::GameMapLoader() : progressCell{0} {
 			SPADES_MARK_FUNCTION();
 
+			StartDecoding();
+		}
+
+		GameMapLoader::GameMapLoader(GameMapCache &cache, std::uint64_t streamLength)
+		    : cache{&cache},
+		      cacheState{CacheState::Probing},
+		      expectedStreamLength{streamLength},
+		      progressCell{0} {}
+
+		GameMapLoader::GameMapLoader(Handle<GameMap> gameMap)
+		    : loadedFromCache{true}, progressCell{512 * 512} {
+			SPADES_MARK_FUNCTION();
+
+			auto result = stmp::make_unique<Result>();
+			result->gameMap = std::move(gameMap);
+			resultCell.store(std::move(result));
+		}
+
+		GameMapLoader::~GameMapLoader() {
+			SPADES_MARK_FUNCTION();
+
+			if (decodingThread) {
+				// Hang up the writer. This causes the decoder thread to exit gracefully.
+				rawDataWriter.reset();
+
+				decodingThread->Join();
+				decodingThread.reset();
+			}
+		}
+
+		void GameMapLoader::StartDecoding() {
+			SPADES_MARK_FUNCTION();
+
+			SPAssert(!decodingThread);
+
 			auto pipe = CreatePipeStream();
 
 			rawDataWriter = std::move(std::get<0>(pipe));
@@ -82,34 +118,94 @@ namespace spades {
 
 			decodingThread = stmp::make_unique<Thread>(&*decodingThreadRunnable);
 			decodingThread->Start();
+
+			cacheState = CacheState::Disabled;
+			if (!pendingData.empty()) {
+				rawDataWriter->Write(pendingData.data(), pendingData.size());
+				pendingData.clear();
+				pendingData.shrink_to_fit();
+			}
 		}
 
-		GameMapLoader::~GameMapLoader() {
+		void GameMapLoader::ProbeCache() {
 			SPADES_MARK_FUNCTION();
 
-			// Hang up the writer. This causes the decoder thread to exit gracefully.
-			rawDataWriter.reset();
+			SPAssert(cacheState == CacheState::Probing);
 
-			decodingThread->Join();
-			decodingThread.reset();
+			cacheCandidate =
+			  cache->FindByPrefix(hasher.GetDigest().prefixHash, expectedStreamLength);
+			if (cacheCandidate) {
+				SPLog("The map data might be in the map cache; deferring decoding");
+				cacheState = CacheState::Matching;
+				pendingData.reserve(static_cast<std::size_t>(expectedStreamLength));
+			} else {
+				StartDecoding();
+			}
 		}
 
 		void GameMapLoader::AddRawChunk(const char *bytes, std::size_t numBytes) {
 			SPADES_MARK_FUNCTION();
 
-			if (!rawDataWriter) {
+			if (receivedEOF) {
 				SPRaise("The raw data channel is already closed.");
 			}
 
-			rawDataWriter->Write(bytes, numBytes);
+			hasher.Update(bytes, numBytes);
+
+			switch (cacheState) {
+				case CacheState::Disabled:
+					if (rawDataWriter) {
+						rawDataWriter->Write(bytes, numBytes);
+					}
+					break;
+				case CacheState::Probing:
+					pendingData.append(bytes, numBytes);
+					if (hasher.IsPrefixComplete()) {
+						ProbeCache();
+					}
+					break;
+				case CacheState::Matching: pendingData.append(bytes, numBytes); break;
+			}
 		}
 
 		void GameMapLoader::MarkEOF() {
 			SPADES_MARK_FUNCTION();
 
-			if (!rawDataWriter) {
+			if (receivedEOF) {
 				SPRaise("The raw data channel is already closed.");
 			}
+			receivedEOF = true;
+
+			if (cacheState == CacheState::Probing) {
+				// The stream was shorter than the prefix
+				ProbeCache();
+			}
+
+			if (cacheState == CacheState::Matching) {
+				GameMapCache::StreamDigest digest = hasher.GetDigest();
+				Handle<GameMap> gameMap;
+				if (digest.Matches(*cacheCandidate)) {
+					gameMap = cache->Load(*cacheCandidate);
+				} else {
+					SPLog("The map data didn't match the map cache entry");
+				}
+
+				if (gameMap) {
+					auto result = stmp::make_unique<Result>();
+					result->gameMap = std::move(gameMap);
+					resultCell.store(std::move(result));
+					progressCell.store(512 * 512);
+					cacheState = CacheState::Disabled;
+					loadedFromCache = true;
+
+					pendingData.clear();
+					pendingData.shrink_to_fit();
+					return;
+				}
+
+				StartDecoding();
+			}
+
 			rawDataWriter.reset();
 		}
 
@@ -118,12 +214,20 @@ namespace spades {
 		void GameMapLoader::WaitComplete() {
 			SPADES_MARK_FUNCTION();
 
-			decodingThread->Join();
+			if (decodingThread) {
+				decodingThread->Join();
+			}
 
 			SPAssert(IsComplete());
 		}
 
 		float GameMapLoader::GetProgress() {
+			if (cacheState != CacheState::Disabled && expectedStreamLength > 0) {
+				// Not decoding yet; estimate the progress based on the amount of received data
+				float progress = static_cast<float>(hasher.GetDigest().length) /
+				                 static_cast<float>(expectedStreamLength);
+				return std::min(progress, 1.0f);
+			}
 			return static_cast<float>(progressCell.load(std::memory_order_relaxed)) / (512 * 512);
 		}
 
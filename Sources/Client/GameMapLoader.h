@@ -19,7 +19,9 @@
  */
 #include <atomic>
 #include <memory>
+#include <string>
 
+#include "GameMapCache.h"
 #include <Core/IStream.h>
 #include <Core/TMPUtils.h>
 
@@ -38,6 +40,25 @@ namespace spades {
 		class GameMapLoader {
 		public:
 			GameMapLoader();
+
+			/**
+			 * Constructs a loader that consults the specified map cache.
+			 *
+			 * The decoding is deferred until the first `GameMapCache::PrefixLength` bytes are
+			 * received. If they match a cache entry, the loader only buffers the rest of the
+			 * stream, and the cached map is used if the whole stream turns out to be identical
+			 * to the cached one. Otherwise, the buffered data is decoded as usual.
+			 *
+			 * @param streamLength The length of the compressed stream advertised by the server.
+			 */
+			GameMapLoader(GameMapCache &, std::uint64_t streamLength);
+
+			/**
+			 * Constructs a loader that is already complete with the specified map. Raw data
+			 * supplied to this loader is ignored.
+			 */
+			explicit GameMapLoader(Handle<GameMap>);
+
 			~GameMapLoader();
 
 			GameMapLoader(const GameMapLoader &) = delete;
@@ -81,10 +102,37 @@ namespace spades {
 			 */
 			Handle<GameMap> TakeGameMap();
 
+			/** Returns `true` if the map wasn't decoded from the supplied data. */
+			bool IsLoadedFromCache() const { return loadedFromCache; }
+
+			/** Gets the digest of the undecoded data supplied so far. */
+			GameMapCache::StreamDigest GetStreamDigest() const { return hasher.GetDigest(); }
+
 		private:
 			struct Decoder;
 			struct Result;
 
+			enum class CacheState {
+				/** Data is sent to the decoding thread as soon as it's received. */
+				Disabled,
+				/** Buffering the stream prefix to look up the map cache. */
+				Probing,
+				/** Buffering the whole stream, which might match `cacheCandidate`. */
+				Matching
+			};
+
+			GameMapCache *cache = nullptr;
+			CacheState cacheState = CacheState::Disabled;
+			std::uint64_t expectedStreamLength = 0;
+			GameMapCache::StreamHasher hasher;
+			stmp::optional<GameMapCache::StreamDigest> cacheCandidate;
+
+			/** Undecoded data received while the decoding thread isn't running. */
+			std::string pendingData;
+
+			bool receivedEOF = false;
+			bool loadedFromCache = false;
+
 			/** A writable stream used to send undecoded data to the decoding thread. */
 			std::unique_ptr<IStream> rawDataWriter;
 
@@ -99,6 +147,12 @@ namespace spades {
 
 			/** The cell for receiving the decode result. */
 			stmp::atomic_unique_ptr<Result> resultCell;
+
+			/** Starts the decoding thread and sends `pendingData` to it. */
+			void StartDecoding();
+
+			/** Looks up the map cache with the stream prefix received so far. */
+			void ProbeCache();
 		};
 
 	} // namespace client
@@ -19,18 +19,33 @@
  */
 
 #include <cstring>
-#include <deque>
-#include <queue>
-#include <set>
 #include <vector>
 
 #include "GameMap.h"
 #include "GameMapWrapper.h"
 #include <Core/Debug.h>
-#include <Core/Stopwatch.h>
+#include <Core/Math.h>
 
 namespace spades {
 	namespace client {
+		namespace {
+			/**
+			 * Extends each bit of `seeds` to the run of set bits of `solid` containing it
+			 * (a Kogge-Stone occluded fill in both directions). `seeds` must be a subset of
+			 * `solid`.
+			 */
+			inline uint64_t FillRuns(uint64_t seeds, uint64_t solid) {
+				uint64_t up = seeds, upMask = solid;
+				uint64_t down = seeds, downMask = solid;
+				for (int shift = 1; shift < 64; shift <<= 1) {
+					up |= upMask & (up << shift);
+					upMask &= upMask << shift;
+					down |= downMask & (down >> shift);
+					downMask &= downMask >> shift;
+				}
+				return up | down;
+			}
+		} // namespace
 
 		GameMapWrapper::GameMapWrapper(GameMap &mp) : map(mp) {
 			SPADES_MARK_FUNCTION();
@@ -38,326 +53,207 @@ namespace spades {
 			width = mp.Width();
 			height = mp.Height();
 			depth = mp.Depth();
+			SPAssert(depth == 64);
+
 			// TODO: `stmp::make_unique` doesn't support array initialization yet
-			linkMap.reset(new uint8_t[width * height * depth]);
-			memset(linkMap.get(), 0, width * height * depth);
+			columnStates.reset(new ColumnState[width * height]);
+			memset(columnStates.get(), 0, sizeof(ColumnState) * width * height);
 		}
 
 		GameMapWrapper::~GameMapWrapper() { SPADES_MARK_FUNCTION(); }
 
-		void GameMapWrapper::Rebuild() {
+		void GameMapWrapper::AddBlock(int x, int y, int z, uint32_t color) {
 			SPADES_MARK_FUNCTION();
 
-			Stopwatch stopwatch;
-
-			GameMap &m = map;
-			memset(linkMap.get(), 0, width * height * depth);
+			if (map.IsSolid(x, y, z)) {
+				return;
+			}
 
-			for (int x = 0; x < width; x++)
-				for (int y = 0; y < height; y++)
-					SetLink(x, y, depth - 1, Root);
+			// Connectivity is computed on demand, so there's nothing to update
+			map.Set(x, y, z, true, color);
+		}
 
-			std::deque<CellPos> queue(width * height * 2);
+		bool GameMapWrapper::SearchComponent(int column, uint64_t seed) {
+			// The blocks at these layers are the ground
+			const uint64_t groundMask = ~0ULL << (depth - 2);
 
-			for (int x = 0; x < width; x++)
-				for (int y = 0; y < height; y++)
-					if (m.IsSolid(x, y, depth - 2)) {
-						SetLink(x, y, depth - 2, PositiveZ);
-						queue.push_back(CellPos(x, y, depth - 2));
-					}
+			const std::size_t firstSpan = visitedSpans.size();
+			bool grounded = false;
 
-			while (!queue.empty()) {
-				CellPos p = queue.front();
-				queue.pop_front();
+			SPAssert(searchStack.empty());
+			searchStack.push_back(Span{column, seed});
 
-				int x = p.x, y = p.y, z = p.z;
+			while (!searchStack.empty()) {
+				Span span = searchStack.back();
+				searchStack.pop_back();
 
-				if (p.x > 0 && m.IsSolid(x - 1, y, z) && GetLink(x - 1, y, z) == Invalid) {
-					SetLink(x - 1, y, z, PositiveX);
-					queue.push_back(CellPos(x - 1, y, z));
-				}
-				if (p.x < width - 1 && m.IsSolid(x + 1, y, z) && GetLink(x + 1, y, z) == Invalid) {
-					SetLink(x + 1, y, z, NegativeX);
-					queue.push_back(CellPos(x + 1, y, z));
-				}
-				if (p.y > 0 && m.IsSolid(x, y - 1, z) && GetLink(x, y - 1, z) == Invalid) {
-					SetLink(x, y - 1, z, PositiveY);
-					queue.push_back(CellPos(x, y - 1, z));
+				ColumnState &state = columnStates[span.column];
+				if (span.bits & state.grounded) {
+					grounded = true;
+					break;
 				}
-				if (p.y < height - 1 && m.IsSolid(x, y + 1, z) && GetLink(x, y + 1, z) == Invalid) {
-					SetLink(x, y + 1, z, NegativeY);
-					queue.push_back(CellPos(x, y + 1, z));
-				}
-				if (p.z > 0 && m.IsSolid(x, y, z - 1) && GetLink(x, y, z - 1) == Invalid) {
-					SetLink(x, y, z - 1, PositiveZ);
-					queue.push_back(CellPos(x, y, z - 1));
-				}
-				if (p.z < depth - 1 && m.IsSolid(x, y, z + 1) && GetLink(x, y, z + 1) == Invalid) {
-					SetLink(x, y, z + 1, NegativeZ);
-					queue.push_back(CellPos(x, y, z + 1));
-				}
-			}
-
-			SPLog("%.3f msecs to rebuild", stopwatch.GetTime() * 1000.);
-		}
-
-		void GameMapWrapper::AddBlock(int x, int y, int z, uint32_t color) {
-			SPADES_MARK_FUNCTION();
-
-			GameMap &m = map;
 
-			if (GetLink(x, y, z) != Invalid) {
-				SPAssert(m.IsSolid(x, y, z));
-				return;
-			}
-
-			m.Set(x, y, z, true, color);
+				// Runs are always visited as a whole, so a run is either entirely visited
+				// or not at all
+				uint64_t bits = span.bits & ~state.visited;
+				if (!bits) {
+					continue;
+				}
 
-			if (GetLink(x, y, z) != Invalid) {
-				return;
-			}
+				int x = span.column / height;
+				int y = span.column % height;
+				bits = FillRuns(bits, map.GetSolidMapWrapped(x, y));
 
-			LinkType l = Invalid;
-			if (x > 0 && m.IsSolid(x - 1, y, z) && GetLink(x - 1, y, z) != Invalid) {
-				l = NegativeX;
-				SPAssert(GetLink(x - 1, y, z) != PositiveX);
-			}
-			if (x < width - 1 && m.IsSolid(x + 1, y, z) && GetLink(x + 1, y, z) != Invalid) {
-				l = PositiveX;
-				SPAssert(GetLink(x + 1, y, z) != NegativeX);
-			}
-			if (y > 0 && m.IsSolid(x, y - 1, z) && GetLink(x, y - 1, z) != Invalid) {
-				l = NegativeY;
-				SPAssert(GetLink(x, y - 1, z) != PositiveY);
-			}
-			if (y < height - 1 && m.IsSolid(x, y + 1, z) && GetLink(x, y + 1, z) != Invalid) {
-				l = PositiveY;
-				SPAssert(GetLink(x, y + 1, z) != NegativeY);
-			}
-			if (z > 0 && m.IsSolid(x, y, z - 1) && GetLink(x, y, z - 1) != Invalid) {
-				l = NegativeZ;
-				SPAssert(GetLink(x, y, z - 1) != PositiveZ);
-			}
-			if (z < depth - 1 && m.IsSolid(x, y, z + 1) && GetLink(x, y, z + 1) != Invalid) {
-				l = PositiveZ;
-				SPAssert(GetLink(x, y, z + 1) != NegativeZ);
-			}
-			SetLink(x, y, z, l);
+				if (!state.visited && !state.grounded) {
+					touchedColumns.push_back(span.column);
+				}
+				state.visited |= bits;
+				visitedSpans.push_back(Span{span.column, bits});
 
-			if (l == Invalid)
-				return;
-			// if there's invalid block around this block,
-			// rebuild tree
-			std::deque<CellPos> queue;
-			queue.push_back(CellPos(x, y, z));
-			while (!queue.empty()) {
-				CellPos p = queue.front();
-				queue.pop_front();
-
-				int x = p.x, y = p.y, z = p.z;
-				SPAssert(m.IsSolid(x, y, z));
-
-				LinkType thisLink = GetLink(x, y, z);
-
-				if (p.x > 0 && m.IsSolid(x - 1, y, z) && GetLink(x - 1, y, z) == Invalid &&
-				    thisLink != NegativeX) {
-					SetLink(x - 1, y, z, PositiveX);
-					queue.push_back(CellPos(x - 1, y, z));
+				if (bits & groundMask) {
+					grounded = true;
+					break;
 				}
-				if (p.x < width - 1 && m.IsSolid(x + 1, y, z) && GetLink(x + 1, y, z) == Invalid &&
-				    thisLink != PositiveX) {
-					SetLink(x + 1, y, z, NegativeX);
-					queue.push_back(CellPos(x + 1, y, z));
+
+				if (x > 0) {
+					uint64_t next = bits & map.GetSolidMapWrapped(x - 1, y);
+					if (next) {
+						searchStack.push_back(Span{span.column - height, next});
+					}
 				}
-				if (p.y > 0 && m.IsSolid(x, y - 1, z) && GetLink(x, y - 1, z) == Invalid &&
-				    thisLink != NegativeY) {
-					SetLink(x, y - 1, z, PositiveY);
-					queue.push_back(CellPos(x, y - 1, z));
+				if (x < width - 1) {
+					uint64_t next = bits & map.GetSolidMapWrapped(x + 1, y);
+					if (next) {
+						searchStack.push_back(Span{span.column + height, next});
+					}
 				}
-				if (p.y < height - 1 && m.IsSolid(x, y + 1, z) && GetLink(x, y + 1, z) == Invalid &&
-				    thisLink != PositiveY) {
-					SetLink(x, y + 1, z, NegativeY);
-					queue.push_back(CellPos(x, y + 1, z));
+				if (y > 0) {
+					uint64_t next = bits & map.GetSolidMapWrapped(x, y - 1);
+					if (next) {
+						searchStack.push_back(Span{span.column - 1, next});
+					}
 				}
-				if (p.z > 0 && m.IsSolid(x, y, z - 1) && GetLink(x, y, z - 1) == Invalid &&
-				    thisLink != NegativeZ) {
-					SetLink(x, y, z - 1, PositiveZ);
-					queue.push_back(CellPos(x, y, z - 1));
+				if (y < height - 1) {
+					uint64_t next = bits & map.GetSolidMapWrapped(x, y + 1);
+					if (next) {
+						searchStack.push_back(Span{span.column + 1, next});
+					}
 				}
-				if (p.z < depth - 1 && m.IsSolid(x, y, z + 1) && GetLink(x, y, z + 1) == Invalid &&
-				    thisLink != PositiveZ) {
-					SetLink(x, y, z + 1, NegativeZ);
-					queue.push_back(CellPos(x, y, z + 1));
+			}
+
+			searchStack.clear();
+
+			if (grounded) {
+				// Later searches reaching these blocks can stop immediately
+				for (std::size_t i = firstSpan; i < visitedSpans.size(); i++) {
+					const Span &span = visitedSpans[i];
+					columnStates[span.column].grounded |= span.bits;
 				}
+				visitedSpans.resize(firstSpan);
 			}
-		}
 
-		template <typename T> static inline bool EqualTwoCond(T a, T b, T c, bool cond) {
-			return a == b || (cond && a == c);
+			return grounded;
 		}
 
-		std::vector<CellPos> GameMapWrapper::RemoveBlocks(const std::vector<CellPos> &cells) {
+		void GameMapWrapper::FindFloatingBlocks(const std::vector<CellPos> &cells,
+		                                        std::vector<std::vector<CellPos>> &clusters) {
 			SPADES_MARK_FUNCTION();
 
-			if (cells.empty())
-				return std::vector<CellPos>();
-
 			GameMap &m = map;
 
-			// solid, but unlinked cells
-			std::vector<CellPos> unlinkedCells;
-			std::deque<CellPos> queue;
-
-			// unlink children
-			for (size_t i = 0; i < cells.size(); i++) {
-				CellPos pos = cells[i];
+			for (const CellPos &pos : cells) {
 				m.Set(pos.x, pos.y, pos.z, false, 0);
-				// if(GetLink(pos.x, pos.y, pos.z) == Invalid){
-				// this block is already disconnected.
-				// }
-
-				if (GetLink(pos.x, pos.y, pos.z) == Marked) {
-					continue;
-				}
-				SPAssert(GetLink(pos.x, pos.y, pos.z) != Root);
-
-				SetLink(pos.x, pos.y, pos.z, Invalid);
-				queue.push_back(pos);
-
-				while (!queue.empty()) {
-					pos = queue.front();
-					queue.pop_front();
-
-					if (m.IsSolid(pos.x, pos.y, pos.z))
-						unlinkedCells.push_back(pos);
-					// don't "continue;" when non-solid
-
-					int x = pos.x, y = pos.y, z = pos.z;
-					if (x > 0 && EqualTwoCond(GetLink(x - 1, y, z), PositiveX, Invalid,
-					                          m.IsSolid(x - 1, y, z))) {
-						SetLink(x - 1, y, z, Marked);
-						queue.push_back(CellPos(x - 1, y, z));
-					}
-					if (x < width - 1 && EqualTwoCond(GetLink(x + 1, y, z), NegativeX, Invalid,
-					                                  m.IsSolid(x + 1, y, z))) {
-						SetLink(x + 1, y, z, Marked);
-						queue.push_back(CellPos(x + 1, y, z));
-					}
-					if (y > 0 && EqualTwoCond(GetLink(x, y - 1, z), PositiveY, Invalid,
-					                          m.IsSolid(x, y - 1, z))) {
-						SetLink(x, y - 1, z, Marked);
-						queue.push_back(CellPos(x, y - 1, z));
-					}
-					if (y < height - 1 && EqualTwoCond(GetLink(x, y + 1, z), NegativeY, Invalid,
-					                                   m.IsSolid(x, y + 1, z))) {
-						SetLink(x, y + 1, z, Marked);
-						queue.push_back(CellPos(x, y + 1, z));
-					}
-					if (z > 0 && EqualTwoCond(GetLink(x, y, z - 1), PositiveZ, Invalid,
-					                          m.IsSolid(x, y, z - 1))) {
-						SetLink(x, y, z - 1, Marked);
-						queue.push_back(CellPos(x, y, z - 1));
-					}
-					if (z < depth - 1 && EqualTwoCond(GetLink(x, y, z + 1), NegativeZ, Invalid,
-					                                  m.IsSolid(x, y, z + 1))) {
-						SetLink(x, y, z + 1, Marked);
-						queue.push_back(CellPos(x, y, z + 1));
-					}
-				}
 			}
 
-			// remove "visited" mark
-			for (size_t i = 0; i < unlinkedCells.size(); i++) {
-				const CellPos &pos = unlinkedCells[i];
-				if (GetLink(pos.x, pos.y, pos.z) == Marked)
-					SetLink(pos.x, pos.y, pos.z, Invalid);
-			}
-
-			SPAssert(queue.empty());
-
-			// start relinking
-			for (size_t i = 0; i < unlinkedCells.size(); i++) {
-				const CellPos &pos = unlinkedCells[i];
+			// Search from every solid block adjacent to the removed ones
+			for (const CellPos &pos : cells) {
 				int x = pos.x, y = pos.y, z = pos.z;
-				if (!m.IsSolid(x, y, z)) {
-					// notice: (x,y,z) may be air, so
-					// don't use SPAssert()
-					continue;
-				}
+				int column = x * height + y;
 
-				LinkType newLink = Invalid;
-				if (z < depth - 1 && GetLink(x, y, z + 1) != Invalid) {
-					newLink = PositiveZ;
-				} else if (x > 0 && GetLink(x - 1, y, z) != Invalid) {
-					newLink = NegativeX;
-				} else if (x < width - 1 && GetLink(x + 1, y, z) != Invalid) {
-					newLink = PositiveX;
-				} else if (y > 0 && GetLink(x, y - 1, z) != Invalid) {
-					newLink = NegativeY;
-				} else if (y < height - 1 && GetLink(x, y + 1, z) != Invalid) {
-					newLink = PositiveY;
-				} else if (z > 0 && GetLink(x, y, z - 1) != Invalid) {
-					newLink = NegativeZ;
+				uint64_t vertical = 0;
+				if (z > 0) {
+					vertical |= 1ULL << (z - 1);
 				}
+				if (z < depth - 1) {
+					vertical |= 1ULL << (z + 1);
+				}
+				const uint64_t horizontal = 1ULL << z;
+
+				struct {
+					bool valid;
+					int column;
+					uint64_t bits;
+				} const seeds[] = {{true, column, vertical},
+				                   {x > 0, column - height, horizontal},
+				                   {x < width - 1, column + height, horizontal},
+				                   {y > 0, column - 1, horizontal},
+				                   {y < height - 1, column + 1, horizontal}};
+
+				for (const auto &seed : seeds) {
+					if (!seed.valid) {
+						continue;
+					}
 
-				if (newLink != Invalid) {
-					SetLink(x, y, z, newLink);
-					queue.push_back(pos);
+					uint64_t solid =
+					  m.GetSolidMapWrapped(seed.column / height, seed.column % height);
+					uint64_t bits = seed.bits & solid;
+					// `vertical` may contain two blocks, which may belong to different
+					// components
+					while (bits) {
+						uint64_t bit = bits & (~bits + 1);
+						bits &= ~bit;
+
+						const ColumnState &state = columnStates[seed.column];
+						if ((state.visited | state.grounded) & bit) {
+							continue;
+						}
+
+						std::size_t firstSpan = visitedSpans.size();
+						if (SearchComponent(seed.column, bit)) {
+							continue;
+						}
+
+						clusters.emplace_back();
+						std::vector<CellPos> &cluster = clusters.back();
+						for (std::size_t i = firstSpan; i < visitedSpans.size(); i++) {
+							const Span &span = visitedSpans[i];
+							int sx = span.column / height;
+							int sy = span.column % height;
+							for (uint64_t b = span.bits; b; b &= b - 1) {
+								cluster.emplace_back(sx, sy, CountTrailingZeros(b));
+							}
+						}
+					}
 				}
 			}
 
-			while (!queue.empty()) {
-				CellPos p = queue.front();
-				queue.pop_front();
+			for (int column : touchedColumns) {
+				columnStates[column] = ColumnState{0, 0};
+			}
+			touchedColumns.clear();
+			visitedSpans.clear();
+		}
 
-				int x = p.x, y = p.y, z = p.z;
-				LinkType thisLink = GetLink(x, y, z);
+		std::vector<CellPos> GameMapWrapper::RemoveBlocks(const std::vector<CellPos> &cells) {
+			SPADES_MARK_FUNCTION();
 
-				if (p.x > 0 && m.IsSolid(x - 1, y, z) && GetLink(x - 1, y, z) == Invalid &&
-				    thisLink != NegativeX) {
-					SetLink(x - 1, y, z, PositiveX);
-					queue.push_back(CellPos(x - 1, y, z));
-				}
-				if (p.x < width - 1 && m.IsSolid(x + 1, y, z) && GetLink(x + 1, y, z) == Invalid &&
-				    thisLink != PositiveX) {
-					SetLink(x + 1, y, z, NegativeX);
-					queue.push_back(CellPos(x + 1, y, z));
-				}
-				if (p.y > 0 && m.IsSolid(x, y - 1, z) && GetLink(x, y - 1, z) == Invalid &&
-				    thisLink != NegativeY) {
-					SetLink(x, y - 1, z, PositiveY);
-					queue.push_back(CellPos(x, y - 1, z));
-				}
-				if (p.y < height - 1 && m.IsSolid(x, y + 1, z) && GetLink(x, y + 1, z) == Invalid &&
-				    thisLink != PositiveY) {
-					SetLink(x, y + 1, z, NegativeY);
-					queue.push_back(CellPos(x, y + 1, z));
-				}
-				if (p.z > 0 && m.IsSolid(x, y, z - 1) && GetLink(x, y, z - 1) == Invalid &&
-				    thisLink != NegativeZ) {
-					SetLink(x, y, z - 1, PositiveZ);
-					queue.push_back(CellPos(x, y, z - 1));
-				}
-				if (p.z < depth - 1 && m.IsSolid(x, y, z + 1) && GetLink(x, y, z + 1) == Invalid &&
-				    thisLink != PositiveZ) {
-					SetLink(x, y, z + 1, NegativeZ);
-					queue.push_back(CellPos(x, y, z + 1));
-				}
-			}
+			std::vector<std::vector<CellPos>> clusters;
+			FindFloatingBlocks(cells, clusters);
 
 			std::vector<CellPos> floatingBlocks;
-			floatingBlocks.reserve(unlinkedCells.size());
-
-			for (size_t i = 0; i < unlinkedCells.size(); i++) {
-				const CellPos &p = unlinkedCells[i];
-				if (!m.IsSolid(p.x, p.y, p.z))
-					continue;
-				if (GetLink(p.x, p.y, p.z) == Invalid) {
-					floatingBlocks.push_back(p);
-				}
+			for (const auto &cluster : clusters) {
+				floatingBlocks.insert(floatingBlocks.end(), cluster.begin(), cluster.end());
 			}
-
 			return floatingBlocks;
 		}
+
+		std::vector<std::vector<CellPos>>
+		GameMapWrapper::RemoveBlocksClustered(const std::vector<CellPos> &cells) {
+			SPADES_MARK_FUNCTION();
+
+			std::vector<std::vector<CellPos>> clusters;
+			FindFloatingBlocks(cells, clusters);
+			return clusters;
+		}
 	} // namespace client
 } // namespace spades
@@ -68,37 +68,55 @@ namespace spades {
 			}
 		};
 
-		/** Wraps GameMap and provides floating-block detection.*/
+		/**
+		 * Wraps GameMap and provides floating-block detection.
+		 *
+		 * A solid block is grounded if it's connected to a block at one of the two bottom
+		 * layers through solid blocks. When blocks are removed, the connected components
+		 * around them are flood-filled using the solid map's 64-bit columns, a whole vertical
+		 * run of blocks at a time. A search stops as soon as it reaches the ground or a
+		 * block found to be grounded by an earlier search, so only floating components are
+		 * traversed entirely.
+		 */
 		class GameMapWrapper {
 			friend class Client; // FIXME: for debug
 		public:
 		private:
 			GameMap &map;
 
-			/** Each element represents where this cell is connected from. */
-			std::unique_ptr<uint8_t[]> linkMap;
+			int width, height, depth;
+
+			/** The search state of a column. */
+			struct ColumnState {
+				/** The blocks visited by the current `RemoveBlocks` call. */
+				uint64_t visited;
+				/** The visited blocks known to be grounded. */
+				uint64_t grounded;
+			};
+
+			/** `[x * height + y]`. All zero outside `RemoveBlocks`. */
+			std::unique_ptr<ColumnState[]> columnStates;
 
-			enum LinkType {
-				Invalid = 0,
-				Root,
-				NegativeX,
-				PositiveX,
-				NegativeY,
-				PositiveY,
-				NegativeZ,
-				PositiveZ,
+			/** The indices of the columns whose `ColumnState` is non-zero. */
+			std::vector<int> touchedColumns;
 
-				Marked
+			struct Span {
+				int column;
+				uint64_t bits;
 			};
+			std::vector<Span> searchStack;
+			/** The spans visited by all searches of the current `RemoveBlocks` call. */
+			std::vector<Span> visitedSpans;
 
-			int width, height, depth;
+			/**
+			 * Finds the connected component containing the blocks `seed` of the column
+			 * `column` and returns whether it's grounded. The spans of the visited blocks are
+			 * appended to `visitedSpans`.
+			 */
+			bool SearchComponent(int column, uint64_t seed);
 
-			inline LinkType GetLink(int x, int y, int z) {
-				return (LinkType)linkMap[(x * height + y) * depth + z];
-			}
-			void SetLink(int x, int y, int z, LinkType l) {
-				linkMap[(x * height + y) * depth + z] = l;
-			}
+			void FindFloatingBlocks(const std::vector<CellPos> &,
+			                        std::vector<std::vector<CellPos>> &clusters);
 
 		public:
 			GameMapWrapper(GameMap &);
@@ -111,7 +129,11 @@ namespace spades {
 			 * This function, however, doesn't remove floating blocks. */
 			std::vector<CellPos> RemoveBlocks(const std::vector<CellPos> &);
 
-			void Rebuild();
+			/**
+			 * Same as `RemoveBlocks`, but returns the floating blocks grouped into
+			 * connected components.
+			 */
+			std::vector<std::vector<CellPos>> RemoveBlocksClustered(const std::vector<CellPos> &);
 		};
 	} // namespace client
 } // namespace spades
@@ -24,7 +24,7 @@
 #include "IAudioChunk.h"
 #include "IAudioDevice.h"
 #include "IRenderer.h"
-#include "ParticleSpriteEntity.h"
+#include "ParticleSystem.h"
 #include "World.h"
 
 namespace spades {
@@ -116,18 +116,18 @@ namespace spades {
 						Vector3 pt = matrix.GetOrigin();
 						pt.z = 62.99f;
 						for (int i = 0; i < splats; i++) {
-							auto ent = stmp::make_unique<ParticleSpriteEntity>(*client, img, col);
-							ent->SetTrajectory(
+							ParticleParam ent{*img, col};
+							ent.SetTrajectory(
 							  pt,
 							  MakeVector3(SampleRandomFloat() - SampleRandomFloat(),
 							              SampleRandomFloat() - SampleRandomFloat(),
 							              -SampleRandomFloat()) *
 							    2.f,
 							  1.f, .4f);
-							ent->SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
-							ent->SetRadius(0.1f + SampleRandomFloat() * SampleRandomFloat() * 0.1f);
-							ent->SetLifeTime(2.f, 0.f, 1.f);
-							client->AddLocalEntity(std::move(ent));
+							ent.SetRotation(SampleRandomFloat() * (float)M_PI * 2.f);
+							ent.SetRadius(0.1f + SampleRandomFloat() * SampleRandomFloat() * 0.1f);
+							ent.SetLifeTime(2.f, 0.f, 1.f);
+							client->GetParticleSystem().Spawn(ent);
 						}
 					}
 
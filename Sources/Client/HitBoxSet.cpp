@@ -0,0 +1,250 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "HitBoxSet.h"
+#include <Core/Debug.h>
+#include <Core/SIMD.h>
+
+namespace spades {
+	namespace client {
+		HitBoxSet::HitBoxSet() : numBoxes{0} {}
+
+		void HitBoxSet::Clear() {
+			numBoxes = 0;
+			fields.clear();
+			boxes.clear();
+			centers.clear();
+		}
+
+		std::size_t HitBoxSet::AddBox(const OBB3 &box, const Vector3 &center) {
+			std::size_t index = numBoxes++;
+			if (index % 4 == 0) {
+				fields.resize(fields.size() + NumFields * 4, 0.f);
+			}
+			boxes.push_back(box);
+			centers.push_back(center);
+
+			float *lane = fields.data() + (index / 4) * NumFields * 4 + index % 4;
+			auto set = [lane](int field, float value) { lane[field * 4] = value; };
+
+			const Matrix4 &m = box.m;
+			const Matrix4 inverse = m.InversedFast();
+			for (int i = 0; i < 3; i++) {
+				set(FieldAxisX + i, m.m[i]);
+				set(FieldAxisY + i, m.m[4 + i]);
+				set(FieldAxisZ + i, m.m[8 + i]);
+				set(FieldOrigin + i, m.m[12 + i]);
+				for (int j = 0; j < 4; j++) {
+					set(FieldInverse + j * 3 + i, inverse.m[j * 4 + i]);
+				}
+			}
+			set(FieldAxisLengthSq + 0, m.GetAxis(0).GetPoweredLength());
+			set(FieldAxisLengthSq + 1, m.GetAxis(1).GetPoweredLength());
+			set(FieldAxisLengthSq + 2, m.GetAxis(2).GetPoweredLength());
+			set(FieldCenter + 0, center.x);
+			set(FieldCenter + 1, center.y);
+			set(FieldCenter + 2, center.z);
+
+			return index;
+		}
+
+#if SPADES_ENABLE_SSE2
+		namespace {
+			inline __m128 Dot(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by,
+			                  __m128 bz) {
+				// Same order as `Vector3::Dot`
+				return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+				                  _mm_mul_ps(az, bz));
+			}
+
+			inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+				return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+			}
+
+			struct Lanes3 {
+				__m128 x, y, z;
+			};
+
+			struct PlaneHit {
+				__m128 mask;
+				Lanes3 pos;
+			};
+
+			/**
+			 * One of the plane tests of `OBB3::RayCast`. `a` is the axis perpendicular to the
+			 * plane, and `b` and `c` are the other two.
+			 */
+			inline PlaneHit TestPlane(const Lanes3 &start, const Lanes3 &end, const Lanes3 &dir,
+			                          const Lanes3 &a, __m128 aLengthSq, const Lanes3 &b,
+			                          __m128 bLengthSq, const Lanes3 &c, __m128 cLengthSq) {
+				const __m128 zero = _mm_setzero_ps();
+
+				__m128 dot = Dot(dir.x, dir.y, dir.z, a.x, a.y, a.z);
+				__m128 startp = Dot(start.x, start.y, start.z, a.x, a.y, a.z);
+				__m128 endp = Dot(end.x, end.y, end.z, a.x, a.y, a.z);
+				__m128 hit = Select(_mm_cmplt_ps(startp, endp),
+				                    _mm_div_ps(startp, _mm_sub_ps(startp, endp)),
+				                    _mm_div_ps(_mm_sub_ps(aLengthSq, startp),
+				                               _mm_sub_ps(endp, startp)));
+
+				PlaneHit result;
+				result.pos.x = _mm_add_ps(start.x, _mm_mul_ps(dir.x, hit));
+				result.pos.y = _mm_add_ps(start.y, _mm_mul_ps(dir.y, hit));
+				result.pos.z = _mm_add_ps(start.z, _mm_mul_ps(dir.z, hit));
+
+				__m128 bd = Dot(result.pos.x, result.pos.y, result.pos.z, b.x, b.y, b.z);
+				__m128 cd = Dot(result.pos.x, result.pos.y, result.pos.z, c.x, c.y, c.z);
+
+				__m128 mask = _mm_and_ps(_mm_cmpneq_ps(dot, zero), _mm_cmpge_ps(hit, zero));
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(bd, zero), _mm_cmpge_ps(cd, zero)));
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmple_ps(bd, bLengthSq),
+				                                   _mm_cmple_ps(cd, cLengthSq)));
+				result.mask = mask;
+				return result;
+			}
+		} // namespace
+
+		void HitBoxSet::RayCast(const Vector3 &start, const Vector3 &dir,
+		                        std::vector<Hit> &hits) const {
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.f);
+			const __m128 approxRadius = _mm_set1_ps(8.f);
+			const Lanes3 s = {_mm_set1_ps(start.x), _mm_set1_ps(start.y), _mm_set1_ps(start.z)};
+			const Lanes3 d = {_mm_set1_ps(dir.x), _mm_set1_ps(dir.y), _mm_set1_ps(dir.z)};
+
+			for (std::size_t group = 0; group * 4 < numBoxes; group++) {
+				const float *f = fields.data() + group * NumFields * 4;
+				auto load = [f](int field) { return _mm_loadu_ps(f + field * 4); };
+
+				// `Player::RayCastApprox`
+				__m128 diffX = _mm_sub_ps(load(FieldCenter + 0), s.x);
+				__m128 diffY = _mm_sub_ps(load(FieldCenter + 1), s.y);
+				__m128 diffZ = _mm_sub_ps(load(FieldCenter + 2), s.z);
+				__m128 c = Dot(diffX, diffY, diffZ, d.x, d.y, d.z);
+				__m128 sq = Dot(diffX, diffY, diffZ, diffX, diffY, diffZ);
+				__m128 dist = _mm_sqrt_ps(_mm_sub_ps(sq, _mm_mul_ps(c, c)));
+				int nearMask = _mm_movemask_ps(_mm_cmplt_ps(dist, approxRadius));
+				std::size_t numLanes = std::min<std::size_t>(numBoxes - group * 4, 4);
+				nearMask &= (1 << numLanes) - 1;
+				if (!nearMask) {
+					continue;
+				}
+
+				// Is the start point inside?
+				__m128 rx = _mm_add_ps(
+				  _mm_add_ps(_mm_add_ps(_mm_mul_ps(load(FieldInverse + 0), s.x),
+				                        _mm_mul_ps(load(FieldInverse + 3), s.y)),
+				             _mm_mul_ps(load(FieldInverse + 6), s.z)),
+				  load(FieldInverse + 9));
+				__m128 ry = _mm_add_ps(
+				  _mm_add_ps(_mm_add_ps(_mm_mul_ps(load(FieldInverse + 1), s.x),
+				                        _mm_mul_ps(load(FieldInverse + 4), s.y)),
+				             _mm_mul_ps(load(FieldInverse + 7), s.z)),
+				  load(FieldInverse + 10));
+				__m128 rz = _mm_add_ps(
+				  _mm_add_ps(_mm_add_ps(_mm_mul_ps(load(FieldInverse + 2), s.x),
+				                        _mm_mul_ps(load(FieldInverse + 5), s.y)),
+				             _mm_mul_ps(load(FieldInverse + 8), s.z)),
+				  load(FieldInverse + 11));
+				__m128 inside = _mm_and_ps(_mm_cmpge_ps(rx, zero), _mm_cmplt_ps(rx, one));
+				inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(ry, zero), _mm_cmplt_ps(ry, one)));
+				inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(rz, zero), _mm_cmplt_ps(rz, one)));
+
+				// Plane tests in the box's local space
+				const Lanes3 origin = {load(FieldOrigin + 0), load(FieldOrigin + 1),
+				                       load(FieldOrigin + 2)};
+				const Lanes3 ls = {_mm_sub_ps(s.x, origin.x), _mm_sub_ps(s.y, origin.y),
+				                   _mm_sub_ps(s.z, origin.z)};
+				const Lanes3 le = {_mm_add_ps(ls.x, d.x), _mm_add_ps(ls.y, d.y),
+				                   _mm_add_ps(ls.z, d.z)};
+				const Lanes3 axisX = {load(FieldAxisX + 0), load(FieldAxisX + 1),
+				                      load(FieldAxisX + 2)};
+				const Lanes3 axisY = {load(FieldAxisY + 0), load(FieldAxisY + 1),
+				                      load(FieldAxisY + 2)};
+				const Lanes3 axisZ = {load(FieldAxisZ + 0), load(FieldAxisZ + 1),
+				                      load(FieldAxisZ + 2)};
+				const __m128 lengthX = load(FieldAxisLengthSq + 0);
+				const __m128 lengthY = load(FieldAxisLengthSq + 1);
+				const __m128 lengthZ = load(FieldAxisLengthSq + 2);
+
+				PlaneHit hitX =
+				  TestPlane(ls, le, d, axisX, lengthX, axisY, lengthY, axisZ, lengthZ);
+				PlaneHit hitY =
+				  TestPlane(ls, le, d, axisY, lengthY, axisX, lengthX, axisZ, lengthZ);
+				PlaneHit hitZ =
+				  TestPlane(ls, le, d, axisZ, lengthZ, axisX, lengthX, axisY, lengthY);
+
+				int hitMask = _mm_movemask_ps(_mm_or_ps(
+				  _mm_or_ps(inside, hitX.mask), _mm_or_ps(hitY.mask, hitZ.mask)));
+				hitMask &= nearMask;
+				if (!hitMask) {
+					continue;
+				}
+
+				// The first successful test determines the hit position
+				Lanes3 pos = hitZ.pos;
+				pos.x = Select(hitY.mask, hitY.pos.x, pos.x);
+				pos.y = Select(hitY.mask, hitY.pos.y, pos.y);
+				pos.z = Select(hitY.mask, hitY.pos.z, pos.z);
+				pos.x = Select(hitX.mask, hitX.pos.x, pos.x);
+				pos.y = Select(hitX.mask, hitX.pos.y, pos.y);
+				pos.z = Select(hitX.mask, hitX.pos.z, pos.z);
+				pos.x = Select(inside, s.x, _mm_add_ps(pos.x, origin.x));
+				pos.y = Select(inside, s.y, _mm_add_ps(pos.y, origin.y));
+				pos.z = Select(inside, s.z, _mm_add_ps(pos.z, origin.z));
+
+				alignas(16) float posX[4], posY[4], posZ[4];
+				_mm_store_ps(posX, pos.x);
+				_mm_store_ps(posY, pos.y);
+				_mm_store_ps(posZ, pos.z);
+				for (; hitMask; hitMask &= hitMask - 1) {
+					int k = CountTrailingZeros((uint32_t)hitMask);
+					Hit hit;
+					hit.box = group * 4 + k;
+					hit.hitPos = MakeVector3(posX[k], posY[k], posZ[k]);
+					hits.push_back(hit);
+				}
+			}
+		}
+#else
+		void HitBoxSet::RayCast(const Vector3 &start, const Vector3 &dir,
+		                        std::vector<Hit> &hits) const {
+			for (std::size_t i = 0; i < numBoxes; i++) {
+				Vector3 diff = centers[i] - start;
+				float c = Vector3::Dot(diff, dir);
+				float sq = diff.GetPoweredLength();
+				if (!(sqrtf(sq - c * c) < 8.f)) {
+					continue;
+				}
+
+				OBB3 box = boxes[i];
+				Hit hit;
+				if (box.RayCast(start, dir, &hit.hitPos)) {
+					hit.box = i;
+					hits.push_back(hit);
+				}
+			}
+		}
+#endif
+	} // namespace client
+} // namespace spades
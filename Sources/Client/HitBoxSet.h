@@ -0,0 +1,88 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <Core/Math.h>
+
+namespace spades {
+	namespace client {
+		/**
+		 * A set of oriented boxes (usually players' hit boxes) stored in a structure-of-arrays
+		 * layout so that a ray can be tested against four boxes at once.
+		 *
+		 * The result of testing a ray against a box is identical to `Player::RayCastApprox`
+		 * followed by `OBB3::RayCast`, including the corner cases of the latter.
+		 */
+		class HitBoxSet {
+		public:
+			struct Hit {
+				/** The index of the box returned by `AddBox`. */
+				std::size_t box;
+				Vector3 hitPos;
+			};
+
+			HitBoxSet();
+
+			void Clear();
+
+			std::size_t GetNumBoxes() const { return numBoxes; }
+
+			/**
+			 * Adds a box and returns its index. Rays passing farther than 8 units from
+			 * `center` (a player's position) never hit the box.
+			 */
+			std::size_t AddBox(const OBB3 &box, const Vector3 &center);
+
+			/**
+			 * Tests a ray against all boxes and appends the hits to `hits` in the ascending
+			 * order of box indices.
+			 */
+			void RayCast(const Vector3 &start, const Vector3 &dir, std::vector<Hit> &hits) const;
+
+		private:
+			enum Field {
+				FieldAxisX,
+				FieldAxisY = FieldAxisX + 3,
+				FieldAxisZ = FieldAxisY + 3,
+				FieldOrigin = FieldAxisZ + 3,
+				/** The squared lengths of the axes. */
+				FieldAxisLengthSq = FieldOrigin + 3,
+				/** The rows of `OBB3::m.InversedFast()` used by the inside test. */
+				FieldInverse = FieldAxisLengthSq + 3,
+				FieldCenter = FieldInverse + 12,
+				NumFields = FieldCenter + 3
+			};
+
+			std::size_t numBoxes;
+
+			/**
+			 * Groups of four boxes. The field `f` of the box `i` is stored at
+			 * `[(i / 4) * NumFields * 4 + f * 4 + i % 4]`.
+			 */
+			std::vector<float> fields;
+
+			std::vector<OBB3> boxes;
+			std::vector<Vector3> centers;
+		};
+	} // namespace client
+} // namespace spades
@@ -24,6 +24,8 @@
 #include <Core/RefCountedObject.h>
 
 namespace spades {
+	class IAudioStream;
+
 	namespace client {
 		class IAudioChunk;
 		class GameMap;
@@ -46,6 +48,16 @@ namespace spades {
 
 			virtual IAudioChunk *RegisterSound(const char *name) = 0;
 
+			/**
+			 * Same as `RegisterSound`, but uses the specified decoded sound if the sound
+			 * isn't loaded yet.
+			 *
+			 * @see MemoryAudioStream
+			 */
+			virtual IAudioChunk *RegisterPreloadedSound(const char *name, IAudioStream &) {
+				return RegisterSound(name);
+			}
+
 			/**
 			 * Clear the cache of chunks loaded via `RegisterSound`. This method
 			 * is merely a hint - the implementation may partially or completely
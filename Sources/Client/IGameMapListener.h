@@ -20,12 +20,19 @@
 
 #pragma once
 
+#include <Core/Math.h>
+
 namespace spades {
 	namespace client {
 		class GameMap;
 		class IGameMapListener {
 		public:
-			virtual void GameMapChanged(int x, int y, int z, GameMap *) = 0;
+			/**
+			 * Called by `GameMap::FlushChanges` for each box containing modified voxels.
+			 * `min` and `max` are both inclusive.
+			 */
+			virtual void GameMapChanged(const IntVector3 &min, const IntVector3 &max,
+			                            GameMap *) = 0;
 		};
 	} // namespace client
 } // namespace spades
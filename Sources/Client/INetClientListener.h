@@ -0,0 +1,73 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <string>
+
+#include <Core/Math.h>
+
+namespace spades {
+	namespace client {
+		class Player;
+		class World;
+
+		/**
+		 * Receives the game state changes and events decoded by `NetClient`.
+		 *
+		 * `Client` implements this interface to present them to the user. `NetDemoPlayer`
+		 * implements it to replay a recorded session without a renderer or an audio device.
+		 */
+		class INetClientListener {
+		public:
+			/**
+			 * Replaces the current world. The listener takes the ownership of the new world.
+			 * `nullptr` removes the current world.
+			 */
+			virtual void SetWorld(World *) = 0;
+			virtual World *GetWorld() const = 0;
+
+			virtual void MarkWorldUpdate() = 0;
+
+			virtual void PlayerSentChatMessage(Player &, bool global, const std::string &) = 0;
+			virtual void ServerSentMessage(const std::string &) = 0;
+
+			virtual void PlayerCapturedIntel(Player &) = 0;
+			virtual void PlayerCreatedBlock(Player &) = 0;
+			virtual void PlayerPickedIntel(Player &) = 0;
+			virtual void PlayerDropIntel(Player &) = 0;
+			virtual void TeamCapturedTerritory(int teamId, int territoryId) = 0;
+			virtual void TeamWon(int) = 0;
+			virtual void JoinedGame() = 0;
+			virtual void LocalPlayerCreated() = 0;
+			/**
+			 * The server corrected the position of the local player. The listener is
+			 * responsible for applying it to the local player.
+			 */
+			virtual void LocalPlayerPositionCorrected(const Vector3 &) = 0;
+			virtual void PlayerDestroyedBlockWithWeaponOrTool(IntVector3) = 0;
+			virtual void PlayerDiggedBlock(IntVector3) = 0;
+			virtual void GrenadeDestroyedBlock(IntVector3) = 0;
+			virtual void PlayerLeaving(Player &) = 0;
+			virtual void PlayerJoinedTeam(Player &) = 0;
+			virtual void PlayerSpawned(Player &) = 0;
+		};
+	} // namespace client
+} // namespace spades
@@ -19,7 +19,27 @@
  */
 
 #include "IRenderer.h"
+#include <Core/Debug.h>
+#include <Core/TMPUtils.h>
+#include <Core/VoxelModel.h>
+#include <Core/VoxelModelLoader.h>
 
 namespace spades {
-	namespace client {}
+	namespace client {
+		PreloadedModel::~PreloadedModel() {}
+
+		std::unique_ptr<PreloadedModel> IRenderer::PreloadModel(const char *filename) {
+			SPADES_MARK_FUNCTION();
+
+			auto model = stmp::make_unique<PreloadedModel>();
+			model->voxelModel = VoxelModelLoader::Load(filename);
+			return model;
+		}
+
+		std::unique_ptr<PreloadedModel> IRenderer::PreloadVoxelModel(VoxelModel &voxelModel) {
+			auto model = stmp::make_unique<PreloadedModel>();
+			model->voxelModel = voxelModel;
+			return model;
+		}
+	} // namespace client
 } // namespace spades
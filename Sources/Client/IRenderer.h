@@ -21,6 +21,8 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
+#include <memory>
 
 #include "IImage.h"
 #include "IModel.h"
@@ -95,6 +97,29 @@ namespace spades {
 			bool useLensFlare = false;
 		};
 
+		/** A sprite submitted by `IRenderer::AddSprites`. */
+		struct SpriteParam {
+			IImage *image;
+			Vector3 center;
+			float radius;
+			float rotation;
+			/** The color of the sprite. Always alpha premultiplied. */
+			Vector4 color;
+		};
+
+		/**
+		 * The result of the part of loading a model that doesn't need the rendering context.
+		 * Renderers may derive this class to store their own data (e.g., a mesh).
+		 *
+		 * @see IRenderer::PreloadModel
+		 */
+		class PreloadedModel {
+		public:
+			virtual ~PreloadedModel();
+
+			Handle<VoxelModel> voxelModel;
+		};
+
 		class IRenderer : public RefCountedObject {
 		protected:
 			virtual ~IRenderer() {}
@@ -115,9 +140,45 @@ namespace spades {
 			 */
 			virtual void ClearCache() {}
 
+			/**
+			 * Performs the CPU-bound part of `RegisterModel` (e.g., parsing the model file and
+			 * building its mesh). Unlike other methods, this method can be called from any
+			 * thread. The result is passed to `RegisterPreloadedModel`.
+			 */
+			virtual std::unique_ptr<PreloadedModel> PreloadModel(const char *filename);
+
+			/**
+			 * Same as `RegisterModel`, but uses the result of `PreloadModel` if the model
+			 * isn't loaded yet.
+			 */
+			virtual Handle<IModel> RegisterPreloadedModel(const char *filename,
+			                                              PreloadedModel &) {
+				return RegisterModel(filename);
+			}
+
+			/**
+			 * Same as `RegisterImage`, but uses the specified decoded image if the image isn't
+			 * loaded yet.
+			 */
+			virtual Handle<IImage> RegisterPreloadedImage(const char *filename, Bitmap &) {
+				return RegisterImage(filename);
+			}
+
 			virtual Handle<IImage> CreateImage(Bitmap &) = 0;
 			virtual Handle<IModel> CreateModel(VoxelModel &) = 0;
 
+			/**
+			 * Performs the CPU-bound part of `CreateModel` (e.g., building the mesh). Like
+			 * `PreloadModel`, this method can be called from any thread. The result is passed
+			 * to `CreatePreloadedModel`. The voxel model must not be modified afterward.
+			 */
+			virtual std::unique_ptr<PreloadedModel> PreloadVoxelModel(VoxelModel &);
+
+			/** Same as `CreateModel`, but uses the result of `PreloadVoxelModel`. */
+			virtual Handle<IModel> CreatePreloadedModel(PreloadedModel &preloaded) {
+				return CreateModel(*preloaded.voxelModel);
+			}
+
 			virtual void SetGameMap(stmp::optional<GameMap &>) = 0;
 
 			virtual void SetFogDistance(float) = 0;
@@ -134,6 +195,20 @@ namespace spades {
 			virtual void AddSprite(IImage &, Vector3 center, float radius, float rotation) = 0;
 			virtual void AddLongSprite(IImage &, Vector3 p1, Vector3 p2, float radius) = 0;
 
+			/**
+			 * Adds multiple sprites at once. This is much faster than calling `AddSprite` for
+			 * each sprite when there are many of them (e.g., particles).
+			 *
+			 * The color set by `SetColorAlphaPremultiplied` is unspecified after calling this.
+			 */
+			virtual void AddSprites(const SpriteParam *sprites, std::size_t numSprites) {
+				for (std::size_t i = 0; i < numSprites; ++i) {
+					const SpriteParam &sprite = sprites[i];
+					SetColorAlphaPremultiplied(sprite.color);
+					AddSprite(*sprite.image, sprite.center, sprite.radius, sprite.rotation);
+				}
+			}
+
 			/** Finalizes a scene. 2D drawing follows. */
 			virtual void EndScene() = 0;
 
@@ -19,6 +19,7 @@
 
  */
 
+#include <algorithm>
 #include <math.h>
 #include <string.h>
 #include <vector>
@@ -26,12 +27,14 @@
 #include <enet/enet.h>
 
 #include "CTFGameMode.h"
-#include "Client.h"
 #include "GameMap.h"
+#include "GameMapCache.h"
 #include "GameMapLoader.h"
 #include "GameProperties.h"
 #include "Grenade.h"
+#include "INetClientListener.h"
 #include "NetClient.h"
+#include "NetDemo.h"
 #include "Player.h"
 #include "TCGameMode.h"
 #include "World.h"
@@ -39,6 +42,8 @@
 #include <Core/Debug.h>
 #include <Core/DeflateStream.h>
 #include <Core/Exception.h>
+#include <Core/FileManager.h>
+#include <Core/IStream.h>
 #include <Core/Math.h>
 #include <Core/MemoryStream.h>
 #include <Core/Settings.h>
@@ -46,6 +51,7 @@
 #include <Core/TMPUtils.h>
 
 DEFINE_SPADES_SETTING(cg_unicode, "1");
+DEFINE_SPADES_SETTING(cg_demoRecord, "0");
 
 namespace spades {
 	namespace client {
@@ -126,7 +132,7 @@ namespace spades {
 				return str;
 			}
 
-			std::string DecodeString(std::string s) {
+			std::string DecodeString(const std::string &s) {
 				if (s.size() > 0 && s[0] == UtfSign) {
 					return s.substr(1);
 				}
@@ -134,23 +140,43 @@ namespace spades {
 			}
 		} // namespace
 
+		/**
+		 * Reads values from a received packet. The reader takes the ownership of the
+		 * `ENetPacket` and reads directly from its buffer, so no copies are made.
+		 *
+		 * A reader can also be created over a packet read from a demo. In this case, the
+		 * reader doesn't own the buffer, which must outlive the reader.
+		 */
 		class NetPacketReader {
-			std::vector<char> data;
-			size_t pos;
+			ENetPacket *packet;
+			const char *data;
+			std::size_t size;
+			std::size_t pos;
 
 		public:
-			NetPacketReader(ENetPacket *packet) {
-				SPADES_MARK_FUNCTION();
-
-				data.resize(packet->dataLength);
-				memcpy(data.data(), packet->data, packet->dataLength);
-				enet_packet_destroy(packet);
-				pos = 1;
+			NetPacketReader(ENetPacket *packet)
+			    : packet{packet},
+			      data{reinterpret_cast<const char *>(packet->data)},
+			      size{packet->dataLength},
+			      pos{1} {}
+
+			NetPacketReader(const char *data, std::size_t size)
+			    : packet{nullptr}, data{data}, size{size}, pos{1} {}
+
+			NetPacketReader(NetPacketReader &&o)
+			    : packet{o.packet}, data{o.data}, size{o.size}, pos{o.pos} {
+				o.packet = nullptr;
+				o.data = nullptr;
+				o.size = 0;
 			}
 
-			NetPacketReader(const std::vector<char> inData) {
-				data = inData;
-				pos = 1;
+			NetPacketReader(const NetPacketReader &) = delete;
+			void operator=(const NetPacketReader &) = delete;
+
+			~NetPacketReader() {
+				if (packet) {
+					enet_packet_destroy(packet);
+				}
 			}
 
 			PacketType GetType() { return (PacketType)data[0]; }
@@ -159,7 +185,7 @@ namespace spades {
 				SPADES_MARK_FUNCTION();
 
 				uint32_t value = 0;
-				if (pos + 4 > data.size()) {
+				if (pos + 4 > size) {
 					SPRaise("Received packet truncated");
 				}
 				value |= ((uint32_t)(uint8_t)data[pos++]);
@@ -173,7 +199,7 @@ namespace spades {
 				SPADES_MARK_FUNCTION();
 
 				uint32_t value = 0;
-				if (pos + 2 > data.size()) {
+				if (pos + 2 > size) {
 					SPRaise("Received packet truncated");
 				}
 				value |= ((uint32_t)(uint8_t)data[pos++]);
@@ -184,7 +210,7 @@ namespace spades {
 			uint8_t ReadByte() {
 				SPADES_MARK_FUNCTION();
 
-				if (pos >= data.size()) {
+				if (pos >= size) {
 					SPRaise("Received packet truncated");
 				}
 				return (uint8_t)data[pos++];
@@ -218,44 +244,40 @@ namespace spades {
 				return col;
 			}
 
-			std::size_t GetNumRemainingBytes() { return data.size() - pos; }
+			std::size_t GetNumRemainingBytes() { return size - pos; }
 
-			std::vector<char> GetData() { return data; }
+			/** Returns the pointer to the packet contents, including the packet type. */
+			const char *GetData() { return data; }
+			/** Returns the length of the packet, including the packet type. */
+			std::size_t GetLength() { return size; }
 
-			std::string ReadData(size_t siz) {
-				if (pos + siz > data.size()) {
+			/**
+			 * Advances the read position by `siz` bytes and returns the pointer to the skipped
+			 * bytes. The pointer is valid until the reader is destroyed.
+			 */
+			const char *ReadData(size_t siz) {
+				if (pos + siz > size) {
 					SPRaise("Received packet truncated");
 				}
-				std::string s = std::string(data.data() + pos, siz);
+				const char *s = data + pos;
 				pos += siz;
 				return s;
 			}
-			std::string ReadRemainingData() {
-				return std::string(data.data() + pos, data.size() - pos);
-			}
 
 			std::string ReadString(size_t siz) {
-				// convert to C string once so that
-				// null-chars are removed
-				std::string s = ReadData(siz).c_str();
-				s = DecodeString(s);
-				return s;
-			}
-			std::string ReadRemainingString() {
-				// convert to C string once so that
-				// null-chars are removed
-				std::string s = ReadRemainingData().c_str();
-				s = DecodeString(s);
-				return s;
+				// null-chars and the following bytes are removed
+				const char *s = ReadData(siz);
+				return DecodeString(std::string(s, std::find(s, s + siz, '\0')));
 			}
+			std::string ReadRemainingString() { return ReadString(GetNumRemainingBytes()); }
 
 			void DumpDebug() {
 #if 1
 				char buf[1024];
 				std::string str;
-				sprintf(buf, "Packet 0x%02x [len=%d]", (int)GetType(), (int)data.size());
+				sprintf(buf, "Packet 0x%02x [len=%d]", (int)GetType(), (int)size);
 				str = buf;
-				int bytes = (int)data.size();
+				int bytes = (int)size;
 				if (bytes > 64) {
 					bytes = 64;
 				}
@@ -352,7 +374,8 @@ namespace spades {
 			}
 		};
 
-		NetClient::NetClient(Client *c) : client(c), host(nullptr), peer(nullptr) {
+		NetClient::NetClient(INetClientListener *c)
+		    : client(c), host(nullptr), peer(nullptr), playingDemo{false} {
 			SPADES_MARK_FUNCTION();
 
 			enet_initialize();
@@ -415,6 +438,7 @@ namespace spades {
 			SPLog("Connecting to %u:%u", (unsigned int)addr.host, (unsigned int)addr.port);
 
 			savedPackets.clear();
+			playingDemo = false;
 
 			peer = enet_host_connect(host, &addr, 1, protocolVersion);
 			if (peer == NULL) {
@@ -423,13 +447,67 @@ namespace spades {
 
 			properties.reset(new GameProperties(hostname.GetProtocolVersion()));
 
+			if (cg_demoRecord) {
+				std::string path = NetDemoWriter::GetDefaultPath(hostname);
+				try {
+					demoWriter.reset(new NetDemoWriter(FileManager::OpenForWriting(path.c_str()),
+					                                   hostname.GetProtocolVersion()));
+					SPLog("Recording a demo to '%s'", path.c_str());
+				} catch (const std::exception &ex) {
+					SPLog("Failed to open demo file '%s' (%s)", path.c_str(), ex.what());
+				}
+			}
+
 			status = NetClientStatusConnecting;
 			statusString = _Tr("NetClient", "Connecting to the server");
 		}
 
+		void NetClient::StartDemoPlayback(ProtocolVersion version) {
+			SPADES_MARK_FUNCTION();
+
+			Disconnect();
+			SPAssert(status == NetClientStatusNotConnected);
+
+			switch (version) {
+				case ProtocolVersion::v075: protocolVersion = 3; break;
+				case ProtocolVersion::v076: protocolVersion = 4; break;
+				default: SPRaise("Invalid ProtocolVersion"); break;
+			}
+
+			savedPackets.clear();
+			playingDemo = true;
+
+			properties.reset(new GameProperties(version));
+
+			status = NetClientStatusConnecting;
+			statusString = _Tr("NetClient", "Awaiting for state");
+		}
+
+		void NetClient::HandleDemoPacket(const char *data, std::size_t length) {
+			SPADES_MARK_FUNCTION();
+
+			SPAssert(playingDemo);
+			if (status == NetClientStatusNotConnected) {
+				SPRaise("Demo playback is not started");
+			}
+
+			NetPacketReader reader{data, length};
+			HandlePacket(reader);
+		}
+
 		void NetClient::Disconnect() {
 			SPADES_MARK_FUNCTION();
 
+			demoWriter.reset();
+
+			if (playingDemo) {
+				playingDemo = false;
+				status = NetClientStatusNotConnected;
+				statusString = _Tr("NetClient", "Not connected");
+				savedPackets.clear();
+				return;
+			}
+
 			if (!peer)
 				return;
 			enet_peer_disconnect(peer, 0);
@@ -492,136 +570,131 @@ namespace spades {
 					enet_peer_reset(peer);
 					peer = NULL;
 					status = NetClientStatusNotConnected;
+					demoWriter.reset();
 
 					SPLog("Disconnected (data = 0x%08x)", (unsigned int)event.data);
 					statusString = "Disconnected: " + DisconnectReasonString(event.data);
 					SPRaise("Disconnected: %s", DisconnectReasonString(event.data).c_str());
 				}
 
-				stmp::optional<NetPacketReader> readerOrNone;
-
-				if (event.type == ENET_EVENT_TYPE_RECEIVE) {
-					readerOrNone.reset(event.packet);
-					auto &reader = readerOrNone.value();
+				if (event.type == ENET_EVENT_TYPE_CONNECT) {
+					if (status == NetClientStatusConnecting) {
+						statusString = _Tr("NetClient", "Awaiting for state");
+					}
+				} else if (event.type == ENET_EVENT_TYPE_RECEIVE) {
+					NetPacketReader reader{event.packet};
 
-					try {
-						if (HandleHandshakePackets(reader)) {
-							continue;
+					if (demoWriter) {
+						try {
+							demoWriter->WritePacket(reader.GetData(), reader.GetLength());
+						} catch (const std::exception &ex) {
+							SPLog("Stopped recording the demo because of an error: %s",
+							      ex.what());
+							demoWriter.reset();
 						}
-					} catch (const std::exception &ex) {
-						int type = reader.GetType();
-						reader.DumpDebug();
-						SPRaise("Exception while handling packet type 0x%08x:\n%s", type,
-						        ex.what());
 					}
+
+					HandlePacket(reader);
 				}
+			}
+		}
 
-				if (status == NetClientStatusConnecting) {
-					if (event.type == ENET_EVENT_TYPE_CONNECT) {
-						statusString = _Tr("NetClient", "Awaiting for state");
-					} else if (event.type == ENET_EVENT_TYPE_RECEIVE) {
-						auto &reader = readerOrNone.value();
-						reader.DumpDebug();
-						if (reader.GetType() != PacketTypeMapStart) {
-							SPRaise("Unexpected packet: %d", (int)reader.GetType());
-						}
+		void NetClient::HandlePacket(NetPacketReader &reader) {
+			SPADES_MARK_FUNCTION();
 
-						auto mapSize = reader.ReadInt();
-						SPLog("Map size advertised by the server: %lu", (unsigned long)mapSize);
+			try {
+				if (HandleHandshakePackets(reader)) {
+					return;
+				}
+			} catch (const std::exception &ex) {
+				int type = reader.GetType();
+				reader.DumpDebug();
+				SPRaise("Exception while handling packet type 0x%08x:\n%s", type, ex.what());
+			}
 
-						mapLoader.reset(new GameMapLoader());
-						mapLoadMonitor.reset(new MapDownloadMonitor(*mapLoader));
+			if (status == NetClientStatusConnecting) {
+				reader.DumpDebug();
+				if (reader.GetType() != PacketTypeMapStart) {
+					SPRaise("Unexpected packet: %d", (int)reader.GetType());
+				}
 
-						status = NetClientStatusReceivingMap;
-						statusString = _Tr("NetClient", "Loading snapshot");
-					}
-				} else if (status == NetClientStatusReceivingMap) {
-					SPAssert(mapLoader);
+				BeginMapTransfer(reader);
+			} else if (status == NetClientStatusReceivingMap) {
+				SPAssert(mapLoader);
 
-					if (event.type == ENET_EVENT_TYPE_RECEIVE) {
-						auto &reader = readerOrNone.value();
+				if (reader.GetType() == PacketTypeMapChunk) {
+					mapLoader->AddRawChunk(reader.GetData() + 1, reader.GetLength() - 1);
+					mapLoadMonitor->AccumulateBytes(
+					  static_cast<unsigned int>(reader.GetLength() - 1));
+				} else {
+					reader.DumpDebug();
 
-						if (reader.GetType() == PacketTypeMapChunk) {
-							std::vector<char> dt = reader.GetData();
+					// The actual size of the map data cannot be known beforehand because
+					// of compression. This means we must detect the end of the map
+					// transfer in another way.
+					//
+					// We do this by checking for a StateData packet, which is sent
+					// directly after the map transfer completes.
+					//
+					// A number of other packets can also be received while loading the map:
+					//
+					//  - World update packets (WorldUpdate, ExistingPlayer, and
+					//    CreatePlayer) for the current round. We must store such packets
+					//    temporarily and process them later when a `World` is created.
+					//
+					//  - Leftover reload packet from the previous round. This happens when
+					//    you initiate the reload action and a map change occurs before it
+					//    is completed. In pyspades, sending a reload packet is implemented
+					//    by registering a callback function to the Twisted reactor. This
+					//    callback function sends a reload packet, but it does not check if
+					//    the current game round is finished, nor is it unregistered on a
+					//    map change.
+					//
+					//    Such a reload packet would not (and should not) have any effect on
+					//    the current round. Also, an attempt to process it would result in
+					//    an "invalid player ID" exception, so we simply drop it during
+					//    map load sequence.
+					//
+
+					if (reader.GetType() == PacketTypeStateData) {
+						status = NetClientStatusConnected;
+						statusString = _Tr("NetClient", "Connected");
 
-							mapLoader->AddRawChunk(dt.data() + 1, dt.size() - 1);
-							mapLoadMonitor->AccumulateBytes(
-							  static_cast<unsigned int>(dt.size() - 1));
-						} else {
-							reader.DumpDebug();
-
-							// The actual size of the map data cannot be known beforehand because
-							// of compression. This means we must detect the end of the map
-							// transfer in another way.
-							//
-							// We do this by checking for a StateData packet, which is sent
-							// directly after the map transfer completes.
-							//
-							// A number of other packets can also be received while loading the map:
-							//
-							//  - World update packets (WorldUpdate, ExistingPlayer, and
-							//    CreatePlayer) for the current round. We must store such packets
-							//    temporarily and process them later when a `World` is created.
-							//
-							//  - Leftover reload packet from the previous round. This happens when
-							//    you initiate the reload action and a map change occurs before it
-							//    is completed. In pyspades, sending a reload packet is implemented
-							//    by registering a callback function to the Twisted reactor. This
-							//    callback function sends a reload packet, but it does not check if
-							//    the current game round is finished, nor is it unregistered on a
-							//    map change.
-							//
-							//    Such a reload packet would not (and should not) have any effect on
-							//    the current round. Also, an attempt to process it would result in
-							//    an "invalid player ID" exception, so we simply drop it during
-							//    map load sequence.
-							//
-
-							if (reader.GetType() == PacketTypeStateData) {
-								status = NetClientStatusConnected;
-								statusString = _Tr("NetClient", "Connected");
-
-								try {
-									MapLoaded();
-								} catch (const std::exception &ex) {
-									if (strstr(ex.what(), "File truncated") ||
-									    strstr(ex.what(), "EOF reached")) {
-										SPLog("Map decoder returned error:\n%s", ex.what());
-										Disconnect();
-										statusString = _Tr("NetClient", "Error");
-										throw;
-									}
-								} catch (...) {
-									Disconnect();
-									statusString = _Tr("NetClient", "Error");
-									throw;
-								}
-								HandleGamePacket(reader);
-							} else if (reader.GetType() == PacketTypeWeaponReload) {
-								// Drop the reload packet. Pyspades does not
-								// cancel the reload packets on map change and
-								// they would cause an error if we would
-								// process them
-							} else {
-								// Save the packet for later
-								savedPackets.push_back(reader.GetData());
-							}
-						}
-					}
-				} else if (status == NetClientStatusConnected) {
-					if (event.type == ENET_EVENT_TYPE_RECEIVE) {
-						auto &reader = readerOrNone.value();
-						// reader.DumpDebug();
 						try {
-							HandleGamePacket(reader);
+							MapLoaded();
 						} catch (const std::exception &ex) {
-							int type = reader.GetType();
-							reader.DumpDebug();
-							SPRaise("Exception while handling packet type 0x%08x:\n%s", type,
-							        ex.what());
+							if (strstr(ex.what(), "File truncated") ||
+							    strstr(ex.what(), "EOF reached")) {
+								SPLog("Map decoder returned error:\n%s", ex.what());
+								Disconnect();
+								statusString = _Tr("NetClient", "Error");
+								throw;
+							}
+						} catch (...) {
+							Disconnect();
+							statusString = _Tr("NetClient", "Error");
+							throw;
 						}
+						HandleGamePacket(reader);
+					} else if (reader.GetType() == PacketTypeWeaponReload) {
+						// Drop the reload packet. Pyspades does not
+						// cancel the reload packets on map change and
+						// they would cause an error if we would
+						// process them
+					} else {
+						// Save the packet for later
+						savedPackets.emplace_back(new NetPacketReader(std::move(reader)));
 					}
 				}
+			} else if (status == NetClientStatusConnected) {
+				// reader.DumpDebug();
+				try {
+					HandleGamePacket(reader);
+				} catch (const std::exception &ex) {
+					int type = reader.GetType();
+					reader.DumpDebug();
+					SPRaise("Exception while handling packet type 0x%08x:\n%s", type, ex.what());
+				}
 			}
 		}
 
@@ -743,9 +816,11 @@ namespace spades {
 
 			switch (reader.GetType()) {
 				case PacketTypePositionData: {
-					Player &p = GetLocalPlayer();
+					// Raises an exception if there's no local player
+					GetLocalPlayer();
+
 					Vector3 pos;
-					if (reader.GetData().size() < 12) {
+					if (reader.GetLength() < 12) {
 						// sometimes 00 00 00 00 packet is sent.
 						// ignore this now
 						break;
@@ -753,7 +828,7 @@ namespace spades {
 					pos.x = reader.ReadFloat();
 					pos.y = reader.ReadFloat();
 					pos.z = reader.ReadFloat();
-					p.SetPosition(pos);
+					client->LocalPlayerPositionCorrected(pos);
 				} break;
 				case PacketTypeOrientationData: {
 					Player &p = GetLocalPlayer();
@@ -771,7 +846,7 @@ namespace spades {
 
 					client->MarkWorldUpdate();
 
-					int entries = static_cast<int>(reader.GetData().size() / bytesPerEntry);
+					int entries = static_cast<int>(reader.GetLength() / bytesPerEntry);
 					for (int i = 0; i < entries; i++) {
 						int idx = i;
 						if (protocolVersion == 4) {
@@ -810,7 +885,7 @@ namespace spades {
 							}
 						}
 					}
-					SPAssert(reader.ReadRemainingData().empty());
+					SPAssert(reader.GetNumRemainingBytes() == 0);
 				} break;
 				case PacketTypeInputData:
 					if (!GetWorld())
@@ -1263,26 +1338,9 @@ namespace spades {
 				} break;
 				case PacketTypeMapStart: {
 					// next map!
-					if (protocolVersion == 4) {
-						// The AoS 0.76 protocol allows the client to load a map from a local cache
-						// if possible. After receiving MapStart, the client should respond with
-						// MapCached to indicate whether the map with a given checksum exists in the
-						// cache or not. We don't implement a local cache, so we always ask the
-						// server to send fresh map data.
-						NetPacketWriter wri(PacketTypeMapCached);
-						wri.Write((uint8_t)0);
-						enet_peer_send(peer, 0, wri.CreatePacket());
-					}
 					client->SetWorld(NULL);
 
-					auto mapSize = reader.ReadInt();
-					SPLog("Map size advertised by the server: %lu", (unsigned long)mapSize);
-
-					mapLoader.reset(new GameMapLoader());
-					mapLoadMonitor.reset(new MapDownloadMonitor(*mapLoader));
-
-					status = NetClientStatusReceivingMap;
-					statusString = _Tr("NetClient", "Loading snapshot");
+					BeginMapTransfer(reader);
 				} break;
 				case PacketTypeMapChunk: SPRaise("Unexpected: received Map Chunk while game");
 				case PacketTypePlayerLeft: {
@@ -1479,6 +1537,13 @@ namespace spades {
 			}
 		}
 
+		void NetClient::SendPacket(NetPacketWriter &wri) {
+			if (playingDemo) {
+				return;
+			}
+			enet_peer_send(peer, 0, wri.CreatePacket());
+		}
+
 		void NetClient::SendVersionEnhanced(const std::set<std::uint8_t> &propertyIds) {
 			NetPacketWriter wri(PacketTypeExistingPlayer);
 			wri.Write((uint8_t)'x');
@@ -1515,7 +1580,7 @@ namespace spades {
 				}
 
 				wri.Update(lengthLabel, (uint8_t)(wri.GetPosition() - beginLabel));
-				enet_peer_send(peer, 0, wri.CreatePacket());
+				SendPacket(wri);
 			}
 		}
 
@@ -1537,7 +1602,7 @@ namespace spades {
 			wri.Write((uint32_t)kills);
 			wri.WriteColor(GetWorld()->GetTeam(team).color);
 			wri.Write(name, 16);
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendPosition() {
@@ -1549,7 +1614,7 @@ namespace spades {
 			wri.Write(v.x);
 			wri.Write(v.y);
 			wri.Write(v.z);
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 			// printf("> (%f %f %f)\n", v.x, v.y, v.z);
 		}
 
@@ -1560,7 +1625,7 @@ namespace spades {
 			wri.Write(v.x);
 			wri.Write(v.y);
 			wri.Write(v.z);
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 			// printf("> (%f %f %f)\n", v.x, v.y, v.z);
 		}
 
@@ -1593,7 +1658,7 @@ namespace spades {
 			wri.Write((uint8_t)GetLocalPlayer().GetId());
 			wri.Write(bits);
 
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendWeaponInput(WeaponInput inp) {
@@ -1612,7 +1677,7 @@ namespace spades {
 			wri.Write((uint8_t)GetLocalPlayer().GetId());
 			wri.Write(bits);
 
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendBlockAction(spades::IntVector3 v, BlockActionType type) {
@@ -1632,7 +1697,7 @@ namespace spades {
 			wri.Write((uint32_t)v.y);
 			wri.Write((uint32_t)v.z);
 
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendBlockLine(spades::IntVector3 v1, spades::IntVector3 v2) {
@@ -1647,7 +1712,7 @@ namespace spades {
 			wri.Write((uint32_t)v2.y);
 			wri.Write((uint32_t)v2.z);
 
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendReload() {
@@ -1661,7 +1726,7 @@ namespace spades {
 			wri.Write((uint8_t)255); // clip_ammo; not used?
 			wri.Write((uint8_t)255); // reserve_ammo; not used?
 
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendHeldBlockColor() {
@@ -1670,7 +1735,7 @@ namespace spades {
 			wri.Write((uint8_t)GetLocalPlayer().GetId());
 			IntVector3 v = GetLocalPlayer().GetBlockColor();
 			wri.WriteColor(v);
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendTool() {
@@ -1685,7 +1750,7 @@ namespace spades {
 				default: SPInvalidEnum("tool", GetLocalPlayer().GetTool());
 			}
 
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendGrenade(const Grenade &g) {
@@ -1704,7 +1769,7 @@ namespace spades {
 			wri.Write(v.x);
 			wri.Write(v.y);
 			wri.Write(v.z);
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendHit(int targetPlayerId, HitType type) {
@@ -1720,7 +1785,7 @@ namespace spades {
 				case HitTypeMelee: wri.Write((uint8_t)4); break;
 				default: SPInvalidEnum("type", type);
 			}
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendChat(std::string text, bool global) {
@@ -1730,7 +1795,7 @@ namespace spades {
 			wri.Write((uint8_t)(global ? 0 : 1));
 			wri.Write(text);
 			wri.Write((uint8_t)0);
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendWeaponChange(WeaponType wt) {
@@ -1742,7 +1807,7 @@ namespace spades {
 				case SMG_WEAPON: wri.Write((uint8_t)1); break;
 				case SHOTGUN_WEAPON: wri.Write((uint8_t)2); break;
 			}
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendTeamChange(int team) {
@@ -1750,7 +1815,7 @@ namespace spades {
 			NetPacketWriter wri(PacketTypeChangeTeam);
 			wri.Write((uint8_t)GetLocalPlayer().GetId());
 			wri.Write((uint8_t)team);
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendHandShakeValid(int challenge) {
@@ -1758,7 +1823,7 @@ namespace spades {
 			NetPacketWriter wri(PacketTypeHandShakeReturn);
 			wri.Write((uint32_t)challenge);
 			SPLog("Sending hand shake back.");
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendVersion() {
@@ -1770,7 +1835,7 @@ namespace spades {
 			wri.Write((uint8_t)OpenSpades_VERSION_REVISION);
 			wri.Write(VersionInfo::GetVersionInfo());
 			SPLog("Sending version back.");
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
 		}
 
 		void NetClient::SendSupportedExtensions() {
@@ -1782,7 +1847,63 @@ namespace spades {
 				wri.Write(static_cast<uint8_t>(i.second)); // ext version
 			}
 			SPLog("Sending extension support.");
-			enet_peer_send(peer, 0, wri.CreatePacket());
+			SendPacket(wri);
+		}
+
+		GameMapCache *NetClient::GetMapCache() {
+			// A demo playback decodes the map every time so that it's reproducible and
+			// leaves nothing behind
+			if (playingDemo) {
+				return nullptr;
+			}
+			return GameMapCache::GetInstance();
+		}
+
+		void NetClient::BeginMapTransfer(NetPacketReader &reader) {
+			SPADES_MARK_FUNCTION();
+
+			auto mapSize = reader.ReadInt();
+			SPLog("Map size advertised by the server: %lu", (unsigned long)mapSize);
+
+			GameMapCache *cache = GetMapCache();
+			Handle<GameMap> cachedMap;
+
+			mapChecksum.reset();
+			if (protocolVersion == 4) {
+				// The AoS 0.76 protocol allows the client to load a map from a local cache
+				// if possible. After receiving MapStart, the client should respond with
+				// MapCached to indicate whether the map with a given checksum exists in the
+				// cache or not.
+				if (reader.GetNumRemainingBytes() >= 4) {
+					mapChecksum = reader.ReadInt();
+
+					// A demo must contain the map data, so don't let the server skip it
+					if (cache && !demoWriter) {
+						auto digest = cache->FindByChecksum(*mapChecksum, mapSize);
+						if (digest) {
+							cachedMap = cache->Load(*digest);
+						}
+					}
+				}
+
+				NetPacketWriter wri(PacketTypeMapCached);
+				wri.Write((uint8_t)(cachedMap ? 1 : 0));
+				SendPacket(wri);
+			}
+
+			if (cachedMap) {
+				mapLoader.reset(new GameMapLoader(std::move(cachedMap)));
+			} else if (cache) {
+				// The server doesn't know about our cache, but we can still skip decoding if the
+				// map data turns out to be identical to a cached one
+				mapLoader.reset(new GameMapLoader(*cache, mapSize));
+			} else {
+				mapLoader.reset(new GameMapLoader());
+			}
+			mapLoadMonitor.reset(new MapDownloadMonitor(*mapLoader));
+
+			status = NetClientStatusReceivingMap;
+			statusString = _Tr("NetClient", "Loading snapshot");
 		}
 
 		void NetClient::MapLoaded() {
@@ -1801,6 +1922,15 @@ namespace spades {
 			GameMap *map = mapLoader->TakeGameMap().Unmanage();
 			SPLog("The game map was decoded successfully.");
 
+			GameMapCache *cache = GetMapCache();
+			if (cache && !mapLoader->IsLoadedFromCache()) {
+				try {
+					cache->Store(mapLoader->GetStreamDigest(), mapChecksum, *map);
+				} catch (const std::exception &ex) {
+					SPLog("Failed to store the game map to the map cache: %s", ex.what());
+				}
+			}
+
 			// now initialize world
 			World *w = new World(properties);
 			w->SetMap(map);
@@ -1818,8 +1948,7 @@ namespace spades {
 			// do saved packets
 			try {
 				for (size_t i = 0; i < savedPackets.size(); i++) {
-					NetPacketReader r(savedPackets[i]);
-					HandleGamePacket(r);
+					HandleGamePacket(*savedPackets[i]);
 				}
 				savedPackets.clear();
 				SPLog("Done.");
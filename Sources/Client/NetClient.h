@@ -34,6 +34,7 @@
 #include <Core/Math.h>
 #include <Core/ServerAddress.h>
 #include <Core/Stopwatch.h>
+#include <Core/TMPUtils.h>
 #include <Core/VersionInfo.h>
 #include <OpenSpades.h>
 
@@ -44,7 +45,7 @@ typedef _ENetPeer ENetPeer;
 
 namespace spades {
 	namespace client {
-		class Client;
+		class INetClientListener;
 		class Player;
 		enum NetClientStatus {
 			NetClientStatusNotConnected = 0,
@@ -61,14 +62,17 @@ namespace spades {
 
 		class World;
 		class NetPacketReader;
+		class NetPacketWriter;
+		class NetDemoWriter;
 		struct PlayerInput;
 		struct WeaponInput;
 		class Grenade;
 		struct GameProperties;
+		class GameMapCache;
 		class GameMapLoader;
 
 		class NetClient {
-			Client *client;
+			INetClientListener *client;
 			NetClientStatus status;
 			ENetHost *host;
 			ENetPeer *peer;
@@ -91,6 +95,8 @@ namespace spades {
 			std::unique_ptr<GameMapLoader> mapLoader;
 			/** Only valid in the `NetClientStatusReceivingMap` state */
 			std::unique_ptr<MapDownloadMonitor> mapLoadMonitor;
+			/** The map checksum sent by the server (AoS 0.76 only). */
+			stmp::optional<std::uint32_t> mapChecksum;
 
 			std::shared_ptr<GameProperties> properties;
 
@@ -121,7 +127,7 @@ namespace spades {
 			std::vector<Vector3> savedPlayerFront;
 			std::vector<int> savedPlayerTeam;
 
-			std::vector<std::vector<char>> savedPackets;
+			std::vector<std::unique_ptr<NetPacketReader>> savedPackets;
 
 			int timeToTryMapLoad;
 			bool tryMapLoadOnPacketType;
@@ -132,6 +138,13 @@ namespace spades {
 			// used for some scripts including Arena by Yourself
 			IntVector3 temporaryPlayerBlockColor;
 
+			/** Records the received packets if `cg_demoRecord` is enabled. */
+			std::unique_ptr<NetDemoWriter> demoWriter;
+			/** `true` if the packets come from `HandleDemoPacket` instead of a server. */
+			bool playingDemo;
+
+			/** Handles a packet received from the server or read from a demo. */
+			void HandlePacket(NetPacketReader &);
 			bool HandleHandshakePackets(NetPacketReader &);
 			void HandleExtensionPacket(NetPacketReader &);
 			void HandleGamePacket(NetPacketReader &);
@@ -143,14 +156,21 @@ namespace spades {
 
 			std::string DisconnectReasonString(uint32_t);
 
+			/** Handles `PacketTypeMapStart` and prepares for receiving the map data. */
+			void BeginMapTransfer(NetPacketReader &);
 			void MapLoaded();
+			/** Returns the map cache to use, or `nullptr` if it shouldn't be used. */
+			GameMapCache *GetMapCache();
+
+			/** Sends a packet to the server. Does nothing while playing a demo. */
+			void SendPacket(NetPacketWriter &);
 
 			void SendVersion();
 			void SendVersionEnhanced(const std::set<std::uint8_t> &propertyIds);
 			void SendSupportedExtensions();
 
 		public:
-			NetClient(Client *);
+			NetClient(INetClientListener *);
 			~NetClient();
 
 			NetClientStatus GetStatus() { return status; }
@@ -177,6 +197,18 @@ namespace spades {
 			void Connect(const ServerAddress &hostname);
 			void Disconnect();
 
+			/**
+			 * Prepares for replaying a recorded session with `HandleDemoPacket` instead of
+			 * connecting to a server. Nothing is sent during the playback.
+			 */
+			void StartDemoPlayback(ProtocolVersion);
+
+			/**
+			 * Handles a packet read from a demo. The packet data must remain valid until the
+			 * playback ends because some packets are kept until the map is loaded.
+			 */
+			void HandleDemoPacket(const char *data, std::size_t length);
+
 			int GetPing();
 
 			void DoEvents(int timeout = 0);
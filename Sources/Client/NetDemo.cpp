@@ -0,0 +1,287 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "GameMap.h"
+#include "NetClient.h"
+#include "NetDemo.h"
+#include "Player.h"
+#include "World.h"
+#include <Core/Debug.h>
+#include <Core/Exception.h>
+#include <Core/IStream.h>
+
+namespace spades {
+	namespace client {
+		namespace {
+			const char Magic[6] = {'S', 'P', 'D', 'E', 'M', 'O'};
+			constexpr std::uint8_t FormatVersion = 1;
+			constexpr std::size_t HeaderSize = sizeof(Magic) + 2;
+
+			/** Matches the fixed time step used by `Client`. */
+			constexpr float FrameStep = 1.f / 60.f;
+
+			// 64-bit FNV-1a
+			constexpr std::uint64_t HashInitialValue = 0xcbf29ce484222325ULL;
+			constexpr std::uint64_t HashPrime = 0x100000001b3ULL;
+
+			void WriteVarint(std::string &buffer, std::uint64_t value) {
+				while (value >= 0x80) {
+					buffer.push_back(static_cast<char>((value & 0x7f) | 0x80));
+					value >>= 7;
+				}
+				buffer.push_back(static_cast<char>(value));
+			}
+
+			template <class T> void HashValue(std::uint64_t &hash, const T &value) {
+				unsigned char bytes[sizeof(T)];
+				std::memcpy(bytes, &value, sizeof(T));
+				for (unsigned char b : bytes) {
+					hash = (hash ^ b) * HashPrime;
+				}
+			}
+		} // namespace
+
+#pragma mark - NetDemoWriter
+
+		NetDemoWriter::NetDemoWriter(std::unique_ptr<IStream> stream, ProtocolVersion version)
+		    : stream{std::move(stream)}, lastTime{0} {
+			SPADES_MARK_FUNCTION();
+
+			buffer.assign(Magic, sizeof(Magic));
+			buffer.push_back(static_cast<char>(FormatVersion));
+			buffer.push_back(static_cast<char>(version));
+			this->stream->Write(buffer);
+		}
+
+		NetDemoWriter::~NetDemoWriter() {}
+
+		void NetDemoWriter::WritePacket(const char *data, std::size_t length) {
+			SPADES_MARK_FUNCTION();
+
+			// `Stopwatch` is monotonic, but a rounding must not make the delta negative
+			auto time = static_cast<std::uint64_t>(stopwatch.GetTime() * 1000.0);
+			time = std::max(time, lastTime);
+
+			buffer.clear();
+			WriteVarint(buffer, time - lastTime);
+			WriteVarint(buffer, length);
+			buffer.append(data, length);
+			stream->Write(buffer);
+
+			lastTime = time;
+		}
+
+		std::string NetDemoWriter::GetDefaultPath(const ServerAddress &address) {
+			// Named in the same way as the netlogs
+			std::string path;
+			{
+				time_t t;
+				struct tm tm;
+				::time(&t);
+				tm = *localtime(&t);
+				char buf[256];
+				sprintf(buf, "%04d%02d%02d%02d%02d%02d_", tm.tm_year + 1900, tm.tm_mon + 1,
+				        tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+				path = buf;
+			}
+			for (char c : address.ToString(false)) {
+				if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+					path += c;
+				} else {
+					path += '_';
+				}
+			}
+			return "Demos/" + path + ".demo";
+		}
+
+#pragma mark - NetDemoReader
+
+		NetDemoReader::NetDemoReader(const char *data, std::size_t size)
+		    : data{data}, size{size}, pos{HeaderSize}, time{0} {
+			SPADES_MARK_FUNCTION();
+
+			if (size < HeaderSize || std::memcmp(data, Magic, sizeof(Magic)) != 0) {
+				SPRaise("Not a demo file");
+			}
+
+			auto formatVersion = static_cast<std::uint8_t>(data[sizeof(Magic)]);
+			if (formatVersion != FormatVersion) {
+				SPRaise("Unsupported demo format version: %d", static_cast<int>(formatVersion));
+			}
+
+			protocolVersion = static_cast<ProtocolVersion>(data[sizeof(Magic) + 1]);
+			if (protocolVersion != ProtocolVersion::v075 &&
+			    protocolVersion != ProtocolVersion::v076) {
+				SPRaise("Invalid protocol version in the demo: %d",
+				        static_cast<int>(protocolVersion));
+			}
+		}
+
+		bool NetDemoReader::ReadVarint(std::uint64_t &value) {
+			value = 0;
+			for (int shift = 0; shift < 64; shift += 7) {
+				if (pos >= size) {
+					return false;
+				}
+				auto b = static_cast<std::uint8_t>(data[pos++]);
+				value |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+				if (!(b & 0x80)) {
+					return true;
+				}
+			}
+			SPRaise("Malformed varint in the demo at offset %llu",
+			        static_cast<unsigned long long>(pos));
+		}
+
+		bool NetDemoReader::ReadPacket(Packet &packet) {
+			SPADES_MARK_FUNCTION();
+
+			if (pos >= size) {
+				return false;
+			}
+
+			std::size_t recordStart = pos;
+			std::uint64_t timeDelta, length;
+			if (!ReadVarint(timeDelta) || !ReadVarint(length) || length > size - pos) {
+				// The client might have been terminated while recording
+				SPLog("The demo is truncated at offset %llu",
+				      static_cast<unsigned long long>(recordStart));
+				pos = size;
+				return false;
+			}
+			if (length == 0) {
+				SPRaise("Empty packet in the demo at offset %llu",
+				        static_cast<unsigned long long>(recordStart));
+			}
+
+			time += timeDelta;
+			packet.time = static_cast<double>(time) / 1000.0;
+			packet.data = data + pos;
+			packet.length = static_cast<std::size_t>(length);
+			pos += packet.length;
+			return true;
+		}
+
+#pragma mark - NetDemoPlayer
+
+		NetDemoPlayer::NetDemoPlayer(const char *data, std::size_t size)
+		    : data{data}, size{size} {}
+
+		NetDemoPlayer::~NetDemoPlayer() {}
+
+		void NetDemoPlayer::SetWorld(World *w) { world.reset(w); }
+
+		void NetDemoPlayer::LocalPlayerPositionCorrected(const Vector3 &pos) {
+			// The recorded session is replayed without prediction
+			world->GetLocalPlayer()->SetPosition(pos);
+		}
+
+		NetDemoPlayer::Statistics NetDemoPlayer::Run() {
+			SPADES_MARK_FUNCTION();
+
+			Statistics stats;
+			Stopwatch wallClock;
+
+			NetDemoReader reader{data, size};
+			NetClient net{this};
+			net.StartDemoPlayback(reader.GetProtocolVersion());
+
+			// The demo time up to which the world has been advanced
+			double worldTime = 0.0;
+			World *lastWorld = nullptr;
+
+			NetDemoReader::Packet packet;
+			while (reader.ReadPacket(packet)) {
+				if (world) {
+					Stopwatch sw;
+					while (worldTime + FrameStep <= packet.time) {
+						world->Advance(FrameStep);
+						worldTime += FrameStep;
+						++stats.numFrames;
+					}
+					stats.advanceTime += sw.GetTime();
+				}
+
+				bool wasReceivingMap = net.GetStatus() == NetClientStatusReceivingMap;
+				Stopwatch sw;
+				net.HandleDemoPacket(packet.data, packet.length);
+				if (wasReceivingMap && net.GetStatus() == NetClientStatusConnected) {
+					// The StateData packet that completed the map transfer
+					stats.mapLoadTime += sw.GetTime();
+				} else {
+					stats.packetTime += sw.GetTime();
+				}
+
+				if (world.get() != lastWorld) {
+					// A new world starts from the current time like `Client::SetWorld` does
+					lastWorld = world.get();
+					worldTime = packet.time;
+				}
+
+				++stats.numPackets;
+				stats.numBytes += packet.length;
+				stats.demoDuration = packet.time;
+			}
+
+			stats.wallTime = wallClock.GetTime();
+			stats.worldDigest = ComputeWorldDigest();
+			return stats;
+		}
+
+		std::uint64_t NetDemoPlayer::ComputeWorldDigest() {
+			SPADES_MARK_FUNCTION();
+
+			if (!world) {
+				return 0;
+			}
+
+			std::uint64_t hash = HashInitialValue;
+
+			for (std::size_t i = 0; i < world->GetNumPlayerSlots(); ++i) {
+				auto player = world->GetPlayer(static_cast<unsigned int>(i));
+				if (!player) {
+					continue;
+				}
+				Vector3 pos = player->GetPosition();
+				HashValue(hash, static_cast<std::uint32_t>(i));
+				HashValue(hash, player->GetTeamId());
+				HashValue(hash, player->GetHealth());
+				HashValue(hash, pos.x);
+				HashValue(hash, pos.y);
+				HashValue(hash, pos.z);
+			}
+
+			// The colors aren't hashed because the hidden voxels get random colors
+			const Handle<GameMap> &map = world->GetMap();
+			for (int x = 0; x < map->Width(); ++x) {
+				for (int y = 0; y < map->Height(); ++y) {
+					HashValue(hash, map->GetSolidMapWrapped(x, y));
+				}
+			}
+
+			return hash;
+		}
+	} // namespace client
+} // namespace spades
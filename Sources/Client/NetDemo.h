@@ -0,0 +1,163 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "INetClientListener.h"
+#include <Core/ServerAddress.h>
+#include <Core/Stopwatch.h>
+
+namespace spades {
+	class IStream;
+
+	namespace client {
+		class World;
+
+		/*
+		 * A demo file holds the packets received from a server, including the map transfer,
+		 * in the order they were received. It consists of a header followed by records, each
+		 * of which holds a single packet:
+		 *
+		 *     header: "SPDEMO" (6 bytes), format version (1 byte), protocol version (1 byte)
+		 *     record: time delta in milliseconds (varint), packet length (varint),
+		 *             packet bytes (including the packet type)
+		 *
+		 * Varints are unsigned LEB128. The time delta of the first record is measured from
+		 * the start of the recording.
+		 */
+
+		/** Records the packets received by `NetClient` to a demo file. */
+		class NetDemoWriter {
+		public:
+			NetDemoWriter(std::unique_ptr<IStream> stream, ProtocolVersion);
+			~NetDemoWriter();
+
+			/** Appends a packet received now. */
+			void WritePacket(const char *data, std::size_t length);
+
+			/** Returns the path of a new demo file for a connection to the specified server. */
+			static std::string GetDefaultPath(const ServerAddress &);
+
+		private:
+			std::unique_ptr<IStream> stream;
+			Stopwatch stopwatch;
+			std::uint64_t lastTime;
+			std::string buffer;
+		};
+
+		/** Reads the packets from a demo file in memory. */
+		class NetDemoReader {
+		public:
+			struct Packet {
+				/** The time the packet was received, in seconds since the recording started. */
+				double time;
+				const char *data;
+				std::size_t length;
+			};
+
+			/** Reads the header. The data must outlive the reader and the packets read. */
+			NetDemoReader(const char *data, std::size_t size);
+
+			ProtocolVersion GetProtocolVersion() const { return protocolVersion; }
+
+			/** Reads the next packet. Returns `false` at the end of the demo. */
+			bool ReadPacket(Packet &);
+
+		private:
+			const char *data;
+			std::size_t size;
+			std::size_t pos;
+			ProtocolVersion protocolVersion;
+			std::uint64_t time;
+
+			bool ReadVarint(std::uint64_t &);
+		};
+
+		/**
+		 * Replays a demo through `NetClient` without a renderer or an audio device, as fast as
+		 * possible. The world is advanced in the same fixed time steps as `Client` does,
+		 * following the recorded timestamps.
+		 */
+		class NetDemoPlayer : public INetClientListener {
+		public:
+			struct Statistics {
+				std::size_t numPackets = 0;
+				std::uint64_t numBytes = 0;
+				/** The recorded duration of the session, in seconds. */
+				double demoDuration = 0.0;
+				/** The wall-clock time taken to replay the demo, in seconds. */
+				double wallTime = 0.0;
+				/** The time spent in the StateData packet handler, including the map decoding. */
+				double mapLoadTime = 0.0;
+				/** The time spent in the other packet handlers. */
+				double packetTime = 0.0;
+				/** The time spent in `World::Advance`. */
+				double advanceTime = 0.0;
+				std::uint64_t numFrames = 0;
+				/**
+				 * A hash of the final player positions and states and the final map shape.
+				 * A change in it indicates that a code change affected the simulation.
+				 */
+				std::uint64_t worldDigest = 0;
+			};
+
+			/** The demo data must outlive the player. */
+			NetDemoPlayer(const char *data, std::size_t size);
+			~NetDemoPlayer();
+
+			Statistics Run();
+
+			void SetWorld(World *) override;
+			World *GetWorld() const override { return world.get(); }
+			void MarkWorldUpdate() override {}
+
+			void PlayerSentChatMessage(Player &, bool, const std::string &) override {}
+			void ServerSentMessage(const std::string &) override {}
+
+			void PlayerCapturedIntel(Player &) override {}
+			void PlayerCreatedBlock(Player &) override {}
+			void PlayerPickedIntel(Player &) override {}
+			void PlayerDropIntel(Player &) override {}
+			void TeamCapturedTerritory(int, int) override {}
+			void TeamWon(int) override {}
+			void JoinedGame() override {}
+			void LocalPlayerCreated() override {}
+			void LocalPlayerPositionCorrected(const Vector3 &) override;
+			void PlayerDestroyedBlockWithWeaponOrTool(IntVector3) override {}
+			void PlayerDiggedBlock(IntVector3) override {}
+			void GrenadeDestroyedBlock(IntVector3) override {}
+			void PlayerLeaving(Player &) override {}
+			void PlayerJoinedTeam(Player &) override {}
+			void PlayerSpawned(Player &) override {}
+
+		private:
+			const char *data;
+			std::size_t size;
+			std::unique_ptr<World> world;
+
+			std::uint64_t ComputeWorldDigest();
+		};
+	} // namespace client
+} // namespace spades
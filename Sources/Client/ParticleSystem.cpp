@@ -0,0 +1,461 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+
+#include "GameMap.h"
+#include "IImage.h"
+#include "ParticleSystem.h"
+#include <Core/Debug.h>
+#include <Core/Exception.h>
+#include <Core/SIMD.h>
+#include <Core/ThreadPool.h>
+
+namespace spades {
+	namespace client {
+		namespace {
+			/** Removes the elements of `v` whose `alive` flags are zero, starting from `first`. */
+			template <class T>
+			void RemoveDead(std::vector<T> &v, const std::vector<std::uint8_t> &alive,
+			                std::size_t first) {
+				// Particles die randomly, so a branch here would be mispredicted very often
+				std::size_t j = first;
+				for (std::size_t i = first; i < v.size(); ++i) {
+					v[j] = v[i];
+					j += alive[i];
+				}
+				v.resize(j);
+			}
+		} // namespace
+
+#pragma mark - ParticleParam
+
+		ParticleParam::ParticleParam(IImage &image, Vector4 color)
+		    : ParticleParam(&image, color, 0.f, SmokeType::Steady) {}
+
+		ParticleParam::ParticleParam(Vector4 color, float fps, SmokeType type)
+		    : ParticleParam(nullptr, color, fps, type) {}
+
+		ParticleParam::ParticleParam(IImage *image, Vector4 color, float fps, SmokeType type)
+		    : image{image},
+		      smokeType{type},
+		      fps{fps},
+		      color{color},
+		      additive{false},
+		      blockHitAction{BlockHitAction::Delete},
+		      position{0, 0, 0},
+		      velocity{0, 0, 0},
+		      radius{1.f},
+		      radiusVelocity{0.f},
+		      angle{0.f},
+		      rotationVelocity{0.f},
+		      velocityDamp{1.f},
+		      radiusDamp{1.f},
+		      gravityScale{1.f},
+		      lifetime{1.f},
+		      fadeInDuration{.1f},
+		      fadeOutDuration{.5f} {}
+
+		void ParticleParam::SetLifeTime(float lifeTime, float fadeIn, float fadeOut) {
+			lifetime = lifeTime;
+			fadeInDuration = fadeIn;
+			fadeOutDuration = fadeOut;
+		}
+
+		void ParticleParam::SetTrajectory(Vector3 pos, Vector3 vel, float damp, float grav) {
+			position = pos;
+			velocity = vel;
+			velocityDamp = damp;
+			gravityScale = grav;
+		}
+
+		void ParticleParam::SetRotation(float initialAngle, float angleVelocity) {
+			angle = initialAngle;
+			rotationVelocity = angleVelocity;
+		}
+
+		void ParticleParam::SetRadius(float initialRadius, float radiusVelocity, float damp) {
+			radius = initialRadius;
+			this->radiusVelocity = radiusVelocity;
+			radiusDamp = damp;
+		}
+
+#pragma mark - ParticleSystem
+
+		ParticleSystem::ParticleSystem(IRenderer &renderer)
+		    : renderer(renderer), lastImageIndex{0}, numDeadParticles{0} {
+			SPADES_MARK_FUNCTION();
+
+			for (int i = 0; i < NumSteadySmokeFrames; i++) {
+				char buf[256];
+				std::snprintf(buf, sizeof(buf), "Textures/Smoke1/%03d.png", i);
+				images.push_back(renderer.RegisterImage(buf));
+			}
+			for (int i = 0; i < NumExplosionSmokeFrames; i++) {
+				char buf[256];
+				std::snprintf(buf, sizeof(buf), "Textures/Smoke2/%03d.png", i);
+				images.push_back(renderer.RegisterImage(buf));
+			}
+		}
+
+		ParticleSystem::~ParticleSystem() {}
+
+		std::uint16_t ParticleSystem::FindImage(IImage &image) {
+			// Spawners usually emit many particles with the same image in a row
+			if (lastImageIndex < images.size() &&
+			    images[lastImageIndex].GetPointerOrNull() == &image) {
+				return static_cast<std::uint16_t>(lastImageIndex);
+			}
+
+			auto it = std::find_if(images.begin(), images.end(), [&](const Handle<IImage> &h) {
+				return h.GetPointerOrNull() == &image;
+			});
+			if (it == images.end()) {
+				if (images.size() > 0xffff) {
+					SPRaise("Too many particle images");
+				}
+				it = images.insert(images.end(), Handle<IImage>{image});
+			}
+			lastImageIndex = it - images.begin();
+			return static_cast<std::uint16_t>(lastImageIndex);
+		}
+
+		void ParticleSystem::Spawn(const ParticleParam &param) {
+			SPADES_MARK_FUNCTION_DEBUG();
+
+			std::uint8_t flag = static_cast<std::uint8_t>(param.blockHitAction);
+			std::uint16_t imageIndex;
+			if (param.image) {
+				imageIndex = FindImage(*param.image);
+			} else {
+				flag |= FlagSmoke;
+				imageIndex = 0;
+				if (param.smokeType == ParticleParam::SmokeType::Explosion) {
+					flag |= FlagExplosionSmoke;
+					imageIndex = NumSteadySmokeFrames;
+				}
+			}
+			if (param.additive) {
+				flag |= FlagAdditive;
+			}
+
+			positionX.push_back(param.position.x);
+			positionY.push_back(param.position.y);
+			positionZ.push_back(param.position.z);
+			velocityX.push_back(param.velocity.x);
+			velocityY.push_back(param.velocity.y);
+			velocityZ.push_back(param.velocity.z);
+			radius.push_back(param.radius);
+			radiusVelocity.push_back(param.radiusVelocity);
+			angle.push_back(param.angle);
+			rotationVelocity.push_back(param.rotationVelocity);
+			velocityDamp.push_back(param.velocityDamp);
+			radiusDamp.push_back(param.radiusDamp);
+			gravityScale.push_back(param.gravityScale);
+			time.push_back(0.f);
+			lifetime.push_back(param.lifetime);
+			fadeInDuration.push_back(param.fadeInDuration);
+			fadeOutDuration.push_back(param.fadeOutDuration);
+			frame.push_back(0.f);
+			fps.push_back(param.fps);
+			color.push_back(param.color);
+			imageIndices.push_back(imageIndex);
+			flags.push_back(flag);
+			alive.push_back(1);
+		}
+
+		void ParticleSystem::Update(float dt, const GameMap *map) {
+			SPADES_MARK_FUNCTION();
+
+			std::size_t numParticles = alive.size();
+			std::size_t numBatches = (numParticles + BatchSize - 1) / BatchSize;
+			if (numBatches <= 1) {
+				numDeadParticles = numBatches ? UpdateBatch(0, numParticles, dt, map) : 0;
+			} else {
+				std::atomic<std::size_t> numDead{0};
+				ThreadPool::GetGlobalPool().ParallelFor(
+				  0, numBatches, 1, [this, dt, map, numParticles, &numDead](std::size_t batch) {
+					  numDead.fetch_add(UpdateBatch(
+					    batch * BatchSize,
+					    std::min<std::size_t>((batch + 1) * BatchSize, numParticles), dt, map));
+				  });
+				numDeadParticles = numDead.load();
+			}
+
+			// Removing particles touches every array, so it's done only occasionally. Expired
+			// particles are kept updated in the meantime because it's cheaper than skipping
+			// them.
+			if (numDeadParticles * 4 > numParticles) {
+				RemoveDeadParticles();
+			}
+		}
+
+		std::size_t ParticleSystem::UpdateBatch(std::size_t begin, std::size_t end, float dt,
+		                                        const GameMap *map) {
+			const std::size_t count = end - begin;
+			SPAssert(count <= BatchSize);
+
+			float *const px = positionX.data() + begin;
+			float *const py = positionY.data() + begin;
+			float *const pz = positionZ.data() + begin;
+			float *const vx = velocityX.data() + begin;
+			float *const vy = velocityY.data() + begin;
+			float *const vz = velocityZ.data() + begin;
+			float *const rad = radius.data() + begin;
+			float *const radVel = radiusVelocity.data() + begin;
+			float *const ang = angle.data() + begin;
+			float *const angVel = rotationVelocity.data() + begin;
+			const float *const grav = gravityScale.data() + begin;
+
+			// Lifetime and smoke animation
+			for (std::size_t i = begin; i < end; ++i) {
+				if (flags[i] & FlagSmoke) {
+					float f = frame[i] + dt * fps[i];
+					if (flags[i] & FlagExplosionSmoke) {
+						if (f > NumExplosionSmokeFrames - 1) {
+							alive[i] = 0;
+							continue;
+						}
+						imageIndices[i] =
+						  static_cast<std::uint16_t>(NumSteadySmokeFrames + (int)floorf(f));
+					} else {
+						f = fmodf(f, static_cast<float>(NumSteadySmokeFrames));
+						imageIndices[i] = static_cast<std::uint16_t>((int)floorf(f));
+					}
+					frame[i] = f;
+				}
+
+				time[i] += dt;
+				if (time[i] > lifetime[i]) {
+					alive[i] = 0;
+				}
+			}
+
+			// Integrate the motion of all particles in the batch
+			float lastX[BatchSize], lastY[BatchSize], lastZ[BatchSize];
+			std::size_t i = 0;
+#if SPADES_ENABLE_SSE2
+			{
+				const __m128 dtv = _mm_set1_ps(dt);
+				const __m128 gravityDt = _mm_set1_ps(32.f * dt);
+				for (; i + 4 <= count; i += 4) {
+					__m128 x = _mm_loadu_ps(px + i);
+					__m128 y = _mm_loadu_ps(py + i);
+					__m128 z = _mm_loadu_ps(pz + i);
+					_mm_storeu_ps(lastX + i, x);
+					_mm_storeu_ps(lastY + i, y);
+					_mm_storeu_ps(lastZ + i, z);
+
+					__m128 velZ = _mm_loadu_ps(vz + i);
+					_mm_storeu_ps(px + i, _mm_add_ps(x, _mm_mul_ps(_mm_loadu_ps(vx + i), dtv)));
+					_mm_storeu_ps(py + i, _mm_add_ps(y, _mm_mul_ps(_mm_loadu_ps(vy + i), dtv)));
+					_mm_storeu_ps(pz + i, _mm_add_ps(z, _mm_mul_ps(velZ, dtv)));
+					_mm_storeu_ps(vz + i,
+					              _mm_add_ps(velZ, _mm_mul_ps(gravityDt, _mm_loadu_ps(grav + i))));
+				}
+			}
+#endif
+			for (; i < count; ++i) {
+				lastX[i] = px[i];
+				lastY[i] = py[i];
+				lastZ[i] = pz[i];
+				px[i] += vx[i] * dt;
+				py[i] += vy[i] * dt;
+				pz[i] += vz[i] * dt;
+				vz[i] += 32.f * dt * grav[i];
+			}
+
+			// Test all particles against the map at once, and then resolve the collisions
+			// of the ones that hit a block
+			if (map) {
+				std::uint8_t hit[BatchSize];
+				map->ClipWorld(px, py, pz, hit, count);
+
+				for (i = 0; i < count; ++i) {
+					if (!hit[i] || !alive[begin + i]) {
+						continue;
+					}
+
+					auto action =
+					  static_cast<BlockHitAction>(flags[begin + i] & FlagsBlockHitActionMask);
+					if (action == BlockHitAction::Ignore) {
+						continue;
+					} else if (action == BlockHitAction::Delete) {
+						alive[begin + i] = 0;
+						continue;
+					}
+
+					IntVector3 lp2 = MakeVector3(lastX[i], lastY[i], lastZ[i]).Floor();
+					IntVector3 lp = MakeVector3(px[i], py[i], pz[i]).Floor();
+					if (lp.z != lp2.z &&
+					    ((lp.x == lp2.x && lp.y == lp2.y) || !map->ClipWorld(lp.x, lp.y, lp2.z)))
+						vz[i] = -vz[i];
+					else if (lp.x != lp2.x && ((lp.y == lp2.y && lp.z == lp2.z) ||
+					                           !map->ClipWorld(lp2.x, lp.y, lp.z)))
+						vx[i] = -vx[i];
+					else if (lp.y != lp2.y && ((lp.x == lp2.x && lp.z == lp2.z) ||
+					                           !map->ClipWorld(lp.x, lp2.y, lp.z)))
+						vy[i] = -vy[i];
+					vx[i] *= .36f;
+					vy[i] *= .36f;
+					vz[i] *= .36f;
+					px[i] = lastX[i];
+					py[i] = lastY[i];
+					pz[i] = lastZ[i];
+				}
+			}
+
+			// Radius and rotation
+			i = 0;
+#if SPADES_ENABLE_SSE2
+			{
+				const __m128 dtv = _mm_set1_ps(dt);
+				for (; i + 4 <= count; i += 4) {
+					_mm_storeu_ps(rad + i, _mm_add_ps(_mm_loadu_ps(rad + i),
+					                                  _mm_mul_ps(_mm_loadu_ps(radVel + i), dtv)));
+					_mm_storeu_ps(ang + i, _mm_add_ps(_mm_loadu_ps(ang + i),
+					                                  _mm_mul_ps(_mm_loadu_ps(angVel + i), dtv)));
+				}
+			}
+#endif
+			for (; i < count; ++i) {
+				rad[i] += radVel[i] * dt;
+				ang[i] += angVel[i] * dt;
+			}
+
+			// Damping. Most particles don't have one, so `powf` is called only when needed.
+			for (i = 0; i < count; ++i) {
+				float vd = velocityDamp[begin + i];
+				if (vd != 1.f) {
+					float factor = powf(vd, dt);
+					vx[i] *= factor;
+					vy[i] *= factor;
+					vz[i] *= factor;
+				}
+				float rd = radiusDamp[begin + i];
+				if (rd != 1.f) {
+					radVel[i] *= powf(rd, dt);
+				}
+			}
+
+			return static_cast<std::size_t>(
+			  std::count(alive.begin() + begin, alive.begin() + end, 0));
+		}
+
+		void ParticleSystem::RemoveDeadParticles() {
+			SPADES_MARK_FUNCTION();
+
+			// Preserve the order so that the particles are drawn in the same order
+			auto firstDead = std::find(alive.begin(), alive.end(), 0);
+			if (firstDead == alive.end()) {
+				return;
+			}
+			std::size_t first = firstDead - alive.begin();
+
+			RemoveDead(positionX, alive, first);
+			RemoveDead(positionY, alive, first);
+			RemoveDead(positionZ, alive, first);
+			RemoveDead(velocityX, alive, first);
+			RemoveDead(velocityY, alive, first);
+			RemoveDead(velocityZ, alive, first);
+			RemoveDead(radius, alive, first);
+			RemoveDead(radiusVelocity, alive, first);
+			RemoveDead(angle, alive, first);
+			RemoveDead(rotationVelocity, alive, first);
+			RemoveDead(velocityDamp, alive, first);
+			RemoveDead(radiusDamp, alive, first);
+			RemoveDead(gravityScale, alive, first);
+			RemoveDead(time, alive, first);
+			RemoveDead(lifetime, alive, first);
+			RemoveDead(fadeInDuration, alive, first);
+			RemoveDead(fadeOutDuration, alive, first);
+			RemoveDead(frame, alive, first);
+			RemoveDead(fps, alive, first);
+			RemoveDead(color, alive, first);
+			RemoveDead(imageIndices, alive, first);
+			RemoveDead(flags, alive, first);
+
+			alive.assign(positionX.size(), 1);
+			numDeadParticles = 0;
+		}
+
+		void ParticleSystem::Render3D() {
+			SPADES_MARK_FUNCTION();
+
+			std::size_t numParticles = alive.size();
+			sprites.resize(numParticles);
+
+			std::size_t numSprites = 0;
+			for (std::size_t i = 0; i < numParticles; ++i) {
+				if (!alive[i]) {
+					continue;
+				}
+
+				float t = time[i];
+				float fade = 1.f;
+				if (t < fadeInDuration[i]) {
+					fade *= t / fadeInDuration[i];
+				}
+				if (t > lifetime[i] - fadeOutDuration[i]) {
+					fade *= (lifetime[i] - t) / fadeOutDuration[i];
+				}
+
+				Vector4 col = color[i];
+				col.w *= fade;
+
+				// premultiplied alpha!
+				col.x *= col.w;
+				col.y *= col.w;
+				col.z *= col.w;
+
+				if (flags[i] & FlagAdditive)
+					col.w = 0.f;
+
+				SpriteParam &sprite = sprites[numSprites++];
+				sprite.image = images[imageIndices[i]].GetPointerOrNull();
+				sprite.center = MakeVector3(positionX[i], positionY[i], positionZ[i]);
+				sprite.radius = radius[i];
+				sprite.rotation = angle[i];
+				sprite.color = col;
+			}
+
+			renderer.AddSprites(sprites.data(), numSprites);
+		}
+
+		void ParticleSystem::Clear() {
+			SPADES_MARK_FUNCTION();
+
+			for (auto *v : {&positionX, &positionY, &positionZ, &velocityX, &velocityY,
+			                &velocityZ, &radius, &radiusVelocity, &angle, &rotationVelocity,
+			                &velocityDamp, &radiusDamp, &gravityScale, &time, &lifetime,
+			                &fadeInDuration, &fadeOutDuration, &frame, &fps}) {
+				v->clear();
+			}
+			color.clear();
+			imageIndices.clear();
+			flags.clear();
+			alive.clear();
+			numDeadParticles = 0;
+		}
+	} // namespace client
+} // namespace spades
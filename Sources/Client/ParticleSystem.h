@@ -0,0 +1,188 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "IRenderer.h"
+#include <Core/Math.h>
+#include <Core/RefCountedObject.h>
+
+namespace spades {
+	namespace client {
+		class GameMap;
+		class IImage;
+
+		enum class BlockHitAction { Delete, Ignore, BounceWeak };
+
+		/** Describes a particle spawned by `ParticleSystem::Spawn`. */
+		class ParticleParam {
+		public:
+			enum class SmokeType { Steady, Explosion };
+
+			/** Creates a particle displayed with the specified image. */
+			ParticleParam(IImage &image, Vector4 color);
+
+			/**
+			 * Creates a particle animated with a smoke texture sequence played at the
+			 * specified frame rate. A `Steady` particle loops the sequence, and an
+			 * `Explosion` particle disappears at the end of the sequence.
+			 */
+			ParticleParam(Vector4 color, float fps, SmokeType type = SmokeType::Steady);
+
+			void SetAdditive(bool b) { additive = b; }
+
+			void SetLifeTime(float lifeTime, float fadeIn, float fadeOut);
+
+			void SetTrajectory(Vector3 initialPosition, Vector3 initialVelocity,
+			                   float velocityDamp = 1.f, float gravityScale = 1.f);
+
+			void SetRotation(float initialAngle, float angleVelocity = 0.f);
+
+			void SetRadius(float initialRadius, float radiusVelocity = 0.f, float radiusDamp = 1.f);
+
+			void SetBlockHitAction(BlockHitAction act) { blockHitAction = act; }
+
+			void SetColor(Vector4 col) { color = col; }
+
+		private:
+			friend class ParticleSystem;
+
+			ParticleParam(IImage *image, Vector4 color, float fps, SmokeType type);
+
+			/** `nullptr` for smoke particles. */
+			IImage *image;
+			SmokeType smokeType;
+			float fps;
+
+			Vector4 color;
+			bool additive;
+			BlockHitAction blockHitAction;
+
+			Vector3 position, velocity;    // unit/sec
+			float radius, radiusVelocity;  // unit/sec
+			float angle, rotationVelocity; // radian/sec
+
+			float velocityDamp;
+			float radiusDamp;
+			float gravityScale;
+
+			float lifetime;
+			float fadeInDuration;
+			float fadeOutDuration;
+		};
+
+		/**
+		 * Simulates and renders sprite particles (blood, debris, smoke, etc.).
+		 *
+		 * The particles are stored in the structure-of-arrays layout and updated in batches
+		 * of `BatchSize` particles, which are distributed among the threads of the global
+		 * `ThreadPool`. Each batch is integrated in a branch-free loop (using SSE2 if
+		 * available), tests the collision against the map for all of its particles at once,
+		 * and only then handles the few particles that actually hit a block. All live
+		 * particles are submitted to the renderer with a single `IRenderer::AddSprites` call.
+		 */
+		class ParticleSystem {
+		public:
+			enum {
+				/** The number of particles updated by a single thread pool chunk. */
+				BatchSize = 256
+			};
+
+			explicit ParticleSystem(IRenderer &);
+			~ParticleSystem();
+
+			ParticleSystem(const ParticleSystem &) = delete;
+			void operator=(const ParticleSystem &) = delete;
+
+			void Spawn(const ParticleParam &);
+
+			/**
+			 * Advances the simulation by `dt` seconds. Expired particles are not drawn anymore,
+			 * and they are removed once they make up a significant part of the arrays.
+			 *
+			 * @param map The map the particles collide with. Can be `nullptr`.
+			 */
+			void Update(float dt, const GameMap *map);
+
+			/** Adds all particles to the current scene of the renderer. */
+			void Render3D();
+
+			void Clear();
+
+			/** Returns the number of particles that haven't expired yet. */
+			std::size_t GetNumParticles() const { return alive.size() - numDeadParticles; }
+
+			/** Removes expired particles now, so the indices of live particles are contiguous. */
+			void RemoveDeadParticles();
+
+			/** Only valid right after `RemoveDeadParticles`. */
+			Vector3 GetParticlePosition(std::size_t index) const {
+				return MakeVector3(positionX[index], positionY[index], positionZ[index]);
+			}
+
+		private:
+			enum {
+				NumSteadySmokeFrames = 180,
+				NumExplosionSmokeFrames = 48,
+
+				FlagAdditive = 1 << 2,
+				FlagSmoke = 1 << 3,
+				FlagExplosionSmoke = 1 << 4,
+				FlagsBlockHitActionMask = 3
+			};
+
+			IRenderer &renderer;
+
+			/**
+			 * The images referenced by `imageIndices`. The smoke sequences occupy the first
+			 * `NumSteadySmokeFrames + NumExplosionSmokeFrames` elements.
+			 */
+			std::vector<Handle<IImage>> images;
+			std::size_t lastImageIndex;
+
+			std::vector<float> positionX, positionY, positionZ;
+			std::vector<float> velocityX, velocityY, velocityZ;
+			std::vector<float> radius, radiusVelocity;
+			std::vector<float> angle, rotationVelocity;
+			std::vector<float> velocityDamp, radiusDamp, gravityScale;
+			std::vector<float> time, lifetime, fadeInDuration, fadeOutDuration;
+			std::vector<float> frame, fps;
+			std::vector<Vector4> color;
+			std::vector<std::uint16_t> imageIndices;
+			/** `Flag...` and `BlockHitAction`. */
+			std::vector<std::uint8_t> flags;
+			/** Set to zero by `UpdateBatch` when a particle expires. */
+			std::vector<std::uint8_t> alive;
+			std::size_t numDeadParticles;
+
+			/** Reused by `Render3D` to avoid allocation. */
+			std::vector<SpriteParam> sprites;
+
+			std::uint16_t FindImage(IImage &);
+
+			/** Returns the number of expired particles in the batch. */
+			std::size_t UpdateBatch(std::size_t begin, std::size_t end, float dt,
+			                        const GameMap *map);
+		};
+	} // namespace client
+} // namespace spades
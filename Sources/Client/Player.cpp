@@ -24,6 +24,7 @@
 #include "GameMap.h"
 #include "GameMapWrapper.h"
 #include "Grenade.h"
+#include "HitBoxSet.h"
 #include "HitTestDebugger.h"
 #include "IWorldListener.h"
 #include "PhysicsConstants.h"
@@ -84,6 +85,9 @@ namespace spades {
 			holdingGrenade = false;
 			reloadingServerSide = false;
 			canPending = false;
+
+			replayingMovement = false;
+			replayTime = 0.f;
 		}
 
 		Player::~Player() { SPADES_MARK_FUNCTION(); }
@@ -350,6 +354,61 @@ namespace spades {
 			orientation = v;
 		}
 
+		Player::PhysicsState Player::GetPhysicsState() {
+			PhysicsState state;
+			state.position = position;
+			state.velocity = velocity;
+			state.orientation = orientation;
+			state.eye = eye;
+			state.input = input;
+			state.weapInput = weapInput;
+			state.airborne = airborne;
+			state.wade = wade;
+			state.lastJump = lastJump;
+			state.lastClimbTime = lastClimbTime;
+			state.lastJumpTime = lastJumpTime;
+			state.moveDistance = moveDistance;
+			state.moveSteps = moveSteps;
+			return state;
+		}
+
+		void Player::SetPhysicsState(const PhysicsState &state) {
+			position = state.position;
+			velocity = state.velocity;
+			orientation = state.orientation;
+			eye = state.eye;
+			input = state.input;
+			weapInput = state.weapInput;
+			airborne = state.airborne;
+			wade = state.wade;
+			lastJump = state.lastJump;
+			lastClimbTime = state.lastClimbTime;
+			lastJumpTime = state.lastJumpTime;
+			moveDistance = state.moveDistance;
+			moveSteps = state.moveSteps;
+		}
+
+		void Player::ReplayMovement(PlayerInput newInput, WeaponInput newWeapInput,
+		                            Vector3 newOrientation, float fsynctics, float time) {
+			SPADES_MARK_FUNCTION();
+
+			replayingMovement = true;
+			replayTime = time;
+
+			SetInput(newInput);
+			weapInput = newWeapInput;
+			orientation = newOrientation;
+			MovePlayer(fsynctics);
+
+			replayingMovement = false;
+		}
+
+		IWorldListener *Player::GetMovementListener() {
+			return replayingMovement ? nullptr : world.GetListener();
+		}
+
+		float Player::GetMovementTime() { return replayingMovement ? replayTime : world.GetTime(); }
+
 		void Player::Turn(float longitude, float latitude) {
 			SPADES_MARK_FUNCTION();
 
@@ -574,75 +633,74 @@ namespace spades {
 			// The custom state data, optionally set by `BulletHitPlayer`'s implementation
 			std::unique_ptr<IBulletHitScanState> stateCell;
 
+			// Generate all pellets first so that the map and the hit boxes can be traversed
+			// in batches
 			Vector3 dir2 = GetFront();
 			for (int i = 0; i < pellets; i++) {
-
 				// AoS 0.75's way (dir2 shouldn't be normalized!)
 				dir2.x += (SampleRandomFloat() - SampleRandomFloat()) * spread;
 				dir2.y += (SampleRandomFloat() - SampleRandomFloat()) * spread;
 				dir2.z += (SampleRandomFloat() - SampleRandomFloat()) * spread;
-				Vector3 dir = dir2.Normalize();
+				bulletVectors.push_back(dir2.Normalize());
+			}
 
-				bulletVectors.push_back(dir);
+			// first do map raycast
+			std::vector<Vector3> muzzles(pellets, muzzle);
+			std::vector<GameMap::RayCastResult> mapResults(pellets);
+			map->CastRays(muzzles.data(), bulletVectors.data(), pellets, 500, mapResults.data());
+
+			// Collect the hit boxes of the players that may be hit by any of the pellets
+			HitBoxSet hitBoxes;
+			std::vector<Player *> boxPlayers;
+			std::vector<HitBodyPart> boxParts;
+			for (int i = 0; i < world.GetNumPlayerSlots(); i++) {
+				// TODO: This is a repeated pattern, add something like
+				//       `World::GetExistingPlayerRange()` returning a range
+				auto maybeOther = world.GetPlayer(i);
+				if (maybeOther == this || !maybeOther)
+					continue;
 
-				// first do map raycast
-				GameMap::RayCastResult mapResult;
-				mapResult = map->CastRay2(muzzle, dir, 500);
+				Player &other = maybeOther.value();
+				if (!other.IsAlive() || other.GetTeamId() >= 2)
+					continue;
+				// quickly reject players unlikely to be hit
+				bool mayHit = false;
+				for (const Vector3 &dir : bulletVectors) {
+					if (other.RayCastApprox(muzzle, dir)) {
+						mayHit = true;
+						break;
+					}
+				}
+				if (!mayHit)
+					continue;
+
+				other.AddHitBoxes(hitBoxes);
+				boxPlayers.resize(hitBoxes.GetNumBoxes(), &other);
+				for (HitBodyPart part : {HitBodyPart::Head, HitBodyPart::Torso, HitBodyPart::Limb1,
+				                         HitBodyPart::Limb2, HitBodyPart::Arms}) {
+					boxParts.push_back(part);
+				}
+			}
+
+			std::vector<HitBoxSet::Hit> hits;
+			for (int i = 0; i < pellets; i++) {
+				const Vector3 &dir = bulletVectors[i];
+				const GameMap::RayCastResult &mapResult = mapResults[i];
 
 				stmp::optional<Player &> hitPlayer;
 				float hitPlayerDistance = 0.f; // disregarding Z coordinate
 				float hitPlayerActualDistance = 0.f;
 				HitBodyPart hitPart = HitBodyPart::None;
 
-				for (int i = 0; i < world.GetNumPlayerSlots(); i++) {
-					// TODO: This is a repeated pattern, add something like
-					//       `World::GetExistingPlayerRange()` returning a range
-					auto maybeOther = world.GetPlayer(i);
-					if (maybeOther == this || !maybeOther)
-						continue;
-
-					Player &other = maybeOther.value();
-					if (!other.IsAlive() || other.GetTeamId() >= 2)
-						continue;
-					// quickly reject players unlikely to be hit
-					if (!other.RayCastApprox(muzzle, dir))
-						continue;
-
-					HitBoxes hb = other.GetHitBoxes();
-					Vector3 hitPos;
-
-					if (hb.head.RayCast(muzzle, dir, &hitPos)) {
-						float dist = GetHorizontalLength(hitPos - muzzle);
-						if (!hitPlayer || dist < hitPlayerDistance) {
-							hitPlayer = other;
-							hitPlayerDistance = dist;
-							hitPlayerActualDistance = (hitPos - muzzle).GetLength();
-							hitPart = HitBodyPart::Head;
-						}
-					}
-					if (hb.torso.RayCast(muzzle, dir, &hitPos)) {
-						float dist = GetHorizontalLength(hitPos - muzzle);
-						if (!hitPlayer || dist < hitPlayerDistance) {
-							hitPlayer = other;
-							hitPlayerDistance = dist;
-							hitPlayerActualDistance = (hitPos - muzzle).GetLength();
-							hitPart = HitBodyPart::Torso;
-						}
-					}
-					for (int j = 0; j < 3; j++) {
-						if (hb.limbs[j].RayCast(muzzle, dir, &hitPos)) {
-							float dist = GetHorizontalLength(hitPos - muzzle);
-							if (!hitPlayer || dist < hitPlayerDistance) {
-								hitPlayer = other;
-								hitPlayerDistance = dist;
-								hitPlayerActualDistance = (hitPos - muzzle).GetLength();
-								switch (j) {
-									case 0: hitPart = HitBodyPart::Limb1; break;
-									case 1: hitPart = HitBodyPart::Limb2; break;
-									case 2: hitPart = HitBodyPart::Arms; break;
-								}
-							}
-						}
+				hits.clear();
+				hitBoxes.RayCast(muzzle, dir, hits);
+				for (const HitBoxSet::Hit &hit : hits) {
+					float dist = GetHorizontalLength(hit.hitPos - muzzle);
+					if (!hitPlayer || dist < hitPlayerDistance) {
+						hitPlayer = *boxPlayers[hit.box];
+						hitPlayerDistance = dist;
+						hitPlayerActualDistance = (hit.hitPos - muzzle).GetLength();
+						hitPart = boxParts[hit.box];
 					}
 				}
 
@@ -1103,7 +1161,7 @@ namespace spades {
 			if (climb) {
 				velocity.x *= .5f;
 				velocity.y *= .5f;
-				lastClimbTime = world.GetTime();
+				lastClimbTime = GetMovementTime();
 				nz -= 1.f;
 				m = -1.35f;
 			} else {
@@ -1146,9 +1204,10 @@ namespace spades {
 			if (input.jump && (!lastJump) && IsOnGroundOrWade()) {
 				velocity.z = -0.36f;
 				lastJump = true;
-				if (world.GetListener() && world.GetTime() > lastJumpTime + .1f) {
-					world.GetListener()->PlayerJumped(*this);
-					lastJumpTime = world.GetTime();
+				IWorldListener *listener = GetMovementListener();
+				if (listener && GetMovementTime() > lastJumpTime + .1f) {
+					listener->PlayerJumped(*this);
+					lastJumpTime = GetMovementTime();
 				}
 			} else if (!input.jump) {
 				lastJump = false;
@@ -1215,12 +1274,12 @@ namespace spades {
 				velocity.y *= .5f;
 
 				if (f2 > FALL_DAMAGE_VELOCITY) {
-					if (world.GetListener()) {
-						world.GetListener()->PlayerLanded(*this, true);
+					if (GetMovementListener()) {
+						GetMovementListener()->PlayerLanded(*this, true);
 					}
 				} else {
-					if (world.GetListener()) {
-						world.GetListener()->PlayerLanded(*this, false);
+					if (GetMovementListener()) {
+						GetMovementListener()->PlayerLanded(*this, false);
 					}
 				}
 			}
@@ -1239,8 +1298,8 @@ namespace spades {
 					moveSteps++;
 					moveDistance -= 1.f;
 
-					if (world.GetListener() && !madeFootstep) {
-						world.GetListener()->PlayerMadeFootstep(*this);
+					if (GetMovementListener() && !madeFootstep) {
+						GetMovementListener()->PlayerMadeFootstep(*this);
 						madeFootstep = true;
 					}
 				}
@@ -1278,7 +1337,7 @@ namespace spades {
 			SPADES_MARK_FUNCTION();
 
 			eye = position = pos2;
-			float f = lastClimbTime - world.GetTime();
+			float f = lastClimbTime - GetMovementTime();
 			if (f > -.25f)
 				eye.z += (f + .25f) / .25f;
 		}
@@ -1415,6 +1474,17 @@ namespace spades {
 
 			return hb;
 		}
+
+		std::size_t Player::AddHitBoxes(HitBoxSet &set) {
+			HitBoxes hb = GetHitBoxes();
+			std::size_t first = set.AddBox(hb.head, position);
+			set.AddBox(hb.torso, position);
+			for (const OBB3 &limb : hb.limbs) {
+				set.AddBox(limb, position);
+			}
+			return first;
+		}
+
 		IntVector3 Player::GetColor() { return world.GetTeam(teamId).color; }
 
 		bool Player::IsCookingGrenade() { return tool == ToolGrenade && holdingGrenade; }
@@ -30,6 +30,8 @@ namespace spades {
 	namespace client {
 		class World;
 		class Weapon;
+		class HitBoxSet;
+		class IWorldListener;
 
 		struct PlayerInput {
 			bool moveForward : 1;
@@ -67,6 +69,26 @@ namespace spades {
 				OBB3 head;
 			};
 
+			/**
+			 * The part of the player state that determines the movement, and the input that
+			 * drives it. Used by `PlayerPrediction` to take and restore snapshots.
+			 */
+			struct PhysicsState {
+				Vector3 position;
+				Vector3 velocity;
+				Vector3 orientation;
+				Vector3 eye;
+				PlayerInput input;
+				WeaponInput weapInput;
+				bool airborne;
+				bool wade;
+				bool lastJump;
+				float lastClimbTime;
+				float lastJumpTime;
+				float moveDistance;
+				int moveSteps;
+			};
+
 		private:
 			World &world;
 
@@ -126,6 +148,14 @@ namespace spades {
 
 			float respawnTime;
 
+			/** `true` while `ReplayMovement` is running. */
+			bool replayingMovement;
+			float replayTime;
+
+			/** Returns `nullptr` while replaying the movement. */
+			IWorldListener *GetMovementListener();
+			float GetMovementTime();
+
 			void RepositionPlayer(const Vector3 &);
 			void MovePlayer(float fsynctics);
 			void BoxClipMove(float fsynctics);
@@ -187,6 +217,17 @@ namespace spades {
 			void SetVelocity(const Vector3 &);
 			void Turn(float longitude, float latitude);
 
+			PhysicsState GetPhysicsState();
+			void SetPhysicsState(const PhysicsState &);
+
+			/**
+			 * Re-simulates the movement of one world tick that started at `time`, for
+			 * client-side prediction. `input` is applied as `SetInput` does. The world listener
+			 * isn't notified of footsteps, jumps, or landings.
+			 */
+			void ReplayMovement(PlayerInput input, WeaponInput weapInput, Vector3 orientation,
+			                    float fsynctics, float time);
+
 			void SetHP(int hp, HurtType, Vector3);
 
 			void SetWeaponType(WeaponType weap);
@@ -236,6 +277,13 @@ namespace spades {
 			// hit tests
 			HitBoxes GetHitBoxes();
 
+			/**
+			 * Adds the boxes of `GetHitBoxes()` to `set` in the order of the head, the torso,
+			 * and `limbs[0..2]`, using the player's position for the approximated test.
+			 * Returns the index of the first box.
+			 */
+			std::size_t AddHitBoxes(HitBoxSet &set);
+
 			/** Does approximated ray casting.
 			 * @param dir normalized direction vector.
 			 * @return true if ray may hit the player. */
@@ -0,0 +1,124 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "PlayerPrediction.h"
+#include <Core/Debug.h>
+#include <Core/Settings.h>
+
+DEFINE_SPADES_SETTING(cg_playerPrediction, "1");
+
+namespace spades {
+	namespace client {
+		namespace {
+			/**
+			 * Corrections moving the player farther than this are treated as teleports and are
+			 * applied without rollback or smoothing.
+			 */
+			constexpr float MaxRollbackDistance = 4.f;
+
+			/** The decay rate of the visual offset, per second. */
+			constexpr float VisualOffsetDecayRate = 12.f;
+		} // namespace
+
+		PlayerPrediction::PlayerPrediction(float tickStep) : tickStep{tickStep} { Reset(); }
+
+		void PlayerPrediction::Reset() {
+			firstTick = 0;
+			numTicks = 0;
+			player = nullptr;
+			visualOffset = MakeVector3(0, 0, 0);
+		}
+
+		void PlayerPrediction::RecordTick(Player &p, float tickTime) {
+			if (!p.IsAlive() || p.IsSpectator()) {
+				Reset();
+				return;
+			}
+			if (&p != player) {
+				// The player was respawned, and the history is no longer valid
+				Reset();
+				player = &p;
+			}
+
+			if (numTicks == HistorySize) {
+				firstTick = (firstTick + 1) % HistorySize;
+				--numTicks;
+			}
+
+			Tick &tick = GetTick(numTicks++);
+			tick.time = tickTime;
+			tick.state = p.GetPhysicsState();
+		}
+
+		void PlayerPrediction::ApplyCorrection(Player &p, const Vector3 &position, float latency) {
+			SPADES_MARK_FUNCTION();
+
+			auto numTicksAgo = static_cast<std::size_t>(std::max(latency / tickStep + .5f, 0.f));
+			if (!cg_playerPrediction || &p != player || numTicksAgo >= numTicks) {
+				// No history to rewind to
+				p.SetPosition(position);
+				Reset();
+				return;
+			}
+
+			std::size_t first = numTicks - 1 - numTicksAgo;
+			Player::PhysicsState state = GetTick(first).state;
+			Vector3 delta = position - state.position;
+			if (delta.GetLength() > MaxRollbackDistance) {
+				p.SetPosition(position);
+				Reset();
+				return;
+			}
+
+			Player::PhysicsState current = p.GetPhysicsState();
+
+			state.position = position;
+			state.eye += delta;
+			GetTick(first).state = state;
+			p.SetPhysicsState(state);
+
+			for (std::size_t i = first + 1; i < numTicks; ++i) {
+				Tick &tick = GetTick(i);
+				p.ReplayMovement(tick.state.input, tick.state.weapInput, tick.state.orientation,
+				                 tickStep, tick.time);
+				tick.state = p.GetPhysicsState();
+			}
+
+			// The input and the view direction may have changed since the last tick
+			state = p.GetPhysicsState();
+			state.input = current.input;
+			state.weapInput = current.weapInput;
+			state.orientation = current.orientation;
+			p.SetPhysicsState(state);
+
+			visualOffset += current.eye - state.eye;
+			if (visualOffset.GetLength() > MaxRollbackDistance) {
+				visualOffset = MakeVector3(0, 0, 0);
+			}
+		}
+
+		void PlayerPrediction::Update(float dt) {
+			visualOffset *= std::exp(-dt * VisualOffsetDecayRate);
+		}
+	} // namespace client
+} // namespace spades
@@ -0,0 +1,105 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "Player.h"
+#include <Core/Math.h>
+
+namespace spades {
+	namespace client {
+		/**
+		 * Client-side prediction of the local player's movement with rollback.
+		 *
+		 * The local player is simulated ahead of the server. After each world tick,
+		 * `RecordTick` stores the tick's input and the resulting `Player::PhysicsState` in a
+		 * fixed-size ring buffer. When the server corrects the local player's position,
+		 * `ApplyCorrection` rewinds to the tick the correction refers to, replaces the position,
+		 * and re-simulates the movement of the following ticks with the recorded input. The
+		 * difference between the old and the new predicted eye positions is presented as a
+		 * visual offset that decays over time instead of a snap.
+		 *
+		 * The protocol doesn't tag the position updates with ticks, so the tick is estimated
+		 * from the round-trip time.
+		 */
+		class PlayerPrediction {
+		public:
+			enum {
+				/** The number of recorded ticks (two seconds at 60 Hz). */
+				HistorySize = 128
+			};
+
+			/** @param tickStep The duration of a world tick, in seconds. */
+			explicit PlayerPrediction(float tickStep);
+
+			/** Discards the recorded ticks and the visual offset. */
+			void Reset();
+
+			/**
+			 * Records the state of the local player after a world tick.
+			 *
+			 * @param tickTime The world time at the beginning of the tick.
+			 */
+			void RecordTick(Player &, float tickTime);
+
+			/**
+			 * Applies an authoritative position of the local player sent by the server.
+			 *
+			 * @param latency The estimated age of the position (usually the round-trip time),
+			 *                in seconds.
+			 */
+			void ApplyCorrection(Player &, const Vector3 &position, float latency);
+
+			/** Decays the visual offset. */
+			void Update(float dt);
+
+			/**
+			 * Returns the offset to add to the local player's eye position when rendering, which
+			 * hides the discontinuity caused by the last corrections.
+			 */
+			Vector3 GetVisualOffset() const { return visualOffset; }
+
+			std::size_t GetNumRecordedTicks() const { return numTicks; }
+
+		private:
+			struct Tick {
+				/** The world time at the beginning of the tick. */
+				float time;
+				/** The input used in the tick and the state after the tick. */
+				Player::PhysicsState state;
+			};
+
+			float tickStep;
+			std::array<Tick, HistorySize> ticks;
+			/** The index of the oldest tick in `ticks`. */
+			std::size_t firstTick;
+			std::size_t numTicks;
+			/** The player whose ticks are recorded. Only used for identity checks. */
+			Player *player;
+
+			Vector3 visualOffset;
+
+			/** Returns the `i`-th oldest recorded tick. */
+			Tick &GetTick(std::size_t i) { return ticks[(firstTick + i) % HistorySize]; }
+		};
+	} // namespace client
+} // namespace spades
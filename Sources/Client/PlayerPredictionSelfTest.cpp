@@ -0,0 +1,181 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "GameMap.h"
+#include "GameProperties.h"
+#include "Player.h"
+#include "PlayerPrediction.h"
+#include "PlayerPredictionSelfTest.h"
+#include "TestMap.h"
+#include "World.h"
+#include <Core/Debug.h>
+#include <Core/Stopwatch.h>
+#include <Core/TMPUtils.h>
+
+namespace spades {
+	namespace client {
+		namespace {
+			/** A world with a single player, used to run the movement without a server. */
+			struct PredictionWorld {
+				World world;
+				Player *player;
+
+				PredictionWorld(GameMap &map, const Vector3 &spawnPosition)
+				    : world{std::make_shared<GameProperties>(ProtocolVersion::v075)} {
+					world.SetMap(map);
+					world.SetPlayer(0, stmp::make_unique<Player>(
+					                     world, 0, RIFLE_WEAPON, 0, spawnPosition,
+					                     IntVector3::Make(255, 255, 255)));
+					world.SetLocalPlayerIndex(0);
+					player = &world.GetPlayer(0).value();
+				}
+
+				/** Returns the world time at the beginning of the tick. */
+				float Advance(PlayerInput input, const Vector3 &orientation, float dt) {
+					player->SetInput(input);
+					player->SetOrientation(orientation);
+					float tickTime = world.GetTime();
+					world.Advance(dt);
+					return tickTime;
+				}
+			};
+
+			bool IsSamePhysicsState(const Player::PhysicsState &a,
+			                        const Player::PhysicsState &b) {
+				return a.position == b.position && a.velocity == b.velocity &&
+				       a.eye == b.eye && a.airborne == b.airborne && a.wade == b.wade &&
+				       a.input.crouch == b.input.crouch && a.moveSteps == b.moveSteps;
+			}
+		} // namespace
+
+		bool RunPlayerPredictionSelfTest() {
+			SPADES_MARK_FUNCTION();
+
+			Handle<GameMap> mapHandle{CreateTestMap(1), false};
+			GameMap &map = *mapHandle;
+
+			const int numTicks = 3600;
+			const int correctionInterval = 90;
+			const float dt = 1.f / 60.f;
+
+			// Spawn on the column at the center of the map
+			int spawnX = map.Width() / 2, spawnY = map.Height() / 2;
+			uint64_t column = map.GetSolidMapWrapped(spawnX, spawnY);
+			int top = column ? CountTrailingZeros(column) : map.Depth() - 1;
+			Vector3 spawnPosition = MakeVector3(spawnX + .5f, spawnY + .5f, top - 2.4f);
+
+			// Scripted input, changed at random intervals
+			std::vector<PlayerInput> inputs(numTicks);
+			std::vector<Vector3> orientations(numTicks);
+			{
+				std::mt19937 rng{42};
+				std::uniform_real_distribution<float> unit{0.f, 1.f};
+				PlayerInput input;
+				float yaw = 0.f, yawRate = 0.f;
+				for (int i = 0, nextChange = 0; i < numTicks; ++i) {
+					if (i == nextChange) {
+						input = PlayerInput();
+						input.moveForward = unit(rng) < .7f;
+						input.moveBackward = !input.moveForward && unit(rng) < .5f;
+						input.moveLeft = unit(rng) < .25f;
+						input.moveRight = !input.moveLeft && unit(rng) < .3f;
+						input.jump = unit(rng) < .3f;
+						input.crouch = unit(rng) < .15f;
+						input.sprint = !input.crouch && unit(rng) < .4f;
+						yawRate = (unit(rng) - .5f) * .1f;
+						nextChange += 20 + (int)(rng() % 40);
+					}
+					yaw += yawRate;
+					inputs[i] = input;
+					orientations[i] = MakeVector3(cosf(yaw), sinf(yaw), 0.f);
+				}
+			}
+
+			SPLog("Player prediction test: %d ticks, a correction every %d ticks", numTicks,
+			      correctionInterval);
+
+			int totalMismatches = 0;
+			for (int latency : {3, 9, 18, 36, 60}) {
+				// `reference` receives the corrections on time, and `predicted` receives them
+				// `latency` ticks late
+				PredictionWorld reference{map, spawnPosition};
+				PredictionWorld predicted{map, spawnPosition};
+				PlayerPrediction prediction{dt};
+
+				Vector3 pendingPosition;
+				int pendingTick = -1;
+				int numCorrections = 0, numMismatches = 0;
+				double recordTime = 0.0, rollbackTime = 0.0;
+
+				for (int i = 0; i < numTicks; ++i) {
+					reference.Advance(inputs[i], orientations[i], dt);
+					float tickTime = predicted.Advance(inputs[i], orientations[i], dt);
+
+					Stopwatch sw;
+					prediction.RecordTick(*predicted.player, tickTime);
+					recordTime += sw.GetTime();
+
+					if (i % correctionInterval == correctionInterval / 2) {
+						// The server disagrees with the position after this tick
+						Player::PhysicsState state = reference.player->GetPhysicsState();
+						Vector3 delta = MakeVector3((float)((i / correctionInterval) % 3) - 1.f,
+						                            (float)((i / correctionInterval) % 5) - 2.f,
+						                            0.f) *
+						                .2f;
+						state.position += delta;
+						state.eye += delta;
+						reference.player->SetPhysicsState(state);
+						pendingPosition = state.position;
+						pendingTick = i;
+					}
+
+					if (pendingTick >= 0 && i == pendingTick + latency) {
+						sw.Reset();
+						prediction.ApplyCorrection(*predicted.player, pendingPosition,
+						                           latency * dt);
+						rollbackTime += sw.GetTime();
+						pendingTick = -1;
+
+						++numCorrections;
+						if (!IsSamePhysicsState(reference.player->GetPhysicsState(),
+						                        predicted.player->GetPhysicsState())) {
+							++numMismatches;
+						}
+					}
+				}
+
+				SPLog("[latency %2d ticks] record: %.1f ns/tick, rollback: %.1f us/correction, "
+				      "%d correction(s), %d mismatched state(s)",
+				      latency, recordTime * 1.0e9 / numTicks,
+				      rollbackTime * 1.0e6 / std::max(numCorrections, 1), numCorrections,
+				      numMismatches);
+				totalMismatches += numMismatches;
+			}
+			return totalMismatches == 0;
+		}
+	} // namespace client
+} // namespace spades
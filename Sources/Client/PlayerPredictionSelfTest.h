@@ -0,0 +1,36 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+namespace spades {
+	namespace client {
+		/**
+		 * Simulates a local player walking on a generated map with scripted input and server
+		 * corrections arriving with a delay of 3-60 ticks, and checks that the rollback of
+		 * `PlayerPrediction` produces exactly the same state as applying the corrections on
+		 * time. Also logs the cost of recording and rolling back ticks. This is run by
+		 * `openspades --self-test`.
+		 *
+		 * @return `false` if any corrected state differs from the reference.
+		 */
+		bool RunPlayerPredictionSelfTest();
+	} // namespace client
+} // namespace spades
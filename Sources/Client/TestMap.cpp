@@ -0,0 +1,80 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "GameMap.h"
+#include "TestMap.h"
+#include <Core/Debug.h>
+
+namespace spades {
+	namespace client {
+		GameMap *CreateTestMap(std::uint32_t seed) {
+			SPADES_MARK_FUNCTION();
+
+			GameMap *map = new GameMap();
+			std::mt19937 rng{seed};
+			std::uniform_real_distribution<float> phaseDist{0.f, 6.2831853f};
+			std::uniform_int_distribution<std::uint32_t> colorDist{0, 0xffffff};
+
+			// Rolling hills with terraces. Z increases downward, and `z = 63` is the water.
+			float phases[4];
+			for (float &phase : phases) {
+				phase = phaseDist(rng);
+			}
+			for (int x = 0; x < map->Width(); x++) {
+				for (int y = 0; y < map->Height(); y++) {
+					float height = 12.f * std::sin(x * .031f + phases[0]) +
+					               9.f * std::sin(y * .043f + phases[1]) +
+					               5.f * std::sin((x + y) * .11f + phases[2]) +
+					               3.f * std::sin((x - y) * .23f + phases[3]);
+					int top = 46 - static_cast<int>(std::floor(height * .5f));
+					if (top > 63) {
+						top = 63;
+					}
+					std::uint32_t color = 0x204060 + ((x * 7 + y * 3) & 0x1f) * 0x10101;
+					for (int z = 0; z < map->Depth(); z++) {
+						map->Set(x, y, z, z >= top, color | (100U << 24), true);
+					}
+				}
+			}
+
+			// Floating slabs and walls, which create overhangs, ceilings, and narrow gaps
+			std::uniform_int_distribution<int> posDist{0, map->Width() - 1};
+			std::uniform_int_distribution<int> sizeDist{1, 12};
+			std::uniform_int_distribution<int> zDist{8, 44};
+			for (int i = 0; i < 600; i++) {
+				int x0 = posDist(rng), y0 = posDist(rng), z0 = zDist(rng);
+				int sizeX = sizeDist(rng), sizeY = sizeDist(rng), sizeZ = sizeDist(rng) / 3 + 1;
+				bool solid = i % 4 != 0; // Some boxes carve tunnels instead
+				std::uint32_t color = colorDist(rng) | (100U << 24);
+				for (int x = x0; x < x0 + sizeX; x++)
+					for (int y = y0; y < y0 + sizeY; y++)
+						for (int z = z0; z < std::min(z0 + sizeZ, 62); z++)
+							map->Set(x & (map->Width() - 1), y & (map->Height() - 1), z, solid,
+							         color, true);
+			}
+
+			return map;
+		}
+	} // namespace client
+} // namespace spades
@@ -1,5 +1,5 @@
 /*
- Copyright (c) 2013 yvt
+ Copyright (c) 2021 yvt
 
  This file is part of OpenSpades.
 
@@ -20,28 +20,17 @@
 
 #pragma once
 
-#include "ParticleSpriteEntity.h"
+#include <cstdint>
 
 namespace spades {
 	namespace client {
-		class IImage;
-		class IRenderer;
-		class SmokeSpriteEntity : public ParticleSpriteEntity {
-		public:
-			enum class Type { Steady, Explosion };
-
-		private:
-			float frame;
-			float fps;
-			Type type;
-			static IImage &GetSequence(int i, IRenderer *r, Type);
-
-		public:
-			SmokeSpriteEntity(Client &cli, Vector4 color, float fps, Type type = Type::Steady);
-
-			static void Preload(IRenderer *);
-
-			bool Update(float dt) override;
-		};
+		class GameMap;
+
+		/**
+		 * Generates a map with hills, cliffs, overhangs, and a water level from the given seed.
+		 * The same seed always produces the same map. Used by the self-tests, which run without
+		 * the game resources.
+		 */
+		GameMap *CreateTestMap(std::uint32_t seed);
 	} // namespace client
 } // namespace spades
@@ -21,12 +21,12 @@
 
 #include <cmath>
 #include <cstdlib>
-#include <deque>
 
 #include "GameMap.h"
 #include "GameMapWrapper.h"
 #include "GameProperties.h"
 #include "Grenade.h"
+#include "HitBoxSet.h"
 #include "HitTestDebugger.h"
 #include "IGameMode.h"
 #include "IWorldListener.h"
@@ -112,7 +112,6 @@ namespace spades {
 			map = newMap;
 			if (map) {
 				mapWrapper = stmp::make_unique<GameMapWrapper>(*map);
-				mapWrapper->Rebuild();
 			}
 		}
 
@@ -151,79 +150,6 @@ namespace spades {
 			blockRegenerationQueueMap.erase(it);
 		}
 
-		static std::vector<std::vector<CellPos>>
-		ClusterizeBlocks(const std::vector<CellPos> &blocks) {
-			std::unordered_map<CellPos, bool, CellPosHash> blockMap;
-			for (const auto &block : blocks) {
-				blockMap[block] = true;
-			}
-
-			std::vector<std::vector<CellPos>> ret;
-			std::deque<decltype(blockMap)::iterator> queue;
-
-			ret.reserve(64);
-			// wish I could `reserve()` queue...
-
-			std::size_t addedCount = 0;
-
-			for (auto it = blockMap.begin(); it != blockMap.end(); it++) {
-				SPAssert(queue.empty());
-
-				if (!it->second)
-					continue;
-				queue.emplace_back(it);
-
-				std::vector<CellPos> outBlocks;
-
-				while (!queue.empty()) {
-					auto blockitem = queue.front();
-					queue.pop_front();
-
-					if (!blockitem->second)
-						continue;
-
-					auto pos = blockitem->first;
-					outBlocks.emplace_back(pos);
-					blockitem->second = false;
-
-					decltype(blockMap)::iterator nextIt;
-
-					nextIt = blockMap.find(CellPos(pos.x - 1, pos.y, pos.z));
-					if (nextIt != blockMap.end() && nextIt->second) {
-						queue.emplace_back(nextIt);
-					}
-					nextIt = blockMap.find(CellPos(pos.x + 1, pos.y, pos.z));
-					if (nextIt != blockMap.end() && nextIt->second) {
-						queue.emplace_back(nextIt);
-					}
-					nextIt = blockMap.find(CellPos(pos.x, pos.y - 1, pos.z));
-					if (nextIt != blockMap.end() && nextIt->second) {
-						queue.emplace_back(nextIt);
-					}
-					nextIt = blockMap.find(CellPos(pos.x, pos.y + 1, pos.z));
-					if (nextIt != blockMap.end() && nextIt->second) {
-						queue.emplace_back(nextIt);
-					}
-					nextIt = blockMap.find(CellPos(pos.x, pos.y, pos.z - 1));
-					if (nextIt != blockMap.end() && nextIt->second) {
-						queue.emplace_back(nextIt);
-					}
-					nextIt = blockMap.find(CellPos(pos.x, pos.y, pos.z + 1));
-					if (nextIt != blockMap.end() && nextIt->second) {
-						queue.emplace_back(nextIt);
-					}
-				}
-
-				SPAssert(!outBlocks.empty());
-				addedCount += outBlocks.size();
-				ret.emplace_back(std::move(outBlocks));
-			}
-
-			SPAssert(addedCount == blocks.size());
-
-			return ret;
-		}
-
 		void World::ApplyBlockActions() {
 			for (const auto &creation : createdBlocks) {
 				const auto &pos = creation.first;
@@ -244,9 +170,7 @@ namespace spades {
 				cells.emplace_back(cell);
 			}
 
-			cells = mapWrapper->RemoveBlocks(cells);
-
-			auto clusters = ClusterizeBlocks(cells);
+			auto clusters = mapWrapper->RemoveBlocksClustered(cells);
 			std::vector<IntVector3> cells2;
 
 			for (const auto &cluster : clusters) {
@@ -386,85 +310,86 @@ namespace spades {
 		                                                spades::Vector3 dir,
 		                                                stmp::optional<int> excludePlayerId) {
 			WeaponRayCastResult result;
-			stmp::optional<int> hitPlayer;
-			float hitPlayerDistance = 0.f;
-			hitTag_t hitFlag = hit_None;
+			WeaponRayCasts(&startPos, &dir, 1, excludePlayerId, &result);
+			return result;
+		}
+
+		void World::WeaponRayCasts(const Vector3 *startPos, const Vector3 *dirs,
+		                           std::size_t count, stmp::optional<int> excludePlayerId,
+		                           WeaponRayCastResult *results) {
+			SPADES_MARK_FUNCTION();
 
+			// Collect the hit boxes of the players that may be hit by any of the rays
+			HitBoxSet hitBoxes;
+			std::vector<int> boxPlayers;
+			std::vector<hitTag_t> boxTags;
 			for (int i = 0; i < (int)players.size(); i++) {
 				const auto &p = players[i];
 				if (!p || (excludePlayerId && *excludePlayerId == i))
 					continue;
 				if (p->GetTeamId() >= 2 || !p->IsAlive())
 					continue;
-				if (!p->RayCastApprox(startPos, dir))
-					continue;
 
-				Player::HitBoxes hb = p->GetHitBoxes();
-				Vector3 hitPos;
+				bool mayHit = false;
+				for (std::size_t k = 0; k < count && !mayHit; k++) {
+					mayHit = p->RayCastApprox(startPos[k], dirs[k]);
+				}
+				if (!mayHit)
+					continue;
 
-				if (hb.head.RayCast(startPos, dir, &hitPos)) {
-					float dist = (hitPos - startPos).GetLength();
-					if (!hitPlayer || dist < hitPlayerDistance) {
-						if (hitPlayer != i) {
-							hitPlayer = i;
-							hitFlag = hit_None;
-						}
-						hitPlayerDistance = dist;
-						hitFlag |= hit_Head;
-					}
+				p->AddHitBoxes(hitBoxes);
+				const hitTag_t tags[] = {hit_Head, hit_Torso, hit_Legs, hit_Legs, hit_Arms};
+				for (hitTag_t tag : tags) {
+					boxPlayers.push_back(i);
+					boxTags.push_back(tag);
 				}
-				if (hb.torso.RayCast(startPos, dir, &hitPos)) {
-					float dist = (hitPos - startPos).GetLength();
+			}
+
+			std::vector<GameMap::RayCastResult> mapResults(count);
+			map->CastRays(startPos, dirs, count, 256, mapResults.data());
+
+			std::vector<HitBoxSet::Hit> hits;
+			for (std::size_t k = 0; k < count; k++) {
+				WeaponRayCastResult &result = results[k];
+				result.playerId.reset();
+
+				stmp::optional<int> hitPlayer;
+				float hitPlayerDistance = 0.f;
+				hitTag_t hitFlag = hit_None;
+
+				hits.clear();
+				hitBoxes.RayCast(startPos[k], dirs[k], hits);
+				for (const HitBoxSet::Hit &hit : hits) {
+					int i = boxPlayers[hit.box];
+					float dist = (hit.hitPos - startPos[k]).GetLength();
 					if (!hitPlayer || dist < hitPlayerDistance) {
 						if (hitPlayer != i) {
 							hitPlayer = i;
 							hitFlag = hit_None;
 						}
 						hitPlayerDistance = dist;
-						hitFlag |= hit_Torso;
-					}
-				}
-				for (int j = 0; j < 3; j++) {
-					if (hb.limbs[j].RayCast(startPos, dir, &hitPos)) {
-						float dist = (hitPos - startPos).GetLength();
-						if (!hitPlayer || dist < hitPlayerDistance) {
-							if (hitPlayer != i) {
-								hitPlayer = i;
-								hitFlag = hit_None;
-							}
-							hitPlayerDistance = dist;
-							if (j == 2) {
-								hitFlag |= hit_Arms;
-							} else {
-								hitFlag |= hit_Legs;
-							}
-						}
+						hitFlag |= boxTags[hit.box];
 					}
 				}
-			}
 
-			// map raycast
-			GameMap::RayCastResult res2;
-			res2 = map->CastRay2(startPos, dir, 256);
-
-			if (res2.hit &&
-			    (!hitPlayer || (res2.hitPos - startPos).GetLength() < hitPlayerDistance)) {
-				result.hit = true;
-				result.startSolid = res2.startSolid;
-				result.hitFlag = hit_None;
-				result.blockPos = res2.hitBlock;
-				result.hitPos = res2.hitPos;
-			} else if (hitPlayer) {
-				result.hit = true;
-				result.startSolid = false; // FIXME: startSolid for player
-				result.playerId = hitPlayer;
-				result.hitPos = startPos + dir * hitPlayerDistance;
-				result.hitFlag = hitFlag;
-			} else {
-				result.hit = false;
+				const GameMap::RayCastResult &res2 = mapResults[k];
+				if (res2.hit &&
+				    (!hitPlayer || (res2.hitPos - startPos[k]).GetLength() < hitPlayerDistance)) {
+					result.hit = true;
+					result.startSolid = res2.startSolid;
+					result.hitFlag = hit_None;
+					result.blockPos = res2.hitBlock;
+					result.hitPos = res2.hitPos;
+				} else if (hitPlayer) {
+					result.hit = true;
+					result.startSolid = false; // FIXME: startSolid for player
+					result.playerId = hitPlayer;
+					result.hitPos = startPos[k] + dirs[k] * hitPlayerDistance;
+					result.hitFlag = hitFlag;
+				} else {
+					result.hit = false;
+				}
 			}
-
-			return result;
 		}
 
 		HitTestDebugger *World::GetHitTestDebugger() {
@@ -153,6 +153,14 @@ namespace spades {
 			WeaponRayCastResult WeaponRayCast(Vector3 startPos, Vector3 dir,
 			                                  stmp::optional<int> excludePlayerId);
 
+			/**
+			 * Performs `WeaponRayCast` for `count` rays at once. The map and the players'
+			 * hit boxes are traversed using `GameMap::CastRays` and `HitBoxSet`.
+			 */
+			void WeaponRayCasts(const Vector3 *startPos, const Vector3 *dirs, std::size_t count,
+			                    stmp::optional<int> excludePlayerId,
+			                    WeaponRayCastResult *results);
+
 			size_t GetNumPlayerSlots() { return players.size(); }
 			size_t GetNumPlayers();
 
@@ -38,7 +38,7 @@ namespace spades {
 #endif
 	}
 
-	CpuID::CpuID() {
+	CpuID::CpuID() : subfeature(0), featureXcr0Avx(false), featureXcr0Avx512(false) {
 		uint32_t maxStdLevel;
 		{
 			auto ar = cpuid(0);
@@ -56,7 +56,8 @@ namespace spades {
 			featureEdx = ar[3];
 
 			// xsave/osxsave
-			if ((featureEcx & (1U << 28)) && (featureEcx & 26) && (featureEcx & 27)) {
+			if ((featureEcx & (1U << 28)) && (featureEcx & (1U << 26)) &&
+			    (featureEcx & (1U << 27))) {
 				auto x = xcr0();
 				featureXcr0Avx = ((x & 6) == 6);
 				featureXcr0Avx512 = ((x & 224) == 224);
@@ -75,7 +76,7 @@ namespace spades {
 				brand = "Unknown";
 			}
 		}
-		{
+		if (maxStdLevel >= 7) {
 			auto ar = cpuid(7);
 			// FIXME: sublevels?
 			subfeature = ar[1];
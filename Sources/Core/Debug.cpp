@@ -18,10 +18,11 @@
 
  */
 
+#include <algorithm>
 #include <cstdarg>
 #include <ctime>
 #include <deque>
-#include <map>
+#include <mutex>
 #include <string>
 
 #include "Debug.h"
@@ -30,102 +31,108 @@
 #include "Math.h"
 #include "Strings.h"
 #include <Core/Debug.h>
-#include <Imports/SDL.h>
-
-#define SPADES_USE_TLS 1
-
-#if SPADES_USE_TLS
-#include "ThreadLocalStorage.h"
-#endif // SPADES_USE_TLS
 
 namespace spades {
 	namespace reflection {
-		BacktraceEntryAdder::BacktraceEntryAdder(const BacktraceEntry &entry) {
-			bt = Backtrace::GetGlobalBacktrace();
-			if (bt)
-				bt->Push(entry);
-		}
-
-		BacktraceEntryAdder::~BacktraceEntryAdder() {
-			if (bt)
-				bt->Pop();
+		namespace {
+			std::atomic<Backtrace *> g_firstBacktrace{nullptr};
+			std::atomic<int> g_nextThreadId{1};
+		} // namespace
+
+		Backtrace::Backtrace() : depth{0}, inUse{false}, threadId{0}, next{nullptr} {
+			for (auto &entry : entries) {
+				entry.store(nullptr, std::memory_order_relaxed);
+			}
 		}
 
-#if SPADES_USE_TLS
-
-		static AutoDeletedThreadLocalStorage<Backtrace> backtraceTls("backtraceTls");
+		Backtrace *Backtrace::Acquire() {
+			// Reuse an object released by an exited thread if possible
+			for (Backtrace *b = g_firstBacktrace.load(std::memory_order_acquire); b; b = b->next) {
+				bool expected = false;
+				if (b->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+					b->threadId.store(g_nextThreadId.fetch_add(1), std::memory_order_relaxed);
+					return b;
+				}
+			}
 
-		// TLS is initialized as global constructor and
-		// some constructors are called before initialization of TLS.
-		// this prevents backtrace to be used until all constructors are
-		// called.
-		static bool backtraceStarted = false;
+			Backtrace *b = new Backtrace();
+			b->inUse.store(true, std::memory_order_relaxed);
+			b->threadId.store(g_nextThreadId.fetch_add(1), std::memory_order_relaxed);
 
-		Backtrace *Backtrace::GetGlobalBacktrace() {
-			if (!backtraceStarted)
-				return NULL;
-			Backtrace *b = backtraceTls;
-			if (!b) {
-				b = new Backtrace;
-				backtraceTls = b;
+			b->next = g_firstBacktrace.load(std::memory_order_relaxed);
+			while (!g_firstBacktrace.compare_exchange_weak(b->next, b, std::memory_order_release,
+			                                               std::memory_order_relaxed)) {
 			}
 			return b;
 		}
 
-		void Backtrace::ThreadExiting() {}
+		void Backtrace::Release() {
+			depth.store(0, std::memory_order_release);
+			inUse.store(false, std::memory_order_release);
+		}
 
-		void Backtrace::StartBacktrace() { backtraceStarted = true; }
+		std::vector<Backtrace *> Backtrace::GetAllBacktraces() {
+			std::vector<Backtrace *> backtraces;
+			for (Backtrace *b = g_firstBacktrace.load(std::memory_order_acquire); b; b = b->next) {
+				backtraces.push_back(b);
+			}
+			return backtraces;
+		}
 
-#else
+		thread_local Backtrace *Backtrace::current = nullptr;
 
-		static std::map<Uint32, Backtrace *> globalBacktrace;
-		static Uint32 firstThread = 0;
-		static Backtrace firstThreadBacktrace;
+		// Stack frames are not recorded until `StartBacktrace` is called so that functions
+		// called by global constructors don't take `Backtrace` objects.
+		static bool backtraceStarted = false;
 
-		Backtrace *Backtrace::GetGlobalBacktrace() {
-			Uint32 thread = SDL_ThreadID();
-			if (firstThread == 0)
-				firstThread = thread;
-			if (thread == firstThread) {
-				return &firstThreadBacktrace;
-			}
-			std::map<Uint32, Backtrace *>::iterator it = globalBacktrace.find(thread);
-			if (it == globalBacktrace.end()) {
-				Backtrace *t = new Backtrace();
-				globalBacktrace[thread] = t;
-				return t;
-			} else {
-				return it->second;
-			}
+		Backtrace *Backtrace::AcquireForCurrentThread() {
+			if (!backtraceStarted)
+				return NULL;
+			current = Acquire();
+			return current;
 		}
 
 		void Backtrace::ThreadExiting() {
-			Uint32 thread = SDL_ThreadID();
-			if (thread == firstThread)
-				return;
-			std::map<Uint32, Backtrace *>::iterator it = globalBacktrace.find(thread);
-			if (it != globalBacktrace.end()) {
-				delete it->second;
-				globalBacktrace.erase(it);
+			Backtrace *b = current;
+			if (b) {
+				current = nullptr;
+				b->Release();
 			}
 		}
 
-		void Backtrace::StartBacktrace() {}
-
-#endif
+		void Backtrace::StartBacktrace() { backtraceStarted = true; }
 
-		void Backtrace::Push(const spades::reflection::BacktraceEntry &entry) {
-			entries.push_back(entry);
+		std::vector<BacktraceEntry> Backtrace::GetAllEntries() {
+			BacktraceRecord record;
+			Sample(record);
+			return record;
 		}
 
-		void Backtrace::Pop() {
-			SPAssert(entries.size() > 0);
-			entries.pop_back();
-		}
+		bool Backtrace::Sample(BacktraceRecord &outRecord) const {
+			outRecord.clear();
+			if (!inUse.load(std::memory_order_acquire)) {
+				return false;
+			}
 
-		std::vector<BacktraceEntry> Backtrace::GetAllEntries() { return entries; }
+			std::size_t d = depth.load(std::memory_order_acquire);
+			std::size_t begin = d > MaxDepth ? d - MaxDepth : 0;
+			outRecord.reserve(d - begin);
+			for (std::size_t i = begin; i < d; ++i) {
+				// Entries point to static `Function` objects, so even a stale one is valid
+				Function const *function =
+				  entries[i & (MaxDepth - 1)].load(std::memory_order_relaxed);
+				if (function) {
+					outRecord.emplace_back(function);
+				}
+			}
+			return true;
+		}
 
-		std::string Backtrace::ToString() const { return BacktraceRecordToString(entries); }
+		std::string Backtrace::ToString() const {
+			BacktraceRecord record;
+			Sample(record);
+			return BacktraceRecordToString(record);
+		}
 		std::string BacktraceRecordToString(const BacktraceRecord &entries) {
 			std::string message;
 			char buf[1024];
@@ -190,6 +197,9 @@ namespace spades {
 
 		/** Stores log lines to be displayed in the internal console. */
 		BoundedLogBuffer g_consoleLogBuffer;
+
+		/** Protects the log destinations. Log messages may be produced by worker threads. */
+		std::mutex g_logMutex;
 	} // namespace
 
 	static std::unique_ptr<IStream> logStream;
@@ -209,10 +219,15 @@ namespace spades {
 
 		// Swap log buffers because `Push` is not safe to call while
 		// `Flush` is in progress
-		std::swap(tmp, g_consoleLogBuffer);
+		{
+			std::lock_guard<std::mutex> lock{g_logMutex};
+			std::swap(tmp, g_consoleLogBuffer);
+		}
 
 		tmp.Flush(cb);
 
+		std::lock_guard<std::mutex> lock{g_logMutex};
+
 		// Swap them back
 		std::swap(tmp, g_consoleLogBuffer);
 
@@ -220,8 +235,6 @@ namespace spades {
 		g_consoleLogBuffer.MergeFrom(std::move(tmp));
 	}
 
-	// TODO: What happened to thread-safety here
-
 	void LogMessage(const char *file, int line, const char *format, ...) {
 		char buf[4096];
 		va_list va;
@@ -245,6 +258,8 @@ namespace spades {
 		         fn.c_str(), line, str.c_str());
 		buf[sizeof(buf) - 1] = 0;
 
+		std::lock_guard<std::mutex> lock{g_logMutex};
+
 		// Log messages are outputted to three destinations.
 
 		// (1) stdout
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <vector>
 
 #include "Exception.h"
@@ -53,31 +55,103 @@ namespace spades {
 			const Function &GetFunction() const { return *function; }
 		};
 
-		class BacktraceEntryAdder {
-			Backtrace *bt;
-
-		public:
-			BacktraceEntryAdder(const BacktraceEntry &);
-			~BacktraceEntryAdder();
-		};
-
 		typedef std::vector<BacktraceEntry> BacktraceRecord;
 
+		/**
+		 * The shadow call stack of a thread, maintained by `SPADES_MARK_FUNCTION`.
+		 *
+		 * The stack is a fixed-capacity ring buffer, so pushing and popping a frame never
+		 * allocates memory. When the stack is deeper than `MaxDepth`, only the innermost
+		 * `MaxDepth` frames are retained.
+		 *
+		 * The stack is only modified by the owning thread, but other threads (e.g., the sampling
+		 * profiler) may read it concurrently without locking.
+		 *
+		 * `Backtrace` objects are never deleted. When a thread exits, its `Backtrace` is returned
+		 * to a global list and reused by a thread created later, so a pointer obtained by
+		 * `GetAllBacktraces` stays valid forever.
+		 */
 		class Backtrace {
-			std::vector<BacktraceEntry> entries;
-
 		public:
-			static Backtrace *GetGlobalBacktrace();
+			enum { MaxDepth = 256 };
+
+			/** Returns the current thread's `Backtrace`, or `nullptr` before `StartBacktrace`. */
+			static Backtrace *GetGlobalBacktrace() {
+				Backtrace *b = current;
+				return b ? b : AcquireForCurrentThread();
+			}
 			static void ThreadExiting();
 			static void StartBacktrace();
 
-			void Push(const BacktraceEntry &);
-			void Pop();
+			/**
+			 * Returns all `Backtrace` objects ever created, including ones that are not in use
+			 * by any threads. Safe to call from any thread.
+			 */
+			static std::vector<Backtrace *> GetAllBacktraces();
+
+			void Push(Function const *function) {
+				// Store the entry before publishing the new depth so a concurrent reader never
+				// sees an uninitialized frame
+				std::size_t d = depth.load(std::memory_order_relaxed);
+				entries[d & (MaxDepth - 1)].store(function, std::memory_order_relaxed);
+				depth.store(d + 1, std::memory_order_release);
+			}
+			void Pop() {
+				std::size_t d = depth.load(std::memory_order_relaxed);
+				depth.store(d - 1, std::memory_order_release);
+			}
 
 			BacktraceRecord GetAllEntries();
 			BacktraceRecord GetRecord() { return GetAllEntries(); }
 
+			/**
+			 * Copies the current stack from any thread without blocking the owning thread.
+			 *
+			 * The result may mix frames from before and after a concurrent modification, which
+			 * is acceptable for statistical purposes.
+			 *
+			 * @return `false` if this object is not in use by any threads.
+			 */
+			bool Sample(BacktraceRecord &outRecord) const;
+
+			/** Returns a number identifying the thread currently using this object. */
+			int GetThreadId() const { return threadId.load(std::memory_order_relaxed); }
+
 			std::string ToString() const;
+
+		private:
+			static_assert((MaxDepth & (MaxDepth - 1)) == 0, "MaxDepth must be a power of two");
+
+			static thread_local Backtrace *current;
+
+			std::atomic<Function const *> entries[MaxDepth];
+			std::atomic<std::size_t> depth;
+
+			std::atomic<bool> inUse;
+			std::atomic<int> threadId;
+
+			/** The next item in the global list of `Backtrace` objects. */
+			Backtrace *next;
+
+			Backtrace();
+
+			static Backtrace *AcquireForCurrentThread();
+			static Backtrace *Acquire();
+			void Release();
+		};
+
+		class BacktraceEntryAdder {
+			Backtrace *bt;
+
+		public:
+			BacktraceEntryAdder(const BacktraceEntry &entry) : bt{Backtrace::GetGlobalBacktrace()} {
+				if (bt)
+					bt->Push(&entry.GetFunction());
+			}
+			~BacktraceEntryAdder() {
+				if (bt)
+					bt->Pop();
+			}
 		};
 
 		std::string BacktraceRecordToString(const BacktraceRecord &);
@@ -102,18 +176,40 @@ namespace spades {
 #define __PRETTY_FUNCTION__ __FUNCDNAME__
 #endif
 
+/**
+ * The instrumentation level of the shadow call stack, which can be set by the
+ * `OPENSPADES_BACKTRACE` CMake option.
+ *
+ *  - 0: Disabled. Exceptions and crash reports don't include backtraces.
+ *  - 1: Only functions marked with `SPADES_MARK_FUNCTION` are recorded.
+ *  - 2: Functions marked with `SPADES_MARK_FUNCTION_DEBUG` are recorded too.
+ */
+#ifndef SPADES_BACKTRACE_LEVEL
+#if NDEBUG
+#define SPADES_BACKTRACE_LEVEL 1
+#else
+#define SPADES_BACKTRACE_LEVEL 2
+#endif
+#endif
+
+#if SPADES_BACKTRACE_LEVEL >= 1
 #define SPADES_MARK_FUNCTION()                                                                     \
 	static constexpr ::spades::reflection::Function thisFunction{__PRETTY_FUNCTION__, __FILE__,    \
 	                                                             __LINE__};                        \
 	::spades::reflection::BacktraceEntryAdder backtraceEntryAdder(                                 \
 	  (::spades::reflection::BacktraceEntry(&thisFunction)))
+#else
+#define SPADES_MARK_FUNCTION()                                                                     \
+	do {                                                                                           \
+	} while (0)
+#endif
 
-#if NDEBUG
+#if SPADES_BACKTRACE_LEVEL >= 2
+#define SPADES_MARK_FUNCTION_DEBUG() SPADES_MARK_FUNCTION()
+#else
 #define SPADES_MARK_FUNCTION_DEBUG()                                                               \
 	do {                                                                                           \
 	} while (0)
-#else
-#define SPADES_MARK_FUNCTION_DEBUG() SPADES_MARK_FUNCTION()
 #endif
 
 #if NDEBUG
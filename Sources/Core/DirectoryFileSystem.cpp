@@ -35,6 +35,7 @@
 
 #include "Debug.h"
 #include "Exception.h"
+#include "MappedFile.h"
 #include "SdlFileStream.h"
 
 namespace spades {
@@ -202,4 +203,23 @@ namespace spades {
 		}
 		return false;
 	}
+
+	std::unique_ptr<MappedFile> DirectoryFileSystem::OpenMapped(const char *fn) {
+		SPADES_MARK_FUNCTION();
+		return MappedFile::Open(PathToPhysical(fn));
+	}
+
+	bool DirectoryFileSystem::RemoveFile(const char *fn) {
+		SPADES_MARK_FUNCTION();
+		if (!canWrite) {
+			return false;
+		}
+
+		std::string path = PathToPhysical(fn);
+#ifdef WIN32
+		return DeleteFileW(Utf8ToWString(path.c_str()).c_str()) != 0;
+#else
+		return remove(path.c_str()) == 0;
+#endif
+	}
 } // namespace spades
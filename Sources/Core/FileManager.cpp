@@ -18,17 +18,19 @@
 
  */
 
-#include <list>
 #include <set>
+#include <vector>
 
 #include "Debug.h"
 #include "Exception.h"
 #include "FileManager.h"
 #include "IFileSystem.h"
 #include "IStream.h"
+#include "MappedFile.h"
+#include "TMPUtils.h"
 
 namespace spades {
-	static std::list<IFileSystem *> g_fileSystems;
+	static std::vector<IFileSystem *> g_fileSystems;
 	std::unique_ptr<IStream> FileManager::OpenForReading(const char *fn) {
 		SPADES_MARK_FUNCTION();
 		if (!fn)
@@ -94,6 +96,39 @@ namespace spades {
 		return false;
 	}
 
+	std::unique_ptr<MappedFile> FileManager::OpenMapped(const char *fn) {
+		SPADES_MARK_FUNCTION();
+		if (!fn)
+			SPInvalidArgument("fn");
+		if (fn[0] == 0)
+			SPFileNotFound(fn);
+
+		for (auto *fs : g_fileSystems) {
+			if (fs->FileExists(fn)) {
+				auto mapped = fs->OpenMapped(fn);
+				if (mapped) {
+					return mapped;
+				}
+				return stmp::make_unique<MappedFile>(fs->OpenForReading(fn)->ReadAllBytes());
+			}
+		}
+
+		SPFileNotFound(fn);
+	}
+
+	bool FileManager::RemoveFile(const char *fn) {
+		SPADES_MARK_FUNCTION();
+		if (!fn)
+			SPInvalidArgument("fn");
+
+		for (auto *fs : g_fileSystems) {
+			if (fs->FileExists(fn)) {
+				return fs->RemoveFile(fn);
+			}
+		}
+		return false;
+	}
+
 	void FileManager::AddFileSystem(spades::IFileSystem *fs) {
 		SPADES_MARK_FUNCTION();
 		AppendFileSystem(fs);
@@ -111,7 +146,7 @@ namespace spades {
 		if (!fs)
 			SPInvalidArgument("fs");
 
-		g_fileSystems.push_front(fs);
+		g_fileSystems.insert(g_fileSystems.begin(), fs);
 	}
 
 	std::string FileManager::ReadAllBytes(const char *fn) {
@@ -27,6 +27,7 @@
 namespace spades {
 	class IStream;
 	class IFileSystem;
+	class MappedFile;
 	class FileManager {
 		FileManager() {}
 
@@ -34,6 +35,13 @@ namespace spades {
 		static std::unique_ptr<IStream> OpenForReading(const char *);
 		static std::unique_ptr<IStream> OpenForWriting(const char *);
 		static bool FileExists(const char *);
+		/**
+		 * Maps a file into memory if the file system supports it. Otherwise, reads the whole
+		 * file into memory.
+		 */
+		static std::unique_ptr<MappedFile> OpenMapped(const char *);
+		/** Deletes a file from the first file system that has it and allows deleting it. */
+		static bool RemoveFile(const char *);
 		static void AddFileSystem(IFileSystem *);
 		static void AppendFileSystem(IFileSystem *);
 		static void PrependFileSystem(IFileSystem *);
@@ -24,6 +24,8 @@
 #include <string>
 #include <vector>
 
+#include "MappedFile.h"
+
 namespace spades {
 	class IStream;
 	class IFileSystem {
@@ -33,5 +35,14 @@ namespace spades {
 		virtual std::unique_ptr<IStream> OpenForReading(const char *) = 0;
 		virtual std::unique_ptr<IStream> OpenForWriting(const char *) = 0;
 		virtual bool FileExists(const char *) = 0;
+
+		/**
+		 * Maps an existing file into memory. Returns `nullptr` if this file system doesn't
+		 * support memory mapping.
+		 */
+		virtual std::unique_ptr<MappedFile> OpenMapped(const char *) { return nullptr; }
+
+		/** Deletes a file. Returns `false` if the file couldn't be deleted. */
+		virtual bool RemoveFile(const char *) { return false; }
 	};
 } // namespace spades
@@ -0,0 +1,147 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Debug.h"
+#include "Exception.h"
+#include "MappedFile.h"
+
+namespace spades {
+	MappedFile::MappedFile()
+	    : data{nullptr}, size{0}, fileHandle{nullptr}, mappingHandle{nullptr} {}
+
+	MappedFile::MappedFile(std::string contents) : MappedFile() {
+		this->contents = std::move(contents);
+		data = this->contents.data();
+		size = this->contents.size();
+	}
+
+	MappedFile::MappedFile(const char *data, std::size_t size) : MappedFile() {
+		this->data = data;
+		this->size = size;
+	}
+
+#ifdef WIN32
+	std::unique_ptr<MappedFile> MappedFile::Open(const std::string &path) {
+		SPADES_MARK_FUNCTION();
+
+		std::unique_ptr<MappedFile> file{new MappedFile()};
+
+		int pathLength = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+		std::wstring widePath(pathLength, L'\0');
+		MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], pathLength);
+
+		HANDLE handle = CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE) {
+			SPRaise("Failed to open %s for mapping: error %d", path.c_str(),
+			        static_cast<int>(GetLastError()));
+		}
+		file->fileHandle = handle;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(handle, &fileSize)) {
+			SPRaise("Failed to get the size of %s: error %d", path.c_str(),
+			        static_cast<int>(GetLastError()));
+		}
+		file->size = static_cast<std::size_t>(fileSize.QuadPart);
+		if (file->size == 0) {
+			// An empty file cannot be mapped
+			return file;
+		}
+
+		HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping) {
+			SPRaise("Failed to map %s: error %d", path.c_str(), static_cast<int>(GetLastError()));
+		}
+		file->mappingHandle = mapping;
+
+		file->data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!file->data) {
+			SPRaise("Failed to map %s: error %d", path.c_str(), static_cast<int>(GetLastError()));
+		}
+
+		return file;
+	}
+
+	MappedFile::~MappedFile() {
+		if (mappingHandle) {
+			if (data) {
+				UnmapViewOfFile(data);
+			}
+			CloseHandle(mappingHandle);
+		}
+		if (fileHandle) {
+			CloseHandle(fileHandle);
+		}
+	}
+#else
+	std::unique_ptr<MappedFile> MappedFile::Open(const std::string &path) {
+		SPADES_MARK_FUNCTION();
+
+		std::unique_ptr<MappedFile> file{new MappedFile()};
+
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			SPRaise("Failed to open %s for mapping", path.c_str());
+		}
+
+		struct stat info;
+		if (fstat(fd, &info) != 0) {
+			close(fd);
+			SPRaise("Failed to get the size of %s", path.c_str());
+		}
+
+		file->size = static_cast<std::size_t>(info.st_size);
+		if (file->size == 0) {
+			// An empty file cannot be mapped
+			close(fd);
+			return file;
+		}
+
+		void *ptr = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		// The mapping remains valid after the file descriptor is closed
+		close(fd);
+
+		if (ptr == MAP_FAILED) {
+			SPRaise("Failed to map %s", path.c_str());
+		}
+		file->data = static_cast<const char *>(ptr);
+		file->mappingHandle = ptr;
+
+		return file;
+	}
+
+	MappedFile::~MappedFile() {
+		if (mappingHandle) {
+			munmap(mappingHandle, size);
+		}
+	}
+#endif
+} // namespace spades
@@ -0,0 +1,67 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace spades {
+	/**
+	 * A read-only view of the whole contents of a file.
+	 *
+	 * A file on a physical file system is mapped into the address space, so its contents are
+	 * paged in on demand. Other files (e.g., ones in an archive) are read into memory.
+	 */
+	class MappedFile {
+	public:
+		/** Maps the file at the specified physical path. Throws an exception on failure. */
+		static std::unique_ptr<MappedFile> Open(const std::string &path);
+
+		/** Creates a `MappedFile` that holds the specified bytes. */
+		explicit MappedFile(std::string contents);
+
+		/**
+		 * Creates a `MappedFile` that refers to the specified bytes without copying them. The
+		 * bytes must outlive the created object.
+		 */
+		MappedFile(const char *data, std::size_t size);
+		~MappedFile();
+
+		MappedFile(const MappedFile &) = delete;
+		void operator=(const MappedFile &) = delete;
+
+		const char *GetData() const { return data; }
+		std::size_t GetSize() const { return size; }
+
+	private:
+		MappedFile();
+
+		const char *data;
+		std::size_t size;
+
+		/** The backing storage when the file isn't actually mapped. */
+		std::string contents;
+
+		/** The platform-specific handles of the mapping. */
+		void *fileHandle;
+		void *mappingHandle;
+	};
+} // namespace spades
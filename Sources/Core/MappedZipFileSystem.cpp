@@ -0,0 +1,343 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <cctype>
+#include <cstring>
+#include <limits>
+
+#include <zlib.h>
+
+#include "Debug.h"
+#include "Exception.h"
+#include "MappedFile.h"
+#include "MappedZipFileSystem.h"
+#include "MemoryStream.h"
+#include "TMPUtils.h"
+
+namespace spades {
+	namespace {
+		enum : std::uint32_t {
+			EndOfCentralDirectorySignature = 0x06054b50,
+			CentralDirectoryEntrySignature = 0x02014b50,
+			LocalFileHeaderSignature = 0x04034b50,
+		};
+
+		enum : std::size_t {
+			EndOfCentralDirectorySize = 22,
+			CentralDirectoryEntrySize = 46,
+			LocalFileHeaderSize = 30,
+			MaxCommentLength = 0xffff,
+		};
+
+		enum : std::uint16_t { MethodStored = 0, MethodDeflated = 8 };
+
+		std::uint16_t ReadUInt16(const char *p) {
+			const auto *b = reinterpret_cast<const unsigned char *>(p);
+			return static_cast<std::uint16_t>(b[0] | (b[1] << 8));
+		}
+
+		std::uint32_t ReadUInt32(const char *p) {
+			const auto *b = reinterpret_cast<const unsigned char *>(p);
+			return static_cast<std::uint32_t>(b[0]) | (static_cast<std::uint32_t>(b[1]) << 8) |
+			       (static_cast<std::uint32_t>(b[2]) << 16) |
+			       (static_cast<std::uint32_t>(b[3]) << 24);
+		}
+
+		/** Converts a path to the form used as keys of the index (same as `ZipFileSystem`). */
+		std::string NormalizeName(const char *fn) {
+			std::string name = fn;
+			for (char &c : name) {
+				if (c == '\\')
+					c = '/';
+				else
+					c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+			}
+			return name;
+		}
+
+		bool MatchesZipFile(const char *fn, const char *path) {
+			for (size_t i = 0;; i++) {
+				if (path[i] == 0) {
+					return true;
+				}
+				if (fn[i] == 0) {
+					return false;
+				}
+				if ((fn[i] == '/' || fn[i] == '\\') && (path[i] == '/' || path[i] == '\\')) {
+					continue;
+				}
+				if (tolower(fn[i]) != tolower(path[i]))
+					return false;
+			}
+		}
+
+		/** A `MemoryStream` that owns its buffer. */
+		struct StringHolder {
+			std::string data;
+		};
+		class StringStream : StringHolder, public MemoryStream {
+		public:
+			explicit StringStream(std::string data)
+			    : StringHolder{std::move(data)},
+			      MemoryStream(StringHolder::data.data(), StringHolder::data.size()) {}
+		};
+	} // namespace
+
+	MappedZipFileSystem::MappedZipFileSystem(std::unique_ptr<MappedFile> archive)
+	    : archive{std::move(archive)} {
+		SPADES_MARK_FUNCTION();
+
+		const char *data = this->archive->GetData();
+		std::size_t size = this->archive->GetSize();
+
+		// Find the end of central directory record, which is followed by a comment
+		if (size < EndOfCentralDirectorySize) {
+			SPRaise("Not a ZIP file: too short");
+		}
+		std::size_t eocd = size - EndOfCentralDirectorySize;
+		std::size_t searchEnd = eocd > MaxCommentLength ? eocd - MaxCommentLength : 0;
+		while (ReadUInt32(data + eocd) != EndOfCentralDirectorySignature) {
+			if (eocd == searchEnd) {
+				SPRaise("Not a ZIP file: end of central directory not found");
+			}
+			--eocd;
+		}
+
+		std::uint16_t diskNumber = ReadUInt16(data + eocd + 4);
+		std::uint16_t centralDirectoryDisk = ReadUInt16(data + eocd + 6);
+		std::uint16_t numEntries = ReadUInt16(data + eocd + 10);
+		std::uint32_t centralDirectorySize = ReadUInt32(data + eocd + 12);
+		std::uint32_t centralDirectoryOffset = ReadUInt32(data + eocd + 16);
+
+		if (diskNumber != 0 || centralDirectoryDisk != 0) {
+			SPRaise("Multi-disk ZIP files are not supported");
+		}
+		if (numEntries == 0xffff || centralDirectorySize == 0xffffffff ||
+		    centralDirectoryOffset == 0xffffffff) {
+			SPRaise("ZIP64 is not supported");
+		}
+		if (static_cast<std::uint64_t>(centralDirectoryOffset) + centralDirectorySize > eocd) {
+			SPRaise("Corrupted ZIP file: central directory out of bounds");
+		}
+
+		entries.reserve(numEntries);
+		index.reserve(numEntries);
+
+		const char *p = data + centralDirectoryOffset;
+		const char *end = p + centralDirectorySize;
+		for (std::uint16_t i = 0; i < numEntries; ++i) {
+			if (static_cast<std::size_t>(end - p) < CentralDirectoryEntrySize ||
+			    ReadUInt32(p) != CentralDirectoryEntrySignature) {
+				SPRaise("Corrupted ZIP file: bad central directory entry");
+			}
+
+			Entry entry;
+			entry.flags = ReadUInt16(p + 8);
+			entry.method = ReadUInt16(p + 10);
+			entry.crc = ReadUInt32(p + 16);
+			entry.compressedSize = ReadUInt32(p + 20);
+			entry.size = ReadUInt32(p + 24);
+			std::uint16_t nameLength = ReadUInt16(p + 28);
+			std::uint16_t extraLength = ReadUInt16(p + 30);
+			std::uint16_t commentLength = ReadUInt16(p + 32);
+			entry.localHeaderOffset = ReadUInt32(p + 42);
+
+			if (entry.compressedSize == 0xffffffff || entry.size == 0xffffffff ||
+			    entry.localHeaderOffset == 0xffffffff) {
+				SPRaise("ZIP64 is not supported");
+			}
+
+			std::size_t recordSize =
+			  CentralDirectoryEntrySize + nameLength + extraLength + commentLength;
+			if (static_cast<std::size_t>(end - p) < recordSize) {
+				SPRaise("Corrupted ZIP file: bad central directory entry");
+			}
+			entry.name.assign(p + CentralDirectoryEntrySize, nameLength);
+			p += recordSize;
+
+			// Like `ZipFileSystem`, the first one wins if there are duplicates
+			if (index.emplace(NormalizeName(entry.name.c_str()), entries.size()).second) {
+				entries.push_back(std::move(entry));
+			}
+		}
+	}
+
+	MappedZipFileSystem::~MappedZipFileSystem() {}
+
+	const MappedZipFileSystem::Entry *MappedZipFileSystem::FindEntry(const char *fn) const {
+		auto it = index.find(NormalizeName(fn));
+		if (it == index.end()) {
+			return nullptr;
+		}
+		return &entries[it->second];
+	}
+
+	const char *MappedZipFileSystem::GetEntryData(const Entry &entry) const {
+		const char *data = archive->GetData();
+		std::size_t size = archive->GetSize();
+
+		if (entry.flags & 1) {
+			SPRaise("Encrypted ZIP entries are not supported: %s", entry.name.c_str());
+		}
+
+		// The lengths of the name and extra field may differ from the central directory's
+		std::uint64_t offset = entry.localHeaderOffset;
+		if (offset + LocalFileHeaderSize > size ||
+		    ReadUInt32(data + offset) != LocalFileHeaderSignature) {
+			SPRaise("Corrupted ZIP file: bad local file header of %s", entry.name.c_str());
+		}
+		offset += LocalFileHeaderSize + ReadUInt16(data + offset + 26) +
+		          ReadUInt16(data + offset + 28);
+		if (offset + entry.compressedSize > size) {
+			SPRaise("Corrupted ZIP file: %s is out of bounds", entry.name.c_str());
+		}
+		return data + offset;
+	}
+
+	const char *MappedZipFileSystem::GetStoredData(const Entry &entry) const {
+		SPADES_MARK_FUNCTION();
+
+		// `GetEntryData` only checks `compressedSize`, which must match for a stored entry
+		if (entry.size != entry.compressedSize) {
+			SPRaise("Corrupted ZIP file: size mismatch in stored entry %s", entry.name.c_str());
+		}
+
+		const char *data = GetEntryData(entry);
+
+		uLong crc = crc32(0L, Z_NULL, 0);
+		crc = crc32(crc, reinterpret_cast<const Bytef *>(data), static_cast<uInt>(entry.size));
+		if (crc != entry.crc) {
+			SPRaise("CRC mismatch in %s", entry.name.c_str());
+		}
+
+		return data;
+	}
+
+	std::string MappedZipFileSystem::Inflate(const Entry &entry) const {
+		SPADES_MARK_FUNCTION();
+
+		const char *compressed = GetEntryData(entry);
+		std::string output(entry.size, '\0');
+
+		z_stream zs;
+		std::memset(&zs, 0, sizeof(zs));
+		// Negative window bits: raw deflate data without a zlib header
+		int ret = inflateInit2(&zs, -MAX_WBITS);
+		if (ret != Z_OK) {
+			SPRaise("Failed to initialize zlib inflator: %s", zError(ret));
+		}
+		zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed));
+		zs.avail_in = entry.compressedSize;
+		zs.next_out = reinterpret_cast<Bytef *>(&output[0]);
+		zs.avail_out = entry.size;
+		ret = inflate(&zs, Z_FINISH);
+		uLong totalOut = zs.total_out;
+		inflateEnd(&zs);
+
+		if (ret != Z_STREAM_END || totalOut != entry.size) {
+			SPRaise("Failed to inflate %s: %s", entry.name.c_str(),
+			        ret == Z_STREAM_END ? "size mismatch" : zError(ret));
+		}
+
+		uLong crc = crc32(0L, Z_NULL, 0);
+		crc = crc32(crc, reinterpret_cast<const Bytef *>(output.data()),
+		            static_cast<uInt>(output.size()));
+		if (crc != entry.crc) {
+			SPRaise("CRC mismatch in %s", entry.name.c_str());
+		}
+
+		return output;
+	}
+
+	std::unique_ptr<IStream> MappedZipFileSystem::OpenForReading(const char *fn) {
+		SPADES_MARK_FUNCTION();
+
+		const Entry *entry = FindEntry(fn);
+		if (!entry) {
+			SPFileNotFound(fn);
+		}
+
+		switch (entry->method) {
+			case MethodStored:
+				return stmp::make_unique<MemoryStream>(GetStoredData(*entry), entry->size);
+			case MethodDeflated: return stmp::make_unique<StringStream>(Inflate(*entry));
+			default:
+				SPRaise("Unsupported compression method %d: %s", static_cast<int>(entry->method),
+				        fn);
+		}
+	}
+
+	std::unique_ptr<MappedFile> MappedZipFileSystem::OpenMapped(const char *fn) {
+		SPADES_MARK_FUNCTION();
+
+		const Entry *entry = FindEntry(fn);
+		if (!entry) {
+			SPFileNotFound(fn);
+		}
+
+		switch (entry->method) {
+			case MethodStored:
+				return stmp::make_unique<MappedFile>(GetStoredData(*entry), entry->size);
+			case MethodDeflated: return stmp::make_unique<MappedFile>(Inflate(*entry));
+			default:
+				SPRaise("Unsupported compression method %d: %s", static_cast<int>(entry->method),
+				        fn);
+		}
+	}
+
+	std::unique_ptr<IStream> MappedZipFileSystem::OpenForWriting(const char *) {
+		SPADES_MARK_FUNCTION();
+		SPRaise("ZIP file system doesn't support writing");
+	}
+
+	bool MappedZipFileSystem::FileExists(const char *fn) {
+		SPADES_MARK_FUNCTION();
+		return FindEntry(fn) != nullptr;
+	}
+
+	std::vector<std::string> MappedZipFileSystem::EnumFiles(const char *path) {
+		SPADES_MARK_FUNCTION();
+
+		// Same as `ZipFileSystem::EnumFiles`
+		std::vector<std::string> lst;
+		size_t ln = strlen(path);
+		for (const Entry &entry : entries) {
+			const char *buf = entry.name.c_str();
+			if (!MatchesZipFile(buf, path))
+				continue;
+			if (buf[ln] != '/' && buf[ln] != '\\')
+				continue;
+			if (strchr(buf + ln + 1, '/') || strchr(buf + ln + 1, '\\'))
+				continue;
+			lst.push_back(buf + ln + 1);
+		}
+		return lst;
+	}
+
+	std::vector<std::string> MappedZipFileSystem::EnumAllFiles() {
+		std::vector<std::string> lst;
+		for (const Entry &entry : entries) {
+			if (!entry.name.empty() && entry.name.back() != '/' && entry.name.back() != '\\') {
+				lst.push_back(entry.name);
+			}
+		}
+		return lst;
+	}
+} // namespace spades
@@ -0,0 +1,87 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "IFileSystem.h"
+
+namespace spades {
+	class MappedFile;
+
+	/**
+	 * A read-only file system backed by a ZIP archive mapped into memory.
+	 *
+	 * The central directory is indexed by a hash table once on construction. Opening a file
+	 * doesn't modify the file system, so any number of threads can read files concurrently.
+	 * Stored (uncompressed) files are accessed without copying them; deflated files are
+	 * inflated in one go.
+	 *
+	 * Streams and mapped files returned by this file system refer to the archive's memory and
+	 * must not outlive the file system.
+	 *
+	 * Encrypted files, multi-disk archives, and ZIP64 are not supported. The constructor throws
+	 * an exception for an archive it can't handle so the caller can fall back to
+	 * `ZipFileSystem`.
+	 */
+	class MappedZipFileSystem : public IFileSystem {
+	public:
+		explicit MappedZipFileSystem(std::unique_ptr<MappedFile> archive);
+		~MappedZipFileSystem();
+
+		std::vector<std::string> EnumFiles(const char *) override;
+
+		std::unique_ptr<IStream> OpenForReading(const char *) override;
+		std::unique_ptr<IStream> OpenForWriting(const char *) override;
+		bool FileExists(const char *) override;
+
+		std::unique_ptr<MappedFile> OpenMapped(const char *) override;
+
+		/** Returns the names of all files (excluding directories) in the archive. */
+		std::vector<std::string> EnumAllFiles();
+
+	private:
+		struct Entry {
+			/** The name as stored in the archive. */
+			std::string name;
+			std::uint16_t flags;
+			std::uint16_t method;
+			std::uint32_t crc;
+			std::uint32_t compressedSize;
+			std::uint32_t size;
+			std::uint32_t localHeaderOffset;
+		};
+
+		std::unique_ptr<MappedFile> archive;
+		std::vector<Entry> entries;
+		/** Maps normalized names to indices into `entries`. */
+		std::unordered_map<std::string, std::size_t> index;
+
+		const Entry *FindEntry(const char *) const;
+		const char *GetEntryData(const Entry &) const;
+		/** Returns the contents of a stored entry after validating its size and CRC. */
+		const char *GetStoredData(const Entry &) const;
+		std::string Inflate(const Entry &) const;
+	};
+} // namespace spades
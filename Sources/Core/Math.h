@@ -919,6 +919,27 @@ namespace spades {
 		vec.resize(vec.size() - 1);
 	}
 
+	/** @return The number of set bits in `v`. */
+	static inline int CountBits(std::uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_popcountll(v);
+#else
+		v = v - ((v >> 1) & 0x5555555555555555ULL);
+		v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+		v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		return static_cast<int>((v * 0x0101010101010101ULL) >> 56);
+#endif
+	}
+
+	/** @return The index of the lowest set bit in `v`. `v` must not be zero. */
+	static inline int CountTrailingZeros(std::uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_ctzll(v);
+#else
+		return CountBits((v & (0 - v)) - 1);
+#endif
+	}
+
 	float Mix(float a, float b, float frac);
 	Vector2 Mix(const Vector2 &a, const Vector2 &b, float frac);
 	Vector3 Mix(const Vector3 &a, const Vector3 &b, float frac);
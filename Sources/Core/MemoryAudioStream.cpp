@@ -0,0 +1,71 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "Debug.h"
+#include "Exception.h"
+#include "MemoryAudioStream.h"
+
+namespace spades {
+	MemoryAudioStream::MemoryAudioStream(IAudioStream &source)
+	    : position{0},
+	      samplingFrequency{source.GetSamplingFrequency()},
+	      sampleFormat{source.GetSampleFormat()},
+	      numChannels{source.GetNumChannels()} {
+		SPADES_MARK_FUNCTION();
+
+		if (source.GetLength() > 128 * 1024 * 1024) {
+			SPRaise("Audio stream too long");
+		}
+
+		samples.resize(static_cast<std::size_t>(source.GetLength()));
+		source.SetPosition(0);
+		if (source.Read(samples.data(), samples.size()) < samples.size()) {
+			SPRaise("Failed to read audio data");
+		}
+	}
+
+	uint64_t MemoryAudioStream::GetLength() { return samples.size(); }
+	int MemoryAudioStream::GetSamplingFrequency() { return samplingFrequency; }
+	auto MemoryAudioStream::GetSampleFormat() -> SampleFormat { return sampleFormat; }
+	int MemoryAudioStream::GetNumChannels() { return numChannels; }
+
+	int MemoryAudioStream::ReadByte() {
+		if (position >= samples.size()) {
+			return -1;
+		}
+		return static_cast<unsigned char>(samples[position++]);
+	}
+
+	size_t MemoryAudioStream::Read(void *data, size_t bytes) {
+		std::size_t numBytes = std::min(bytes, samples.size() - position);
+		std::memcpy(data, samples.data() + position, numBytes);
+		position += numBytes;
+		return numBytes;
+	}
+
+	uint64_t MemoryAudioStream::GetPosition() { return position; }
+
+	void MemoryAudioStream::SetPosition(uint64_t pos) {
+		position = static_cast<std::size_t>(std::min<uint64_t>(pos, samples.size()));
+	}
+} // namespace spades
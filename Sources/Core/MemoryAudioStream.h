@@ -0,0 +1,57 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <vector>
+
+#include "IAudioStream.h"
+
+namespace spades {
+	/**
+	 * An `IAudioStream` holding fully decoded samples in memory.
+	 *
+	 * Decoding a sound is the most expensive part of loading it, so this class is used to
+	 * decode a sound on a worker thread before passing it to an audio device.
+	 */
+	class MemoryAudioStream : public IAudioStream {
+	public:
+		/** Decodes the whole contents of `source`. */
+		explicit MemoryAudioStream(IAudioStream &source);
+
+		uint64_t GetLength() override;
+		int GetSamplingFrequency() override;
+		SampleFormat GetSampleFormat() override;
+		int GetNumChannels() override;
+
+		int ReadByte() override;
+		size_t Read(void *, size_t bytes) override;
+
+		uint64_t GetPosition() override;
+		void SetPosition(uint64_t) override;
+
+	private:
+		std::vector<char> samples;
+		std::size_t position;
+
+		int samplingFrequency;
+		SampleFormat sampleFormat;
+		int numChannels;
+	};
+} // namespace spades
@@ -131,6 +131,7 @@ namespace spades {
 			SPAssert(Validate());
 		}
 		bool Validate();
+		size_t GetCapacity() const { return buffer.size(); }
 		void Reserve(size_t bytes) {
 			size_t newSize = buffer.size();
 			while (newSize < bytes)
@@ -93,6 +93,15 @@ namespace spades {
 			ExpandTo(length);
 		}
 
+		/**
+		 * Returns the data read from the inner stream so far. The returned pointer is
+		 * invalidated when the internal buffer is expanded by a subsequent read.
+		 */
+		const char *GetBufferedData() const { return buffer.data(); }
+
+		/** Returns the number of bytes read from the inner stream so far. */
+		std::size_t GetBufferedSize() const { return buffer.size(); }
+
 	private:
 		/**
 		 * Tries to ensure `buffer` is at least `newBufferSize` bytes long.
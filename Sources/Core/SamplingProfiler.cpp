@@ -0,0 +1,347 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "Exception.h"
+#include "FileManager.h"
+#include "IStream.h"
+#include "SamplingProfiler.h"
+#include "Stopwatch.h"
+#include "Thread.h"
+
+namespace spades {
+	namespace {
+		/** Limits the memory usage of trace events (about 32 bytes each). */
+		constexpr std::size_t MaxNumTraceEvents = 1 << 21;
+
+		std::string GetFunctionName(const reflection::Function &function) {
+			std::string name = function.GetName();
+			// Semicolons and newlines are delimiters in the collapsed stack format
+			std::replace(name.begin(), name.end(), ';', ':');
+			std::replace(name.begin(), name.end(), '\n', ' ');
+			return name;
+		}
+
+		std::string GetLocation(const reflection::Function &function) {
+			std::string file = function.GetFileName();
+			std::size_t ind = file.find_last_of("/\\");
+			if (ind != std::string::npos) {
+				file = file.substr(ind + 1);
+			}
+			return file + ":" + std::to_string(function.GetLineNumber());
+		}
+
+		std::string EscapeJsonString(const std::string &str) {
+			std::string out;
+			out.reserve(str.size());
+			for (char c : str) {
+				if (c == '"' || c == '\\') {
+					out += '\\';
+					out += c;
+				} else if (static_cast<unsigned char>(c) < 0x20) {
+					char buf[8];
+					std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<int>(c));
+					out += buf;
+				} else {
+					out += c;
+				}
+			}
+			return out;
+		}
+	} // namespace
+
+	class SamplingProfiler::SamplerThread : public Thread {
+	public:
+		SamplerThread(SamplingProfiler &profiler) : profiler{profiler} {}
+
+		void Run() noexcept override {
+			SPADES_MARK_FUNCTION();
+			profiler.SamplerMain();
+		}
+
+	private:
+		SamplingProfiler &profiler;
+	};
+
+	SamplingProfiler &SamplingProfiler::GetInstance() {
+		static SamplingProfiler instance;
+		return instance;
+	}
+
+	SamplingProfiler::SamplingProfiler()
+	    : stopRequested{false}, interval{0.0}, numSamples{0}, lastSampleTime{0.0} {}
+
+	SamplingProfiler::~SamplingProfiler() {
+		if (thread) {
+			stopRequested.store(true);
+			thread->Join();
+		}
+	}
+
+	bool SamplingProfiler::IsRunning() {
+		std::lock_guard<std::mutex> lock{mutex};
+		return static_cast<bool>(thread);
+	}
+
+	void SamplingProfiler::Start(double interval) {
+		SPADES_MARK_FUNCTION();
+
+		std::lock_guard<std::mutex> lock{mutex};
+		if (thread) {
+			SPRaise("The profiler is already running");
+		}
+		if (!(interval > 0.0)) {
+			SPRaise("Invalid sampling interval: %f", interval);
+		}
+
+		this->interval = interval;
+		numSamples = 0;
+		stackCounts.clear();
+		traceEvents.clear();
+		threads.clear();
+		lastSampleTime = 0.0;
+
+		SPLog("Starting the sampling profiler (interval: %.2f ms)", interval * 1000.0);
+#if SPADES_BACKTRACE_LEVEL == 0
+		SPLog("Warning: The shadow call stack is disabled in this build, so the profile will be "
+		      "empty");
+#endif
+
+		stopRequested.store(false);
+		thread.reset(new SamplerThread(*this));
+		thread->Start();
+	}
+
+	std::string SamplingProfiler::Stop() {
+		SPADES_MARK_FUNCTION();
+
+		std::lock_guard<std::mutex> lock{mutex};
+		if (!thread) {
+			SPRaise("The profiler is not running");
+		}
+
+		stopRequested.store(true);
+		thread->Join();
+		thread.reset();
+
+		// Close the frames that are still open
+		for (auto &item : threads) {
+			UpdateThreadStack(lastSampleTime, item.first, item.second, {});
+		}
+		threads.clear();
+
+		SPLog("Stopped the sampling profiler: %llu sample(s), %d unique stack(s), "
+		      "%d trace event(s)",
+		      static_cast<unsigned long long>(numSamples), static_cast<int>(stackCounts.size()),
+		      static_cast<int>(traceEvents.size()));
+
+		char bufText[256], bufJson[256];
+		for (int i = 0;; ++i) {
+			if (i >= 10000) {
+				SPRaise("No free file name");
+			}
+			std::snprintf(bufText, sizeof(bufText), "Profiles/profile%04d.txt", i);
+			std::snprintf(bufJson, sizeof(bufJson), "Profiles/profile%04d.json", i);
+			if (!FileManager::FileExists(bufText) && !FileManager::FileExists(bufJson)) {
+				break;
+			}
+		}
+
+		WriteCollapsedStacks(bufText);
+		WriteTraceEvents(bufJson);
+		SPLog("Wrote the profile to %s and %s", bufText, bufJson);
+
+		stackCounts.clear();
+		traceEvents.clear();
+
+		return bufText;
+	}
+
+	void SamplingProfiler::SamplerMain() {
+		SPADES_MARK_FUNCTION();
+
+		// Don't profile the profiler
+		reflection::Backtrace *self = reflection::Backtrace::GetGlobalBacktrace();
+
+		Stopwatch stopwatch;
+		std::vector<reflection::Backtrace *> backtraces;
+
+		while (!stopRequested.load()) {
+			std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+
+			// New threads may have been created since the last sample
+			backtraces = reflection::Backtrace::GetAllBacktraces();
+			TakeSample(stopwatch.GetTime(), backtraces, self);
+		}
+	}
+
+	void SamplingProfiler::TakeSample(double time,
+	                                  const std::vector<reflection::Backtrace *> &backtraces,
+	                                  reflection::Backtrace *self) {
+		++numSamples;
+		lastSampleTime = time;
+
+		reflection::BacktraceRecord record;
+		Stack stack;
+		for (reflection::Backtrace *backtrace : backtraces) {
+			if (backtrace == self || !backtrace->Sample(record)) {
+				continue;
+			}
+			int threadId = backtrace->GetThreadId();
+
+			stack.clear();
+			for (const reflection::BacktraceEntry &entry : record) {
+				stack.push_back(&entry.GetFunction());
+			}
+
+			if (!stack.empty()) {
+				++stackCounts[std::make_pair(threadId, stack)];
+			}
+
+			ThreadState &state = threads[threadId];
+			UpdateThreadStack(time, threadId, state, stack);
+			state.lastSample = numSamples;
+		}
+
+		// Close the frames of the threads that have exited
+		for (auto it = threads.begin(); it != threads.end();) {
+			if (it->second.lastSample != numSamples) {
+				UpdateThreadStack(time, it->first, it->second, {});
+				it = threads.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	void SamplingProfiler::UpdateThreadStack(double time, int threadId, ThreadState &state,
+	                                         const Stack &stack) {
+		std::size_t numCommonFrames = 0;
+		while (numCommonFrames < state.stack.size() && numCommonFrames < stack.size() &&
+		       state.stack[numCommonFrames] == stack[numCommonFrames]) {
+			++numCommonFrames;
+		}
+
+		// Emit the frames that have ended, innermost first
+		while (state.stack.size() > numCommonFrames) {
+			if (traceEvents.size() < MaxNumTraceEvents) {
+				TraceEvent event;
+				event.start = state.startTimes.back();
+				event.duration = time - event.start;
+				event.threadId = threadId;
+				event.function = state.stack.back();
+				traceEvents.push_back(event);
+			}
+			state.stack.pop_back();
+			state.startTimes.pop_back();
+		}
+
+		for (std::size_t i = numCommonFrames; i < stack.size(); ++i) {
+			state.stack.push_back(stack[i]);
+			state.startTimes.push_back(time);
+		}
+	}
+
+	void SamplingProfiler::WriteCollapsedStacks(const std::string &path) {
+		SPADES_MARK_FUNCTION();
+
+		std::map<reflection::Function const *, std::string> names;
+		auto getName = [&](reflection::Function const *function) -> const std::string & {
+			auto it = names.find(function);
+			if (it == names.end()) {
+				it = names.emplace(function, GetFunctionName(*function)).first;
+			}
+			return it->second;
+		};
+
+		// Each line is formatted as `<thread>;<outermost frame>;...;<innermost frame> <count>`
+		std::string text;
+		for (const auto &item : stackCounts) {
+			text += "Thread ";
+			text += std::to_string(item.first.first);
+			for (reflection::Function const *function : item.first.second) {
+				text += ';';
+				text += getName(function);
+			}
+			text += ' ';
+			text += std::to_string(item.second);
+			text += '\n';
+		}
+
+		FileManager::OpenForWriting(path.c_str())->Write(text);
+	}
+
+	void SamplingProfiler::WriteTraceEvents(const std::string &path) {
+		SPADES_MARK_FUNCTION();
+
+		std::map<reflection::Function const *, std::pair<std::string, std::string>> names;
+		std::map<int, bool> threadIds;
+
+		std::string text = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		char buf[256];
+		bool first = true;
+
+		for (const TraceEvent &event : traceEvents) {
+			auto it = names.find(event.function);
+			if (it == names.end()) {
+				it = names
+				       .emplace(event.function,
+				                std::make_pair(EscapeJsonString(event.function->GetName()),
+				                               EscapeJsonString(GetLocation(*event.function))))
+				       .first;
+			}
+			threadIds[event.threadId] = true;
+
+			if (!first) {
+				text += ",\n";
+			}
+			first = false;
+
+			text += "{\"ph\":\"X\",\"pid\":1,\"name\":\"";
+			text += it->second.first;
+			text += "\",\"args\":{\"location\":\"";
+			text += it->second.second;
+			std::snprintf(buf, sizeof(buf), "\"},\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f}",
+			              event.threadId, event.start * 1.0e6, event.duration * 1.0e6);
+			text += buf;
+		}
+
+		for (const auto &item : threadIds) {
+			if (!first) {
+				text += ",\n";
+			}
+			first = false;
+
+			std::snprintf(buf, sizeof(buf),
+			              "{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\","
+			              "\"args\":{\"name\":\"Thread %d\"}}",
+			              item.first, item.first);
+			text += buf;
+		}
+
+		text += "\n]}\n";
+
+		FileManager::OpenForWriting(path.c_str())->Write(text);
+	}
+} // namespace spades
@@ -0,0 +1,115 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Debug.h"
+
+namespace spades {
+	/**
+	 * A statistical profiler that periodically takes snapshots of every thread's shadow call
+	 * stack (see `SPADES_MARK_FUNCTION`) from a background thread.
+	 *
+	 * Sampling doesn't block the profiled threads, so the profiler can be used in release builds.
+	 * Only functions marked with `SPADES_MARK_FUNCTION` appear in the results; the time spent in
+	 * unmarked callees is attributed to the nearest marked caller.
+	 *
+	 * When stopped, the profiler writes two files:
+	 *
+	 *  - `Profiles/profileNNNN.txt` contains collapsed stacks, which can be converted into a flame
+	 *    graph by `flamegraph.pl` or loaded by speedscope.
+	 *  - `Profiles/profileNNNN.json` contains Chrome trace events, which can be viewed by
+	 *    `chrome://tracing` or Perfetto.
+	 */
+	class SamplingProfiler {
+	public:
+		static SamplingProfiler &GetInstance();
+
+		~SamplingProfiler();
+
+		bool IsRunning();
+
+		/**
+		 * Starts sampling. Discards the results of the previous run.
+		 *
+		 * @param interval The sampling interval in seconds.
+		 */
+		void Start(double interval);
+
+		/**
+		 * Stops sampling and writes the results.
+		 *
+		 * @return The path of the collapsed stack file.
+		 */
+		std::string Stop();
+
+	private:
+		class SamplerThread;
+
+		using Stack = std::vector<reflection::Function const *>;
+
+		/** A function call observed in consecutive samples. */
+		struct TraceEvent {
+			/** The time in seconds since the profiler was started. */
+			double start;
+			double duration;
+			int threadId;
+			reflection::Function const *function;
+		};
+
+		struct ThreadState {
+			/** The stack recorded in the last sample. */
+			Stack stack;
+			/** The time when each frame of `stack` was first observed. */
+			std::vector<double> startTimes;
+			std::uint64_t lastSample;
+		};
+
+		std::mutex mutex;
+		std::unique_ptr<SamplerThread> thread;
+		std::atomic<bool> stopRequested;
+
+		// The following fields are only accessed by the sampler thread while it's running
+		double interval;
+		std::uint64_t numSamples;
+		std::map<std::pair<int, Stack>, std::uint64_t> stackCounts;
+		std::vector<TraceEvent> traceEvents;
+		std::map<int, ThreadState> threads;
+		double lastSampleTime;
+
+		SamplingProfiler();
+
+		void SamplerMain();
+		void TakeSample(double time, const std::vector<reflection::Backtrace *> &backtraces,
+		                reflection::Backtrace *self);
+		void UpdateThreadStack(double time, int threadId, ThreadState &state, const Stack &stack);
+
+		void WriteCollapsedStacks(const std::string &path);
+		void WriteTraceEvents(const std::string &path);
+	};
+} // namespace spades
@@ -0,0 +1,120 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "Debug.h"
+#include "Exception.h"
+#include "SizeClassHeap.h"
+
+namespace spades {
+	namespace {
+		constexpr SizeClassHeap::Ref EndOfList = static_cast<SizeClassHeap::Ref>(-1);
+
+		/** `Compact` is not worth it unless it reclaims at least this many bytes. */
+		constexpr std::size_t MinCompactionGain = 1 << 20;
+
+		static_assert(SizeClassHeap::Granularity >= sizeof(SizeClassHeap::Ref),
+		              "A free block cannot hold a link");
+	} // namespace
+
+	SizeClassHeap::SizeClassHeap(std::size_t initialCapacity)
+	    : buffer(std::max<std::size_t>(initialCapacity, Granularity)),
+	      initialCapacity{buffer.size()},
+	      top{0},
+	      liveSize{0} {}
+
+	std::size_t SizeClassHeap::GetSizeClass(std::size_t bytes) {
+		return (std::max<std::size_t>(bytes, 1) + Granularity - 1) / Granularity;
+	}
+
+	SizeClassHeap::Ref SizeClassHeap::Alloc(std::size_t bytes) {
+		std::size_t sizeClass = GetSizeClass(bytes);
+		std::size_t size = sizeClass * Granularity;
+
+		if (sizeClass < freeLists.size() && freeLists[sizeClass] != EndOfList) {
+			// Reuse a freed block of the same size
+			Ref ref = freeLists[sizeClass];
+			std::memcpy(&freeLists[sizeClass], buffer.data() + ref, sizeof(Ref));
+			liveSize += size;
+			return ref;
+		}
+
+		if (top + size > buffer.size()) {
+			std::size_t newCapacity = buffer.size();
+			while (newCapacity < top + size) {
+				newCapacity <<= 1;
+			}
+			buffer.resize(newCapacity);
+		}
+
+		Ref ref = top;
+		top += size;
+		liveSize += size;
+		return ref;
+	}
+
+	void SizeClassHeap::Free(Ref ref, std::size_t bytes) {
+		std::size_t sizeClass = GetSizeClass(bytes);
+		std::size_t size = sizeClass * Granularity;
+		SPAssert(ref + size <= top);
+		SPAssert(ref % Granularity == 0);
+
+		if (sizeClass >= freeLists.size()) {
+			freeLists.resize(sizeClass + 1, EndOfList);
+		}
+		std::memcpy(buffer.data() + ref, &freeLists[sizeClass], sizeof(Ref));
+		freeLists[sizeClass] = ref;
+		liveSize -= size;
+	}
+
+	bool SizeClassHeap::ShouldCompact() const {
+		return GetFreeListSize() > std::max(liveSize / 4, MinCompactionGain);
+	}
+
+	void SizeClassHeap::Compact(Ref *refs, const std::size_t *sizes, std::size_t numBlocks) {
+		SPADES_MARK_FUNCTION();
+
+		// Leave some room for growth so the next allocations don't reallocate immediately
+		std::vector<char> newBuffer(std::max(initialCapacity, liveSize + liveSize / 2));
+		std::size_t newTop = 0;
+
+		for (std::size_t i = 0; i < numBlocks; ++i) {
+			std::size_t size = GetSizeClass(sizes[i]) * Granularity;
+			SPAssert(refs[i] + size <= top);
+			if (newTop + size > newBuffer.size()) {
+				SPRaise("The specified blocks exceed the live size");
+			}
+			std::memcpy(newBuffer.data() + newTop, buffer.data() + refs[i], sizes[i]);
+			refs[i] = newTop;
+			newTop += size;
+		}
+
+		if (newTop != liveSize) {
+			SPRaise("The specified blocks don't match the live blocks (%d bytes vs %d bytes)",
+			        static_cast<int>(newTop), static_cast<int>(liveSize));
+		}
+
+		buffer.swap(newBuffer);
+		top = newTop;
+		freeLists.clear();
+	}
+} // namespace spades
@@ -0,0 +1,92 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace spades {
+	/**
+	 * An allocator of variable-sized blocks in a single growable buffer, designed for data that
+	 * is reallocated frequently (e.g., the RLE columns of `SWMapRenderer`).
+	 *
+	 * Block sizes are rounded up to a multiple of `Granularity`, and each size class has its own
+	 * free list, so both `Alloc` and `Free` take constant time. A freed block is only reused by
+	 * an allocation of the same size class, so memory is wasted when the distribution of block
+	 * sizes changes over time. `Compact` reclaims it.
+	 *
+	 * Blocks are referred to by offsets (`Ref`) because `Alloc` may reallocate the buffer.
+	 */
+	class SizeClassHeap {
+	public:
+		typedef std::size_t Ref;
+
+		enum {
+			/** Must be large enough to hold the free list link (`Ref`). */
+			Granularity = 8
+		};
+
+		explicit SizeClassHeap(std::size_t initialCapacity);
+
+		Ref Alloc(std::size_t bytes);
+
+		/** Frees a block. `bytes` must be the value passed to `Alloc`. */
+		void Free(Ref ref, std::size_t bytes);
+
+		template <typename T> T *Dereference(Ref ref) {
+			return reinterpret_cast<T *>(buffer.data() + ref);
+		}
+
+		/** Returns the size of the underlying buffer in bytes. */
+		std::size_t GetCapacity() const { return buffer.size(); }
+
+		/** Returns the number of bytes occupied by live blocks, including the rounding. */
+		std::size_t GetLiveSize() const { return liveSize; }
+
+		/** Returns the number of bytes in the free lists. */
+		std::size_t GetFreeListSize() const { return top - liveSize; }
+
+		/** Returns `true` if `Compact` would reclaim a significant amount of memory. */
+		bool ShouldCompact() const;
+
+		/**
+		 * Moves the specified blocks to a new buffer in the given order, discarding all other
+		 * blocks including free ones. `refs` is updated in place. All pointers obtained by
+		 * `Dereference` are invalidated.
+		 *
+		 * @param refs The blocks to preserve. This must include all live blocks.
+		 * @param sizes The sizes of the blocks, as passed to `Alloc`.
+		 */
+		void Compact(Ref *refs, const std::size_t *sizes, std::size_t numBlocks);
+
+	private:
+		std::vector<char> buffer;
+		std::size_t initialCapacity;
+
+		/** The end of the part of `buffer` that has ever been allocated. */
+		std::size_t top;
+		std::size_t liveSize;
+
+		/** The first free block of each size class. */
+		std::vector<Ref> freeLists;
+
+		static std::size_t GetSizeClass(std::size_t bytes);
+	};
+} // namespace spades
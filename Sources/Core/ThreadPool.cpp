@@ -0,0 +1,340 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <thread>
+
+#include "Debug.h"
+#include "Exception.h"
+#include "Settings.h"
+#include "Thread.h"
+#include "ThreadLocalStorage.h"
+#include "ThreadPool.h"
+
+DEFINE_SPADES_SETTING(core_numWorkerThreads, "auto");
+
+namespace spades {
+	namespace {
+		/** The number of times an idle worker polls for a new job before going to sleep. */
+		constexpr int NumIdleSpins = 256;
+
+		struct WorkerIdentity {
+			ThreadPool *pool;
+			int participant;
+		};
+
+		ThreadLocalStorage<WorkerIdentity> currentWorker("threadPoolWorker");
+	} // namespace
+
+	class ThreadPool::Worker : public Thread {
+	public:
+		Worker(ThreadPool &pool, int participant)
+		    : pool{pool}, identity{&pool, participant} {}
+
+		void Run() noexcept override {
+			SPADES_MARK_FUNCTION();
+			currentWorker = &identity;
+			pool.WorkerMain(identity.participant);
+			currentWorker = nullptr;
+		}
+
+	private:
+		ThreadPool &pool;
+		WorkerIdentity identity;
+	};
+
+#pragma mark - ThreadPoolJob
+
+	ThreadPoolJob::ThreadPoolJob() : pool{nullptr}, slot{-1}, numPendingChunks{0} {
+		for (auto &range : ranges) {
+			range.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	// A derived class must have joined the job already
+	ThreadPoolJob::~ThreadPoolJob() {}
+
+	void ThreadPoolJob::Start(ThreadPool &pool, std::size_t numChunks) {
+		SPADES_MARK_FUNCTION();
+
+		if (this->pool) {
+			SPRaise("Attempted to start a job that is already running");
+		}
+		if (numChunks > 0xffffffffU) {
+			SPRaise("Too many chunks: %llu", static_cast<unsigned long long>(numChunks));
+		}
+
+		exception = nullptr;
+
+		if (numChunks == 0) {
+			return;
+		}
+
+		int numParticipants = pool.GetNumParticipants();
+		if (numParticipants > 1) {
+			for (int i = 0; i < numParticipants; ++i) {
+				auto begin = static_cast<std::uint32_t>(numChunks * i / numParticipants);
+				auto end = static_cast<std::uint32_t>(numChunks * (i + 1) / numParticipants);
+				ranges[i].store(Pack(begin, end), std::memory_order_relaxed);
+			}
+			numPendingChunks.store(numChunks, std::memory_order_relaxed);
+
+			// Workers may pick up the job as soon as it's placed in a slot
+			this->pool = &pool;
+			int slot = pool.AcquireSlot(*this);
+			if (slot >= 0) {
+				this->slot = slot;
+				pool.WakeWorkers();
+				return;
+			}
+			this->pool = nullptr;
+		}
+
+		// No workers available; run the job synchronously
+		for (std::size_t i = 0; i < numChunks; ++i) {
+			ExecuteChunk(i);
+		}
+		numPendingChunks.store(0, std::memory_order_relaxed);
+	}
+
+	void ThreadPoolJob::Join() {
+		if (pool) {
+			int participant = pool->GetCurrentParticipant();
+
+			while (numPendingChunks.load(std::memory_order_acquire) != 0) {
+				if (!RunAvailableChunks(participant)) {
+					// Other threads are executing the last chunks
+					std::this_thread::yield();
+				}
+			}
+
+			pool->ReleaseSlot(slot);
+			pool = nullptr;
+			slot = -1;
+		}
+
+		if (exception) {
+			std::exception_ptr ex = exception;
+			exception = nullptr;
+			std::rethrow_exception(ex);
+		}
+	}
+
+	bool ThreadPoolJob::IsDone() const {
+		return numPendingChunks.load(std::memory_order_acquire) == 0;
+	}
+
+	void ThreadPoolJob::ExecuteChunk(std::size_t index) {
+		try {
+			RunChunk(index);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock{exceptionMutex};
+			if (!exception) {
+				exception = std::current_exception();
+			}
+		}
+	}
+
+	bool ThreadPoolJob::PopChunk(int participant, std::size_t &outIndex) {
+		std::atomic<std::uint64_t> &range = ranges[participant];
+		std::uint64_t value = range.load(std::memory_order_acquire);
+		while (true) {
+			auto begin = static_cast<std::uint32_t>(value);
+			auto end = static_cast<std::uint32_t>(value >> 32);
+			if (begin >= end) {
+				return false;
+			}
+			if (range.compare_exchange_weak(value, Pack(begin + 1, end),
+			                                std::memory_order_acq_rel)) {
+				outIndex = begin;
+				return true;
+			}
+		}
+	}
+
+	bool ThreadPoolJob::Steal(int participant) {
+		int numParticipants = pool->GetNumParticipants();
+		for (int i = 1; i < numParticipants; ++i) {
+			int victim = (participant + i) % numParticipants;
+			std::atomic<std::uint64_t> &range = ranges[victim];
+			std::uint64_t value = range.load(std::memory_order_acquire);
+			while (true) {
+				auto begin = static_cast<std::uint32_t>(value);
+				auto end = static_cast<std::uint32_t>(value >> 32);
+				if (begin >= end) {
+					break;
+				}
+
+				// Take the back half (rounded up)
+				std::uint32_t mid = end - (end - begin + 1) / 2;
+				if (range.compare_exchange_weak(value, Pack(begin, mid),
+				                                std::memory_order_acq_rel)) {
+					// Nobody modifies an empty range, so a plain store is fine here
+					ranges[participant].store(Pack(mid, end), std::memory_order_release);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	bool ThreadPoolJob::RunAvailableChunks(int participant) {
+		bool executed = false;
+		while (true) {
+			std::size_t index;
+			while (PopChunk(participant, index)) {
+				ExecuteChunk(index);
+				numPendingChunks.fetch_sub(1, std::memory_order_acq_rel);
+				executed = true;
+			}
+			if (!Steal(participant)) {
+				return executed;
+			}
+		}
+	}
+
+#pragma mark - ThreadPool
+
+	ThreadPool::ThreadPool(int numWorkers) {
+		SPADES_MARK_FUNCTION();
+
+		numWorkers = std::max(0, std::min(numWorkers, ThreadPoolJob::MaxParticipants - 1));
+
+		SPLog("Creating a thread pool with %d worker thread(s)", numWorkers);
+		for (int i = 0; i < numWorkers; ++i) {
+			// Participant #0 is reserved for non-worker threads
+			workers.emplace_back(new Worker(*this, i + 1));
+		}
+		for (const auto &worker : workers) {
+			worker->Start();
+		}
+	}
+
+	ThreadPool::~ThreadPool() {
+		SPADES_MARK_FUNCTION();
+
+		{
+			std::lock_guard<std::mutex> lock{wakeMutex};
+			shutdown = true;
+		}
+		wakeCond.notify_all();
+
+		for (const auto &worker : workers) {
+			worker->Join();
+		}
+		workers.clear();
+	}
+
+	ThreadPool &ThreadPool::GetGlobalPool() {
+		static std::unique_ptr<ThreadPool> globalPool;
+		static std::once_flag globalPoolInitialized;
+
+		std::call_once(globalPoolInitialized, [] {
+			int numWorkers;
+			if ("auto" == core_numWorkerThreads) {
+				// The thread calling `Join` participates too
+				numWorkers = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+			} else {
+				numWorkers = core_numWorkerThreads;
+			}
+			globalPool.reset(new ThreadPool(numWorkers));
+		});
+
+		return *globalPool;
+	}
+
+	int ThreadPool::AcquireSlot(ThreadPoolJob &job) {
+		for (int i = 0; i < MaxJobs; ++i) {
+			ThreadPoolJob *expected = nullptr;
+			if (slots[i].job.compare_exchange_strong(expected, &job)) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	void ThreadPool::ReleaseSlot(int slot) {
+		Slot &s = slots[slot];
+		s.job.store(nullptr);
+
+		// Wait until no workers refer to the job. They leave soon because the job has
+		// no chunks left.
+		while (s.numUsers.load() != 0) {
+			std::this_thread::yield();
+		}
+	}
+
+	void ThreadPool::WakeWorkers() {
+		generation.fetch_add(1);
+		if (numSleepingWorkers.load() > 0) {
+			{ std::lock_guard<std::mutex> lock{wakeMutex}; }
+			wakeCond.notify_all();
+		}
+	}
+
+	int ThreadPool::GetCurrentParticipant() {
+		WorkerIdentity *identity = currentWorker;
+		if (identity && identity->pool == this) {
+			return identity->participant;
+		}
+		return 0;
+	}
+
+	void ThreadPool::WorkerMain(int participant) {
+		int idleSpins = 0;
+
+		while (true) {
+			std::uint64_t lastGeneration = generation.load();
+
+			bool executed = false;
+			for (Slot &slot : slots) {
+				slot.numUsers.fetch_add(1);
+				ThreadPoolJob *job = slot.job.load();
+				if (job) {
+					executed |= job->RunAvailableChunks(participant);
+				}
+				slot.numUsers.fetch_sub(1);
+			}
+
+			if (executed) {
+				idleSpins = 0;
+				continue;
+			}
+
+			if (idleSpins < NumIdleSpins) {
+				++idleSpins;
+				if (generation.load() == lastGeneration) {
+					std::this_thread::yield();
+				}
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock{wakeMutex};
+			numSleepingWorkers.fetch_add(1);
+			while (!shutdown && generation.load() == lastGeneration) {
+				wakeCond.wait(lock);
+			}
+			numSleepingWorkers.fetch_sub(1);
+			if (shutdown) {
+				return;
+			}
+			idleSpins = 0;
+		}
+	}
+} // namespace spades
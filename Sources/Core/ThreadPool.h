@@ -0,0 +1,215 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace spades {
+	class ThreadPool;
+
+	/**
+	 * A unit of work executed by `ThreadPool`.
+	 *
+	 * A job consists of chunks numbered `[0, numChunks)`. When a job is started, the chunk
+	 * range is split evenly among the participating threads (the worker threads and the
+	 * thread calling `Join`). Each participant consumes its own range from the front, and a
+	 * participant that has run out of chunks steals the back half of another participant's
+	 * range. No memory is allocated by starting or executing a job.
+	 *
+	 * The job object is owned by the submitter (usually it's a local variable) and must
+	 * outlive the execution. Derived classes must call `Join` in their destructors because
+	 * `RunChunk` cannot be called once the derived part is destroyed.
+	 */
+	class ThreadPoolJob {
+	public:
+		enum {
+			/** The maximum number of threads participating in a job (workers + joiner). */
+			MaxParticipants = 64
+		};
+
+		ThreadPoolJob();
+		virtual ~ThreadPoolJob();
+
+		ThreadPoolJob(const ThreadPoolJob &) = delete;
+		void operator=(const ThreadPoolJob &) = delete;
+
+		/**
+		 * Submits this job to the specified pool. The chunks are executed by the worker
+		 * threads and the thread that calls `Join`.
+		 *
+		 * If the pool has no worker threads or it's too busy to accept a new job, the chunks
+		 * are executed by the calling thread before this method returns.
+		 *
+		 * This means that this method can block for as long as the whole job takes, even if
+		 * the caller doesn't call `Join` immediately. A thread that must not stall (e.g., the
+		 * render thread) shouldn't start a long job directly; it should start and join the
+		 * job from a `ConcurrentDispatch` instead, as `GLRadiosityRenderer` does.
+		 */
+		void Start(ThreadPool &, std::size_t numChunks);
+
+		/**
+		 * Helps executing the remaining chunks and waits until all chunks are complete.
+		 * Rethrows the first exception thrown by `RunChunk`, if any.
+		 * Does nothing if the job is not running.
+		 */
+		void Join();
+
+		/** Returns `true` if the job is not running or all of its chunks are complete. */
+		bool IsDone() const;
+
+	protected:
+		virtual void RunChunk(std::size_t index) = 0;
+
+	private:
+		friend class ThreadPool;
+
+		ThreadPool *pool;
+		int slot;
+
+		/** Per-participant chunk ranges. Each range is encoded by `Pack`. */
+		std::atomic<std::uint64_t> ranges[MaxParticipants];
+		std::atomic<std::size_t> numPendingChunks;
+
+		std::mutex exceptionMutex;
+		std::exception_ptr exception;
+
+		static std::uint64_t Pack(std::uint32_t begin, std::uint32_t end) {
+			return static_cast<std::uint64_t>(begin) | (static_cast<std::uint64_t>(end) << 32);
+		}
+
+		void ExecuteChunk(std::size_t index);
+		bool PopChunk(int participant, std::size_t &outIndex);
+		bool Steal(int participant);
+
+		/**
+		 * Executes chunks as the specified participant until there is no more work to
+		 * steal. Returns `true` if at least one chunk was executed.
+		 */
+		bool RunAvailableChunks(int participant);
+	};
+
+	/** A `ThreadPoolJob` that calls `f(i)` for every `i` in a given range. */
+	template <class F> class ParallelForJob : public ThreadPoolJob {
+	public:
+		ParallelForJob(F f) : f(std::move(f)) {}
+		~ParallelForJob() { Join(); }
+
+		void Start(ThreadPool &pool, std::size_t begin, std::size_t end,
+		           std::size_t grainSize = 1) {
+			this->begin = begin;
+			this->end = end;
+			this->grainSize = std::max<std::size_t>(grainSize, 1);
+			ThreadPoolJob::Start(pool, (end - begin + this->grainSize - 1) / this->grainSize);
+		}
+
+	protected:
+		void RunChunk(std::size_t index) override {
+			std::size_t i = begin + index * grainSize;
+			std::size_t chunkEnd = std::min(i + grainSize, end);
+			for (; i < chunkEnd; ++i) {
+				f(i);
+			}
+		}
+
+	private:
+		F f;
+		std::size_t begin = 0, end = 0, grainSize = 1;
+	};
+
+	/**
+	 * A persistent pool of worker threads that execute `ThreadPoolJob`s.
+	 *
+	 * The worker threads sleep while there are no jobs, so an idle pool doesn't consume any
+	 * CPU time.
+	 */
+	class ThreadPool {
+	public:
+		enum {
+			/** The maximum number of concurrently running jobs. */
+			MaxJobs = 32
+		};
+
+		explicit ThreadPool(int numWorkers);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool &) = delete;
+		void operator=(const ThreadPool &) = delete;
+
+		/**
+		 * Returns the process-wide pool. The number of worker threads is specified by
+		 * `core_numWorkerThreads`.
+		 */
+		static ThreadPool &GetGlobalPool();
+
+		/** Returns the number of threads that can execute a job, including the caller. */
+		int GetNumParticipants() const { return static_cast<int>(workers.size()) + 1; }
+
+		/**
+		 * Calls `f(i)` for every `i` in `[begin, end)` and waits for the completion.
+		 * `grainSize` specifies the number of consecutive indices executed as a single
+		 * chunk.
+		 */
+		template <class F>
+		void ParallelFor(std::size_t begin, std::size_t end, std::size_t grainSize, F f) {
+			if (end <= begin) {
+				return;
+			}
+			ParallelForJob<F> job{std::move(f)};
+			job.Start(*this, begin, end, grainSize);
+			job.Join();
+		}
+
+	private:
+		friend class ThreadPoolJob;
+		class Worker;
+
+		struct Slot {
+			std::atomic<ThreadPoolJob *> job{nullptr};
+			/** The number of threads that might be accessing `job`. */
+			std::atomic<int> numUsers{0};
+		};
+
+		Slot slots[MaxJobs];
+		std::vector<std::unique_ptr<Worker>> workers;
+
+		std::mutex wakeMutex;
+		std::condition_variable wakeCond;
+		std::atomic<std::uint64_t> generation{0};
+		std::atomic<int> numSleepingWorkers{0};
+		bool shutdown = false;
+
+		int AcquireSlot(ThreadPoolJob &);
+		void ReleaseSlot(int slot);
+		void WakeWorkers();
+
+		/** Returns the participant index of the current thread. */
+		int GetCurrentParticipant();
+
+		void WorkerMain(int participant);
+	};
+} // namespace spades
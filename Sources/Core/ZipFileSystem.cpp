@@ -333,6 +333,8 @@ namespace spades {
 	std::unique_ptr<IStream> ZipFileSystem::OpenForReading(const char *fn) {
 		SPADES_MARK_FUNCTION();
 
+		std::lock_guard<std::mutex> lock{mutex};
+
 		if (currentStream) {
 			currentStream->ForceCloseUnzipFile();
 		}
@@ -388,6 +390,7 @@ namespace spades {
 	}
 
 	std::vector<std::string> ZipFileSystem::EnumFiles(const char *path) {
+		std::lock_guard<std::mutex> lock{mutex};
 
 		if (currentStream) {
 			currentStream->ForceCloseUnzipFile();
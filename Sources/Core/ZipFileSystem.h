@@ -22,6 +22,7 @@
 
 #include <cstdint>
 #include <map>
+#include <mutex>
 #include <string>
 
 #include "IFileSystem.h"
@@ -46,6 +47,9 @@ namespace spades {
 
 		ZipFileInputStream *currentStream;
 
+		/** Serializes the accesses to `zip`, which has a single cursor. */
+		std::mutex mutex;
+
 		uint64_t cursorPos;
 
 		static ZipFileHandle *InternalOpen(ZipFileSystem *fs, const char *fn, int mode);
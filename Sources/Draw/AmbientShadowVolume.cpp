@@ -0,0 +1,397 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <utility>
+
+#include "AmbientShadowVolume.h"
+#include <Client/GameMap.h>
+#include <Core/ThreadPool.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			/** Returns the bit of a column at `z` like `GameMap::IsSolidWrapped` does. */
+			inline bool GetColumnBit(std::uint64_t column, int z) {
+				if (z < 0)
+					return false;
+				if (z >= 64)
+					return true;
+				return ((column >> z) & 1) != 0;
+			}
+		} // namespace
+
+		AmbientShadowVolume::AmbientShadowVolume(client::GameMap &m) : map(m) {
+			SPADES_MARK_FUNCTION();
+
+			for (auto &rayDir : rays) {
+				Vector3 dir =
+				  MakeVector3(SampleRandomFloat(), SampleRandomFloat(), SampleRandomFloat());
+				dir = dir.Normalize();
+				dir += 0.01f;
+				rayDir = dir;
+			}
+
+			w = map->Width();
+			h = map->Height();
+			d = map->Depth();
+
+			chunkW = w / ChunkSize;
+			chunkH = h / ChunkSize;
+			chunkD = d / ChunkSize;
+
+			chunks = std::vector<Chunk>{static_cast<std::size_t>(chunkW * chunkH * chunkD)};
+
+			for (Chunk &c : chunks) {
+				float *data = (float *)c.data;
+				std::fill(data, data + ChunkSize * ChunkSize * ChunkSize * 2, 1.f);
+			}
+
+			for (int x = 0; x < chunkW; x++) {
+				for (int y = 0; y < chunkH; y++) {
+					for (int z = 0; z < chunkD; z++) {
+						Chunk &c = GetChunk(x, y, z);
+						c.cx = x;
+						c.cy = y;
+						c.cz = z;
+					}
+				}
+			}
+
+			SPLog("Chunk buffer allocated (%d bytes)",
+			      (int)sizeof(Chunk) * chunkW * chunkH * chunkD);
+		}
+
+		/**
+		 * Evaluate the AO term at the point specified by given world coordinates.
+		 */
+		float AmbientShadowVolume::Evaluate(IntVector3 ipos) const {
+			SPADES_MARK_FUNCTION_DEBUG();
+
+			float sum = 0.0f;
+			Vector3 pos = MakeVector3((float)ipos.x, (float)ipos.y, (float)ipos.z);
+			pos.x += 0.5f;
+			pos.y += 0.5f;
+			pos.z += 0.5f;
+
+			for (int i = 0; i < NumRays; i++) {
+				Vector3 dir = rays[i];
+
+				unsigned int bits = i & 7;
+				if (bits & 1)
+					dir.x = -dir.x;
+				if (bits & 2)
+					dir.y = -dir.y;
+				if (bits & 4)
+					dir.z = -dir.z;
+
+				Vector3 muzzle = pos;
+				IntVector3 hitBlock;
+
+				float brightness = 1.f;
+				if (map->CastRay(muzzle, dir, (float)RayLength, hitBlock)) {
+					Vector3 centerPos =
+					  MakeVector3(hitBlock.x + .5f, hitBlock.y + .5f, hitBlock.z + .5f);
+					float dist = (centerPos - muzzle).GetPoweredLength();
+					brightness = dist * (1.0 / float((RayLength - 1) * (RayLength - 1)));
+					if (brightness > 1.f)
+						brightness = 1.f;
+				}
+
+				sum += brightness;
+			}
+
+			sum = std::min(sum * (2.f / (float)NumRays), 1.0f);
+
+			return sum;
+		}
+
+		void AmbientShadowVolume::Invalidate(int minX, int minY, int minZ, int maxX, int maxY,
+		                                     int maxZ) {
+			SPADES_MARK_FUNCTION_DEBUG();
+			if (minZ < 0) {
+				minZ = 0;
+			}
+			if (maxZ > d - 1) {
+				maxZ = d - 1;
+			}
+			if (minX > maxX || minY > maxY || minZ > maxZ) {
+				return;
+			}
+
+			// these should be floor div
+			int cx1 = minX >> ChunkSizeBits;
+			int cy1 = minY >> ChunkSizeBits;
+			int cz1 = minZ >> ChunkSizeBits;
+			int cx2 = maxX >> ChunkSizeBits;
+			int cy2 = maxY >> ChunkSizeBits;
+			int cz2 = maxZ >> ChunkSizeBits;
+
+			for (int cx = cx1; cx <= cx2; cx++) {
+				for (int cy = cy1; cy <= cy2; cy++) {
+					for (int cz = cz1; cz <= cz2; cz++) {
+						Chunk &c = GetChunkWrapped(cx, cy, cz);
+						int originX = cx * ChunkSize;
+						int originY = cy * ChunkSize;
+						int originZ = cz * ChunkSize;
+
+						int inMinX = std::max(minX - originX, 0);
+						int inMinY = std::max(minY - originY, 0);
+						int inMinZ = std::max(minZ - originZ, 0);
+						int inMaxX = std::min(maxX - originX, ChunkSize - 1);
+						int inMaxY = std::min(maxY - originY, ChunkSize - 1);
+						int inMaxZ = std::min(maxZ - originZ, ChunkSize - 1);
+
+						if (!c.dirty) {
+							c.dirtyMinX = inMinX;
+							c.dirtyMinY = inMinY;
+							c.dirtyMinZ = inMinZ;
+							c.dirtyMaxX = inMaxX;
+							c.dirtyMaxY = inMaxY;
+							c.dirtyMaxZ = inMaxZ;
+							c.dirty = true;
+						} else {
+							c.dirtyMinX = std::min(inMinX, c.dirtyMinX);
+							c.dirtyMinY = std::min(inMinY, c.dirtyMinY);
+							c.dirtyMinZ = std::min(inMinZ, c.dirtyMinZ);
+							c.dirtyMaxX = std::max(inMaxX, c.dirtyMaxX);
+							c.dirtyMaxY = std::max(inMaxY, c.dirtyMaxY);
+							c.dirtyMaxZ = std::max(inMaxZ, c.dirtyMaxZ);
+						}
+					}
+				}
+			}
+		}
+
+		int AmbientShadowVolume::GetNumDirtyChunks() const {
+			return (int)std::count_if(chunks.begin(), chunks.end(),
+			                          [](const Chunk &c) { return c.dirty; });
+		}
+
+		void AmbientShadowVolume::SelectDirtyChunks(const Vector3 &eye, std::size_t maxChunks,
+		                                            std::vector<ChunkUpdate> &out) {
+			SPADES_MARK_FUNCTION();
+
+			int eyeX = (int)(eye.x) >> ChunkSizeBits;
+			int eyeY = (int)(eye.y) >> ChunkSizeBits;
+			int eyeZ = (int)(eye.z) >> ChunkSizeBits;
+
+			// (squared distance in chunks, chunk index)
+			std::vector<std::pair<int, std::size_t>> candidates;
+			for (std::size_t i = 0; i < chunks.size(); i++) {
+				const Chunk &c = chunks[i];
+				if (!c.dirty)
+					continue;
+				int dx = (c.cx - eyeX) & (chunkW - 1);
+				int dy = (c.cy - eyeY) & (chunkH - 1);
+				int dz = c.cz - eyeZ;
+				dx = std::min(dx, chunkW - dx);
+				dy = std::min(dy, chunkH - dy);
+				candidates.emplace_back(dx * dx + dy * dy + dz * dz, i);
+			}
+
+			std::size_t numSelected = std::min(maxChunks, candidates.size());
+			std::partial_sort(candidates.begin(), candidates.begin() + numSelected,
+			                  candidates.end());
+
+			for (std::size_t i = 0; i < numSelected; i++) {
+				Chunk &c = chunks[candidates[i].second];
+				ChunkUpdate update;
+				update.chunkIndex = candidates[i].second;
+				update.dirtyMin = IntVector3{c.dirtyMinX, c.dirtyMinY, c.dirtyMinZ};
+				update.dirtyMax = IntVector3{c.dirtyMaxX, c.dirtyMaxY, c.dirtyMaxZ};
+				out.push_back(update);
+				c.dirty = false;
+			}
+		}
+
+		void AmbientShadowVolume::UpdateChunks(const std::vector<ChunkUpdate> &updates,
+		                                       ThreadPool &pool) {
+			SPADES_MARK_FUNCTION();
+
+			pool.ParallelFor(0, updates.size(), 1,
+			                 [&](std::size_t i) { UpdateChunk(updates[i]); });
+		}
+
+		void AmbientShadowVolume::ComputeColumnFlags(const client::GameMap &map, int x, int y,
+		                                             int minZ, int maxZ, std::uint8_t *outFlags,
+		                                             std::ptrdiff_t outStride) {
+			std::uint64_t column = map.GetSolidMapWrapped(x, y);
+			std::uint64_t neighborhood = 0;
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dx = -1; dx <= 1; dx++)
+					neighborhood |= map.GetSolidMapWrapped(x + dx, y + dy);
+
+			// Dilate along the Z axis. The voxels below the map are solid.
+			std::uint64_t contact =
+			  neighborhood | (neighborhood << 1) | (neighborhood >> 1) | (1ULL << 63);
+
+			for (int z = minZ; z <= maxZ; z++, outFlags += outStride) {
+				bool isContact = z < 0 ? (z == -1 && (neighborhood & 1) != 0)
+				                       : GetColumnBit(contact, z);
+				*outFlags = static_cast<std::uint8_t>((GetColumnBit(column, z) ? 1 : 0) |
+				                                      (isContact ? 2 : 0));
+			}
+		}
+
+		void AmbientShadowVolume::UpdateChunk(const ChunkUpdate &update) {
+			Chunk &c = chunks[update.chunkIndex];
+
+			int originX = c.cx * ChunkSize;
+			int originY = c.cy * ChunkSize;
+			int originZ = c.cz * ChunkSize;
+
+			// Compute the slightly larger volume for blurring
+			constexpr int padding = 2;
+			constexpr int wSize = ChunkSize + padding * 2;
+			float wData[wSize][wSize][wSize][2];
+			std::uint8_t wFlags[wSize][wSize][wSize];
+			int wOriginX = originX - padding;
+			int wOriginY = originY - padding;
+			int wOriginZ = originZ - padding;
+			int wDirtyMinX = update.dirtyMin.x;
+			int wDirtyMinY = update.dirtyMin.y;
+			int wDirtyMinZ = update.dirtyMin.z;
+			int wDirtyMaxX = update.dirtyMax.x + padding * 2;
+			int wDirtyMaxY = update.dirtyMax.y + padding * 2;
+			int wDirtyMaxZ = update.dirtyMax.z + padding * 2;
+
+			auto b = [](int i) -> std::uint8_t { return (std::uint8_t)1 << i; };
+
+			// bit 0: solids
+			// bit 1: contact (by-surface voxel)
+			for (int y = wDirtyMinY; y <= wDirtyMaxY; y++)
+				for (int x = wDirtyMinX; x <= wDirtyMaxX; x++) {
+					ComputeColumnFlags(*map, x + wOriginX, y + wOriginY, wDirtyMinZ + wOriginZ,
+					                   wDirtyMaxZ + wOriginZ, &wFlags[wDirtyMinZ][y][x],
+					                   wSize * wSize);
+				}
+
+			for (int z = wDirtyMinZ; z <= wDirtyMaxZ; z++)
+				for (int y = wDirtyMinY; y <= wDirtyMaxY; y++)
+					for (int x = wDirtyMinX; x <= wDirtyMaxX; x++) {
+						if (wFlags[z][y][x] & b(0)) {
+							wData[z][y][x][0] = 0.0;
+							wData[z][y][x][1] = 0.0;
+						} else {
+							wData[z][y][x][0] =
+							  Evaluate(IntVector3{x + wOriginX, y + wOriginY, z + wOriginZ});
+							wData[z][y][x][1] = 1.0;
+						}
+					}
+
+			// The AO terms are sampled 0.5 blocks away from the terrain surface,
+			// which leads to under-shadowing. Compensate for this effect.
+			for (int z = wDirtyMinZ; z <= wDirtyMaxZ; z++)
+				for (int y = wDirtyMinY; y <= wDirtyMaxY; y++)
+					for (int x = wDirtyMinX; x <= wDirtyMaxX; x++) {
+						float &d = wData[z][y][x][0];
+						d *= d * d + 1.0f - d;
+					}
+
+			// Blur the result to remove noise
+			//
+			//	  |     this        |     neighbor    |
+			//	  | solid | contact | solid | contact | blur
+			//	  |   0        0    |   0        x    |   1
+			//	  |   0        1    |   0        0    |   0  (prevent under-shadowing)
+			//	  |   0        1    |   0        1    |   1
+			//	  |   0        x    |   1        x    |   0  (solid voxel's value is zero)
+			//	  |   1        x    |   0        x    |   0  (solid voxel's value must remain zero)
+			//	  |   1        x    |   1        x    |   x
+			//
+			//
+			//	             this voxel
+			//
+			//	                    solid
+			//	                  /-------\  				.
+			//	          +---+---+---+---+
+			//	          | 1 | 0 | 0 | 0 |
+			//	          +---+---+---+---+\				.
+			//	          | 1 | 1 | 0 | 0 | |
+			//	         /+---+---+---+---+ | contact  neighbor
+			//	        | | 0 | 0 |   |   | |
+			//	  solid | +---+---+---+---+/
+			//	        | | 0 | 0 |   |   |
+			//	         \+---+---+---+---+
+			//	              \-------/
+			//	               contact
+			//
+			static const float divider[] = {1.0f, 1.0f / 2.0f, 1.0f / 3.0f};
+			auto mask = [](bool b, float x) { return b ? x : 0.0f; };
+			auto shouldBlur = [=](std::uint8_t thisFlags, std::uint8_t neighborFlags) {
+				return ((neighborFlags & b(0)) | ((~thisFlags | neighborFlags) & b(1))) == 0b10;
+			};
+			for (int blurPass = 0; blurPass < 2; ++blurPass) {
+				for (int z = wDirtyMinZ; z <= wDirtyMaxZ; z++)
+					for (int y = wDirtyMinY; y <= wDirtyMaxY; y++)
+						for (int x = wDirtyMinX + 1; x < wDirtyMaxX; x++) {
+							if (wFlags[z][y][x] & b(0)) {
+								continue;
+							}
+							// Do not blur between by-surface voxels and
+							// in-the-air voxels
+							bool m1 = shouldBlur(wFlags[z][y][x], wFlags[z][y][x - 1]);
+							bool m2 = shouldBlur(wFlags[z][y][x], wFlags[z][y][x + 1]);
+							wData[z][y][x][0] =
+							  (wData[z][y][x][0] + mask(m1, wData[z][y][x - 1][0]) +
+							   mask(m2, wData[z][y][x + 1][0])) *
+							  divider[(int)m1 + (int)m2];
+						}
+				for (int z = wDirtyMinZ; z <= wDirtyMaxZ; z++)
+					for (int y = wDirtyMinY + 1; y < wDirtyMaxY; y++)
+						for (int x = wDirtyMinX; x <= wDirtyMaxX; x++) {
+							if (wFlags[z][y][x] & b(0)) {
+								continue;
+							}
+							bool m1 = shouldBlur(wFlags[z][y][x], wFlags[z][y - 1][x]);
+							bool m2 = shouldBlur(wFlags[z][y][x], wFlags[z][y + 1][x]);
+							wData[z][y][x][0] =
+							  (wData[z][y][x][0] + mask(m1, wData[z][y - 1][x][0]) +
+							   mask(m2, wData[z][y + 1][x][0])) *
+							  divider[(int)m1 + (int)m2];
+						}
+				for (int z = wDirtyMinZ + 1; z < wDirtyMaxZ; z++)
+					for (int y = wDirtyMinY; y <= wDirtyMaxY; y++)
+						for (int x = wDirtyMinX; x <= wDirtyMaxX; x++) {
+							if (wFlags[z][y][x] & b(0)) {
+								continue;
+							}
+							bool m1 = shouldBlur(wFlags[z][y][x], wFlags[z - 1][y][x]);
+							bool m2 = shouldBlur(wFlags[z][y][x], wFlags[z + 1][y][x]);
+							wData[z][y][x][0] =
+							  (wData[z][y][x][0] + mask(m1, wData[z - 1][y][x][0]) +
+							   mask(m2, wData[z + 1][y][x][0])) *
+							  divider[(int)m1 + (int)m2];
+						}
+			}
+
+			// Copy the result to `c.data`
+			for (int z = update.dirtyMin.z; z <= update.dirtyMax.z; z++)
+				for (int y = update.dirtyMin.y; y <= update.dirtyMax.y; y++)
+					for (int x = update.dirtyMin.x; x <= update.dirtyMax.x; x++) {
+						c.data[z][y][x][0] = wData[z + padding][y + padding][x + padding][0];
+						c.data[z][y][x][1] = wData[z + padding][y + padding][x + padding][1];
+					}
+
+			c.transferDone = false;
+		}
+	} // namespace draw
+} // namespace spades
@@ -0,0 +1,141 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Core/Debug.h>
+#include <Core/Math.h>
+#include <Core/RefCountedObject.h>
+
+namespace spades {
+	class ThreadPool;
+	namespace client {
+		class GameMap;
+	}
+	namespace draw {
+		/**
+		 * Computes the large-scale ambient occlusion volume sampled by
+		 * `GLAmbientShadowRenderer`. This class doesn't depend on a GL context.
+		 *
+		 * The volume stores two values per voxel: the AO term and whether the voxel is empty.
+		 * It's divided into chunks of `ChunkSize`^3 voxels, and the parts of the chunks affected
+		 * by map changes are recomputed by `UpdateChunks`.
+		 */
+		class AmbientShadowVolume {
+		public:
+			static constexpr int NumRays = 16;
+			static constexpr int ChunkSizeBits = 4;
+			static constexpr int ChunkSize = 1 << ChunkSizeBits;
+			static constexpr int RayLength = 16;
+
+			struct Chunk {
+				int cx, cy, cz;
+				float data[ChunkSize][ChunkSize][ChunkSize][2];
+				bool dirty = true;
+				int dirtyMinX = 0, dirtyMaxX = ChunkSize - 1;
+				int dirtyMinY = 0, dirtyMaxY = ChunkSize - 1;
+				int dirtyMinZ = 0, dirtyMaxZ = ChunkSize - 1;
+
+				/** Cleared when `data` is recomputed. */
+				std::atomic<bool> transferDone{true};
+			};
+
+			/** A chunk selected by `SelectDirtyChunks` and its part to recompute (inclusive). */
+			struct ChunkUpdate {
+				std::size_t chunkIndex;
+				IntVector3 dirtyMin, dirtyMax;
+			};
+
+			AmbientShadowVolume(client::GameMap &);
+
+			client::GameMap &GetMap() { return *map; }
+
+			int GetNumChunksX() const { return chunkW; }
+			int GetNumChunksY() const { return chunkH; }
+			int GetNumChunksZ() const { return chunkD; }
+			std::vector<Chunk> &GetChunks() { return chunks; }
+
+			inline Chunk &GetChunk(int cx, int cy, int cz) {
+				SPAssert(cx >= 0);
+				SPAssert(cx < chunkW);
+				SPAssert(cy >= 0);
+				SPAssert(cy < chunkH);
+				SPAssert(cz >= 0);
+				SPAssert(cz < chunkD);
+				return chunks[(cx + cy * chunkW) * chunkD + cz];
+			}
+
+			inline Chunk &GetChunkWrapped(int cx, int cy, int cz) {
+				// FIXME: support for non-POT dimensions?
+				return GetChunk(cx & (chunkW - 1), cy & (chunkH - 1), cz);
+			}
+
+			/** Evaluates the AO term at the specified voxel. */
+			float Evaluate(IntVector3) const;
+
+			/** Marks the specified box (inclusive) as dirty. */
+			void Invalidate(int minX, int minY, int minZ, int maxX, int maxY, int maxZ);
+
+			int GetNumDirtyChunks() const;
+
+			/**
+			 * Appends up to `maxChunks` dirty chunks to `out`, nearest to `eye` first, and
+			 * clears their dirty flags. A chunk invalidated again before it's recomputed will
+			 * be selected again.
+			 */
+			void SelectDirtyChunks(const Vector3 &eye, std::size_t maxChunks,
+			                       std::vector<ChunkUpdate> &out);
+
+			/**
+			 * Recomputes the specified chunks in parallel and waits for the completion. Must not
+			 * be called while another call is in progress.
+			 */
+			void UpdateChunks(const std::vector<ChunkUpdate> &, ThreadPool &);
+
+			/**
+			 * Computes the flags of the voxels `(x, y, minZ)`-`(x, y, maxZ)`. `z` may be
+			 * outside the map. Bit 0 indicates a solid voxel. Bit 1 indicates that the voxel's
+			 * 3x3x3 neighborhood contains a solid voxel.
+			 *
+			 * The flags of a column are computed at once from the 64-bit solid maps of the
+			 * nine columns around it.
+			 */
+			static void ComputeColumnFlags(const client::GameMap &, int x, int y, int minZ,
+			                               int maxZ, std::uint8_t *outFlags,
+			                               std::ptrdiff_t outStride);
+
+		private:
+			Handle<client::GameMap> map;
+			std::array<Vector3, NumRays> rays;
+
+			int w, h, d;
+			int chunkW, chunkH, chunkD;
+
+			std::vector<Chunk> chunks;
+
+			void UpdateChunk(const ChunkUpdate &);
+		};
+	} // namespace draw
+} // namespace spades
@@ -0,0 +1,143 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "AmbientShadowVolume.h"
+#include "AmbientShadowVolumeSelfTest.h"
+#include <Client/GameMap.h>
+#include <Client/TestMap.h>
+#include <Core/Debug.h>
+#include <Core/Stopwatch.h>
+#include <Core/ThreadPool.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			/** The flags of `AmbientShadowVolume::ComputeColumnFlags` for one voxel. */
+			std::uint8_t ComputeVoxelFlags(const client::GameMap &map, int x, int y, int z) {
+				bool contact = false;
+				for (int dz = -1; dz <= 1; dz++)
+					for (int dy = -1; dy <= 1; dy++)
+						for (int dx = -1; dx <= 1; dx++)
+							contact |= map.IsSolidWrapped(x + dx, y + dy, z + dz);
+				return static_cast<std::uint8_t>((map.IsSolidWrapped(x, y, z) ? 1 : 0) |
+				                                 (contact ? 2 : 0));
+			}
+		} // namespace
+
+		bool RunAmbientShadowVolumeSelfTest() {
+			SPADES_MARK_FUNCTION();
+
+			Handle<client::GameMap> mapHandle{client::CreateTestMap(2), false};
+			client::GameMap &map = *mapHandle;
+			int numFailures = 0;
+			SPLog("Ambient occlusion volume test");
+
+			// Contact and occupancy flags
+			{
+				const int numColumns = 20000;
+				const int minZ = -2, maxZ = map.Depth() + 1;
+				const int numVoxels = numColumns * (maxZ - minZ + 1);
+				std::vector<std::uint8_t> expected(numVoxels), actual(numVoxels);
+				std::vector<IntVector3> columns(numColumns);
+				std::mt19937 rng{42};
+				for (IntVector3 &column : columns) {
+					column.x = (int)(rng() % (uint32_t)map.Width());
+					column.y = (int)(rng() % (uint32_t)map.Height());
+				}
+
+				Stopwatch sw;
+				std::size_t k = 0;
+				for (const IntVector3 &column : columns) {
+					for (int z = minZ; z <= maxZ; z++) {
+						expected[k++] = ComputeVoxelFlags(map, column.x, column.y, z);
+					}
+				}
+				double scalarTime = sw.GetTime();
+
+				sw.Reset();
+				for (int i = 0; i < numColumns; i++) {
+					AmbientShadowVolume::ComputeColumnFlags(
+					  map, columns[i].x, columns[i].y, minZ, maxZ,
+					  &actual[i * (maxZ - minZ + 1)], 1);
+				}
+				double columnTime = sw.GetTime();
+
+				int numMismatches = 0;
+				for (int i = 0; i < numVoxels; i++) {
+					numMismatches += expected[i] != actual[i];
+				}
+
+				SPLog("AO flags: %d voxels, per voxel: %.2f ns/voxel, per column: %.2f "
+				      "ns/voxel (%.1fx), %d mismatch(es)",
+				      numVoxels, scalarTime * 1.0e9 / numVoxels,
+				      columnTime * 1.0e9 / numVoxels, scalarTime / columnTime,
+				      numMismatches);
+				numFailures += numMismatches;
+			}
+
+			// Recompute the chunks around the center of the map with one thread and with several
+			// threads. The pool has its own workers so that the chunks are computed concurrently
+			// regardless of `core_numWorkerThreads` and the number of CPU cores.
+			AmbientShadowVolume volume{map};
+			std::vector<AmbientShadowVolume::ChunkUpdate> updates;
+			ThreadPool pool{3};
+			Vector3 eye = MakeVector3(map.Width() * .5f, map.Height() * .5f, 32.f);
+			volume.SelectDirtyChunks(eye, 16 * pool.GetNumParticipants(), updates);
+
+			std::vector<AmbientShadowVolume::Chunk> &chunks = volume.GetChunks();
+			ThreadPool serialPool{0};
+			Stopwatch sw;
+			volume.UpdateChunks(updates, serialPool);
+			double serialTime = sw.GetTime();
+
+			const std::size_t chunkSize = sizeof(AmbientShadowVolume::Chunk::data);
+			std::vector<char> serialData(updates.size() * chunkSize);
+			for (std::size_t i = 0; i < updates.size(); i++) {
+				std::memcpy(serialData.data() + i * chunkSize,
+				            chunks[updates[i].chunkIndex].data, chunkSize);
+			}
+
+			sw.Reset();
+			volume.UpdateChunks(updates, pool);
+			double parallelTime = sw.GetTime();
+
+			int numMismatches = 0;
+			for (std::size_t i = 0; i < updates.size(); i++) {
+				numMismatches += std::memcmp(serialData.data() + i * chunkSize,
+				                             chunks[updates[i].chunkIndex].data,
+				                             chunkSize) != 0;
+			}
+
+			SPLog("AO chunks: %d chunk(s), 1 thread: %.2f ms/chunk, %d thread(s): %.2f "
+			      "ms/chunk (%.1fx), %d mismatched chunk(s)",
+			      (int)updates.size(), serialTime * 1000.0 / updates.size(),
+			      pool.GetNumParticipants(), parallelTime * 1000.0 / updates.size(),
+			      serialTime / parallelTime, numMismatches);
+			numFailures += numMismatches;
+
+			return numFailures == 0;
+		}
+	} // namespace draw
+} // namespace spades
@@ -0,0 +1,36 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+namespace spades {
+	namespace draw {
+		/**
+		 * Checks `AmbientShadowVolume` on a generated map without a GL context: the
+		 * word-parallel contact and occupancy flags against per-voxel tests, and the chunks
+		 * computed by one thread against those computed by several threads, which must be
+		 * byte-identical. Also logs the time taken by both. This is run by
+		 * `openspades --self-test`.
+		 *
+		 * @return `false` if any check failed.
+		 */
+		bool RunAmbientShadowVolumeSelfTest();
+	} // namespace draw
+} // namespace spades
@@ -73,23 +73,26 @@ namespace spades {
 			return std::move(bmp).Unmanage();
 		}
 
-		void GLFlatMapRenderer::GameMapChanged(int x, int y, int z, client::GameMap &map) {
+		void GLFlatMapRenderer::GameMapChanged(const IntVector3 &min, const IntVector3 &max,
+		                                       client::GameMap &map) {
 			if (this->map.GetPointerOrNull() != &map)
 				return;
 
-			SPAssert(x >= 0);
-			SPAssert(x < map.Width());
-			SPAssert(y >= 0);
-			SPAssert(y < map.Height());
-			SPAssert(z >= 0);
-			SPAssert(z < map.Depth());
-
-			int chunkX = x >> ChunkBits;
-			int chunkY = y >> ChunkBits;
-			int chunkId = chunkX + chunkY * chunkCols;
-			SPAssert(chunkId >= 0);
-			SPAssert(chunkId < chunkCols * chunkRows);
-			chunkInvalid[chunkId] = true;
+			SPAssert(min.x >= 0);
+			SPAssert(max.x < map.Width());
+			SPAssert(min.y >= 0);
+			SPAssert(max.y < map.Height());
+			SPAssert(min.z >= 0);
+			SPAssert(max.z < map.Depth());
+
+			for (int chunkY = min.y >> ChunkBits; chunkY <= (max.y >> ChunkBits); chunkY++) {
+				for (int chunkX = min.x >> ChunkBits; chunkX <= (max.x >> ChunkBits); chunkX++) {
+					int chunkId = chunkX + chunkY * chunkCols;
+					SPAssert(chunkId >= 0);
+					SPAssert(chunkId < chunkCols * chunkRows);
+					chunkInvalid[chunkId] = true;
+				}
+			}
 		}
 
 		void GLFlatMapRenderer::Draw(const AABB2 &dest, const AABB2 &src) {
@@ -51,7 +51,7 @@ namespace spades {
 			~GLFlatMapRenderer();
 			void Draw(const AABB2 &dest, const AABB2 &src);
 
-			void GameMapChanged(int x, int y, int z, client::GameMap &);
+			void GameMapChanged(const IntVector3 &min, const IntVector3 &max, client::GameMap &);
 		};
 	} // namespace draw
 } // namespace spades
@@ -61,6 +61,21 @@ namespace spades {
 			return it->second;
 		}
 
+		GLImage *GLImageManager::RegisterImage(const std::string &name, Bitmap &bmp) {
+			SPADES_MARK_FUNCTION();
+
+			std::map<std::string, GLImage *>::iterator it;
+			it = images.find(name);
+			if (it == images.end()) {
+				GLImage *img = GLImage::FromBitmap(bmp, &device).Unmanage();
+				images[name] = img;
+				img->AddRef();
+				return img;
+			}
+			it->second->AddRef();
+			return it->second;
+		}
+
 		GLImage *GLImageManager::GetWhiteImage() {
 			if (!whiteImage) {
 				whiteImage = RegisterImage("Gfx/White.tga");
@@ -25,6 +25,8 @@
 #include <vector>
 
 namespace spades {
+	class Bitmap;
+
 	namespace draw {
 		class IGLDevice;
 		class GLImage;
@@ -42,6 +44,8 @@ namespace spades {
 			~GLImageManager();
 
 			GLImage *RegisterImage(const std::string &);
+			/** Same as the above, but uses the specified bitmap if the image isn't loaded. */
+			GLImage *RegisterImage(const std::string &, Bitmap &);
 			GLImage *GetWhiteImage();
 
 			void DrawAllImages(GLRenderer *);
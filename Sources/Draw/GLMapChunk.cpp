@@ -35,6 +35,18 @@
 
 namespace spades {
 	namespace draw {
+		namespace {
+			IGLDevice::UInteger CreateBuffer(IGLDevice &device, const void *data,
+			                                 std::size_t size) {
+				IGLDevice::UInteger buffer = device.GenBuffer();
+				device.BindBuffer(IGLDevice::ArrayBuffer, buffer);
+				device.BufferData(IGLDevice::ArrayBuffer, static_cast<IGLDevice::Sizei>(size),
+				                  data, IGLDevice::StaticDraw);
+				device.BindBuffer(IGLDevice::ArrayBuffer, 0);
+				return buffer;
+			}
+		} // namespace
+
 		GLMapChunk::GLMapChunk(GLMapRenderer &r, client::GameMap *mp, int cx, int cy, int cz)
 		    : renderer(r), device(r.device) {
 			SPADES_MARK_FUNCTION();
@@ -45,6 +57,7 @@ namespace spades {
 			chunkZ = cz;
 			needsUpdate = true;
 			realized = false;
+			updating = false;
 
 			centerPos =
 			  MakeVector3(cx * Size + Size / 2, cy * Size + Size / 2, cz * Size + Size / 2);
@@ -53,6 +66,7 @@ namespace spades {
 
 			buffer = 0;
 			iBuffer = 0;
+			numIndices = 0;
 		}
 
 		GLMapChunk::~GLMapChunk() { SetRealized(false); }
@@ -64,19 +78,13 @@ namespace spades {
 				return;
 
 			if (!b) {
-				if (buffer) {
-					device.DeleteBuffer(buffer);
-					buffer = 0;
-				}
-				if (iBuffer) {
-					device.DeleteBuffer(iBuffer);
-					iBuffer = 0;
-				}
-				std::vector<Vertex> i;
-				i.swap(vertices);
+				DeleteBuffers();
 
-				std::vector<uint16_t> i2;
-				i2.swap(indices);
+				// `BuildMesh` may be writing to `mesh`; `FinishUpdate` releases it instead
+				if (!updating) {
+					MapChunkMesher::Mesh m;
+					std::swap(m, mesh);
+				}
 			} else {
 				needsUpdate = true;
 			}
@@ -84,137 +92,7 @@ namespace spades {
 			realized = b;
 		}
 
-		uint8_t GLMapChunk::calcAOID(int x, int y, int z, int ux, int uy, int uz, int vx, int vy,
-		                             int vz) {
-			int v = 0;
-			if (IsSolid(x - ux, y - uy, z - uz))
-				v |= 1;
-			if (IsSolid(x + ux, y + uy, z + uz))
-				v |= 1 << 1;
-			if (IsSolid(x - vx, y - vy, z - vz))
-				v |= 1 << 2;
-			if (IsSolid(x + vx, y + vy, z + vz))
-				v |= 1 << 3;
-			if (IsSolid(x - ux + vx, y - uy + vy, z - uz + vz))
-				v |= 1 << 4;
-			if (IsSolid(x - ux - vx, y - uy - vy, z - uz - vz))
-				v |= 1 << 5;
-			if (IsSolid(x + ux + vx, y + uy + vy, z + uz + vz))
-				v |= 1 << 6;
-			if (IsSolid(x + ux - vx, y + uy - vy, z + uz - vz))
-				v |= 1 << 7;
-			return (uint8_t)v;
-		}
-
-		/**
-		 * @param aoX Global X coordinate of the cell to evaluate ambient occlusion.
-		 * @param aoY Global Y coordinate of the cell to evaluate ambient occlusion.
-		 * @param aoZ Global Z coordinate of the cell to evaluate ambient occlusion.
-		 * @param x Chunk local X coordinate
-		 * @param y Chunk local Y coordinate
-		 * @param z Chunk local Z coordinate
-		 */
-		void GLMapChunk::EmitVertex(int x, int y, int z, int aoX, int aoY, int aoZ, int ux, int uy,
-		                            int vx, int vy, uint32_t color, int nx, int ny, int nz) {
-			SPADES_MARK_FUNCTION_DEBUG();
-
-			int uz = (ux == 0 && uy == 0) ? 1 : 0;
-			int vz = (vx == 0 && vy == 0) ? 1 : 0;
-			Vertex inst;
-			// evaluate ambient occlusion
-			unsigned int aoID = calcAOID(aoX, aoY, aoZ, ux, uy, uz, vx, vy, vz);
-
-			if (nz == 1 || ny == 1) {
-				inst.shading = 0;
-			} else if (nx == 1 || nx == -1) {
-				inst.shading = 0; // 50;
-			} else if (nz == -1) {
-				inst.shading = 220;
-			} else {
-				inst.shading = 255;
-			}
-
-			inst.x = x;
-			inst.y = y;
-			inst.z = z;
-			inst.colorRed = (uint8_t)(color);
-			inst.colorGreen = (uint8_t)(color >> 8);
-			inst.colorBlue = (uint8_t)(color >> 16);
-
-			inst.nx = nx;
-			inst.ny = ny;
-			inst.nz = nz;
-
-			// fixed position to avoid self-shadow glitch
-			inst.sx = (x << 1) + ux + vx;
-			inst.sy = (y << 1) + uy + vy;
-			inst.sz = (z << 1) + uz + vz;
-
-			unsigned int aoTexX = aoID & 15;
-			unsigned int aoTexY = aoID >> 4;
-			aoTexX *= 16;
-			aoTexY *= 16;
-
-			uint16_t idx = (uint16_t)vertices.size();
-			inst.x = x;
-			inst.y = y;
-			inst.z = z;
-			inst.aoX = aoTexX;
-			inst.aoY = aoTexY;
-			vertices.push_back(inst);
-			inst.x = x + ux;
-			inst.y = y + uy;
-			inst.z = z + uz;
-			inst.aoX = aoTexX + 15;
-			inst.aoY = aoTexY;
-			vertices.push_back(inst);
-			inst.x = x + vx;
-			inst.y = y + vy;
-			inst.z = z + vz;
-			inst.aoX = aoTexX;
-			inst.aoY = aoTexY + 15;
-			vertices.push_back(inst);
-			inst.x = x + ux + vx;
-			inst.y = y + uy + vy;
-			inst.z = z + uz + vz;
-			inst.aoX = aoTexX + 15;
-			inst.aoY = aoTexY + 15;
-			vertices.push_back(inst);
-
-			indices.push_back(idx);
-			indices.push_back(idx + 1);
-			indices.push_back(idx + 2);
-			indices.push_back(idx + 1);
-			indices.push_back(idx + 3);
-			indices.push_back(idx + 2);
-		}
-
-		bool GLMapChunk::IsSolid(int x, int y, int z) {
-			if (z < 0)
-				return false;
-			if (z >= 64)
-				return true;
-
-			// FIXME: variable map size
-			x &= 511;
-			y &= 511;
-
-			if (z == 63) {
-				if (renderer.renderer.GetSettings().r_water) {
-					return map->IsSolid(x, y, 62);
-				} else {
-					return map->IsSolid(x, y, 63);
-				}
-			} else {
-				return map->IsSolid(x, y, z);
-			}
-		}
-
-		void GLMapChunk::Update() {
-			SPADES_MARK_FUNCTION();
-
-			vertices.clear();
-			indices.clear();
+		void GLMapChunk::DeleteBuffers() {
 			if (buffer) {
 				device.DeleteBuffer(buffer);
 				buffer = 0;
@@ -223,74 +101,44 @@ namespace spades {
 				device.DeleteBuffer(iBuffer);
 				iBuffer = 0;
 			}
+			numIndices = 0;
+		}
 
-			int rchunkX = chunkX * Size;
-			int rchunkY = chunkY * Size;
-			int rchunkZ = chunkZ * Size;
-
-			int x, y, z;
-			for (x = 0; x < Size; x++) {
-				for (y = 0; y < Size; y++) {
-					for (z = 0; z < Size; z++) {
-						int xx = x + rchunkX;
-						int yy = y + rchunkY;
-						int zz = z + rchunkZ;
-
-						if (!IsSolid(xx, yy, zz))
-							continue;
-
-						uint32_t col = map->GetColor(xx, yy, zz);
-						// col = 0xffffffff;
-
-						// damaged block?
-						int health = col >> 24;
-						if (health < 100) {
-							col &= 0xffffff;
-							col &= 0xfefefe;
-							col >>= 1;
-						}
-
-						if (!IsSolid(xx, yy, zz + 1)) {
-							EmitVertex(x + 1, y, z + 1, xx, yy, zz + 1, -1, 0, 0, 1, col, 0, 0, 1);
-						}
-						if (!IsSolid(xx, yy, zz - 1)) {
-							EmitVertex(x, y, z, xx, yy, zz - 1, 1, 0, 0, 1, col, 0, 0, -1);
-						}
-						if (!IsSolid(xx - 1, yy, zz)) {
-							EmitVertex(x, y + 1, z, xx - 1, yy, zz, 0, 0, 0, -1, col, -1, 0, 0);
-						}
-						if (!IsSolid(xx + 1, yy, zz)) {
-							EmitVertex(x + 1, y, z, xx + 1, yy, zz, 0, 0, 0, 1, col, 1, 0, 0);
-						}
-						if (!IsSolid(xx, yy - 1, zz)) {
-							EmitVertex(x, y, z, xx, yy - 1, zz, 0, 0, 1, 0, col, 0, -1, 0);
-						}
-						if (!IsSolid(xx, yy + 1, zz)) {
-							EmitVertex(x + 1, y + 1, z, xx, yy + 1, zz, 0, 0, -1, 0, col, 0, 1, 0);
-						}
-					}
-				}
-			}
-
-			if (vertices.size() == 0)
-				return;
+		void GLMapChunk::StartUpdate() {
+			SPAssert(!updating);
+			needsUpdate = false;
+			updating = true;
+		}
 
-			buffer = device.GenBuffer();
-			device.BindBuffer(IGLDevice::ArrayBuffer, buffer);
+		void GLMapChunk::BuildMesh(const MapChunkMesher &mesher) {
+			SPADES_MARK_FUNCTION();
+			mesher.Build(chunkX, chunkY, chunkZ, mesh);
+		}
 
-			device.BufferData(IGLDevice::ArrayBuffer,
-			                  static_cast<IGLDevice::Sizei>(vertices.size() * sizeof(Vertex)),
-			                  vertices.data(), IGLDevice::DynamicDraw);
+		void GLMapChunk::FinishUpdate() {
+			SPADES_MARK_FUNCTION();
+			SPAssert(updating);
+			updating = false;
 
-			if (!indices.empty()) {
-				iBuffer = device.GenBuffer();
-				device.BindBuffer(IGLDevice::ArrayBuffer, iBuffer);
+			if (!realized) {
+				MapChunkMesher::Mesh m;
+				std::swap(m, mesh);
+				return;
+			}
 
-				device.BufferData(IGLDevice::ArrayBuffer,
-				                  static_cast<IGLDevice::Sizei>(indices.size() * sizeof(uint16_t)),
-				                  indices.data(), IGLDevice::DynamicDraw);
+			// Upload the new mesh first, and then replace the old one at once
+			IGLDevice::UInteger newBuffer = 0, newIBuffer = 0;
+			if (!mesh.vertices.empty()) {
+				newBuffer = CreateBuffer(device, mesh.vertices.data(),
+				                         mesh.vertices.size() * sizeof(Vertex));
+				newIBuffer = CreateBuffer(device, mesh.indices.data(),
+				                          mesh.indices.size() * sizeof(uint16_t));
 			}
-			device.BindBuffer(IGLDevice::ArrayBuffer, 0);
+
+			DeleteBuffers();
+			buffer = newBuffer;
+			iBuffer = newIBuffer;
+			numIndices = mesh.indices.size();
 		}
 
 		void GLMapChunk::RenderDepthPass() {
@@ -299,10 +147,6 @@ namespace spades {
 
 			if (!realized)
 				return;
-			if (needsUpdate) {
-				Update();
-				needsUpdate = false;
-			}
 			if (!buffer) {
 				// empty chunk
 				return;
@@ -347,7 +191,7 @@ namespace spades {
 
 			device.BindBuffer(IGLDevice::ArrayBuffer, 0);
 			device.BindBuffer(IGLDevice::ElementArrayBuffer, iBuffer);
-			device.DrawElements(IGLDevice::Triangles, static_cast<IGLDevice::Sizei>(indices.size()),
+			device.DrawElements(IGLDevice::Triangles, static_cast<IGLDevice::Sizei>(numIndices),
 			                    IGLDevice::UnsignedShort, NULL);
 			device.BindBuffer(IGLDevice::ElementArrayBuffer, 0);
 		}
@@ -357,10 +201,6 @@ namespace spades {
 
 			if (!realized)
 				return;
-			if (needsUpdate) {
-				Update();
-				needsUpdate = false;
-			}
 			if (!buffer) {
 				// empty chunk
 				return;
@@ -400,13 +240,11 @@ namespace spades {
 			  "ambientOcclusionCoordAttribute");
 			static GLProgramAttribute colorAttribute("colorAttribute");
 			static GLProgramAttribute normalAttribute("normalAttribute");
-			static GLProgramAttribute fixedPositionAttribute("fixedPositionAttribute");
 
 			positionAttribute(basicProgram);
 			ambientOcclusionCoordAttribute(basicProgram);
 			colorAttribute(basicProgram);
 			normalAttribute(basicProgram);
-			fixedPositionAttribute(basicProgram);
 
 			device.BindBuffer(IGLDevice::ArrayBuffer, buffer);
 			device.VertexAttribPointer(positionAttribute(), 3, IGLDevice::UnsignedByte, false,
@@ -421,12 +259,9 @@ namespace spades {
 				device.VertexAttribPointer(normalAttribute(), 3, IGLDevice::Byte, false,
 				                           sizeof(Vertex), (void *)asOFFSET(Vertex, nx));
 
-			device.VertexAttribPointer(fixedPositionAttribute(), 3, IGLDevice::Byte, false,
-			                           sizeof(Vertex), (void *)asOFFSET(Vertex, sx));
-
 			device.BindBuffer(IGLDevice::ArrayBuffer, 0);
 			device.BindBuffer(IGLDevice::ElementArrayBuffer, iBuffer);
-			device.DrawElements(IGLDevice::Triangles, static_cast<IGLDevice::Sizei>(indices.size()),
+			device.DrawElements(IGLDevice::Triangles, static_cast<IGLDevice::Sizei>(numIndices),
 			                    IGLDevice::UnsignedShort, NULL);
 			device.BindBuffer(IGLDevice::ElementArrayBuffer, 0);
 		}
@@ -437,10 +272,6 @@ namespace spades {
 
 			if (!realized)
 				return;
-			if (needsUpdate) {
-				Update();
-				needsUpdate = false;
-			}
 			if (!buffer) {
 				// empty chunk
 				return;
@@ -502,7 +333,7 @@ namespace spades {
 					continue;
 
 				device.DrawElements(IGLDevice::Triangles,
-				                    static_cast<IGLDevice::Sizei>(indices.size()),
+				                    static_cast<IGLDevice::Sizei>(numIndices),
 				                    IGLDevice::UnsignedShort, NULL);
 			}
 
@@ -20,10 +20,12 @@
 
 #pragma once
 
+#include <cstddef>
 #include <vector>
 
 #include "GLDynamicLight.h"
 #include "IGLDevice.h"
+#include "MapChunkMesher.h"
 #include <Client/GameMap.h>
 #include <Client/IRenderer.h>
 #include <Core/Math.h>
@@ -33,23 +35,7 @@ namespace spades {
 		class GLMapRenderer;
 		class IGLDevice;
 		class GLMapChunk {
-			struct Vertex {
-				uint8_t x, y, z;
-				uint8_t pad;
-
-				uint16_t aoX, aoY;
-
-				uint8_t colorRed;
-				uint8_t colorGreen;
-				uint8_t colorBlue;
-				uint8_t shading;
-
-				int8_t nx, ny, nz;
-				uint8_t pad2;
-
-				int8_t sx, sy, sz;
-				uint8_t pad3;
-			};
+			typedef MapChunkMesher::Vertex Vertex;
 
 			GLMapRenderer &renderer;
 			IGLDevice &device;
@@ -60,30 +46,43 @@ namespace spades {
 			Vector3 centerPos;
 			float radius;
 
-			std::vector<Vertex> vertices;
-			std::vector<uint16_t> indices;
+			/** Written by `BuildMesh` and uploaded by `FinishUpdate`. */
+			MapChunkMesher::Mesh mesh;
+
 			IGLDevice::UInteger buffer;
 			IGLDevice::UInteger iBuffer;
+			std::size_t numIndices;
 
 			bool needsUpdate;
 			bool realized;
 
-			uint8_t calcAOID(int x, int y, int z, int ux, int uy, int uz, int vx, int vy, int vz);
-
-			void EmitVertex(int aoX, int aoY, int aoZ, int x, int y, int z, int ux, int uy, int vx,
-			                int vy, uint32_t color, int nx, int ny, int nz);
+			/** Set between `StartUpdate` and `FinishUpdate`. */
+			bool updating;
 
-			bool IsSolid(int x, int y, int z);
-
-			void Update();
+			void DeleteBuffers();
 
 		public:
-			enum { Size = 16, SizeBits = 4 };
+			enum { Size = MapChunkMesher::Size, SizeBits = MapChunkMesher::SizeBits };
 			GLMapChunk(GLMapRenderer &, client::GameMap *mp, int cx, int cy, int cz);
 			~GLMapChunk();
 
 			void SetNeedsUpdate() { needsUpdate = true; }
 
+			/** Returns `true` if the mesh is out of date and no update is in progress. */
+			bool IsUpdateNeeded() const { return realized && needsUpdate && !updating; }
+
+			/**
+			 * Clears the out-of-date flag before `BuildMesh` is called. The currently uploaded
+			 * mesh is kept drawn until `FinishUpdate` replaces it.
+			 */
+			void StartUpdate();
+
+			/** Builds a new mesh. Can be called by any thread between the other two calls. */
+			void BuildMesh(const MapChunkMesher &);
+
+			/** Uploads the built mesh to new buffers and releases the old ones. */
+			void FinishUpdate();
+
 			void SetRealized(bool);
 
 			float DistanceFromEye(const Vector3 &eye);
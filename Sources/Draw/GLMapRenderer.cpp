@@ -18,6 +18,8 @@
 
  */
 
+#include <algorithm>
+
 #include "GLMapRenderer.h"
 #include "GLDynamicLightShader.h"
 #include "GLImage.h"
@@ -33,9 +35,27 @@
 #include <Client/GameMap.h>
 #include <Core/Debug.h>
 #include <Core/Settings.h>
+#include <Core/ThreadPool.h>
 
 namespace spades {
 	namespace draw {
+		class GLMapRenderer::MeshJob : public ThreadPoolJob {
+			GLMapRenderer &renderer;
+
+		public:
+			/** Whether the voxels at `z = 63` are hidden by the water. */
+			bool water = false;
+
+			MeshJob(GLMapRenderer &r) : renderer(r) {}
+			~MeshJob() { Join(); }
+
+		protected:
+			void RunChunk(std::size_t index) override {
+				MapChunkMesher mesher{*renderer.gameMap, water};
+				renderer.meshBatch[index]->BuildMesh(mesher);
+			}
+		};
+
 		void GLMapRenderer::PreloadShaders(GLRenderer &renderer) {
 			if (renderer.GetSettings().r_physicalLighting)
 				renderer.RegisterProgram("Shaders/BasicBlockPhys.program");
@@ -73,6 +93,8 @@ namespace spades {
 			backfaceProgram = renderer.RegisterProgram("Shaders/BackFaceBlock.program");
 			aoImage = renderer.RegisterImage("Gfx/AmbientOcclusion.png").Cast<GLImage>();
 
+			meshJob.reset(new MeshJob(*this));
+
 			static const uint8_t squareVertices[] = {0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 0, 1};
 			squareVertexBuffer = device.GenBuffer();
 			device.BindBuffer(IGLDevice::ArrayBuffer, squareVertexBuffer);
@@ -84,40 +106,33 @@ namespace spades {
 		GLMapRenderer::~GLMapRenderer() {
 			SPADES_MARK_FUNCTION();
 
+			// Wait for the chunks being built before deleting them
+			meshJob.reset();
+			if (!meshBatch.empty())
+				gameMap->EndConcurrentRead();
+
 			device.DeleteBuffer(squareVertexBuffer);
 			for (int i = 0; i < numChunks; i++)
 				delete chunks[i];
 			delete[] chunks;
 			delete[] chunkInfos;
 		}
-		void GLMapRenderer::GameMapChanged(int x, int y, int z, client::GameMap *map) {
+		void GLMapRenderer::GameMapChanged(const IntVector3 &min, const IntVector3 &max,
+		                                   client::GameMap *map) {
 			SPADES_MARK_FUNCTION_DEBUG();
 
-			/*GetChunk(x >> GLMapChunk::SizeBits,
-			         y >> GLMapChunk::SizeBits,
-			         z >> GLMapChunk::SizeBits)->SetNeedsUpdate();*/
-			// int fx = x & (GLMapChunk::Size - 1);
-			// int fy = y & (GLMapChunk::Size - 1);
-			int fz = z & (GLMapChunk::Size - 1);
-			int sx = -1;
-			int sy = -1;
-			int sz = fz == 0 ? -1 : 0;
-			int ex = 1;
-			int ey = 1;
-			int ez = fz == (GLMapChunk::Size - 1) ? 1 : 0;
-			for (int cx = sx; cx <= ex; cx++)
-				for (int cy = sy; cy <= ey; cy++)
-					for (int cz = sz; cz <= ez; cz++) {
-						int xx = x + cx, yy = y + cy, zz = z + cz;
-						xx >>= GLMapChunk::SizeBits;
-						yy >>= GLMapChunk::SizeBits;
-						zz >>= GLMapChunk::SizeBits;
-						xx &= numChunkWidth - 1;
-						yy &= numChunkHeight - 1;
-						if (xx >= 0 && yy >= 0 && zz >= 0 && xx < numChunkWidth &&
-						    yy < numChunkHeight && zz < numChunkDepth) {
-							GetChunk(xx, yy, zz)->SetNeedsUpdate();
-						}
+			// A voxel also affects the faces of its neighbors
+			int cx1 = (min.x - 1) >> GLMapChunk::SizeBits;
+			int cy1 = (min.y - 1) >> GLMapChunk::SizeBits;
+			int cz1 = std::max((min.z - 1) >> GLMapChunk::SizeBits, 0);
+			int cx2 = (max.x + 1) >> GLMapChunk::SizeBits;
+			int cy2 = (max.y + 1) >> GLMapChunk::SizeBits;
+			int cz2 = std::min((max.z + 1) >> GLMapChunk::SizeBits, numChunkDepth - 1);
+			for (int cx = cx1; cx <= cx2; cx++)
+				for (int cy = cy1; cy <= cy2; cy++)
+					for (int cz = cz1; cz <= cz2; cz++) {
+						GetChunk(cx & (numChunkWidth - 1), cy & (numChunkHeight - 1), cz)
+						  ->SetNeedsUpdate();
 					}
 		}
 
@@ -141,6 +156,58 @@ namespace spades {
 
 			Vector3 eye = renderer.GetSceneDef().viewOrigin;
 			RealizeChunks(eye);
+
+			FinishChunkUpdates();
+			StartChunkUpdates();
+		}
+
+		void GLMapRenderer::StartChunkUpdates() {
+			SPADES_MARK_FUNCTION();
+			SPAssert(meshBatch.empty());
+
+			std::vector<int> candidates;
+			for (int i = 0; i < numChunks; i++) {
+				if (chunks[i]->IsUpdateNeeded())
+					candidates.push_back(i);
+			}
+			if (candidates.empty())
+				return;
+
+			ThreadPool &pool = ThreadPool::GetGlobalPool();
+			std::size_t maxChunks =
+			  static_cast<std::size_t>(ChunksPerThread * pool.GetNumParticipants());
+			if (candidates.size() > maxChunks) {
+				std::partial_sort(candidates.begin(), candidates.begin() + maxChunks,
+				                  candidates.end(), [&](int a, int b) {
+					                  return chunkInfos[a].distance < chunkInfos[b].distance;
+				                  });
+				candidates.resize(maxChunks);
+			}
+
+			for (int i : candidates) {
+				chunks[i]->StartUpdate();
+				meshBatch.push_back(chunks[i]);
+			}
+
+			// The chunks are built while the rest of the frame is rendered
+			gameMap->BeginConcurrentRead();
+			meshJob->water = renderer.GetSettings().r_water;
+			meshJob->Start(pool, meshBatch.size());
+		}
+
+		void GLMapRenderer::FinishChunkUpdates() {
+			SPADES_MARK_FUNCTION();
+
+			if (meshBatch.empty())
+				return;
+
+			GLProfiler::Context profiler(renderer.GetGLProfiler(), "Map Chunk Upload");
+
+			meshJob->Join();
+			gameMap->EndConcurrentRead();
+			for (GLMapChunk *chunk : meshBatch)
+				chunk->FinishUpdate();
+			meshBatch.clear();
 		}
 
 		void GLMapRenderer::Prerender() {
@@ -240,13 +307,11 @@ namespace spades {
 			  "ambientOcclusionCoordAttribute");
 			static GLProgramAttribute colorAttribute("colorAttribute");
 			static GLProgramAttribute normalAttribute("normalAttribute");
-			static GLProgramAttribute fixedPositionAttribute("fixedPositionAttribute");
 
 			positionAttribute(basicProgram);
 			ambientOcclusionCoordAttribute(basicProgram);
 			colorAttribute(basicProgram);
 			normalAttribute(basicProgram);
-			fixedPositionAttribute(basicProgram);
 
 			device.EnableVertexAttribArray(positionAttribute(), true);
 			if (ambientOcclusionCoordAttribute() != -1)
@@ -254,7 +319,6 @@ namespace spades {
 			device.EnableVertexAttribArray(colorAttribute(), true);
 			if (normalAttribute() != -1)
 				device.EnableVertexAttribArray(normalAttribute(), true);
-			device.EnableVertexAttribArray(fixedPositionAttribute(), true);
 
 			static GLProgramUniform projectionViewMatrix("projectionViewMatrix");
 			projectionViewMatrix(basicProgram);
@@ -295,7 +359,6 @@ namespace spades {
 			device.EnableVertexAttribArray(colorAttribute(), false);
 			if (normalAttribute() != -1)
 				device.EnableVertexAttribArray(normalAttribute(), false);
-			device.EnableVertexAttribArray(fixedPositionAttribute(), false);
 
 			device.ActiveTexture(1);
 			device.BindTexture(IGLDevice::Texture2D, 0);
@@ -20,6 +20,9 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include "GLDynamicLight.h"
 #include "IGLDevice.h"
 #include <Client/IGameMapListener.h>
@@ -35,6 +38,10 @@ namespace spades {
 		class GLMapRenderer {
 
 			friend class GLMapChunk;
+			class MeshJob;
+
+			/** The number of chunks rebuilt at once per thread. */
+			static constexpr int ChunksPerThread = 32;
 
 		protected:
 			GLRenderer &renderer;
@@ -68,8 +75,15 @@ namespace spades {
 				return chunks[GetChunkIndex(x, y, z)];
 			}
 
+			/** The chunks whose meshes are being built by `meshJob`. */
+			std::vector<GLMapChunk *> meshBatch;
+			std::unique_ptr<MeshJob> meshJob;
+
 			void RealizeChunks(Vector3 eye);
 
+			/** Starts building the meshes of the out-of-date chunks, nearest first. */
+			void StartChunkUpdates();
+
 			void DrawColumnDepth(int cx, int cy, int cz, Vector3 eye);
 			void DrawColumnSunlight(int cx, int cy, int cz, Vector3 eye);
 			void DrawColumnDLight(int cx, int cy, int cz, Vector3 eye,
@@ -83,11 +97,17 @@ namespace spades {
 
 			static void PreloadShaders(GLRenderer &);
 
-			void GameMapChanged(int x, int y, int z, client::GameMap *);
+			void GameMapChanged(const IntVector3 &min, const IntVector3 &max, client::GameMap *);
 
 			client::GameMap *GetMap() { return gameMap; }
 
 			void Realize();
+
+			/**
+			 * Waits for the chunk meshes being built since `Realize` and replaces the drawn
+			 * meshes with them. Must be called before the map is modified again.
+			 */
+			void FinishChunkUpdates();
 			void Prerender();
 			void RenderSunlightPass();
 			void RenderDynamicLightPass(std::vector<GLDynamicLight> lights);
@@ -18,6 +18,8 @@
 
  */
 
+#include <algorithm>
+
 #include "GLMapShadowRenderer.h"
 #include "GLProfiler.h"
 #include "GLRadiosityRenderer.h"
@@ -223,9 +225,16 @@ namespace spades {
 			updateBitmap[(x >> 5) + y * updateBitmapPitch] |= 1UL << (x & 31);
 		}
 
-		void GLMapShadowRenderer::GameMapChanged(int x, int y, int z, client::GameMap *m) {
-			MarkUpdate(x, y - z);
-			MarkUpdate(x, y - z - 1);
+		void GLMapShadowRenderer::GameMapChanged(const IntVector3 &min, const IntVector3 &max,
+		                                         client::GameMap *m) {
+			// A voxel at (x, y, z) affects the pixels (x, y - z) and (x, y - z - 1)
+			int minY = min.y - max.z - 1;
+			int maxY = std::min(max.y - min.z, minY + h - 1);
+			for (int y = minY; y <= maxY; y++) {
+				for (int x = min.x; x <= max.x; x++) {
+					MarkUpdate(x, y);
+				}
+			}
 		}
 	} // namespace draw
 } // namespace spades
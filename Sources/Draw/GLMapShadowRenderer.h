@@ -59,7 +59,7 @@ namespace spades {
 			GLMapShadowRenderer(GLRenderer &renderer, client::GameMap *map);
 			~GLMapShadowRenderer();
 
-			void GameMapChanged(int x, int y, int z, client::GameMap *);
+			void GameMapChanged(const IntVector3 &min, const IntVector3 &max, client::GameMap *);
 
 			void Update();
 
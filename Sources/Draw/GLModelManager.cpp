@@ -20,17 +20,30 @@
 #include <memory>
 
 #include "GLModelManager.h"
+#include "GLOptimizedVoxelModel.h"
 #include "GLRenderer.h"
+#include "GLSettings.h"
 #include "GLVoxelModel.h"
 #include <Core/Debug.h>
 #include <Core/IStream.h>
 #include <Core/Settings.h>
+#include <Core/TMPUtils.h>
 #include <Core/VoxelModel.h>
 #include <Core/VoxelModelLoader.h>
 
 namespace spades {
 	namespace draw {
-		GLModelManager::GLModelManager(GLRenderer &r) : renderer{r} { SPADES_MARK_FUNCTION(); }
+		namespace {
+			class GLPreloadedModel : public client::PreloadedModel {
+			public:
+				std::unique_ptr<GLOptimizedVoxelModel::Mesh> mesh;
+			};
+		} // namespace
+
+		GLModelManager::GLModelManager(GLRenderer &r)
+		    : renderer{r}, optimizedVoxelModel{r.GetSettings().r_optimizedVoxelModel} {
+			SPADES_MARK_FUNCTION();
+		}
 		GLModelManager::~GLModelManager() { SPADES_MARK_FUNCTION(); }
 
 		Handle<GLModel> GLModelManager::RegisterModel(const char *name) {
@@ -53,6 +66,48 @@ namespace spades {
 			return renderer.CreateModelOptimized(*voxelModel).Cast<GLModel>();
 		}
 
+		std::unique_ptr<client::PreloadedModel> GLModelManager::PreloadModel(const char *name) {
+			SPADES_MARK_FUNCTION();
+
+			return PreloadModel(*VoxelModelLoader::Load(name));
+		}
+
+		std::unique_ptr<client::PreloadedModel> GLModelManager::PreloadModel(VoxelModel &model) {
+			SPADES_MARK_FUNCTION();
+
+			auto preloaded = stmp::make_unique<GLPreloadedModel>();
+			preloaded->voxelModel = model;
+			if (optimizedVoxelModel) {
+				preloaded->mesh = stmp::make_unique<GLOptimizedVoxelModel::Mesh>(model);
+			}
+			return preloaded;
+		}
+
+		Handle<GLModel> GLModelManager::RegisterPreloadedModel(const char *name,
+		                                                      client::PreloadedModel &preloaded) {
+			SPADES_MARK_FUNCTION();
+
+			auto it = models.find(std::string(name));
+			if (it != models.end()) {
+				return it->second;
+			}
+
+			Handle<GLModel> m = CreatePreloadedModel(preloaded);
+			models[name] = m;
+			return m;
+		}
+
+		Handle<GLModel> GLModelManager::CreatePreloadedModel(client::PreloadedModel &preloaded) {
+			SPADES_MARK_FUNCTION();
+
+			auto *glPreloaded = dynamic_cast<GLPreloadedModel *>(&preloaded);
+			if (glPreloaded && glPreloaded->mesh) {
+				return Handle<GLOptimizedVoxelModel>::New(*glPreloaded->mesh, renderer)
+				  .Cast<GLModel>();
+			}
+			return renderer.CreateModelOptimized(*preloaded.voxelModel).Cast<GLModel>();
+		}
+
 		void GLModelManager::ClearCache() { models.clear(); }
 	} // namespace draw
 } // namespace spades
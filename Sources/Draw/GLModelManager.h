@@ -21,9 +21,11 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <string>
 
 #include <Client/IModel.h>
+#include <Client/IRenderer.h>
 #include <Core/RefCountedObject.h>
 
 namespace spades {
@@ -33,6 +35,8 @@ namespace spades {
 		class GLModelManager {
 			GLRenderer &renderer;
 			std::map<std::string, Handle<GLModel>> models;
+			/** The value of `r_optimizedVoxelModel`, which is read by `PreloadModel`. */
+			bool optimizedVoxelModel;
 			Handle<GLModel> CreateModel(const char *);
 
 		public:
@@ -40,6 +44,14 @@ namespace spades {
 			~GLModelManager();
 			Handle<GLModel> RegisterModel(const char *);
 
+			/** Thread-safe. Builds the mesh too if `GLOptimizedVoxelModel` is in use. */
+			std::unique_ptr<client::PreloadedModel> PreloadModel(const char *);
+			Handle<GLModel> RegisterPreloadedModel(const char *, client::PreloadedModel &);
+
+			/** Thread-safe. Same as `PreloadModel(const char *)`, but for a given model. */
+			std::unique_ptr<client::PreloadedModel> PreloadModel(VoxelModel &);
+			Handle<GLModel> CreatePreloadedModel(client::PreloadedModel &);
+
 			void ClearCache();
 		};
 	} // namespace draw
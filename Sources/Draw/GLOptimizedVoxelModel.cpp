@@ -44,12 +44,26 @@ namespace spades {
 			renderer.RegisterProgram("Shaders/OptimizedVoxelModelShadowMap.program");
 			renderer.RegisterImage("Gfx/AmbientOcclusion.png");
 		}
+		GLOptimizedVoxelModel::Mesh::Mesh(VoxelModel &m) {
+			SPADES_MARK_FUNCTION();
+
+			BuildVertices(&m);
+			GenerateTexture();
+
+			origin = m.GetOrigin();
+			size = IntVector3::Make(m.GetWidth(), m.GetHeight(), m.GetDepth());
+		}
+
+		GLOptimizedVoxelModel::Mesh::~Mesh() {}
+
 		GLOptimizedVoxelModel::GLOptimizedVoxelModel(VoxelModel *m, GLRenderer &r)
+		    : GLOptimizedVoxelModel(Mesh{*m}, r) {}
+
+		GLOptimizedVoxelModel::GLOptimizedVoxelModel(const Mesh &mesh, GLRenderer &r)
 		    : renderer{r}, device{r.GetGLDevice()} {
 			SPADES_MARK_FUNCTION();
 
-			BuildVertices(m);
-			GenerateTexture();
+			image = renderer.CreateImage(*mesh.texture).Cast<GLImage>();
 
 			program = renderer.RegisterProgram("Shaders/OptimizedVoxelModel.program");
 			dlightProgram =
@@ -61,21 +75,21 @@ namespace spades {
 			buffer = device.GenBuffer();
 			device.BindBuffer(IGLDevice::ArrayBuffer, buffer);
 			device.BufferData(IGLDevice::ArrayBuffer,
-			                  static_cast<IGLDevice::Sizei>(vertices.size() * sizeof(Vertex)),
-			                  vertices.data(), IGLDevice::StaticDraw);
+			                  static_cast<IGLDevice::Sizei>(mesh.vertices.size() * sizeof(Vertex)),
+			                  mesh.vertices.data(), IGLDevice::StaticDraw);
 
 			idxBuffer = device.GenBuffer();
 			device.BindBuffer(IGLDevice::ArrayBuffer, idxBuffer);
 			device.BufferData(IGLDevice::ArrayBuffer,
-			                  static_cast<IGLDevice::Sizei>(indices.size() * sizeof(uint32_t)),
-			                  indices.data(), IGLDevice::StaticDraw);
+			                  static_cast<IGLDevice::Sizei>(mesh.indices.size() * sizeof(uint32_t)),
+			                  mesh.indices.data(), IGLDevice::StaticDraw);
 			device.BindBuffer(IGLDevice::ArrayBuffer, 0);
 
-			origin = m->GetOrigin();
+			origin = mesh.origin;
 			origin -= .5f; // (0,0,0) is center of voxel (0,0,0)
 
 			Vector3 minPos = {0, 0, 0};
-			Vector3 maxPos = {(float)m->GetWidth(), (float)m->GetHeight(), (float)m->GetDepth()};
+			Vector3 maxPos = {(float)mesh.size.x, (float)mesh.size.y, (float)mesh.size.z};
 			minPos += origin;
 			maxPos += origin;
 			Vector3 maxDiff = {std::max(fabsf(minPos.x), fabsf(maxPos.x)),
@@ -86,10 +100,7 @@ namespace spades {
 			boundingBox.min = minPos;
 			boundingBox.max = maxPos;
 
-			// clean up
-			numIndices = (unsigned int)indices.size();
-			std::vector<Vertex>().swap(vertices);
-			std::vector<uint32_t>().swap(indices);
+			numIndices = (unsigned int)mesh.indices.size();
 		}
 		GLOptimizedVoxelModel::~GLOptimizedVoxelModel() {
 			SPADES_MARK_FUNCTION();
@@ -98,7 +109,7 @@ namespace spades {
 			device.DeleteBuffer(buffer);
 		}
 
-		void GLOptimizedVoxelModel::GenerateTexture() {
+		void GLOptimizedVoxelModel::Mesh::GenerateTexture() {
 			BitmapAtlasGenerator atlasGen;
 			std::map<Bitmap *, int> idx;
 			std::vector<IntVector3> poss;
@@ -134,11 +145,11 @@ namespace spades {
 
 			std::vector<uint16_t>().swap(bmpIndex);
 
-			image = renderer.CreateImage(*bmp).Cast<GLImage>();
+			texture = std::move(bmp);
 		}
 
-		uint8_t GLOptimizedVoxelModel::calcAOID(VoxelModel *m, int x, int y, int z, int ux, int uy,
-		                                        int uz, int vx, int vy, int vz) {
+		uint8_t GLOptimizedVoxelModel::Mesh::calcAOID(VoxelModel *m, int x, int y, int z, int ux,
+		                                              int uy, int uz, int vx, int vy, int vz) {
 			int v = 0;
 			if (m->IsSolid(x - ux, y - uy, z - uz))
 				v |= 1;
@@ -227,10 +238,10 @@ namespace spades {
 			return (x1 - x3) * (y2 - y1) - (x1 - x2) * (y3 - y1);
 		}
 
-		void GLOptimizedVoxelModel::EmitSlice(uint8_t *slice, int usize, int vsize, int sx, int sy,
-		                                      int sz, int ux, int uy, int uz, int vx, int vy,
-		                                      int vz, int mx, int my, int mz, bool flip,
-		                                      VoxelModel *model) {
+		void GLOptimizedVoxelModel::Mesh::EmitSlice(uint8_t *slice, int usize, int vsize, int sx,
+		                                            int sy, int sz, int ux, int uy, int uz, int vx,
+		                                            int vy, int vz, int mx, int my, int mz,
+		                                            bool flip, VoxelModel *model) {
 			SPADES_MARK_FUNCTION();
 			int minU = -1, minV = -1, maxU = -1, maxV = -1;
 
@@ -426,7 +437,7 @@ namespace spades {
 			}
 		}
 
-		void GLOptimizedVoxelModel::BuildVertices(spades::VoxelModel *model) {
+		void GLOptimizedVoxelModel::Mesh::BuildVertices(spades::VoxelModel *model) {
 			SPADES_MARK_FUNCTION();
 
 			SPAssert(vertices.empty());
@@ -55,12 +55,41 @@ namespace spades {
 			Handle<GLImage> image;
 			Handle<GLImage> aoImage;
 
+		public:
+			/**
+			 * The vertices and the texture of a model. Building them doesn't involve the GL
+			 * context, so it can be done on any thread.
+			 */
+			class Mesh {
+			public:
+				explicit Mesh(VoxelModel &);
+				~Mesh();
+
+			private:
+				friend class GLOptimizedVoxelModel;
+
+				std::vector<Vertex> vertices;
+				std::vector<uint32_t> indices;
+				std::vector<uint16_t> bmpIndex; // bmp id for vertex (not index)
+				std::vector<Bitmap *> bmps;
+				Handle<Bitmap> texture;
+
+				Vector3 origin;
+				IntVector3 size;
+
+				uint8_t calcAOID(VoxelModel *, int x, int y, int z, int ux, int uy, int uz,
+				                 int vx, int vy, int vz);
+				// v major
+				void EmitSlice(uint8_t *slice, int usize, int vsize, int sx, int sy, int sz,
+				               int ux, int uy, int uz, int vx, int vy, int vz, int mx, int my,
+				               int mz, bool flip, VoxelModel *);
+				void BuildVertices(VoxelModel *);
+				void GenerateTexture();
+			};
+
+		private:
 			IGLDevice::UInteger buffer;
 			IGLDevice::UInteger idxBuffer;
-			std::vector<Vertex> vertices;
-			std::vector<uint32_t> indices;
-			std::vector<uint16_t> bmpIndex; // bmp id for vertex (not index)
-			std::vector<Bitmap *> bmps;
 			unsigned int numIndices;
 
 			Vector3 origin;
@@ -68,22 +97,13 @@ namespace spades {
 
 			AABB3 boundingBox;
 
-			uint8_t calcAOID(VoxelModel *, int x, int y, int z, int ux, int uy, int uz, int vx,
-			                 int vy, int vz);
-			void EmitFace(VoxelModel *, int x, int y, int z, int nx, int ny, int nz,
-			              uint32_t color);
-			// v major
-			void EmitSlice(uint8_t *slice, int usize, int vsize, int sx, int sy, int sz, int ux,
-			               int uy, int uz, int vx, int vy, int vz, int mx, int my, int mz,
-			               bool flip, VoxelModel *);
-			void BuildVertices(VoxelModel *);
-			void GenerateTexture();
-
 		protected:
 			~GLOptimizedVoxelModel();
 
 		public:
 			GLOptimizedVoxelModel(VoxelModel *, GLRenderer &r);
+			/** Uploads a mesh built in advance. */
+			GLOptimizedVoxelModel(const Mesh &, GLRenderer &r);
 
 			static void PreloadShaders(GLRenderer &);
 
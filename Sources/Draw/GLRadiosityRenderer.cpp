@@ -18,8 +18,10 @@
 
  */
 
+#include <algorithm>
 #include <atomic>
 #include <cstdlib>
+#include <utility>
 
 #include "GLMapShadowRenderer.h"
 #include "GLRadiosityRenderer.h"
@@ -28,6 +30,7 @@
 
 #include <Core/ConcurrentDispatch.h>
 #include <Core/Settings.h>
+#include <Core/ThreadPool.h>
 #if defined(__APPLE__)
 #if defined(__x86_64__)
 #include <xmmintrin.h>
@@ -49,7 +52,11 @@ namespace spades {
 			void Run() override {
 				SPADES_MARK_FUNCTION();
 
-				renderer.UpdateDirtyChunks();
+				// This thread joins the job, so the render thread is never blocked even if the
+				// pool has no worker threads or is too busy to accept the job
+				const std::vector<ChunkUpdate> &batch = renderer.batch;
+				ThreadPool::GetGlobalPool().ParallelFor(
+				  0, batch.size(), 1, [&](std::size_t i) { renderer.UpdateChunk(batch[i]); });
 
 				done = true;
 			}
@@ -68,6 +75,7 @@ namespace spades {
 			chunkD = d / ChunkSize;
 
 			chunks = std::vector<Chunk>{static_cast<std::size_t>(chunkW * chunkH * chunkD)};
+			numDirtyChunks = chunks.size();
 
 			for (size_t i = 0; i < chunks.size(); i++) {
 				Chunk &c = chunks[i];
@@ -140,16 +148,15 @@ namespace spades {
 					                     IGLDevice::UnsignedInt2101010Rev, v.data());
 				}
 			}
-			dispatch = NULL;
 
 			SPLog("Chunk texture initialized");
 		}
 
 		GLRadiosityRenderer::~GLRadiosityRenderer() {
 			SPADES_MARK_FUNCTION();
-			if (dispatch) {
-				dispatch->Join();
-				delete dispatch;
+			if (updateDispatch) {
+				updateDispatch->Join();
+				updateDispatch.reset();
 			}
 			SPLog("Releasing textures");
 
@@ -324,6 +331,7 @@ namespace spades {
 							c.dirtyMaxY = inMaxY;
 							c.dirtyMaxZ = inMaxZ;
 							c.dirty = true;
+							++numDirtyChunks;
 						} else {
 							c.dirtyMinX = std::min(inMinX, c.dirtyMinX);
 							c.dirtyMinY = std::min(inMinY, c.dirtyMinY);
@@ -335,122 +343,116 @@ namespace spades {
 					}
 		}
 
-		int GLRadiosityRenderer::GetNumDirtyChunks() {
-			int cnt = 0;
-			for (size_t i = 0; i < chunks.size(); i++) {
-				Chunk &c = chunks[i];
-				if (c.dirty)
-					cnt++;
-			}
-			return cnt;
+		GLRadiosityRenderer::Stats GLRadiosityRenderer::GetStats() const {
+			Stats stats;
+			stats.numPendingChunks = numDirtyChunks;
+			stats.numComputingChunks = batch.size();
+			stats.numQueuedChunks = uploadQueue.size();
+			stats.numComputedChunks = numComputedChunks;
+			stats.numUploadedChunks = numUploadedChunks;
+			return stats;
 		}
 
 		void GLRadiosityRenderer::Update() {
-			if (GetNumDirtyChunks() > 0 && (dispatch == NULL || dispatch->done.load())) {
-				if (dispatch) {
-					dispatch->Join();
-					delete dispatch;
-				}
-				dispatch = new UpdateDispatch(*this);
-				dispatch->Start();
-			}
-			int cnt = 0;
-			for (size_t i = 0; i < chunks.size(); i++) {
-				if (!chunks[i].transferDone.load())
-					cnt++;
-			}
-			GLProfiler::Context profiler(renderer.GetGLProfiler(), "Radiosity [>= %d chunk(s)]",
-			                             cnt);
-			for (size_t i = 0; i < chunks.size(); i++) {
-				Chunk &c = chunks[i];
-				if (!c.transferDone.exchange(true)) {
-					device.BindTexture(IGLDevice::Texture3D, textureFlat);
-					device.TexSubImage3D(IGLDevice::Texture3D, 0, c.cx * ChunkSize,
-					                     c.cy * ChunkSize, c.cz * ChunkSize, ChunkSize, ChunkSize,
-					                     ChunkSize, IGLDevice::BGRA,
-					                     IGLDevice::UnsignedInt2101010Rev, c.dataFlat);
+			SPADES_MARK_FUNCTION();
 
-					device.BindTexture(IGLDevice::Texture3D, textureX);
-					device.TexSubImage3D(IGLDevice::Texture3D, 0, c.cx * ChunkSize,
-					                     c.cy * ChunkSize, c.cz * ChunkSize, ChunkSize, ChunkSize,
-					                     ChunkSize, IGLDevice::BGRA,
-					                     IGLDevice::UnsignedInt2101010Rev, c.dataX);
+			ThreadPool &pool = ThreadPool::GetGlobalPool();
 
-					device.BindTexture(IGLDevice::Texture3D, textureY);
-					device.TexSubImage3D(IGLDevice::Texture3D, 0, c.cx * ChunkSize,
-					                     c.cy * ChunkSize, c.cz * ChunkSize, ChunkSize, ChunkSize,
-					                     ChunkSize, IGLDevice::BGRA,
-					                     IGLDevice::UnsignedInt2101010Rev, c.dataY);
+			if (updateDispatch && updateDispatch->done) {
+				updateDispatch->Join();
+				updateDispatch.reset();
+				for (const ChunkUpdate &update : batch) {
+					uploadQueue.push_back(update.chunkIndex);
+				}
+				numComputedChunks += batch.size();
+				batch.clear();
+			}
 
-					device.BindTexture(IGLDevice::Texture3D, textureZ);
-					device.TexSubImage3D(IGLDevice::Texture3D, 0, c.cx * ChunkSize,
-					                     c.cy * ChunkSize, c.cz * ChunkSize, ChunkSize, ChunkSize,
-					                     ChunkSize, IGLDevice::BGRA,
-					                     IGLDevice::UnsignedInt2101010Rev, c.dataZ);
+			if (!updateDispatch && numDirtyChunks > 0) {
+				SelectDirtyChunks(renderer.GetSceneDef().viewOrigin,
+				                  pool.GetNumParticipants() * ChunksPerThread);
+				if (!batch.empty()) {
+					updateDispatch.reset(new UpdateDispatch(*this));
+					updateDispatch->Start();
 				}
 			}
+
+			GLProfiler::Context profiler(renderer.GetGLProfiler(),
+			                             "Radiosity [%d pending, %d queued chunk(s)]",
+			                             static_cast<int>(numDirtyChunks + batch.size()),
+			                             static_cast<int>(uploadQueue.size()));
+			UploadChunks();
 		}
 
-		void GLRadiosityRenderer::UpdateDirtyChunks() {
-			int dirtyChunkIds[256];
-			int numDirtyChunks = 0;
-			int nearDirtyChunks = 0;
+		void GLRadiosityRenderer::SelectDirtyChunks(const Vector3 &eye, std::size_t maxChunks) {
+			SPADES_MARK_FUNCTION();
 
-			// first, check only chunks in near range
-			Vector3 eyePos = renderer.GetSceneDef().viewOrigin;
-			int eyeX = (int)(eyePos.x) >> ChunkSizeBits;
-			int eyeY = (int)(eyePos.y) >> ChunkSizeBits;
-			int eyeZ = (int)(eyePos.z) >> ChunkSizeBits;
+			int eyeX = (int)(eye.x) >> ChunkSizeBits;
+			int eyeY = (int)(eye.y) >> ChunkSizeBits;
+			int eyeZ = (int)(eye.z) >> ChunkSizeBits;
 
-			for (size_t i = 0; i < chunks.size(); i++) {
-				Chunk &c = chunks[i];
+			// (squared distance in chunks, chunk index)
+			std::vector<std::pair<int, std::size_t>> candidates;
+			for (std::size_t i = 0; i < chunks.size(); i++) {
+				const Chunk &c = chunks[i];
+				if (!c.dirty || c.busy)
+					continue;
 				int dx = (c.cx - eyeX) & (chunkW - 1);
 				int dy = (c.cy - eyeY) & (chunkH - 1);
-				int dz = (c.cz - eyeZ);
-				if (dx >= 6 && dx <= chunkW - 6)
-					continue;
-				if (dy >= 6 && dy <= chunkW - 6)
-					continue;
-				if (dz >= 6 || dz <= -6)
-					continue;
-				if (c.dirty) {
-					dirtyChunkIds[numDirtyChunks++] = static_cast<int>(i);
-					nearDirtyChunks++;
-					if (numDirtyChunks >= 256)
-						break;
-				}
+				int dz = c.cz - eyeZ;
+				dx = std::min(dx, chunkW - dx);
+				dy = std::min(dy, chunkH - dy);
+				candidates.emplace_back(dx * dx + dy * dy + dz * dz, i);
 			}
 
-			// far chunks
-			if (numDirtyChunks == 0) {
-				for (size_t i = 0; i < chunks.size(); i++) {
-					Chunk &c = chunks[i];
-					if (c.dirty) {
-						dirtyChunkIds[numDirtyChunks++] = static_cast<int>(i);
-						if (numDirtyChunks >= 256)
-							break;
-					}
-				}
+			std::size_t numSelected = std::min(maxChunks, candidates.size());
+			std::partial_sort(candidates.begin(), candidates.begin() + numSelected,
+			                  candidates.end());
+
+			for (std::size_t i = 0; i < numSelected; i++) {
+				Chunk &c = chunks[candidates[i].second];
+				ChunkUpdate update;
+				update.chunkIndex = candidates[i].second;
+				update.dirtyMin = IntVector3{c.dirtyMinX, c.dirtyMinY, c.dirtyMinZ};
+				update.dirtyMax = IntVector3{c.dirtyMaxX, c.dirtyMaxY, c.dirtyMaxZ};
+				batch.push_back(update);
+				c.dirty = false;
+				c.busy = true;
+				--numDirtyChunks;
 			}
+		}
 
-			// limit update count per frame
-			for (int i = 0; i < 8; i++) {
-				if (numDirtyChunks <= 0)
-					break;
-				int idx = SampleRandomInt(0, numDirtyChunks - 1);
-				Chunk &c = chunks[dirtyChunkIds[idx]];
+		void GLRadiosityRenderer::UploadChunks() {
+			SPADES_MARK_FUNCTION();
+
+			std::size_t numChunks = uploadQueue.size();
+			int budget = settings.r_radiosityUploadBudget;
+			if (budget > 0) {
+				numChunks = std::min(numChunks, static_cast<std::size_t>(budget));
+			}
+			if (numChunks == 0) {
+				return;
+			}
 
-				// remove from list (fast)
-				if (idx < numDirtyChunks - 1) {
-					std::swap(dirtyChunkIds[idx], dirtyChunkIds[numDirtyChunks - 1]);
+			IGLDevice::UInteger textures[] = {textureFlat, textureX, textureY, textureZ};
+			for (int i = 0; i < 4; i++) {
+				device.BindTexture(IGLDevice::Texture3D, textures[i]);
+				for (std::size_t k = 0; k < numChunks; k++) {
+					Chunk &c = chunks[uploadQueue[k]];
+					VoxelType *data[] = {&c.dataFlat[0][0][0], &c.dataX[0][0][0],
+					                     &c.dataY[0][0][0], &c.dataZ[0][0][0]};
+					device.TexSubImage3D(IGLDevice::Texture3D, 0, c.cx * ChunkSize,
+					                     c.cy * ChunkSize, c.cz * ChunkSize, ChunkSize, ChunkSize,
+					                     ChunkSize, IGLDevice::BGRA,
+					                     IGLDevice::UnsignedInt2101010Rev, data[i]);
 				}
-				numDirtyChunks--;
+			}
 
-				UpdateChunk(c.cx, c.cy, c.cz);
+			for (std::size_t k = 0; k < numChunks; k++) {
+				chunks[uploadQueue.front()].busy = false;
+				uploadQueue.pop_front();
 			}
-			/*
-			printf("%d (%d near) chunk update left\n",
-			       GetNumDirtyChunks(), nearDirtyChunks);*/
+			numUploadedChunks += numChunks;
 		}
 
 		float GLRadiosityRenderer::CompressDynamicRange(float v) {
@@ -514,18 +516,17 @@ namespace spades {
 			return (uint32_t)out;
 		}
 
-		void GLRadiosityRenderer::UpdateChunk(int cx, int cy, int cz) {
-			Chunk &c = GetChunk(cx, cy, cz);
-			if (!c.dirty)
-				return;
+		void GLRadiosityRenderer::UpdateChunk(const ChunkUpdate &update) {
+			Chunk &c = chunks[update.chunkIndex];
 
-			int originX = cx * ChunkSize;
-			int originY = cy * ChunkSize;
-			int originZ = cz * ChunkSize;
+			int originX = c.cx * ChunkSize;
+			int originY = c.cy * ChunkSize;
+			int originZ = c.cz * ChunkSize;
 
-			for (int z = c.dirtyMinZ; z <= c.dirtyMaxZ; z++)
-				for (int y = c.dirtyMinY; y <= c.dirtyMaxY; y++)
-					for (int x = c.dirtyMinX; x <= c.dirtyMaxX; x++) {
+			// Only the part affected by the map changes is recomputed
+			for (int z = update.dirtyMin.z; z <= update.dirtyMax.z; z++)
+				for (int y = update.dirtyMin.y; y <= update.dirtyMax.y; y++)
+					for (int x = update.dirtyMin.x; x <= update.dirtyMax.x; x++) {
 						IntVector3 pos;
 						pos.x = (x + originX);
 						pos.y = (y + originY);
@@ -537,9 +538,6 @@ namespace spades {
 						c.dataY[z][y][x] = EncodeValue(res.y);
 						c.dataZ[z][y][x] = EncodeValue(res.z);
 					}
-
-			c.dirty = false;
-			c.transferDone = false;
 		}
 	} // namespace draw
 } // namespace spades
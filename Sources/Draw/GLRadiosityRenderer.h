@@ -20,8 +20,10 @@
 
 #pragma once
 
-#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include "IGLDevice.h"
@@ -42,6 +44,10 @@ namespace spades {
 
 			class UpdateDispatch;
 			enum { ChunkSize = 16, ChunkSizeBits = 4, Envelope = 6 };
+
+			/** The number of chunks recomputed at once per thread. */
+			static constexpr int ChunksPerThread = 4;
+
 			GLRenderer &renderer;
 			IGLDevice &device;
 			GLSettings &settings;
@@ -58,7 +64,17 @@ namespace spades {
 				int dirtyMinY = 0, dirtyMaxY = ChunkSize - 1;
 				int dirtyMinZ = 0, dirtyMaxZ = ChunkSize - 1;
 
-				std::atomic<bool> transferDone{true};
+				/**
+				 * Set while the chunk is being recomputed or waiting to be uploaded. Such a
+				 * chunk is not selected again until it's uploaded even if it's dirty.
+				 */
+				bool busy = false;
+			};
+
+			/** A chunk being recomputed and its part to recompute (inclusive). */
+			struct ChunkUpdate {
+				std::size_t chunkIndex;
+				IntVector3 dirtyMin, dirtyMax;
 			};
 
 			IGLDevice::UInteger textureFlat;
@@ -70,6 +86,15 @@ namespace spades {
 			int chunkW, chunkH, chunkD;
 
 			std::vector<Chunk> chunks;
+			std::size_t numDirtyChunks;
+
+			/** The chunks being recomputed by `updateDispatch`. */
+			std::vector<ChunkUpdate> batch;
+			/** The indices of the recomputed chunks waiting to be uploaded. */
+			std::deque<std::size_t> uploadQueue;
+
+			std::uint64_t numComputedChunks = 0;
+			std::uint64_t numUploadedChunks = 0;
 
 			inline Chunk &GetChunk(int cx, int cy, int cz) {
 				SPAssert(cx >= 0);
@@ -88,20 +113,36 @@ namespace spades {
 
 			void Invalidate(int minX, int minY, int minZ, int maxX, int maxY, int maxZ);
 
-			void UpdateChunk(int cx, int cy, int cz);
-			void UpdateDirtyChunks();
-			int GetNumDirtyChunks();
+			/** Moves up to `maxChunks` dirty chunks nearest to `eye` to `batch`. */
+			void SelectDirtyChunks(const Vector3 &eye, std::size_t maxChunks);
+			void UpdateChunk(const ChunkUpdate &);
+			void UploadChunks();
 
 			uint32_t EncodeValue(Vector3 vec);
 			float CompressDynamicRange(float v);
 
-			UpdateDispatch *dispatch;
+			/** Recomputes `batch`, or `nullptr` if no batch is being recomputed. */
+			std::unique_ptr<UpdateDispatch> updateDispatch;
 
 		public:
 			struct Result {
 				Vector3 base, x, y, z;
 			};
 
+			/** Counters for watching the volume converge after map changes. */
+			struct Stats {
+				/** The number of dirty chunks waiting to be recomputed. */
+				std::size_t numPendingChunks;
+				/** The number of chunks being recomputed. */
+				std::size_t numComputingChunks;
+				/** The number of recomputed chunks waiting to be uploaded. */
+				std::size_t numQueuedChunks;
+				/** The total number of chunks recomputed so far. */
+				std::uint64_t numComputedChunks;
+				/** The total number of chunks uploaded so far. */
+				std::uint64_t numUploadedChunks;
+			};
+
 			GLRadiosityRenderer(GLRenderer &renderer, client::GameMap *map);
 			~GLRadiosityRenderer();
 
@@ -111,6 +152,8 @@ namespace spades {
 
 			void Update();
 
+			Stats GetStats() const;
+
 			IGLDevice::UInteger GetTextureFlat() { return textureFlat; }
 			IGLDevice::UInteger GetTextureX() { return textureX; }
 			IGLDevice::UInteger GetTextureY() { return textureY; }
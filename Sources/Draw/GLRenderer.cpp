@@ -291,6 +291,26 @@ namespace spades {
 			return modelManager->RegisterModel(filename).Cast<client::IModel>();
 		}
 
+		std::unique_ptr<client::PreloadedModel> GLRenderer::PreloadModel(const char *filename) {
+			SPADES_MARK_FUNCTION();
+			EnsureInitialized();
+			return modelManager->PreloadModel(filename);
+		}
+
+		Handle<client::IModel>
+		GLRenderer::RegisterPreloadedModel(const char *filename,
+		                                   client::PreloadedModel &preloaded) {
+			SPADES_MARK_FUNCTION();
+			return modelManager->RegisterPreloadedModel(filename, preloaded)
+			  .Cast<client::IModel>();
+		}
+
+		Handle<client::IImage> GLRenderer::RegisterPreloadedImage(const char *filename,
+		                                                          spades::Bitmap &bmp) {
+			SPADES_MARK_FUNCTION();
+			return imageManager->RegisterImage(filename, bmp);
+		}
+
 		void GLRenderer::ClearCache() {
 			SPADES_MARK_FUNCTION();
 			modelManager->ClearCache();
@@ -316,6 +336,19 @@ namespace spades {
 			}
 		}
 
+		std::unique_ptr<client::PreloadedModel>
+		GLRenderer::PreloadVoxelModel(spades::VoxelModel &model) {
+			SPADES_MARK_FUNCTION();
+			EnsureInitialized();
+			return modelManager->PreloadModel(model);
+		}
+
+		Handle<client::IModel>
+		GLRenderer::CreatePreloadedModel(client::PreloadedModel &preloaded) {
+			SPADES_MARK_FUNCTION();
+			return modelManager->CreatePreloadedModel(preloaded).Cast<client::IModel>();
+		}
+
 		void GLRenderer::EnsureInitialized() {
 			SPADES_MARK_FUNCTION_DEBUG();
 			if (modelManager == NULL) {
@@ -482,6 +515,10 @@ namespace spades {
 
 			profiler->BeginFrame();
 
+			// Invalidate the parts of the caches affected by the last frame's map changes
+			if (map)
+				map->FlushChanges();
+
 			// clear scene objects
 			debugLines.clear();
 			spriteRenderer->Clear();
@@ -547,6 +584,31 @@ namespace spades {
 			spriteRenderer->Add(&glImage, center, radius, rotation, drawColorAlphaPremultiplied);
 		}
 
+		void GLRenderer::AddSprites(const client::SpriteParam *sprites, std::size_t numSprites) {
+			SPADES_MARK_FUNCTION();
+
+			EnsureInitialized();
+			EnsureSceneStarted();
+
+			// Particles mostly share a handful of images, so avoid `dynamic_cast` for each
+			client::IImage *lastImage = nullptr;
+			GLImage *lastGLImage = nullptr;
+
+			for (std::size_t i = 0; i < numSprites; ++i) {
+				const client::SpriteParam &sprite = sprites[i];
+				if (!SphereFrustrumCull(sprite.center, sprite.radius * 1.5f))
+					continue;
+
+				if (sprite.image != lastImage) {
+					lastImage = sprite.image;
+					lastGLImage = &dynamic_cast<GLImage &>(*sprite.image);
+				}
+
+				spriteRenderer->Add(lastGLImage, sprite.center, sprite.radius, sprite.rotation,
+				                    sprite.color);
+			}
+		}
+
 		void GLRenderer::AddLongSprite(client::IImage &img, spades::Vector3 p1, spades::Vector3 p2,
 		                               float radius) {
 			SPADES_MARK_FUNCTION_DEBUG();
@@ -1140,6 +1202,12 @@ namespace spades {
 			// some models might be deleted before the next frame
 			modelRenderer->Clear();
 
+			// the map chunks being built since `mapRenderer->Realize()` must be finished
+			// before the map is modified
+			if (mapRenderer) {
+				mapRenderer->FinishChunkUpdates();
+			}
+
 			// prepare for 2d drawing
 			Prepare2DRendering(true);
 		}
@@ -1361,17 +1429,18 @@ namespace spades {
 			return bmp;
 		}
 
-		void GLRenderer::GameMapChanged(int x, int y, int z, client::GameMap *map) {
+		void GLRenderer::GameMapChanged(const IntVector3 &min, const IntVector3 &max,
+		                                client::GameMap *map) {
 			if (mapRenderer)
-				mapRenderer->GameMapChanged(x, y, z, map);
+				mapRenderer->GameMapChanged(min, max, map);
 			if (flatMapRenderer)
-				flatMapRenderer->GameMapChanged(x, y, z, *map);
+				flatMapRenderer->GameMapChanged(min, max, *map);
 			if (mapShadowRenderer)
-				mapShadowRenderer->GameMapChanged(x, y, z, map);
+				mapShadowRenderer->GameMapChanged(min, max, map);
 			if (waterRenderer)
-				waterRenderer->GameMapChanged(x, y, z, map);
+				waterRenderer->GameMapChanged(min, max, map);
 			if (ambientShadowRenderer)
-				ambientShadowRenderer->GameMapChanged(x, y, z, map);
+				ambientShadowRenderer->GameMapChanged(min, max, map);
 		}
 
 		bool GLRenderer::BoxFrustrumCull(const AABB3 &box) {
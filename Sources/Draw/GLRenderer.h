@@ -165,12 +165,19 @@ namespace spades {
 
 			Handle<client::IImage> RegisterImage(const char *filename) override;
 			Handle<client::IModel> RegisterModel(const char *filename) override;
+			std::unique_ptr<client::PreloadedModel> PreloadModel(const char *filename) override;
+			Handle<client::IModel> RegisterPreloadedModel(const char *filename,
+			                                              client::PreloadedModel &) override;
+			Handle<client::IImage> RegisterPreloadedImage(const char *filename,
+			                                              Bitmap &) override;
 
 			void ClearCache() override;
 
 			Handle<client::IImage> CreateImage(Bitmap &) override;
 			Handle<client::IModel> CreateModel(VoxelModel &) override;
 			Handle<client::IModel> CreateModelOptimized(VoxelModel &);
+			std::unique_ptr<client::PreloadedModel> PreloadVoxelModel(VoxelModel &) override;
+			Handle<client::IModel> CreatePreloadedModel(client::PreloadedModel &) override;
 
 			GLProgram *RegisterProgram(const std::string &name);
 			GLShader *RegisterShader(const std::string &name);
@@ -193,6 +200,7 @@ namespace spades {
 
 			void AddSprite(client::IImage &, Vector3 center, float radius, float rotation) override;
 			void AddLongSprite(client::IImage &, Vector3 p1, Vector3 p2, float radius) override;
+			void AddSprites(const client::SpriteParam *, std::size_t numSprites) override;
 
 			void EndScene() override;
 
@@ -241,7 +249,8 @@ namespace spades {
 
 			bool IsRenderingMirror() const { return renderingMirror; }
 
-			void GameMapChanged(int x, int y, int z, client::GameMap *) override;
+			void GameMapChanged(const IntVector3 &min, const IntVector3 &max,
+			                    client::GameMap *) override;
 
 			const client::SceneDefinition &GetSceneDef() const { return sceneDef; }
 
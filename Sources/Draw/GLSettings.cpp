@@ -58,6 +58,7 @@ DEFINE_SPADES_SETTING(r_occlusionQuery, "0");
 DEFINE_SPADES_SETTING(r_optimizedVoxelModel, "1");
 DEFINE_SPADES_SETTING(r_physicalLighting, "0");
 DEFINE_SPADES_SETTING(r_radiosity, "0");
+DEFINE_SPADES_SETTING(r_radiosityUploadBudget, "32");
 DEFINE_SPADES_SETTING(r_saturation, "1");
 DEFINE_SPADES_SETTING(r_scale, "1");
 DEFINE_SPADES_SETTING(r_scaleFilter, "1");
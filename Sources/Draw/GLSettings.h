@@ -64,6 +64,7 @@ namespace spades {
 			TypedItemHandle<bool> r_optimizedVoxelModel { *this, "r_optimizedVoxelModel", ItemFlags::Latch };
 			TypedItemHandle<bool> r_physicalLighting    { *this, "r_physicalLighting", ItemFlags::Latch };
 			TypedItemHandle<int> r_radiosity            { *this, "r_radiosity", ItemFlags::Latch };
+			TypedItemHandle<int> r_radiosityUploadBudget { *this, "r_radiosityUploadBudget" };
 			TypedItemHandle<float> r_saturation         { *this, "r_saturation" };
 			TypedItemHandle<float> r_scale              { *this, "r_scale" };
 			TypedItemHandle<int> r_scaleFilter          { *this, "r_scaleFilter" };
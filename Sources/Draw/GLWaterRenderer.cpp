@@ -977,12 +977,17 @@ namespace spades {
 			updateBitmap[(x >> 5) + y * updateBitmapPitch] |= 1UL << (x & 31);
 		}
 
-		void GLWaterRenderer::GameMapChanged(int x, int y, int z, client::GameMap *map) {
+		void GLWaterRenderer::GameMapChanged(const IntVector3 &min, const IntVector3 &max,
+		                                     client::GameMap *map) {
 			if (map != this->map)
 				return;
-			if (z < 63)
+			if (max.z < 63)
 				return;
-			MarkUpdate(x, y);
+			for (int y = min.y; y <= max.y; y++) {
+				for (int x = min.x; x <= max.x; x++) {
+					MarkUpdate(x, y);
+				}
+			}
 		}
 	} // namespace draw
 } // namespace spades
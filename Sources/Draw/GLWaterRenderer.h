@@ -82,7 +82,7 @@ namespace spades {
 
 			void Update(float dt);
 
-			void GameMapChanged(int x, int y, int z, client::GameMap *);
+			void GameMapChanged(const IntVector3 &min, const IntVector3 &max, client::GameMap *);
 
 			IGLDevice::UInteger GetOcclusionQuery() { return occlusionQuery; }
 		};
@@ -0,0 +1,309 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "MapChunkMesher.h"
+#include <Client/GameMap.h>
+#include <Core/Debug.h>
+#include <Core/Math.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			struct FaceDirection {
+				int nx, ny, nz;
+				/** The offset from a voxel to the first vertex of its face. */
+				int ox, oy, oz;
+				int ux, uy, uz;
+				int vx, vy, vz;
+			};
+
+			// +Z, -Z, -X, +X, -Y, +Y
+			const FaceDirection faceDirections[6] = {
+			  {0, 0, 1, 1, 0, 1, -1, 0, 0, 0, 1, 0}, {0, 0, -1, 0, 0, 0, 1, 0, 0, 0, 1, 0},
+			  {-1, 0, 0, 0, 1, 0, 0, 0, 1, 0, -1, 0}, {1, 0, 0, 1, 0, 0, 0, 0, 1, 0, 1, 0},
+			  {0, -1, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0},  {0, 1, 0, 1, 1, 0, 0, 0, 1, -1, 0, 0},
+			};
+
+			uint8_t GetShading(const FaceDirection &dir) {
+				if (dir.nz == 1 || dir.ny == 1) {
+					return 0;
+				} else if (dir.nx == 1 || dir.nx == -1) {
+					return 0; // 50;
+				} else if (dir.nz == -1) {
+					return 220;
+				} else {
+					return 255;
+				}
+			}
+
+			void EmitQuad(MapChunkMesher::Mesh &out, MapChunkMesher::Vertex inst, int x,
+			              int y, int z, int ux, int uy, int uz, int vx, int vy, int vz) {
+				uint16_t idx = (uint16_t)out.vertices.size();
+				inst.x = x;
+				inst.y = y;
+				inst.z = z;
+				out.vertices.push_back(inst);
+				inst.x = x + ux;
+				inst.y = y + uy;
+				inst.z = z + uz;
+				out.vertices.push_back(inst);
+				inst.x = x + vx;
+				inst.y = y + vy;
+				inst.z = z + vz;
+				out.vertices.push_back(inst);
+				inst.x = x + ux + vx;
+				inst.y = y + uy + vy;
+				inst.z = z + uz + vz;
+				out.vertices.push_back(inst);
+
+				out.indices.push_back(idx);
+				out.indices.push_back(idx + 1);
+				out.indices.push_back(idx + 2);
+				out.indices.push_back(idx + 1);
+				out.indices.push_back(idx + 3);
+				out.indices.push_back(idx + 2);
+			}
+		} // namespace
+
+		struct MapChunkMesher::Neighborhood {
+			/** The global coordinate of the chunk's first voxel. */
+			int originX, originY, originZ;
+
+			/** The solid maps of the columns `[-1, Size]` x `[-1, Size]` (chunk local). */
+			uint64_t columns[Size + 2][Size + 2];
+
+			/** `exposed[face][x][y]` has the bit `z` set if the face of the voxel is visible. */
+			uint16_t exposed[6][Size][Size];
+
+			/** The colors of the voxels having a visible face. Damaged voxels are darkened. */
+			uint32_t colors[Size][Size][Size];
+
+			/**
+			 * @param x Chunk local X coordinate in `[-1, Size]`.
+			 * @param y Chunk local Y coordinate in `[-1, Size]`.
+			 * @param z Global Z coordinate.
+			 */
+			bool IsSolid(int x, int y, int z) const {
+				if (z < 0)
+					return false;
+				if (z >= 64)
+					return true;
+				return ((columns[x + 1][y + 1] >> z) & 1) != 0;
+			}
+
+			uint8_t CalcAOID(int x, int y, int z, int ux, int uy, int uz, int vx, int vy,
+			                 int vz) const {
+				int v = 0;
+				if (IsSolid(x - ux, y - uy, z - uz))
+					v |= 1;
+				if (IsSolid(x + ux, y + uy, z + uz))
+					v |= 1 << 1;
+				if (IsSolid(x - vx, y - vy, z - vz))
+					v |= 1 << 2;
+				if (IsSolid(x + vx, y + vy, z + vz))
+					v |= 1 << 3;
+				if (IsSolid(x - ux + vx, y - uy + vy, z - uz + vz))
+					v |= 1 << 4;
+				if (IsSolid(x - ux - vx, y - uy - vy, z - uz - vz))
+					v |= 1 << 5;
+				if (IsSolid(x + ux + vx, y + uy + vy, z + uz + vz))
+					v |= 1 << 6;
+				if (IsSolid(x + ux - vx, y + uy - vy, z + uz - vz))
+					v |= 1 << 7;
+				return (uint8_t)v;
+			}
+		};
+
+		MapChunkMesher::MapChunkMesher(const client::GameMap &map, bool water)
+		    : map(map), water(water) {}
+
+		void MapChunkMesher::Build(int cx, int cy, int cz, Mesh &out) const {
+			SPADES_MARK_FUNCTION();
+
+			out.Clear();
+
+			Neighborhood nb;
+			nb.originX = cx * Size;
+			nb.originY = cy * Size;
+			nb.originZ = cz * Size;
+
+			for (int x = -1; x <= Size; x++) {
+				for (int y = -1; y <= Size; y++) {
+					uint64_t column = map.GetSolidMapWrapped(nb.originX + x, nb.originY + y);
+					if (water) {
+						// The voxels at `z = 63` are hidden, so their neighbors at `z = 62`
+						// are treated as if they continued downward
+						column &= ~(1ULL << 63);
+						column |= ((column >> 62) & 1) << 63;
+					}
+					nb.columns[x + 1][y + 1] = column;
+				}
+			}
+
+			// Find the visible faces a column at a time
+			bool empty = true;
+			for (int x = 0; x < Size; x++) {
+				for (int y = 0; y < Size; y++) {
+					uint64_t column = nb.columns[x + 1][y + 1];
+					uint64_t above = (column >> 1) | (1ULL << 63);
+					uint64_t below = column << 1;
+					uint64_t faces[6] = {
+					  column & ~above,
+					  column & ~below,
+					  column & ~nb.columns[x][y + 1],
+					  column & ~nb.columns[x + 2][y + 1],
+					  column & ~nb.columns[x + 1][y],
+					  column & ~nb.columns[x + 1][y + 2],
+					};
+
+					uint32_t visible = 0;
+					for (int f = 0; f < 6; f++) {
+						nb.exposed[f][x][y] = (uint16_t)(faces[f] >> nb.originZ);
+						visible |= nb.exposed[f][x][y];
+					}
+					empty = empty && !visible;
+
+					while (visible) {
+						int z = CountTrailingZeros(visible);
+						visible &= visible - 1;
+
+						uint32_t col = map.GetColor(nb.originX + x, nb.originY + y, nb.originZ + z);
+
+						// damaged block?
+						int health = col >> 24;
+						if (health < 100) {
+							col &= 0xfefefe;
+							col >>= 1;
+						}
+						nb.colors[x][y][z] = col & 0xffffff;
+					}
+				}
+			}
+
+			if (empty)
+				return;
+
+			BuildFaces(nb, out);
+		}
+
+		void MapChunkMesher::BuildFaces(const Neighborhood &nb, Mesh &out) const {
+			// `keys[a][b]` is the color and the ambient occlusion ID of the face at `(a, b)`
+			// in the current slice. `pending[b]` has the bit `a` set if the face is exposed
+			// and not emitted yet.
+			uint32_t keys[Size][Size];
+			uint32_t pending[Size];
+
+			for (int f = 0; f < 6; f++) {
+				const FaceDirection &dir = faceDirections[f];
+				const int u[3] = {dir.ux, dir.uy, dir.uz};
+				const int v[3] = {dir.vx, dir.vy, dir.vz};
+				const int o[3] = {dir.ox, dir.oy, dir.oz};
+
+				// Slices are perpendicular to `normalAxis`, and `a` and `b` are the positions
+				// along `axisA` and `axisB` in a slice
+				const int normalAxis = dir.nx ? 0 : dir.ny ? 1 : 2;
+				const int axisA = normalAxis == 0 ? 1 : 0;
+				const int axisB = normalAxis == 2 ? 1 : 2;
+
+				Vertex inst = {};
+				inst.shading = GetShading(dir);
+				inst.nx = dir.nx;
+				inst.ny = dir.ny;
+				inst.nz = dir.nz;
+
+				for (int s = 0; s < Size; s++) {
+					int p[3];
+					p[normalAxis] = s;
+
+					bool anyFaces = false;
+					for (int b = 0; b < Size; b++) {
+						p[axisB] = b;
+						pending[b] = 0;
+						for (int a = 0; a < Size; a++) {
+							p[axisA] = a;
+							if (!((nb.exposed[f][p[0]][p[1]] >> p[2]) & 1))
+								continue;
+
+							// evaluate ambient occlusion
+							uint32_t aoID = nb.CalcAOID(
+							  p[0] + dir.nx, p[1] + dir.ny, nb.originZ + p[2] + dir.nz, dir.ux,
+							  dir.uy, dir.uz, dir.vx, dir.vy, dir.vz);
+
+							keys[a][b] = nb.colors[p[0]][p[1]][p[2]] | (aoID << 24);
+							pending[b] |= 1U << a;
+							anyFaces = true;
+							out.numFaces++;
+						}
+					}
+
+					if (!anyFaces)
+						continue;
+
+					// Merge the faces into rectangles greedily, first along `axisA` and then
+					// along `axisB`
+					for (int b0 = 0; b0 < Size; b0++) {
+						while (pending[b0]) {
+							int a0 = CountTrailingZeros(pending[b0]);
+							uint32_t key = keys[a0][b0];
+
+							int a1 = a0 + 1;
+							while (a1 < Size && ((pending[b0] >> a1) & 1) && keys[a1][b0] == key)
+								a1++;
+							uint32_t rowMask = ((1U << a1) - 1) & ~((1U << a0) - 1);
+
+							int b1 = b0 + 1;
+							for (; b1 < Size; b1++) {
+								if ((pending[b1] & rowMask) != rowMask)
+									break;
+								int a = a0;
+								while (a < a1 && keys[a][b1] == key)
+									a++;
+								if (a < a1)
+									break;
+							}
+
+							for (int b = b0; b < b1; b++)
+								pending[b] &= ~rowMask;
+
+							// The quad starts from the corner voxel opposite to `u + v`
+							int start[3], extentU = 0, extentV = 0;
+							start[normalAxis] = s;
+							start[axisA] = u[axisA] + v[axisA] > 0 ? a0 : a1 - 1;
+							start[axisB] = u[axisB] + v[axisB] > 0 ? b0 : b1 - 1;
+							(u[axisA] ? extentU : extentV) = a1 - a0;
+							(u[axisB] ? extentU : extentV) = b1 - b0;
+
+							inst.colorRed = (uint8_t)(key);
+							inst.colorGreen = (uint8_t)(key >> 8);
+							inst.colorBlue = (uint8_t)(key >> 16);
+							inst.aoX = (uint16_t)(((key >> 24) & 15) * 16);
+							inst.aoY = (uint16_t)((key >> 28) * 16);
+
+							EmitQuad(out, inst, start[0] + o[0], start[1] + o[1],
+							         start[2] + o[2], u[0] * extentU, u[1] * extentU,
+							         u[2] * extentU, v[0] * extentV, v[1] * extentV,
+							         v[2] * extentV);
+						}
+					}
+				}
+			}
+		}
+	} // namespace draw
+} // namespace spades
@@ -0,0 +1,95 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace spades {
+	namespace client {
+		class GameMap;
+	}
+	namespace draw {
+		/**
+		 * Builds the vertex data of a map chunk drawn by `GLMapChunk`. This class doesn't
+		 * depend on a GL context, and `Build` can be called from any thread as long as the map
+		 * isn't modified at the same time.
+		 */
+		class MapChunkMesher {
+		public:
+			enum { Size = 16, SizeBits = 4 };
+
+			struct Vertex {
+				uint8_t x, y, z;
+				uint8_t pad;
+
+				/**
+				 * The origin of the ambient occlusion tile. The position in the tile is found
+				 * from the position on the face in the vertex shader.
+				 */
+				uint16_t aoX, aoY;
+
+				uint8_t colorRed;
+				uint8_t colorGreen;
+				uint8_t colorBlue;
+				uint8_t shading;
+
+				int8_t nx, ny, nz;
+				uint8_t pad2;
+			};
+
+			/**
+			 * One quad per rectangle of coplanar exposed faces sharing the color and the
+			 * ambient occlusion tile. Every pass draws this mesh; the passes other than the
+			 * depth-only one test against its depth with `LessOrEqual` or `Equal`, so they
+			 * can't use a different geometry. The shaders find the voxel face containing each
+			 * fragment from its position and normal to sample the shadow and the radiosity.
+			 */
+			struct Mesh {
+				std::vector<Vertex> vertices;
+				std::vector<uint16_t> indices;
+
+				/** The number of exposed faces merged into the quads. */
+				std::size_t numFaces = 0;
+
+				void Clear() {
+					vertices.clear();
+					indices.clear();
+					numFaces = 0;
+				}
+			};
+
+			/** @param water `true` if the voxels at `z = 63` are hidden by the water. */
+			MapChunkMesher(const client::GameMap &, bool water);
+
+			/** Builds the mesh of the specified chunk, replacing the contents of `out`. */
+			void Build(int cx, int cy, int cz, Mesh &out) const;
+
+		private:
+			struct Neighborhood;
+
+			const client::GameMap &map;
+			bool water;
+
+			void BuildFaces(const Neighborhood &, Mesh &) const;
+		};
+	} // namespace draw
+} // namespace spades
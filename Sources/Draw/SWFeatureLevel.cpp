@@ -29,6 +29,10 @@ namespace spades {
 #if ENABLE_SSE2
 		SWFeatureLevel DetectFeatureLevel() {
 			CpuID cpuid;
+#if ENABLE_AVX2
+			if (cpuid.Supports(CpuFeature::AVX2))
+				return SWFeatureLevel::AVX2;
+#endif
 			if (cpuid.Supports(CpuFeature::SSE2))
 				return SWFeatureLevel::SSE2;
 
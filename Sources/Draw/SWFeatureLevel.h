@@ -47,12 +47,28 @@
 #define ENABLE_SSE2 0
 #endif
 
+// AVX2 code is compiled for specific functions (marked with `SW_AVX2_FUNCTION`) and only
+// executed if `DetectFeatureLevel` finds AVX2 at runtime
+#if ENABLE_SSE2 && (defined(__GNUC__) || defined(_MSC_VER))
+#define ENABLE_AVX2 1
+#else
+#define ENABLE_AVX2 0
+#endif
+
 #if ENABLE_SSE
 #include <xmmintrin.h>
 #endif
 #if ENABLE_SSE2
 #include <emmintrin.h>
 #endif
+#if ENABLE_AVX2
+#include <immintrin.h>
+#if defined(__GNUC__)
+#define SW_AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#define SW_AVX2_FUNCTION
+#endif
+#endif
 
 #include <Core/ConcurrentDispatch.h>
 #include <Core/Debug.h>
@@ -74,13 +90,16 @@ namespace spades {
 #endif
 #if ENABLE_SSE2
 			SSE2,
+#endif
+#if ENABLE_AVX2
+			AVX2,
 #endif
 		};
 
-		static inline bool operator>(SWFeatureLevel a, SWFeatureLevel b) {
+		static constexpr inline bool operator>(SWFeatureLevel a, SWFeatureLevel b) {
 			return static_cast<int>(a) > static_cast<int>(b);
 		}
-		static inline bool operator>=(SWFeatureLevel a, SWFeatureLevel b) {
+		static constexpr inline bool operator>=(SWFeatureLevel a, SWFeatureLevel b) {
 			return static_cast<int>(a) >= static_cast<int>(b);
 		}
 
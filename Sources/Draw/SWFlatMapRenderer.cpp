@@ -104,10 +104,14 @@ namespace spades {
 			return 0; // shouldn't reach here for valid maps
 		}
 
-		void SWFlatMapRenderer::SetNeedsUpdate(int x, int y) {
+		void SWFlatMapRenderer::SetNeedsUpdate(int minX, int minY, int maxX, int maxY) {
 			std::lock_guard<std::mutex> lock(updateInfoLock);
 			needsUpdate = true;
-			updateMap[(x + y * w) >> 5] |= 1 << (x & 31);
+			for (int y = minY; y <= maxY; y++) {
+				for (int x = minX; x <= maxX; x++) {
+					updateMap[(x + y * w) >> 5] |= 1 << (x & 31);
+				}
+			}
 		}
 	} // namespace draw
 } // namespace spades
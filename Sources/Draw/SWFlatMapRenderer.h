@@ -55,7 +55,8 @@ namespace spades {
 			}
 
 			void Update(bool firstTime = false);
-			void SetNeedsUpdate(int x, int y);
+			/** Marks the columns in the specified rectangle (inclusive) as modified. */
+			void SetNeedsUpdate(int minX, int minY, int maxX, int maxY);
 		};
 	} // namespace draw
 } // namespace spades
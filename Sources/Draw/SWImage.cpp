@@ -119,6 +119,17 @@ namespace spades {
 			}
 		}
 
+		Handle<SWImage> SWImageManager::RegisterImage(const std::string &name, Bitmap &bitmap) {
+			auto it = images.find(name);
+			if (it == images.end()) {
+				Handle<SWImage> image = CreateImage(bitmap);
+				images.insert(std::make_pair(name, image));
+				return image;
+			} else {
+				return it->second;
+			}
+		}
+
 		Handle<SWImage> SWImageManager::CreateImage(Bitmap &bitmap) {
 			return Handle<SWImage>::New(bitmap);
 		}
@@ -67,6 +67,8 @@ namespace spades {
 			~SWImageManager();
 
 			Handle<SWImage> RegisterImage(const std::string &);
+			/** Same as the above, but uses the specified bitmap if the image isn't loaded. */
+			Handle<SWImage> RegisterImage(const std::string &, Bitmap &);
 			Handle<SWImage> CreateImage(Bitmap &);
 
 			void ClearCache();
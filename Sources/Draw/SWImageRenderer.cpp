@@ -20,12 +20,18 @@
 
 #include "SWImageRenderer.h"
 #include "SWImage.h"
+#include "SWKernels.h"
 #include <Core/Bitmap.h>
 
 namespace spades {
 	namespace draw {
 		SWImageRenderer::SWImageRenderer(SWFeatureLevel lvl)
-		    : shader(ShaderType::Image), featureLevel(lvl) {}
+		    : shader(ShaderType::Image),
+		      featureLevel(lvl),
+		      clipMinX(0),
+		      clipMinY(0),
+		      clipMaxX(0),
+		      clipMaxY(0) {}
 
 		SWImageRenderer::~SWImageRenderer() {}
 
@@ -36,9 +42,18 @@ namespace spades {
 				                      static_cast<float>(bmp->GetHeight()) * -.5f, 1.f, 1.f);
 				fbCenter4 = MakeVector4(static_cast<float>(bmp->GetWidth()) * .5f,
 				                        static_cast<float>(bmp->GetHeight()) * .5f, 0.f, 0.f);
+				SetScissor(0, 0, bmp->GetWidth(), bmp->GetHeight());
 			}
 		}
 
+		void SWImageRenderer::SetScissor(int minX, int minY, int maxX, int maxY) {
+			SPAssert(frame);
+			clipMinX = std::max(minX, 0);
+			clipMinY = std::max(minY, 0);
+			clipMaxX = std::min(maxX, frame->GetWidth());
+			clipMaxY = std::min(maxY, frame->GetHeight());
+		}
+
 		void SWImageRenderer::SetDepthBuffer(float *f) { depthBuffer = f; }
 
 		void SWImageRenderer::SetShaderType(ShaderType type) { shader = type; }
@@ -282,7 +297,7 @@ namespace spades {
 
 				Bitmap &fb = *r.frame;
 
-				if (v3.position.y <= 0.f) {
+				if (v3.position.y <= static_cast<float>(r.clipMinY)) {
 					// viewport cull
 					return;
 				}
@@ -291,7 +306,7 @@ namespace spades {
 				const int fbH = fb.GetHeight();
 				uint32_t *const bmp = fb.GetPixels();
 
-				if (v1.position.y >= static_cast<float>(fbH)) {
+				if (v1.position.y >= static_cast<float>(r.clipMaxY)) {
 					// viewport cull
 					return;
 				}
@@ -316,9 +331,9 @@ namespace spades {
 					return; // area cull
 				if (y1 == y3)
 					return; // area cull
-				if (std::min(std::min(x1, x2), x3) >= fbW)
+				if (std::min(std::min(x1, x2), x3) >= r.clipMaxX)
 					return; // viewport cull
-				if (std::max(std::max(x1, x2), x3) <= 0)
+				if (std::max(std::max(x1, x2), x3) <= r.clipMinX)
 					return; // viewport cull
 
 				auto convertColor = [](float f) {
@@ -413,8 +428,10 @@ namespace spades {
 					SPAssert(x1 < x2);
 					int width = x2 - x1;
 					SWImageGouraudInterpolator<level> vary(vary1, vary2, width);
-					int minX = std::max(x1, 0);
-					int maxX = std::min(x2, fbW);
+					int minX = std::max(x1, r.clipMinX);
+					int maxX = std::min(x2, r.clipMaxX);
+					if (minX >= maxX)
+						return; // scissor cull
 					vary.MoveNext(minX - x1);
 					out += minX;
 					if (depthTest) {
@@ -454,8 +471,9 @@ namespace spades {
 				{
 					Interpolator shortSpanX(x1, x2, y2 - y1);
 					SWImageGouraudInterpolator<level> shortSpan(v1, v2, y2 - y1);
-					int minY = std::max(0, y1);
-					int maxY = std::min(fbH, y2);
+					// `longSpan` must reach `y2` even if this half is entirely culled
+					int minY = std::min(std::max(r.clipMinY, y1), y2);
+					int maxY = std::min(r.clipMaxY, y2);
 					shortSpanX.MoveNext(minY - y1);
 					shortSpan.MoveNext(minY - y1);
 					longSpanX.MoveNext(minY - y1);
@@ -483,8 +501,8 @@ namespace spades {
 				{
 					Interpolator shortSpanX(x2, x3, y3 - y2);
 					SWImageGouraudInterpolator<level> shortSpan(v2, v3, y3 - y2);
-					int minY = std::max(0, y2);
-					int maxY = std::min(fbH, y3);
+					int minY = std::max(r.clipMinY, y2);
+					int maxY = std::min(r.clipMaxY, y3);
 					shortSpanX.MoveNext(minY - y2);
 					shortSpan.MoveNext(minY - y2);
 					longSpanX.MoveNext(minY - y2);
@@ -547,7 +565,7 @@ namespace spades {
 
 				Bitmap &fb = *r.frame;
 
-				if (v3.position.y <= 0.f) {
+				if (v3.position.y <= static_cast<float>(r.clipMinY)) {
 					// viewport cull
 					return;
 				}
@@ -556,7 +574,7 @@ namespace spades {
 				const int fbH = fb.GetHeight();
 				uint32_t *const bmp = fb.GetPixels();
 
-				if (v1.position.y >= static_cast<float>(fbH)) {
+				if (v1.position.y >= static_cast<float>(r.clipMaxY)) {
 					// viewport cull
 					return;
 				}
@@ -581,9 +599,9 @@ namespace spades {
 					return; // area cull
 				if (y1 == y3)
 					return; // area cull
-				if (std::min(std::min(x1, x2), x3) >= fbW)
+				if (std::min(std::min(x1, x2), x3) >= r.clipMaxX)
 					return; // viewport cull
-				if (std::max(std::max(x1, x2), x3) <= 0)
+				if (std::max(std::max(x1, x2), x3) <= r.clipMinX)
 					return; // viewport cull
 
 				auto convertColor = [](float f) {
@@ -774,7 +792,7 @@ namespace spades {
 				};
 
 				auto drawScanline =
-				  [tw, th, tpixels, bmp, fbW, fbH, depthBuffer, &drawPixel, &drawPixel2, &r,
+				  [tw, th, tpixels, bmp, fbW, fbH, depthBuffer, mulCol, &drawPixel, &drawPixel2, &r,
 				   &ditherMap, &ditherMap2](int y, int x1, int x2, const SWImageVarying &vary1,
 				                            const SWImageVarying &vary2, float z1, float z2) {
 					  uint32_t *out = bmp + (y * fbW);
@@ -785,8 +803,10 @@ namespace spades {
 					  SPAssert(x1 < x2);
 					  int width = x2 - x1;
 					  SWImageGouraudInterpolator<SWFeatureLevel::SSE2> vary(vary1, vary2, width);
-					  int minX = std::max(x1, 0);
-					  int maxX = std::min(x2, fbW);
+					  int minX = std::max(x1, r.clipMinX);
+					  int maxX = std::min(x2, r.clipMaxX);
+					  if (minX >= maxX)
+						  return; // scissor cull
 					  r.pixelsDrawn += maxX - minX;
 					  vary.MoveNext(minX - x1);
 					  out += minX;
@@ -836,6 +856,18 @@ namespace spades {
 					  }
 					  int reminders = maxX & 1;
 					  maxX -= reminders;
+#if ENABLE_AVX2
+					  if (!depthTest && !linearInterpolate &&
+					      r.featureLevel >= SWFeatureLevel::AVX2) {
+						  static_assert(texUVScaleBits == 16, "texUVScaleBits must be 16");
+						  int count = (maxX - minX) & ~7;
+						  DrawImageSpanAVX2(out, count, vary.uvU, vary.uvV, vary.stepU, vary.stepV,
+						                    tpixels, tw, th, mulCol);
+						  out += count;
+						  minX += count;
+						  vary.MoveNext(count);
+					  }
+#endif
 					  auto dither = ditherMap2[y & 1];
 					  for (int x = minX; x < maxX; x += 2) {
 						  auto vr1 = vary.GetCurrent();
@@ -892,8 +924,9 @@ namespace spades {
 				{
 					Interpolator shortSpanX(x1, x2, y2 - y1);
 					SWImageGouraudInterpolator<SWFeatureLevel::SSE2> shortSpan(v1, v2, y2 - y1);
-					int minY = std::max(0, y1);
-					int maxY = std::min(fbH, y2);
+					// `longSpan` must reach `y2` even if this half is entirely culled
+					int minY = std::min(std::max(r.clipMinY, y1), y2);
+					int maxY = std::min(r.clipMaxY, y2);
 					shortSpanX.MoveNext(minY - y1);
 					shortSpan.MoveNext(minY - y1);
 					longSpanX.MoveNext(minY - y1);
@@ -921,8 +954,8 @@ namespace spades {
 				{
 					Interpolator shortSpanX(x2, x3, y3 - y2);
 					SWImageGouraudInterpolator<SWFeatureLevel::SSE2> shortSpan(v2, v3, y3 - y2);
-					int minY = std::max(0, y2);
-					int maxY = std::min(fbH, y3);
+					int minY = std::max(r.clipMinY, y2);
+					int maxY = std::min(r.clipMaxY, y3);
 					shortSpanX.MoveNext(minY - y2);
 					shortSpan.MoveNext(minY - y2);
 					longSpanX.MoveNext(minY - y2);
@@ -980,7 +1013,7 @@ namespace spades {
 
 				Bitmap &fb = *r.frame;
 
-				if (v3.position.y <= 0.f) {
+				if (v3.position.y <= static_cast<float>(r.clipMinY)) {
 					// viewport cull
 					return;
 				}
@@ -989,7 +1022,7 @@ namespace spades {
 				const int fbH = fb.GetHeight();
 				uint32_t *const bmp = fb.GetPixels();
 
-				if (v1.position.y >= static_cast<float>(fbH)) {
+				if (v1.position.y >= static_cast<float>(r.clipMaxY)) {
 					// viewport cull
 					return;
 				}
@@ -1010,9 +1043,9 @@ namespace spades {
 					return; // area cull
 				if (y1 == y3)
 					return; // area cull
-				if (std::min(std::min(x1, x2), x3) >= fbW)
+				if (std::min(std::min(x1, x2), x3) >= r.clipMaxX)
 					return; // viewport cull
-				if (std::max(std::max(x1, x2), x3) <= 0)
+				if (std::max(std::max(x1, x2), x3) <= r.clipMinX)
 					return; // viewport cull
 
 				auto convertColor = [](float f) {
@@ -1111,8 +1144,10 @@ namespace spades {
 					}
 					SPAssert(x1 < x2);
 					// int width = x2 - x1;
-					int minX = std::max(x1, 0);
-					int maxX = std::min(x2, fbW);
+					int minX = std::max(x1, r.clipMinX);
+					int maxX = std::min(x2, r.clipMaxX);
+					if (minX >= maxX)
+						return; // scissor cull
 					r.pixelsDrawn += maxX - minX;
 					out += minX;
 					if (depthTest) {
@@ -1157,8 +1192,9 @@ namespace spades {
 				{
 					Interpolator shortSpanX(x1, x2, y2 - y1);
 					SWImageGouraudInterpolator<SWFeatureLevel::SSE2> shortSpan(v1, v2, y2 - y1);
-					int minY = std::max(0, y1);
-					int maxY = std::min(fbH, y2);
+					// `longSpan` must reach `y2` even if this half is entirely culled
+					int minY = std::min(std::max(r.clipMinY, y1), y2);
+					int maxY = std::min(r.clipMaxY, y2);
 					shortSpanX.MoveNext(minY - y1);
 					shortSpan.MoveNext(minY - y1);
 					longSpanX.MoveNext(minY - y1);
@@ -1186,8 +1222,8 @@ namespace spades {
 				{
 					Interpolator shortSpanX(x2, x3, y3 - y2);
 					SWImageGouraudInterpolator<SWFeatureLevel::SSE2> shortSpan(v2, v3, y3 - y2);
-					int minY = std::max(0, y2);
-					int maxY = std::min(fbH, y3);
+					int minY = std::max(r.clipMinY, y2);
+					int maxY = std::min(r.clipMaxY, y3);
 					shortSpanX.MoveNext(minY - y2);
 					shortSpan.MoveNext(minY - y2);
 					longSpanX.MoveNext(minY - y2);
@@ -48,6 +48,7 @@ namespace spades {
 			Matrix4 matrix;
 			SWFeatureLevel featureLevel;
 			unsigned long long pixelsDrawn;
+			int clipMinX, clipMinY, clipMaxX, clipMaxY;
 
 			template <SWFeatureLevel, bool, bool, bool, bool, bool> struct PolygonRenderer;
 
@@ -66,9 +67,19 @@ namespace spades {
 
 			void SetShaderType(ShaderType);
 
+			/**
+			 * Restricts drawing to the specified rectangle of the framebuffer. `SetFramebuffer`
+			 * resets it to the whole framebuffer.
+			 *
+			 * The dither pattern depends on the parity of pixel coordinates, so `minX` should be
+			 * even for the output to match that of drawing without a scissor rectangle.
+			 */
+			void SetScissor(int minX, int minY, int maxX, int maxY);
+
 			void DrawPolygon(SWImage *img, const Vertex &v1, const Vertex &v2, const Vertex &v3);
 
 			unsigned long long GetPixelsDrawn() { return pixelsDrawn; }
+			void AddPixelStatistics(unsigned long long count) { pixelsDrawn += count; }
 			void ResetPixelStatistics() { pixelsDrawn = 0; }
 		};
 	} // namespace draw
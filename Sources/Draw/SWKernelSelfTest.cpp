@@ -0,0 +1,235 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "SWFeatureLevel.h"
+#include "SWImage.h"
+#include "SWImageRenderer.h"
+#include "SWKernelSelfTest.h"
+#include "SWKernels.h"
+#include <Core/Bitmap.h>
+#include <Core/Debug.h>
+#include <Core/Stopwatch.h>
+
+namespace spades {
+	namespace draw {
+#if ENABLE_AVX2
+		namespace {
+			const int NumKernelRounds = 20;
+
+			int CountMismatches(const std::uint32_t *a, const std::uint32_t *b,
+			                    std::size_t count) {
+				int numMismatches = 0;
+				for (std::size_t i = 0; i < count; i++) {
+					numMismatches += a[i] != b[i] ? 1 : 0;
+				}
+				return numMismatches;
+			}
+
+			int MeasureFogKernel(std::mt19937 &rng) {
+				const int width = 1024, height = 768;
+				const int numBlocks = width / 4;
+				Handle<Bitmap> original{new Bitmap(width, height), false};
+				Handle<Bitmap> expected{new Bitmap(width, height), false};
+				Handle<Bitmap> actual{new Bitmap(width, height), false};
+				std::vector<float> depths(width * height);
+				std::vector<float> depthScales(numBlocks * (height / 4));
+				std::uniform_real_distribution<float> depth{0.f, 128.f};
+				std::uniform_real_distribution<float> scale{0.f, 4.f};
+				for (int i = 0; i < width * height; i++) {
+					original->GetPixels()[i] = rng();
+					depths[i] = depth(rng);
+				}
+				for (float &s : depthScales) {
+					s = scale(rng);
+				}
+
+				double sse2Time = 1.0e9, avx2Time = 1.0e9;
+				for (int round = 0; round < NumKernelRounds; round++) {
+					std::copy(original->GetPixels(), original->GetPixels() + width * height,
+					          expected->GetPixels());
+					std::copy(original->GetPixels(), original->GetPixels() + width * height,
+					          actual->GetPixels());
+
+					Stopwatch sw;
+					for (int y = 0; y < height; y += 4) {
+						ApplyFogToBand<SWFeatureLevel::SSE2>(
+						  expected->GetPixels() + y * width, depths.data() + y * width, width,
+						  numBlocks, depthScales.data() + (y / 4) * numBlocks, 0x40, 0x80,
+						  0xc0);
+					}
+					sse2Time = std::min(sse2Time, sw.GetTime());
+
+					sw.Reset();
+					for (int y = 0; y < height; y += 4) {
+						ApplyFogToBand<SWFeatureLevel::AVX2>(
+						  actual->GetPixels() + y * width, depths.data() + y * width, width,
+						  numBlocks, depthScales.data() + (y / 4) * numBlocks, 0x40, 0x80,
+						  0xc0);
+					}
+					avx2Time = std::min(avx2Time, sw.GetTime());
+				}
+
+				int numMismatches =
+				  CountMismatches(expected->GetPixels(), actual->GetPixels(), width * height);
+				SPLog("[fog] %dx%d, SSE2: %.3f ms, AVX2: %.3f ms (%.2fx), %d mismatch(es)",
+				      width, height, sse2Time * 1000.0, avx2Time * 1000.0,
+				      sse2Time / avx2Time, numMismatches);
+				return numMismatches;
+			}
+
+			int MeasureFillKernel(std::mt19937 &rng) {
+				// Spans of `SWMapRenderer`'s line pixels, partially covered by nearer spans
+				const std::size_t numPixels = 1 << 20;
+				const int numSpans = 1 << 16;
+				std::vector<std::uint64_t> original(numPixels), expected, actual;
+				for (std::uint64_t &p : original) {
+					p = (rng() & 3) ? 0 : (static_cast<std::uint64_t>(rng()) << 32) | rng();
+				}
+				std::vector<std::pair<std::size_t, std::size_t>> spans;
+				for (int i = 0; i < numSpans; i++) {
+					std::size_t start = rng() % numPixels;
+					std::size_t length = std::min<std::size_t>(rng() % 64, numPixels - start);
+					spans.emplace_back(start, length);
+				}
+
+				double scalarTime = 1.0e9, avx2Time = 1.0e9;
+				for (int round = 0; round < NumKernelRounds; round++) {
+					expected = original;
+					actual = original;
+
+					Stopwatch sw;
+					for (const auto &span : spans) {
+						FillEmptyPixels<SWFeatureLevel::None>(
+						  expected.data() + span.first, span.second, 0x3f80000000123456ULL);
+					}
+					scalarTime = std::min(scalarTime, sw.GetTime());
+
+					sw.Reset();
+					for (const auto &span : spans) {
+						FillEmptyPixels<SWFeatureLevel::AVX2>(
+						  actual.data() + span.first, span.second, 0x3f80000000123456ULL);
+					}
+					avx2Time = std::min(avx2Time, sw.GetTime());
+				}
+
+				int numMismatches = expected == actual ? 0 : 1;
+				SPLog("[map span fill] %d spans, scalar: %.3f ms, AVX2: %.3f ms (%.2fx), "
+				      "%d mismatch(es)",
+				      numSpans, scalarTime * 1000.0, avx2Time * 1000.0,
+				      scalarTime / avx2Time, numMismatches);
+				return numMismatches;
+			}
+
+			int MeasureImageKernel(std::mt19937 &rng) {
+				// Draw 2D images like `SWRenderer::DrawImage` does
+				const int width = 1024, height = 768;
+				const int numQuads = 2000;
+				Handle<Bitmap> texture{new Bitmap(64, 64), false};
+				for (int i = 0; i < 64 * 64; i++) {
+					texture->GetPixels()[i] = rng();
+				}
+				Handle<SWImage> image{new SWImage(*texture), false};
+
+				std::uniform_real_distribution<float> position{-64.f, 1088.f};
+				std::uniform_real_distribution<float> size{1.f, 256.f};
+				std::uniform_real_distribution<float> unit{0.f, 1.f};
+				std::vector<std::array<SWImageRenderer::Vertex, 4>> quads(numQuads);
+				for (auto &quad : quads) {
+					float x = position(rng), y = position(rng) * 0.75f;
+					float w = size(rng), h = size(rng);
+					float u = unit(rng) * 4.f, v = unit(rng) * 4.f;
+					float uw = unit(rng) * 4.f - 2.f, vh = unit(rng) * 4.f - 2.f;
+					Vector4 color = MakeVector4(unit(rng), unit(rng), unit(rng), unit(rng));
+					const float xs[] = {x, x + w, x, x + w};
+					const float ys[] = {y, y, y + h, y + h};
+					for (int i = 0; i < 4; i++) {
+						quad[i].position = MakeVector4(xs[i], ys[i], 1.f, 1.f);
+						quad[i].uv = MakeVector2(u + uw * (i & 1), v + vh * (i >> 1));
+						quad[i].color = color;
+					}
+				}
+
+				Handle<Bitmap> frames[2] = {{new Bitmap(width, height), false},
+				                            {new Bitmap(width, height), false}};
+				const SWFeatureLevel levels[2] = {SWFeatureLevel::SSE2,
+				                                        SWFeatureLevel::AVX2};
+				double times[2] = {1.0e9, 1.0e9};
+				for (int round = 0; round < NumKernelRounds; round++) {
+					for (int i = 0; i < 2; i++) {
+						std::fill(frames[i]->GetPixels(),
+						          frames[i]->GetPixels() + width * height, 0x80604020U);
+
+						SWImageRenderer renderer{levels[i]};
+						renderer.SetFramebuffer(frames[i].GetPointerOrNull());
+						renderer.SetShaderType(SWImageRenderer::ShaderType::Image);
+
+						Stopwatch sw;
+						for (const auto &quad : quads) {
+							renderer.DrawPolygon(image.GetPointerOrNull(), quad[0], quad[1],
+							                     quad[2]);
+							renderer.DrawPolygon(image.GetPointerOrNull(), quad[1], quad[3],
+							                     quad[2]);
+						}
+						times[i] = std::min(times[i], sw.GetTime());
+					}
+				}
+
+				int numMismatches = CountMismatches(frames[0]->GetPixels(),
+				                                    frames[1]->GetPixels(), width * height);
+				SPLog("[image] %d quads, SSE2: %.3f ms, AVX2: %.3f ms (%.2fx), "
+				      "%d mismatch(es)",
+				      numQuads, times[0] * 1000.0, times[1] * 1000.0, times[0] / times[1],
+				      numMismatches);
+				return numMismatches;
+			}
+		} // namespace
+#endif
+
+		bool RunSWKernelSelfTest() {
+			SPADES_MARK_FUNCTION();
+
+#if ENABLE_AVX2
+			if (DetectFeatureLevel() < SWFeatureLevel::AVX2) {
+				SPLog("SW renderer kernel test: skipped (AVX2 is not supported by this CPU)");
+				return true;
+			}
+
+			std::mt19937 rng{42};
+			SPLog("SW renderer kernel test");
+			int numMismatches = 0;
+			numMismatches += MeasureFogKernel(rng);
+			numMismatches += MeasureFillKernel(rng);
+			numMismatches += MeasureImageKernel(rng);
+			return numMismatches == 0;
+#else
+			SPLog("SW renderer kernel test: skipped (AVX2 kernels are not available in this "
+			      "build)");
+			return true;
+#endif
+		}
+	} // namespace draw
+} // namespace spades
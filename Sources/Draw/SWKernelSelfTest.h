@@ -0,0 +1,35 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+namespace spades {
+	namespace draw {
+		/**
+		 * Checks that the AVX2 kernels of the software renderer produce exactly the same pixels
+		 * as the code they replace, and logs the time taken by both. This is run by
+		 * `openspades --self-test`, which is registered as a CTest test.
+		 *
+		 * @return `false` if any kernel produced different pixels. `true` if all of them
+		 *         matched, or if the AVX2 kernels are unavailable.
+		 */
+		bool RunSWKernelSelfTest();
+	} // namespace draw
+} // namespace spades
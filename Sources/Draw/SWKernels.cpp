@@ -0,0 +1,311 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+
+#include "SWKernels.h"
+#include <Core/Debug.h>
+
+namespace spades {
+	namespace draw {
+		template <>
+		void ApplyFogToBand<SWFeatureLevel::None>(std::uint32_t *pixels, const float *depths,
+		                                          int pitch, int numBlocks,
+		                                          const float *depthScales, int fogR, int fogG,
+		                                          int fogB) {
+			uint32_t fog1 = static_cast<uint32_t>(fogB + fogR * 0x10000);
+			uint32_t fog2 = static_cast<uint32_t>(fogG * 0x100);
+
+			for (int i = 0; i < numBlocks; i++) {
+				float depthScale = depthScales[i];
+				auto *fb2 = pixels + i * 4;
+				auto *db2 = depths + i * 4;
+				for (int by = 0; by < 4; by++) {
+					auto *fb3 = fb2;
+					auto *db3 = db2;
+
+					for (int bx = 0; bx < 4; bx++) {
+
+						float dist = *db3 * depthScale;
+						int factor = std::min(static_cast<int>(dist), 256);
+						factor = std::max(0, factor);
+						int factor2 = 256 - factor;
+
+						uint32_t color = *fb3;
+						uint32_t v1 = (color & 0xff00ff) * factor2;
+						uint32_t v2 = (color & 0x00ff00) * factor2;
+						v1 += fog1 * factor;
+						v2 += fog2 * factor;
+						v1 &= 0xff00ff00;
+						v2 &= 0xff0000;
+						*fb3 = (v1 | v2) >> 8;
+
+						fb3++;
+						db3++;
+					}
+
+					fb2 += pitch;
+					db2 += pitch;
+				}
+			}
+		}
+
+		template <>
+		void FillEmptyPixels<SWFeatureLevel::None>(std::uint64_t *pixels, std::size_t count,
+		                                           std::uint64_t value) {
+			for (std::size_t i = 0; i < count; i++) {
+				if (static_cast<std::uint32_t>(pixels[i]) == 0) {
+					pixels[i] = value;
+				}
+			}
+		}
+
+#if ENABLE_SSE2
+		template <>
+		void ApplyFogToBand<SWFeatureLevel::SSE2>(std::uint32_t *pixels, const float *depths,
+		                                          int pitch, int numBlocks,
+		                                          const float *depthScales, int fogR, int fogG,
+		                                          int fogB) {
+			__m128i fog = _mm_setr_epi16(fogB, fogG, fogR, 0, fogB, fogG, fogR, 0);
+
+			for (int i = 0; i < numBlocks; i++) {
+				auto depthScale4 = _mm_set1_ps(depthScales[i]);
+
+				auto *fb2 = pixels + i * 4;
+				auto *db2 = depths + i * 4;
+				for (int by = 0; by < 4; by++) {
+					auto *fb3 = fb2;
+					auto *db3 = db2;
+
+					auto dist = _mm_load_ps(db3);
+					auto color = _mm_load_si128(reinterpret_cast<__m128i *>(fb3));
+
+					dist = _mm_mul_ps(dist, depthScale4);
+					dist = _mm_max_ps(dist, _mm_set1_ps(0.f));
+					dist = _mm_min_ps(dist, _mm_set1_ps(256.f));
+					auto factorX = _mm_cvtps_epi32(dist);
+
+					auto factorY = _mm_sub_epi32(_mm_set1_epi32(0x100), factorX);
+
+					factorX = _mm_shufflelo_epi16(factorX, 0xa0);
+					factorX = _mm_shufflehi_epi16(factorX, 0xa0);
+					factorY = _mm_shufflelo_epi16(factorY, 0xa0);
+					factorY = _mm_shufflehi_epi16(factorY, 0xa0);
+
+					// first 2px
+					auto color1 = _mm_unpacklo_epi8(color, _mm_setzero_si128());
+					auto factor1X = _mm_shuffle_epi32(factorY, 0x50);
+					auto factor1Y = _mm_shuffle_epi32(factorX, 0x50);
+					color1 = _mm_mullo_epi16(color1, factor1X);
+					auto fog1 = _mm_mullo_epi16(fog, factor1Y);
+					fog1 = _mm_adds_epu16(fog1, color1);
+					fog1 = _mm_srli_epi16(fog1, 8);
+
+					// next 2px
+					auto color2 = _mm_unpackhi_epi8(color, _mm_setzero_si128());
+					auto factor2X = _mm_shuffle_epi32(factorY, 0xfa);
+					auto factor2Y = _mm_shuffle_epi32(factorX, 0xfa);
+					color2 = _mm_mullo_epi16(color2, factor2X);
+					auto fog2 = _mm_mullo_epi16(fog, factor2Y);
+					fog2 = _mm_adds_epu16(fog2, color2);
+					fog2 = _mm_srli_epi16(fog2, 8);
+
+					auto pack = _mm_packus_epi16(fog1, fog2);
+					_mm_store_si128(reinterpret_cast<__m128i *>(fb3), pack);
+
+					fb2 += pitch;
+					db2 += pitch;
+				}
+			}
+		}
+#endif
+
+#if ENABLE_AVX2
+		namespace {
+			// Lambda expressions don't inherit the target attribute, so helpers are defined as
+			// functions.
+
+			/** Gathers the integral parts (the upper halves) of eight 64-bit values. */
+			SW_AVX2_FUNCTION inline __m256i IntegralParts(__m256i a, __m256i b) {
+				auto upperHalves = _mm256_setr_epi32(1, 3, 5, 7, 1, 3, 5, 7);
+				return _mm256_permute2x128_si256(_mm256_permutevar8x32_epi32(a, upperHalves),
+				                                 _mm256_permutevar8x32_epi32(b, upperHalves),
+				                                 0x20);
+			}
+
+			/**
+			 * Blends premultiplied texels `[u16.0 x 4 x 4]` modulated by `mulCol` over
+			 * `dcol`. See `drawPixel2` in SWImageRenderer.cpp.
+			 */
+			SW_AVX2_FUNCTION inline __m256i BlendPremultiplied(__m256i tcol, __m256i dcol,
+			                                                   __m256i mulCol) {
+				tcol = _mm256_mullo_epi16(tcol, mulCol);
+
+				auto alpha = _mm256_shufflelo_epi16(tcol, 0xff);
+				alpha = _mm256_shufflehi_epi16(alpha, 0xff);
+				alpha = _mm256_srli_epi16(alpha, 8);
+				alpha = _mm256_add_epi16(alpha, _mm256_srli_epi16(alpha, 7));
+				alpha = _mm256_sub_epi16(_mm256_set1_epi16(0x100), alpha);
+
+				dcol = _mm256_mullo_epi16(dcol, alpha);
+				dcol = _mm256_adds_epu16(dcol, tcol);
+				return _mm256_srli_epi16(dcol, 8);
+			}
+		} // namespace
+
+		// These are the 256-bit versions of the SSE2 code. AVX2 integer instructions operate
+		// on two independent 128-bit lanes, so each lane computes exactly what an SSE2
+		// instruction does.
+
+		template <>
+		SW_AVX2_FUNCTION void
+		ApplyFogToBand<SWFeatureLevel::AVX2>(std::uint32_t *pixels, const float *depths,
+		                                     int pitch, int numBlocks, const float *depthScales,
+		                                     int fogR, int fogG, int fogB) {
+			__m256i fog = _mm256_setr_epi16(fogB, fogG, fogR, 0, fogB, fogG, fogR, 0, fogB, fogG,
+			                                fogR, 0, fogB, fogG, fogR, 0);
+
+			// process two blocks at once
+			int i = 0;
+			for (; i + 2 <= numBlocks; i += 2) {
+				auto depthScale8 = _mm256_insertf128_ps(
+				  _mm256_castps128_ps256(_mm_set1_ps(depthScales[i])),
+				  _mm_set1_ps(depthScales[i + 1]), 1);
+
+				auto *fb2 = pixels + i * 4;
+				auto *db2 = depths + i * 4;
+				for (int by = 0; by < 4; by++) {
+					auto dist = _mm256_loadu_ps(db2);
+					auto color = _mm256_loadu_si256(reinterpret_cast<__m256i *>(fb2));
+
+					dist = _mm256_mul_ps(dist, depthScale8);
+					dist = _mm256_max_ps(dist, _mm256_set1_ps(0.f));
+					dist = _mm256_min_ps(dist, _mm256_set1_ps(256.f));
+					auto factorX = _mm256_cvtps_epi32(dist);
+
+					auto factorY = _mm256_sub_epi32(_mm256_set1_epi32(0x100), factorX);
+
+					factorX = _mm256_shufflelo_epi16(factorX, 0xa0);
+					factorX = _mm256_shufflehi_epi16(factorX, 0xa0);
+					factorY = _mm256_shufflelo_epi16(factorY, 0xa0);
+					factorY = _mm256_shufflehi_epi16(factorY, 0xa0);
+
+					// first 2px of each block
+					auto color1 = _mm256_unpacklo_epi8(color, _mm256_setzero_si256());
+					auto factor1X = _mm256_shuffle_epi32(factorY, 0x50);
+					auto factor1Y = _mm256_shuffle_epi32(factorX, 0x50);
+					color1 = _mm256_mullo_epi16(color1, factor1X);
+					auto fog1 = _mm256_mullo_epi16(fog, factor1Y);
+					fog1 = _mm256_adds_epu16(fog1, color1);
+					fog1 = _mm256_srli_epi16(fog1, 8);
+
+					// next 2px of each block
+					auto color2 = _mm256_unpackhi_epi8(color, _mm256_setzero_si256());
+					auto factor2X = _mm256_shuffle_epi32(factorY, 0xfa);
+					auto factor2Y = _mm256_shuffle_epi32(factorX, 0xfa);
+					color2 = _mm256_mullo_epi16(color2, factor2X);
+					auto fog2 = _mm256_mullo_epi16(fog, factor2Y);
+					fog2 = _mm256_adds_epu16(fog2, color2);
+					fog2 = _mm256_srli_epi16(fog2, 8);
+
+					auto pack = _mm256_packus_epi16(fog1, fog2);
+					_mm256_storeu_si256(reinterpret_cast<__m256i *>(fb2), pack);
+
+					fb2 += pitch;
+					db2 += pitch;
+				}
+			}
+
+			if (i < numBlocks) {
+				ApplyFogToBand<SWFeatureLevel::SSE2>(pixels + i * 4, depths + i * 4, pitch,
+				                                     numBlocks - i, depthScales + i, fogR, fogG,
+				                                     fogB);
+			}
+		}
+
+		template <>
+		SW_AVX2_FUNCTION void FillEmptyPixels<SWFeatureLevel::AVX2>(std::uint64_t *pixels,
+		                                                            std::size_t count,
+		                                                            std::uint64_t value) {
+			auto value4 = _mm256_set1_epi64x(static_cast<long long>(value));
+			auto lowMask = _mm256_set1_epi64x(0xffffffffLL);
+
+			std::size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				auto *p = reinterpret_cast<__m256i *>(pixels + i);
+				auto m = _mm256_loadu_si256(p);
+				auto empty =
+				  _mm256_cmpeq_epi64(_mm256_and_si256(m, lowMask), _mm256_setzero_si256());
+				_mm256_storeu_si256(p, _mm256_blendv_epi8(m, value4, empty));
+			}
+
+			FillEmptyPixels<SWFeatureLevel::None>(pixels + i, count - i, value);
+		}
+
+		SW_AVX2_FUNCTION void DrawImageSpanAVX2(std::uint32_t *out, int count, std::int64_t u,
+		                                        std::int64_t v, std::int64_t du,
+		                                        std::int64_t dv, const std::uint32_t *texture,
+		                                        int tw, int th, __m128i mulColor) {
+			SPAssert((count & 7) == 0);
+
+			auto mulCol = _mm256_broadcastsi128_si256(mulColor);
+			auto uvMask = _mm256_set1_epi32(0xffff);
+			auto texW = _mm256_set1_epi32(tw);
+			auto texH = _mm256_set1_epi32(th);
+
+			// the coordinates wrap around like the SSE2 code's 64-bit adds
+			auto at = [](std::int64_t x, std::int64_t dx, int i) {
+				return static_cast<long long>(static_cast<std::uint64_t>(x) +
+				                              static_cast<std::uint64_t>(dx) * i);
+			};
+			auto u1 = _mm256_setr_epi64x(at(u, du, 0), at(u, du, 1), at(u, du, 2), at(u, du, 3));
+			auto u2 = _mm256_setr_epi64x(at(u, du, 4), at(u, du, 5), at(u, du, 6), at(u, du, 7));
+			auto v1 = _mm256_setr_epi64x(at(v, dv, 0), at(v, dv, 1), at(v, dv, 2), at(v, dv, 3));
+			auto v2 = _mm256_setr_epi64x(at(v, dv, 4), at(v, dv, 5), at(v, dv, 6), at(v, dv, 7));
+			auto stepU = _mm256_set1_epi64x(at(0, du, 8));
+			auto stepV = _mm256_set1_epi64x(at(0, dv, 8));
+
+			for (int x = 0; x < count; x += 8) {
+				auto iu = _mm256_and_si256(IntegralParts(u1, u2), uvMask);
+				auto iv = _mm256_and_si256(IntegralParts(v1, v2), uvMask);
+				iu = _mm256_srli_epi32(_mm256_mullo_epi32(iu, texW), 16);
+				iv = _mm256_srli_epi32(_mm256_mullo_epi32(iv, texH), 16);
+				auto index = _mm256_add_epi32(iu, _mm256_mullo_epi32(iv, texW));
+				auto tex = _mm256_i32gather_epi32(reinterpret_cast<const int *>(texture), index, 4);
+
+				auto *dest = reinterpret_cast<__m256i *>(out + x);
+				auto dcol = _mm256_loadu_si256(dest);
+
+				auto zero = _mm256_setzero_si256();
+				auto col1 = BlendPremultiplied(_mm256_unpacklo_epi8(tex, zero),
+				                               _mm256_unpacklo_epi8(dcol, zero), mulCol);
+				auto col2 = BlendPremultiplied(_mm256_unpackhi_epi8(tex, zero),
+				                               _mm256_unpackhi_epi8(dcol, zero), mulCol);
+				_mm256_storeu_si256(dest, _mm256_packus_epi16(col1, col2));
+
+				u1 = _mm256_add_epi64(u1, stepU);
+				u2 = _mm256_add_epi64(u2, stepU);
+				v1 = _mm256_add_epi64(v1, stepV);
+				v2 = _mm256_add_epi64(v2, stepV);
+			}
+		}
+#endif
+	} // namespace draw
+} // namespace spades
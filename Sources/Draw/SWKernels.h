@@ -0,0 +1,87 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SWFeatureLevel.h"
+
+namespace spades {
+	namespace draw {
+		/**
+		 * Blends the fog color into a band of four rows, which is processed in 4x4 blocks.
+		 *
+		 * @param pixels The top-left pixel of the band. Must be 16-byte aligned.
+		 * @param depths The depth values corresponding to `pixels`.
+		 * @param pitch The distance between rows, in pixels.
+		 * @param depthScales The factor converting a depth value to a fog density (`[0, 256]`)
+		 *                    for each block.
+		 */
+		template <SWFeatureLevel>
+		void ApplyFogToBand(std::uint32_t *pixels, const float *depths, int pitch, int numBlocks,
+		                    const float *depthScales, int fogR, int fogG, int fogB);
+
+		/**
+		 * Replaces every element whose lower 32 bits are zero with `value`. This is used to
+		 * fill spans of `SWMapRenderer`'s line pixels, whose lower halves hold colors and are
+		 * zero for empty pixels.
+		 */
+		template <SWFeatureLevel>
+		void FillEmptyPixels(std::uint64_t *pixels, std::size_t count, std::uint64_t value);
+
+		template <>
+		void ApplyFogToBand<SWFeatureLevel::None>(std::uint32_t *, const float *, int, int,
+		                                          const float *, int, int, int);
+		template <>
+		void FillEmptyPixels<SWFeatureLevel::None>(std::uint64_t *, std::size_t, std::uint64_t);
+
+#if ENABLE_SSE2
+		template <>
+		void ApplyFogToBand<SWFeatureLevel::SSE2>(std::uint32_t *, const float *, int, int,
+		                                          const float *, int, int, int);
+#endif
+
+#if ENABLE_AVX2
+		template <>
+		SW_AVX2_FUNCTION void
+		ApplyFogToBand<SWFeatureLevel::AVX2>(std::uint32_t *, const float *, int, int,
+		                                     const float *, int, int, int);
+		template <>
+		SW_AVX2_FUNCTION void FillEmptyPixels<SWFeatureLevel::AVX2>(std::uint64_t *,
+		                                                            std::size_t, std::uint64_t);
+
+		/**
+		 * Draws a horizontal span of a point-sampled texture like `SWImageRenderer`'s SSE2
+		 * rasterizer does for `ShaderType::Image`, producing exactly the same pixels.
+		 *
+		 * @param count The number of pixels to draw. Must be a multiple of 8.
+		 * @param u The horizontal texture coordinate of the first pixel in 32.32 fixed point,
+		 *          where the lower 16 bits of the integral part map to the texture width.
+		 * @param du The increment of `u` per pixel.
+		 * @param mulColor The modulation color `[B, G, R, A, B, G, R, A]` in 8.8 fixed point.
+		 */
+		SW_AVX2_FUNCTION void DrawImageSpanAVX2(std::uint32_t *out, int count, std::int64_t u,
+		                                        std::int64_t v, std::int64_t du,
+		                                        std::int64_t dv, const std::uint32_t *texture,
+		                                        int tw, int th, __m128i mulColor);
+#endif
+	} // namespace draw
+} // namespace spades
@@ -22,13 +22,13 @@
 #include <cstdint>
 #include <cstring>
 
+#include "SWKernels.h"
 #include "SWMapRenderer.h"
 #include "SWRenderer.h"
 #include "SWUtils.h"
 #include <Client/GameMap.h>
 #include <Core/Bitmap.h>
 #include <Core/ConcurrentDispatch.h>
-#include <Core/MiniHeap.h>
 #include <Core/Settings.h>
 #include <Core/Stopwatch.h>
 
@@ -216,6 +216,20 @@ namespace spades {
 			rleLen[idx] = rleBuf.size() * sizeof(RleData);
 		}
 
+		void SWMapRenderer::CompactRle() {
+			if (!rleHeap.ShouldCompact()) {
+				return;
+			}
+
+			SPADES_MARK_FUNCTION();
+
+			Stopwatch sw;
+			std::size_t oldCapacity = rleHeap.GetCapacity();
+			rleHeap.Compact(rle.data(), rleLen.data(), rle.size());
+			SPLog("RLE heap compacted in %.2f ms (%.1f MB -> %.1f MB)", sw.GetTime() * 1000.0,
+			      oldCapacity / 1048576.0, rleHeap.GetCapacity() / 1048576.0);
+		}
+
 		template <SWFeatureLevel flevel>
 		void SWMapRenderer::BuildLine(Line &line, float minPitch, float maxPitch) {
 
@@ -533,7 +547,7 @@ namespace spades {
 					LinePixel px;
 					px.depth = dist;
 #if ENABLE_SSE
-					if constexpr (flevel == SWFeatureLevel::SSE2) {
+					if constexpr (flevel >= SWFeatureLevel::SSE2) {
 						__m128i m;
 						uint32_t col = map.GetColorWrapped(x, y, z);
 						m = _mm_setr_epi32(col, 0, 0, 0);
@@ -575,6 +589,26 @@ namespace spades {
 					return px;
 				};
 
+				// fills the empty pixels in `[p1, p2)`
+				auto FillSpan = [pixels](std::uint_fast16_t p1, std::uint_fast16_t p2,
+				                         const LinePixel &pix) {
+#if ENABLE_AVX2
+					if constexpr (flevel >= SWFeatureLevel::AVX2) {
+						if (p1 < p2) {
+							FillEmptyPixels<SWFeatureLevel::AVX2>(&pixels[p1].allData, p2 - p1,
+							                                      pix.allData);
+						}
+						return;
+					}
+#endif
+					for (std::uint_fast16_t j = p1; j < p2; j++) {
+						auto &p = pixels[j];
+						if (!p.IsEmpty())
+							continue;
+						p.Set(pix);
+					}
+				};
+
 				// floor/ceiling
 				{
 
@@ -592,12 +626,7 @@ namespace spades {
 								LinePixel pix = BuildLinePixel(oirx, oiry, z, Face::NegZ,
 								                               medDist + heightScaleVal[z]);
 
-								for (std::uint_fast16_t j = p1; j < p2; j++) {
-									auto &p = pixels[j];
-									if (!p.IsEmpty())
-										continue;
-									p.Set(pix);
-								}
+								FillSpan(p1, p2, pix);
 							}
 							ptr++;
 						}
@@ -610,12 +639,7 @@ namespace spades {
 								LinePixel pix = BuildLinePixel(oirx, oiry, z, Face::PosZ,
 								                               medDist + heightScaleVal[z + 1]);
 
-								for (std::uint_fast16_t j = p2; j < p1; j++) {
-									auto &p = pixels[j];
-									if (!p.IsEmpty())
-										continue;
-									p.Set(pix);
-								}
+								FillSpan(p2, p1, pix);
 							}
 							ptr++;
 						}
@@ -648,12 +672,7 @@ namespace spades {
 						LinePixel pix =
 						  BuildLinePixel(irx, iry, z, wallFace, medDist + heightScaleVal[z]);
 
-						for (std::uint_fast16_t j = p1; j < p2; j++) {
-							auto &p = pixels[j];
-							if (!p.IsEmpty())
-								continue;
-							p.Set(pix);
-						}
+						FillSpan(p1, p2, pix);
 					}
 
 				} // add wall - end
@@ -887,7 +906,7 @@ namespace spades {
 // though this isn't a problem as long as the color comes
 // in the LSB's
 #if ENABLE_SSE
-							if constexpr (flevel == SWFeatureLevel::SSE2) {
+							if constexpr (flevel >= SWFeatureLevel::SSE2) {
 								__m128i m;
 
 								if (under == 1) {
@@ -985,7 +1004,7 @@ namespace spades {
 // though this isn't a problem as long as the color comes
 // in the LSB's
 #if ENABLE_SSE
-							if constexpr (flevel == SWFeatureLevel::SSE2) {
+							if constexpr (flevel >= SWFeatureLevel::SSE2) {
 								__m128i m;
 
 								if (under == 1) {
@@ -1183,6 +1202,13 @@ namespace spades {
 				return;
 			}
 
+#if ENABLE_AVX2
+			if (level >= SWFeatureLevel::AVX2) {
+				RenderInner<SWFeatureLevel::AVX2>(def, &frame, depthBuffer);
+				return;
+			}
+#endif
+
 #if ENABLE_SSE2
 			if (static_cast<int>(level) >= static_cast<int>(SWFeatureLevel::SSE2)) {
 				RenderInner<SWFeatureLevel::SSE2>(def, &frame, depthBuffer);
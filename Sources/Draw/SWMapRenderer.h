@@ -26,8 +26,8 @@
 #include "SWFeatureLevel.h"
 #include <Client/SceneDefinition.h>
 #include <Core/Math.h>
-#include <Core/MiniHeap.h>
 #include <Core/RefCountedObject.h>
+#include <Core/SizeClassHeap.h>
 
 namespace spades {
 	namespace client {
@@ -53,7 +53,7 @@ namespace spades {
 			Bitmap *frameBuf;
 			float *depthBuf;
 			std::vector<Line> lines;
-			std::vector<MiniHeap::Ref> rle;
+			std::vector<SizeClassHeap::Ref> rle;
 			std::vector<size_t> rleLen;
 
 			int lineResolution;
@@ -61,7 +61,7 @@ namespace spades {
 			typedef int8_t RleData;
 			std::vector<RleData> rleBuf;
 
-			MiniHeap rleHeap;
+			SizeClassHeap rleHeap;
 
 			template <SWFeatureLevel level>
 			void BuildLine(Line &line, float minPitch, float maxPitch);
@@ -81,6 +81,12 @@ namespace spades {
 			void Render(const client::SceneDefinition &, Bitmap &fb, float *depthBuffer);
 
 			void UpdateRle(int x, int y);
+
+			/**
+			 * Reclaims the memory wasted by `UpdateRle` if there is a lot. Must not be called
+			 * while rendering.
+			 */
+			void CompactRle();
 		};
 	} // namespace draw
 } // namespace spades
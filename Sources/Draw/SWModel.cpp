@@ -21,10 +21,18 @@
 
 #include "SWModel.h"
 #include <Core/IStream.h>
+#include <Core/TMPUtils.h>
 #include <Core/VoxelModelLoader.h>
 
 namespace spades {
 	namespace draw {
+		namespace {
+			class SWPreloadedModel : public client::PreloadedModel {
+			public:
+				Handle<SWModel> model;
+			};
+		} // namespace
+
 		SWModel::SWModel(VoxelModel &m) : rawModel(m) {
 			center.x = m.GetWidth();
 			center.y = m.GetHeight();
@@ -144,6 +152,37 @@ namespace spades {
 			return Handle<SWModel>::New(vm);
 		}
 
+		std::unique_ptr<client::PreloadedModel>
+		SWModelManager::PreloadModel(const std::string &name) {
+			return PreloadModel(*VoxelModelLoader::Load(name.c_str()));
+		}
+
+		std::unique_ptr<client::PreloadedModel> SWModelManager::PreloadModel(VoxelModel &vm) {
+			auto preloaded = stmp::make_unique<SWPreloadedModel>();
+			preloaded->voxelModel = vm;
+			preloaded->model = CreateModel(vm);
+			return preloaded;
+		}
+
+		Handle<SWModel> SWModelManager::RegisterPreloadedModel(const std::string &name,
+		                                                       client::PreloadedModel &preloaded) {
+			auto it = models.find(name);
+			if (it != models.end()) {
+				return it->second;
+			}
+
+			Handle<SWModel> model = CreatePreloadedModel(preloaded);
+			models.insert(std::make_pair(name, model));
+			return model;
+		}
+
+		Handle<SWModel> SWModelManager::CreatePreloadedModel(client::PreloadedModel &preloaded) {
+			if (auto *swPreloaded = dynamic_cast<SWPreloadedModel *>(&preloaded)) {
+				return swPreloaded->model;
+			}
+			return CreateModel(*preloaded.voxelModel);
+		}
+
 		void SWModelManager::ClearCache() { models.clear(); }
 	} // namespace draw
 } // namespace spades
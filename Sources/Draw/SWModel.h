@@ -20,10 +20,12 @@
 
 #pragma once
 
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
 #include <Client/IModel.h>
+#include <Client/IRenderer.h>
 #include <Core/VoxelModel.h>
 
 namespace spades {
@@ -63,6 +65,14 @@ namespace spades {
 			Handle<SWModel> RegisterModel(const std::string &);
 			Handle<SWModel> CreateModel(VoxelModel &);
 
+			/** Thread-safe. Creates `SWModel` too because it doesn't touch the renderer. */
+			std::unique_ptr<client::PreloadedModel> PreloadModel(const std::string &);
+			Handle<SWModel> RegisterPreloadedModel(const std::string &, client::PreloadedModel &);
+
+			/** Thread-safe. Same as `PreloadModel(const std::string &)`, but for a given model. */
+			std::unique_ptr<client::PreloadedModel> PreloadModel(VoxelModel &);
+			Handle<SWModel> CreatePreloadedModel(client::PreloadedModel &);
+
 			void ClearCache();
 		};
 	} // namespace draw
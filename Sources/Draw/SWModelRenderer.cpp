@@ -44,8 +44,13 @@ namespace spades {
 		static ZVals zvals;
 
 		template <SWFeatureLevel lvl>
-		void SWModelRenderer::RenderInner(spades::draw::SWModel &model,
-		                                  const client::ModelRenderParam &param) {
+		void SWModelRenderer::PrepareInner(spades::draw::SWModel &model,
+		                                   const client::ModelRenderParam &param,
+		                                   PreparedModel &out) {
+			out.splats.clear();
+			out.minX = out.minY = 0;
+			out.maxX = out.maxY = 0;
+
 			auto &mat = param.matrix;
 			auto origin = mat.GetOrigin();
 			auto axis1 = mat.GetAxis(0);
@@ -145,10 +150,9 @@ namespace spades {
 			}
 
 			Bitmap &fbmp = *r->fb;
-			auto *fb = fbmp.GetPixels();
 			int fw = fbmp.GetWidth();
 			int fh = fbmp.GetHeight();
-			auto *db = r->depthBuffer.data();
+			int boundMinX = fw, boundMinY = fh, boundMaxX = 0, boundMaxY = 0;
 
 			Matrix4 viewproj = r->GetProjectionViewMatrix();
 			Vector4 ndc2scrscale = {fw * 0.5f, -fh * 0.5f, 1.f, 1.f};
@@ -223,10 +227,6 @@ namespace spades {
 						maxX = std::min(maxX, fw);
 						maxY = std::min(maxY, fh);
 
-						auto *fb2 = fb + (minX + minY * fw);
-						auto *db2 = db + (minX + minY * fw);
-						int w = maxX - minX;
-
 						uint32_t color = data & 0xffffff;
 						if (color == 0)
 							color = customColor;
@@ -253,37 +253,87 @@ namespace spades {
 							color = ((c1 & 0xff0000) | (c2 & 0xff00ff00)) >> 8;
 						}
 
-						for (int yy = minY; yy < maxY; yy++) {
-							auto *fb3 = fb2;
-							auto *db3 = db2;
-
-							for (int xx = w; xx > 0; xx--) {
-								if (zval < *db3) {
-									*db3 = zval;
-									*fb3 = color;
-								}
-								fb3++;
-								db3++;
-							}
-
-							fb2 += fw;
-							db2 += fw;
-						}
+						Splat splat;
+						splat.minX = minX;
+						splat.minY = minY;
+						splat.maxX = maxX;
+						splat.maxY = maxY;
+						splat.depth = zval;
+						splat.color = color;
+						out.splats.push_back(splat);
+
+						boundMinX = std::min(boundMinX, minX);
+						boundMinY = std::min(boundMinY, minY);
+						boundMaxX = std::max(boundMaxX, maxX);
+						boundMaxY = std::max(boundMaxY, maxY);
 					}
 					v2 += tAxis2;
 				}
 				v1 += tAxis1;
 			}
+
+			if (!out.splats.empty()) {
+				out.minX = boundMinX;
+				out.minY = boundMinY;
+				out.maxX = boundMaxX;
+				out.maxY = boundMaxY;
+			}
 		}
 
-		void SWModelRenderer::Render(spades::draw::SWModel &model,
-		                             const client::ModelRenderParam &param) {
+		void SWModelRenderer::Prepare(spades::draw::SWModel &model,
+		                              const client::ModelRenderParam &param,
+		                              PreparedModel &out) {
 #if ENABLE_SSE2
 			if (static_cast<int>(level) >= static_cast<int>(SWFeatureLevel::SSE2)) {
-				RenderInner<SWFeatureLevel::SSE2>(model, param);
+				PrepareInner<SWFeatureLevel::SSE2>(model, param, out);
 			} else
 #endif
-				RenderInner<SWFeatureLevel::None>(model, param);
+				PrepareInner<SWFeatureLevel::None>(model, param, out);
+		}
+
+		void SWModelRenderer::Draw(const PreparedModel &model, int minX, int minY, int maxX,
+		                           int maxY) {
+			if (model.minX >= maxX || model.minY >= maxY || model.maxX <= minX ||
+			    model.maxY <= minY) {
+				return;
+			}
+
+			Bitmap &fbmp = *r->fb;
+			auto *fb = fbmp.GetPixels();
+			int fw = fbmp.GetWidth();
+			auto *db = r->depthBuffer.data();
+
+			for (const Splat &splat : model.splats) {
+				int sMinX = std::max(splat.minX, minX);
+				int sMinY = std::max(splat.minY, minY);
+				int sMaxX = std::min(splat.maxX, maxX);
+				int sMaxY = std::min(splat.maxY, maxY);
+				if (sMinX >= sMaxX || sMinY >= sMaxY)
+					continue;
+
+				auto *fb2 = fb + (sMinX + sMinY * fw);
+				auto *db2 = db + (sMinX + sMinY * fw);
+				int w = sMaxX - sMinX;
+				float zval = splat.depth;
+				uint32_t color = splat.color;
+
+				for (int yy = sMinY; yy < sMaxY; yy++) {
+					auto *fb3 = fb2;
+					auto *db3 = db2;
+
+					for (int xx = w; xx > 0; xx--) {
+						if (zval < *db3) {
+							*db3 = zval;
+							*fb3 = color;
+						}
+						fb3++;
+						db3++;
+					}
+
+					fb2 += fw;
+					db2 += fw;
+				}
+			}
 		}
 	} // namespace draw
 } // namespace spades
@@ -20,6 +20,9 @@
 
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 #include "SWFeatureLevel.h"
 #include <Client/IRenderer.h>
 
@@ -32,14 +35,39 @@ namespace spades {
 			SWRenderer *r;
 			SWFeatureLevel level;
 
+		public:
+			/** A shaded square drawn for a voxel, clipped to the framebuffer. */
+			struct Splat {
+				int minX, minY, maxX, maxY;
+				float depth;
+				std::uint32_t color;
+			};
+
+			/** The splats of a model in the drawing order. */
+			struct PreparedModel {
+				std::vector<Splat> splats;
+				/** The bounding rectangle of `splats`. */
+				int minX, minY, maxX, maxY;
+			};
+
+		private:
 			template <SWFeatureLevel>
-			void RenderInner(SWModel &model, const client::ModelRenderParam &param);
+			void PrepareInner(SWModel &model, const client::ModelRenderParam &param,
+			                  PreparedModel &out);
 
 		public:
 			SWModelRenderer(SWRenderer *, SWFeatureLevel level);
 			~SWModelRenderer();
 
-			void Render(SWModel &model, const client::ModelRenderParam &param);
+			/**
+			 * Transforms and shades the voxels of a model. `out.splats` is left empty if the
+			 * model is outside the view. This method can be called from multiple threads.
+			 */
+			void Prepare(SWModel &model, const client::ModelRenderParam &param,
+			             PreparedModel &out);
+
+			/** Draws the splats of a prepared model inside the specified rectangle. */
+			void Draw(const PreparedModel &model, int minX, int minY, int maxX, int maxY);
 		};
 	} // namespace draw
 } // namespace spades
@@ -20,17 +20,21 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cfenv>
+#include <cmath>
 #include <cstdlib>
 
 #include "SWFlatMapRenderer.h"
 #include "SWImage.h"
 #include "SWImageRenderer.h"
+#include "SWKernels.h"
 #include "SWMapRenderer.h"
 #include "SWModel.h"
 #include "SWModelRenderer.h"
 #include "SWPort.h"
 #include "SWRenderer.h"
+#include "SWTileBinner.h"
 #include <Client/GameMap.h>
 #include <Core/Bitmap.h>
 #include <Core/Settings.h>
@@ -115,6 +119,7 @@ namespace spades {
 
 			SPLog("creating model renderer");
 			modelRenderer = std::make_shared<SWModelRenderer>(this, featureLevel);
+			tileBinner = std::make_shared<SWTileBinner>();
 			renderStopwatch.Reset();
 
 			SPLog("---- SWRenderer late initialization done ---");
@@ -150,6 +155,28 @@ namespace spades {
 			return modelManager->RegisterModel(filename).Cast<client::IModel>();
 		}
 
+		std::unique_ptr<client::PreloadedModel> SWRenderer::PreloadModel(const char *filename) {
+			SPADES_MARK_FUNCTION();
+			EnsureInitialized();
+			return modelManager->PreloadModel(filename);
+		}
+
+		Handle<client::IModel>
+		SWRenderer::RegisterPreloadedModel(const char *filename,
+		                                   client::PreloadedModel &preloaded) {
+			SPADES_MARK_FUNCTION();
+			EnsureInitialized();
+			return modelManager->RegisterPreloadedModel(filename, preloaded)
+			  .Cast<client::IModel>();
+		}
+
+		Handle<client::IImage> SWRenderer::RegisterPreloadedImage(const char *filename,
+		                                                          spades::Bitmap &bmp) {
+			SPADES_MARK_FUNCTION();
+			EnsureValid();
+			return imageManager->RegisterImage(filename, bmp).Cast<client::IImage>();
+		}
+
 		void SWRenderer::ClearCache() {
 			SPADES_MARK_FUNCTION();
 			EnsureValid();
@@ -169,6 +196,20 @@ namespace spades {
 			return modelManager->CreateModel(model).Cast<client::IModel>();
 		}
 
+		std::unique_ptr<client::PreloadedModel>
+		SWRenderer::PreloadVoxelModel(spades::VoxelModel &model) {
+			SPADES_MARK_FUNCTION();
+			EnsureInitialized();
+			return modelManager->PreloadModel(model);
+		}
+
+		Handle<client::IModel>
+		SWRenderer::CreatePreloadedModel(client::PreloadedModel &preloaded) {
+			SPADES_MARK_FUNCTION();
+			EnsureInitialized();
+			return modelManager->CreatePreloadedModel(preloaded).Cast<client::IModel>();
+		}
+
 		void SWRenderer::SetGameMap(stmp::optional<client::GameMap &> map) {
 			SPADES_MARK_FUNCTION();
 			if (map)
@@ -351,8 +392,6 @@ namespace spades {
 			int fogR = ToFixed8(fogColor.x);
 			int fogG = ToFixed8(fogColor.y);
 			int fogB = ToFixed8(fogColor.z);
-			uint32_t fog1 = static_cast<uint32_t>(fogB + fogR * 0x10000);
-			uint32_t fog2 = static_cast<uint32_t>(fogG * 0x100);
 
 			float scale = 255.f / fogDistance;
 
@@ -370,143 +409,20 @@ namespace spades {
 				fb += fw * startY;
 				db += fw * startY;
 
-				for (int y = startY; y < endY; y += 4) {
-					float vx = fovX;
-
-					for (int x = 0; x < fw; x += 4) {
-						float depthScale = (1.f + vx * vx + vy * vy);
-						depthScale *= fastRSqrt(depthScale) * scale;
-						auto *fb2 = fb + x;
-						auto *db2 = db + x;
-						for (int by = 0; by < 4; by++) {
-							auto *fb3 = fb2;
-							auto *db3 = db2;
-
-							for (int bx = 0; bx < 4; bx++) {
-
-								float dist = *db3 * depthScale;
-								int factor = std::min(static_cast<int>(dist), 256);
-								factor = std::max(0, factor);
-								int factor2 = 256 - factor;
-
-								uint32_t color = *fb3;
-								uint32_t v1 = (color & 0xff00ff) * factor2;
-								uint32_t v2 = (color & 0x00ff00) * factor2;
-								v1 += fog1 * factor;
-								v2 += fog2 * factor;
-								v1 &= 0xff00ff00;
-								v2 &= 0xff0000;
-								*fb3 = (v1 | v2) >> 8;
-
-								fb3++;
-								db3++;
-							}
-
-							fb2 += fw;
-							db2 += fw;
-						}
-
-						vx += dvx;
-					}
-
-					vy += dvy;
-					fb += fw * 4;
-					db += fw * 4;
-				}
-			});
-
-		} // ApplyFog()
-
-#if ENABLE_SSE2
-
-		template <> void SWRenderer::ApplyFog<SWFeatureLevel::SSE2>() {
-			int fw = this->fb->GetWidth();
-			int fh = this->fb->GetHeight();
-
-			float fovX = tanf(sceneDef.fovX * 0.5f);
-			float fovY = tanf(sceneDef.fovY * 0.5f);
-
-			float dvx = -fovX * 2.f / static_cast<float>(fw / 4);
-			float dvy = -fovY * 2.f / static_cast<float>(fh / 4);
-
-			int fogR = ToFixed8(fogColor.x);
-			int fogG = ToFixed8(fogColor.y);
-			int fogB = ToFixed8(fogColor.z);
-			__m128i fog = _mm_setr_epi16(fogB, fogG, fogR, 0, fogB, fogG, fogR, 0);
-
-			float scale = 255.f / fogDistance;
-
-			InvokeParallel2([&](unsigned int threadId, unsigned int numThreads) {
-				int startY = fh * threadId / numThreads;
-				int endY = fh * (threadId + 1) / numThreads;
-				startY &= ~3;
-				endY &= ~3;
-
-				float vy = fovY;
-				auto *fb = this->fb->GetPixels();
-				float *db = depthBuffer.data();
-
-				vy += dvy * (startY >> 2);
-				fb += fw * startY;
-				db += fw * startY;
+				std::vector<float> depthScales(fw / 4);
 
 				for (int y = startY; y < endY; y += 4) {
 					float vx = fovX;
 
-					for (int x = 0; x < fw; x += 4) {
-						float depthScale = (1.f + vx * vx + vy * vy);
+					for (float &depthScale : depthScales) {
+						depthScale = (1.f + vx * vx + vy * vy);
 						depthScale *= fastRSqrt(depthScale) * scale;
-						auto depthScale4 = _mm_set1_ps(depthScale);
-
-						auto *fb2 = fb + x;
-						auto *db2 = db + x;
-						for (int by = 0; by < 4; by++) {
-							auto *fb3 = fb2;
-							auto *db3 = db2;
-
-							auto dist = _mm_load_ps(db3);
-							auto color = _mm_load_si128(reinterpret_cast<__m128i *>(fb3));
-
-							dist = _mm_mul_ps(dist, depthScale4);
-							dist = _mm_max_ps(dist, _mm_set1_ps(0.f));
-							dist = _mm_min_ps(dist, _mm_set1_ps(256.f));
-							auto factorX = _mm_cvtps_epi32(dist);
-
-							auto factorY = _mm_sub_epi32(_mm_set1_epi32(0x100), factorX);
-
-							factorX = _mm_shufflelo_epi16(factorX, 0xa0);
-							factorX = _mm_shufflehi_epi16(factorX, 0xa0);
-							factorY = _mm_shufflelo_epi16(factorY, 0xa0);
-							factorY = _mm_shufflehi_epi16(factorY, 0xa0);
-
-							// first 2px
-							auto color1 = _mm_unpacklo_epi8(color, _mm_setzero_si128());
-							auto factor1X = _mm_shuffle_epi32(factorY, 0x50);
-							auto factor1Y = _mm_shuffle_epi32(factorX, 0x50);
-							color1 = _mm_mullo_epi16(color1, factor1X);
-							auto fog1 = _mm_mullo_epi16(fog, factor1Y);
-							fog1 = _mm_adds_epu16(fog1, color1);
-							fog1 = _mm_srli_epi16(fog1, 8);
-
-							// next 2px
-							auto color2 = _mm_unpackhi_epi8(color, _mm_setzero_si128());
-							auto factor2X = _mm_shuffle_epi32(factorY, 0xfa);
-							auto factor2Y = _mm_shuffle_epi32(factorX, 0xfa);
-							color2 = _mm_mullo_epi16(color2, factor2X);
-							auto fog2 = _mm_mullo_epi16(fog, factor2Y);
-							fog2 = _mm_adds_epu16(fog2, color2);
-							fog2 = _mm_srli_epi16(fog2, 8);
-
-							auto pack = _mm_packus_epi16(fog1, fog2);
-							_mm_store_si128(reinterpret_cast<__m128i *>(fb3), pack);
-
-							fb2 += fw;
-							db2 += fw;
-						}
-
 						vx += dvx;
 					}
 
+					ApplyFogToBand<level>(fb, db, fw, fw / 4, depthScales.data(), fogR, fogG,
+					                      fogB);
+
 					vy += dvy;
 					fb += fw * 4;
 					db += fw * 4;
@@ -515,8 +431,6 @@ namespace spades {
 
 		} // ApplyFog()
 
-#endif
-
 		void SWRenderer::EnsureSceneStarted() {
 			SPADES_MARK_FUNCTION_DEBUG();
 			if (!duringSceneRendering) {
@@ -555,6 +469,10 @@ namespace spades {
 			sceneDef = def;
 			duringSceneRendering = true;
 
+			if (map) {
+				map->FlushChanges();
+			}
+
 			BuildProjectionMatrix();
 			BuildView();
 			BuildFrustrum();
@@ -685,6 +603,37 @@ namespace spades {
 			spr.color = drawColorAlphaPremultiplied;
 		}
 
+		void SWRenderer::AddSprites(const client::SpriteParam *sprites, std::size_t numSprites) {
+			SPADES_MARK_FUNCTION();
+			EnsureInitialized();
+			EnsureSceneStarted();
+
+			this->sprites.reserve(this->sprites.size() + numSprites);
+
+			client::IImage *lastImage = nullptr;
+			SWImage *lastSWImage = nullptr;
+
+			for (std::size_t i = 0; i < numSprites; ++i) {
+				const client::SpriteParam &sprite = sprites[i];
+				if (!SphereFrustrumCull(sprite.center, sprite.radius * 1.5f))
+					continue;
+
+				if (sprite.image != lastImage) {
+					lastImage = sprite.image;
+					lastSWImage = &dynamic_cast<SWImage &>(*sprite.image);
+				}
+
+				this->sprites.push_back(Sprite());
+				auto &spr = this->sprites.back();
+
+				spr.img = *lastSWImage;
+				spr.center = sprite.center;
+				spr.radius = sprite.radius;
+				spr.rotation = sprite.rotation;
+				spr.color = sprite.color;
+			}
+		}
+
 		void SWRenderer::AddLongSprite(client::IImage &, spades::Vector3 p1, spades::Vector3 p2,
 		                               float radius) {
 			SPADES_MARK_FUNCTION();
@@ -725,9 +674,7 @@ namespace spades {
 			}
 
 			// draw models
-			for (auto &m : models) {
-				modelRenderer->Render(*m.model, m.param);
-			}
+			RenderModels();
 			models.clear();
 
 			// deferred lighting
@@ -736,54 +683,21 @@ namespace spades {
 			}
 			lights.clear();
 
+#if ENABLE_AVX2
+			if (featureLevel >= SWFeatureLevel::AVX2)
+				ApplyFog<SWFeatureLevel::AVX2>();
+			else
+#endif
 #if ENABLE_SSE2
-			if (static_cast<int>(featureLevel) >= static_cast<int>(SWFeatureLevel::SSE2))
+			if (featureLevel >= SWFeatureLevel::SSE2)
 				ApplyFog<SWFeatureLevel::SSE2>();
 			else
 #endif
 				ApplyFog<SWFeatureLevel::None>();
 
 			// render sprites
-			{
-				imageRenderer->SetShaderType(SWImageRenderer::ShaderType::Sprite);
-				imageRenderer->SetMatrix(projectionViewMatrix);
-				imageRenderer->SetZRange(sceneDef.zNear, sceneDef.zFar);
-
-				auto right = sceneDef.viewAxis[0];
-				auto up = sceneDef.viewAxis[1];
-				for (std::size_t i = 0; i < sprites.size(); i++) {
-					auto &spr = sprites[i];
-					float s = sinf(spr.rotation) * spr.radius;
-					float c = cosf(spr.rotation) * spr.radius;
-					auto trans = [s, c, &spr, right, up](float x, float y) {
-						auto v = spr.center;
-						v += right * (c * x - s * y);
-						v += up * (s * x + c * y);
-						return MakeVector4(v.x, v.y, v.z, 1.f);
-					};
-					auto x1 = trans(-1.f, -1.f);
-					auto x2 = trans(1.f, -1.f);
-					auto x3 = trans(-1.f, 1.f);
-					auto x4 = trans(1.f, 1.f);
-					SWImageRenderer::Vertex v1, v2, v3;
-					v1.color = v2.color = v3.color = spr.color;
-					v1.uv = MakeVector2(0.f, 0.f);
-					v1.position = x1;
-					v2.uv = MakeVector2(1.f, 0.f);
-					v2.position = x2;
-					v3.uv = MakeVector2(0.f, 1.f);
-					v3.position = x3;
-					imageRenderer->DrawPolygon(spr.img.GetPointerOrNull(), v1, v2, v3);
-					v1.uv = MakeVector2(1.f, 0.f);
-					v1.position = x2;
-					v2.uv = MakeVector2(1.f, 1.f);
-					v2.position = x4;
-					v3.uv = MakeVector2(0.f, 1.f);
-					v3.position = x3;
-					imageRenderer->DrawPolygon(spr.img.GetPointerOrNull(), v1, v2, v3);
-				}
-				sprites.clear();
-			}
+			RenderSprites();
+			sprites.clear();
 
 			// render debug lines
 			{
@@ -917,6 +831,163 @@ namespace spades {
 			duringSceneRendering = false;
 		}
 
+		void SWRenderer::RenderModels() {
+			SPADES_MARK_FUNCTION();
+
+			if (models.empty()) {
+				return;
+			}
+
+			// transform the models. this doesn't touch the framebuffer, so models can be
+			// processed in any order
+			if (preparedModels.size() < models.size()) {
+				preparedModels.resize(models.size());
+			}
+			{
+				std::atomic<std::size_t> nextModel{0};
+				InvokeParallel2([&](unsigned int, unsigned int) {
+					std::size_t i;
+					while ((i = nextModel.fetch_add(1)) < models.size()) {
+						modelRenderer->Prepare(*models[i].model, models[i].param,
+						                       preparedModels[i]);
+					}
+				});
+			}
+
+			tileBinner->Reset(fb->GetWidth(), fb->GetHeight());
+			for (std::size_t i = 0; i < models.size(); i++) {
+				const auto &prepared = preparedModels[i];
+				if (prepared.splats.empty()) {
+					continue;
+				}
+				tileBinner->Add(static_cast<std::uint32_t>(i), prepared.minX, prepared.minY,
+				                prepared.maxX, prepared.maxY,
+				                static_cast<std::uint32_t>(prepared.splats.size()));
+			}
+			tileBinner->StartDispatch();
+
+			InvokeParallel2([&](unsigned int, unsigned int) {
+				SWTileBinner::Tile tile;
+				while (tileBinner->PopTile(tile)) {
+					for (std::uint32_t i : *tile.indices) {
+						modelRenderer->Draw(preparedModels[i], tile.minX, tile.minY, tile.maxX,
+						                    tile.maxY);
+					}
+				}
+			});
+		}
+
+		void SWRenderer::RenderSprites() {
+			SPADES_MARK_FUNCTION();
+
+			if (sprites.empty()) {
+				return;
+			}
+
+			imageRenderer->SetShaderType(SWImageRenderer::ShaderType::Sprite);
+			imageRenderer->SetMatrix(projectionViewMatrix);
+			imageRenderer->SetZRange(sceneDef.zNear, sceneDef.zFar);
+
+			int fw = fb->GetWidth();
+			int fh = fb->GetHeight();
+			float cw = fw * 0.5f;
+			float ch = fh * 0.5f;
+
+			auto right = sceneDef.viewAxis[0];
+			auto up = sceneDef.viewAxis[1];
+			spriteQuads.resize(sprites.size());
+			tileBinner->Reset(fw, fh);
+			for (std::size_t i = 0; i < sprites.size(); i++) {
+				auto &spr = sprites[i];
+				float s = sinf(spr.rotation) * spr.radius;
+				float c = cosf(spr.rotation) * spr.radius;
+				auto trans = [s, c, &spr, right, up](float x, float y) {
+					auto v = spr.center;
+					v += right * (c * x - s * y);
+					v += up * (s * x + c * y);
+					return MakeVector4(v.x, v.y, v.z, 1.f);
+				};
+				auto &quad = spriteQuads[i];
+				quad[0] = trans(-1.f, -1.f);
+				quad[1] = trans(1.f, -1.f);
+				quad[2] = trans(-1.f, 1.f);
+				quad[3] = trans(1.f, 1.f);
+
+				// compute a conservative screen-space bounding rectangle. a sprite clipped
+				// by the near plane may cover anywhere on the screen.
+				float minX = static_cast<float>(fw), minY = static_cast<float>(fh);
+				float maxX = 0.f, maxY = 0.f;
+				bool clipped = false;
+				for (const auto &corner : quad) {
+					auto v = projectionViewMatrix * corner;
+					if (v.z < sceneDef.zNear || v.w <= 0.f) {
+						clipped = true;
+						break;
+					}
+					float x = v.x / v.w * cw + cw;
+					float y = ch - v.y / v.w * ch;
+					minX = std::min(minX, x);
+					minY = std::min(minY, y);
+					maxX = std::max(maxX, x);
+					maxY = std::max(maxY, y);
+				}
+				if (clipped) {
+					tileBinner->Add(static_cast<std::uint32_t>(i), 0, 0, fw, fh,
+					                static_cast<std::uint32_t>(fw * fh));
+					continue;
+				}
+
+				// `SWImageRenderer` uses an approximate reciprocal for the perspective
+				// division, so leave some margin
+				const float margin = 2.f;
+				int iMinX = static_cast<int>(std::floor(std::max(minX - margin, -1.f)));
+				int iMinY = static_cast<int>(std::floor(std::max(minY - margin, -1.f)));
+				int iMaxX = static_cast<int>(std::ceil(std::min(maxX + margin, fw + 1.f)));
+				int iMaxY = static_cast<int>(std::ceil(std::min(maxY + margin, fh + 1.f)));
+				if (iMinX >= iMaxX || iMinY >= iMaxY) {
+					continue;
+				}
+				tileBinner->Add(static_cast<std::uint32_t>(i), iMinX, iMinY, iMaxX, iMaxY,
+				                static_cast<std::uint32_t>((iMaxX - iMinX) * (iMaxY - iMinY)));
+			}
+			tileBinner->StartDispatch();
+
+			std::atomic<unsigned long long> pixelsDrawn{0};
+			InvokeParallel2([&](unsigned int, unsigned int) {
+				// each thread has its own copy for the scissor rectangle and the statistics
+				SWImageRenderer renderer = *imageRenderer;
+				renderer.ResetPixelStatistics();
+
+				SWTileBinner::Tile tile;
+				while (tileBinner->PopTile(tile)) {
+					renderer.SetScissor(tile.minX, tile.minY, tile.maxX, tile.maxY);
+					for (std::uint32_t i : *tile.indices) {
+						const auto &spr = sprites[i];
+						const auto &quad = spriteQuads[i];
+						SWImageRenderer::Vertex v1, v2, v3;
+						v1.color = v2.color = v3.color = spr.color;
+						v1.uv = MakeVector2(0.f, 0.f);
+						v1.position = quad[0];
+						v2.uv = MakeVector2(1.f, 0.f);
+						v2.position = quad[1];
+						v3.uv = MakeVector2(0.f, 1.f);
+						v3.position = quad[2];
+						renderer.DrawPolygon(spr.img.GetPointerOrNull(), v1, v2, v3);
+						v1.uv = MakeVector2(1.f, 0.f);
+						v1.position = quad[1];
+						v2.uv = MakeVector2(1.f, 1.f);
+						v2.position = quad[3];
+						v3.uv = MakeVector2(0.f, 1.f);
+						v3.position = quad[2];
+						renderer.DrawPolygon(spr.img.GetPointerOrNull(), v1, v2, v3);
+					}
+				}
+
+				pixelsDrawn.fetch_add(renderer.GetPixelsDrawn());
+			});
+			imageRenderer->AddPixelStatistics(pixelsDrawn.load());
+		}
+
 		void SWRenderer::MultiplyScreenColor(spades::Vector3 v) { EnsureSceneNotStarted(); }
 
 		void SWRenderer::SetColor(spades::Vector4 col) {
@@ -1040,6 +1111,11 @@ namespace spades {
 			SPADES_MARK_FUNCTION();
 			EnsureValid();
 			EnsureSceneNotStarted();
+
+			if (mapRenderer) {
+				// Nothing refers to the RLE data between frames
+				mapRenderer->CompactRle();
+			}
 		}
 
 		void SWRenderer::Flip() {
@@ -1145,12 +1221,13 @@ namespace spades {
 			return true;
 		}
 
-		void SWRenderer::GameMapChanged(int x, int y, int z, client::GameMap *map) {
+		void SWRenderer::GameMapChanged(const IntVector3 &min, const IntVector3 &max,
+		                                client::GameMap *map) {
 			if (map != this->map.GetPointerOrNull()) {
 				return;
 			}
 
-			flatMapRenderer->SetNeedsUpdate(x, y);
+			flatMapRenderer->SetNeedsUpdate(min.x, min.y, max.x, max.y);
 		}
 	} // namespace draw
 } // namespace spades
@@ -26,6 +26,7 @@
 #include <vector>
 
 #include "SWFeatureLevel.h"
+#include "SWModelRenderer.h"
 #include <Client/IGameMapListener.h>
 #include <Client/IRenderer.h>
 #include <Client/SceneDefinition.h>
@@ -39,11 +40,11 @@ namespace spades {
 		class SWImageManager;
 		class SWModelManager;
 		class SWImageRenderer;
-		class SWModelRenderer;
 		class SWFlatMapRenderer;
 		class SWMapRenderer;
 		class SWImage;
 		class SWModel;
+		class SWTileBinner;
 
 		class SWRenderer : public client::IRenderer, public client::IGameMapListener {
 			friend class SWFlatMapRenderer;
@@ -67,6 +68,9 @@ namespace spades {
 			std::shared_ptr<SWFlatMapRenderer> flatMapRenderer;
 			std::shared_ptr<SWMapRenderer> mapRenderer;
 
+			/** Sorts models and sprites into screen tiles so they can be drawn in parallel. */
+			std::shared_ptr<SWTileBinner> tileBinner;
+
 			struct Sprite {
 				Handle<SWImage> img;
 				Vector3 center;
@@ -75,6 +79,8 @@ namespace spades {
 				Vector4 color;
 			};
 			std::vector<Sprite> sprites;
+			/** The world-space corners of `sprites`' quads. */
+			std::vector<std::array<Vector4, 4>> spriteQuads;
 
 			struct LongSprite {
 				Handle<SWImage> img;
@@ -90,6 +96,8 @@ namespace spades {
 				client::ModelRenderParam param;
 			};
 			std::vector<Model> models;
+			/** `models` transformed to splats. Reused across frames to keep the allocations. */
+			std::vector<SWModelRenderer::PreparedModel> preparedModels;
 
 			struct DynamicLight {
 				client::DynamicLightParam param;
@@ -133,6 +141,8 @@ namespace spades {
 			void RenderDebugLines();
 
 			void RenderObjects();
+			void RenderModels();
+			void RenderSprites();
 
 			void EnsureInitialized();
 			void EnsureSceneStarted();
@@ -156,9 +166,16 @@ namespace spades {
 
 			Handle<client::IImage> RegisterImage(const char *filename) override;
 			Handle<client::IModel> RegisterModel(const char *filename) override;
+			std::unique_ptr<client::PreloadedModel> PreloadModel(const char *filename) override;
+			Handle<client::IModel> RegisterPreloadedModel(const char *filename,
+			                                              client::PreloadedModel &) override;
+			Handle<client::IImage> RegisterPreloadedImage(const char *filename,
+			                                              Bitmap &) override;
 
 			Handle<client::IImage> CreateImage(Bitmap &) override;
 			Handle<client::IModel> CreateModel(VoxelModel &) override;
+			std::unique_ptr<client::PreloadedModel> PreloadVoxelModel(VoxelModel &) override;
+			Handle<client::IModel> CreatePreloadedModel(client::PreloadedModel &) override;
 
 			void ClearCache() override;
 
@@ -179,6 +196,7 @@ namespace spades {
 
 			void AddSprite(client::IImage &, Vector3 center, float radius, float rotation) override;
 			void AddLongSprite(client::IImage &, Vector3 p1, Vector3 p2, float radius) override;
+			void AddSprites(const client::SpriteParam *, std::size_t numSprites) override;
 
 			void EndScene() override;
 
@@ -210,7 +228,8 @@ namespace spades {
 			const Matrix4 &GetProjectionViewMatrix() const { return projectionViewMatrix; }
 			const Matrix4 &GetViewMatrix() const { return viewMatrix; }
 
-			void GameMapChanged(int x, int y, int z, client::GameMap *) override;
+			void GameMapChanged(const IntVector3 &min, const IntVector3 &max,
+			                    client::GameMap *) override;
 
 			const client::SceneDefinition &GetSceneDef() const { return sceneDef; }
 
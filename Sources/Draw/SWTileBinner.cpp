@@ -0,0 +1,100 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+
+#include "SWTileBinner.h"
+
+namespace spades {
+	namespace draw {
+		SWTileBinner::SWTileBinner()
+		    : width(0), height(0), numTilesX(0), numTilesY(0), queueHead(0) {}
+
+		void SWTileBinner::Reset(int width, int height) {
+			this->width = width;
+			this->height = height;
+			numTilesX = (width + TileSize - 1) >> TileSizeBits;
+			numTilesY = (height + TileSize - 1) >> TileSizeBits;
+
+			std::size_t numTiles = static_cast<std::size_t>(numTilesX * numTilesY);
+			bins.resize(numTiles);
+			for (auto &bin : bins) {
+				// Keep the capacity for the next frame
+				bin.clear();
+			}
+			costs.assign(numTiles, 0);
+			queue.clear();
+			queueHead.store(0, std::memory_order_relaxed);
+		}
+
+		void SWTileBinner::Add(std::uint32_t index, int minX, int minY, int maxX, int maxY,
+		                       std::uint32_t cost) {
+			minX = std::max(minX, 0);
+			minY = std::max(minY, 0);
+			maxX = std::min(maxX, width);
+			maxY = std::min(maxY, height);
+			if (minX >= maxX || minY >= maxY) {
+				return;
+			}
+
+			int tx1 = minX >> TileSizeBits, tx2 = (maxX - 1) >> TileSizeBits;
+			int ty1 = minY >> TileSizeBits, ty2 = (maxY - 1) >> TileSizeBits;
+			for (int ty = ty1; ty <= ty2; ty++) {
+				for (int tx = tx1; tx <= tx2; tx++) {
+					int tile = tx + ty * numTilesX;
+					bins[tile].push_back(index);
+					costs[tile] += cost;
+				}
+			}
+		}
+
+		void SWTileBinner::StartDispatch() {
+			queue.clear();
+			for (int i = 0; i < static_cast<int>(bins.size()); i++) {
+				if (!bins[i].empty()) {
+					queue.push_back(i);
+				}
+			}
+
+			// Hand out the busiest tiles first so that no thread is left with a heavy tile
+			// while the others are idle
+			std::stable_sort(queue.begin(), queue.end(),
+			                 [this](int a, int b) { return costs[a] > costs[b]; });
+
+			queueHead.store(0, std::memory_order_release);
+		}
+
+		bool SWTileBinner::PopTile(Tile &outTile) {
+			std::size_t i = queueHead.fetch_add(1, std::memory_order_acq_rel);
+			if (i >= queue.size()) {
+				return false;
+			}
+
+			int tile = queue[i];
+			int tx = tile % numTilesX, ty = tile / numTilesX;
+			outTile.minX = tx << TileSizeBits;
+			outTile.minY = ty << TileSizeBits;
+			outTile.maxX = std::min(outTile.minX + TileSize, width);
+			outTile.maxY = std::min(outTile.minY + TileSize, height);
+			outTile.indices = &bins[tile];
+			return true;
+		}
+	} // namespace draw
+} // namespace spades
@@ -0,0 +1,81 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace spades {
+	namespace draw {
+		/**
+		 * Sorts screen-space primitives into fixed-size tiles of the framebuffer, so that
+		 * each tile can be rendered by a single thread while its part of the framebuffer and
+		 * the depth buffer stays in the cache.
+		 *
+		 * Primitives are identified by indices. A tile lists the primitives overlapping it in
+		 * the order they were added, so drawing them in that order (clipped to the tile)
+		 * produces the same image as drawing every primitive sequentially.
+		 *
+		 * Usage: `Reset`, `Add` each primitive, `StartDispatch`, and then call `PopTile`
+		 * from any number of threads until it returns `false`.
+		 */
+		class SWTileBinner {
+		public:
+			/** The width and the height of a tile. Tile boundaries are thus at even pixels. */
+			enum { TileSizeBits = 6, TileSize = 1 << TileSizeBits };
+
+			struct Tile {
+				int minX, minY, maxX, maxY;
+				const std::vector<std::uint32_t> *indices;
+			};
+
+			SWTileBinner();
+
+			/** Removes all primitives and sets the size of the framebuffer. */
+			void Reset(int width, int height);
+
+			/**
+			 * Adds a primitive covering the rectangle `[minX, maxX) × [minY, maxY)`. The parts
+			 * outside the framebuffer are ignored.
+			 *
+			 * @param cost The estimated cost of drawing the primitive, used to hand out the
+			 *             busiest tiles first.
+			 */
+			void Add(std::uint32_t index, int minX, int minY, int maxX, int maxY,
+			         std::uint32_t cost = 1);
+
+			/** Builds the queue of non-empty tiles consumed by `PopTile`. */
+			void StartDispatch();
+
+			/** Takes the next tile from the queue. This method is thread-safe. */
+			bool PopTile(Tile &);
+
+		private:
+			int width, height;
+			int numTilesX, numTilesY;
+			std::vector<std::vector<std::uint32_t>> bins;
+			std::vector<std::uint64_t> costs;
+			std::vector<int> queue;
+			std::atomic<std::size_t> queueHead;
+		};
+	} // namespace draw
+} // namespace spades
@@ -24,8 +24,8 @@
 #include <array>
 #include <memory>
 
-#include <Core/ConcurrentDispatch.h>
 #include <Core/Debug.h>
+#include <Core/ThreadPool.h>
 
 namespace spades {
 	namespace draw {
@@ -33,17 +33,8 @@ namespace spades {
 
 		template <class F> static void InvokeParallel(F f, unsigned int numThreads) {
 			SPAssert(numThreads <= 32);
-			std::array<std::unique_ptr<ConcurrentDispatch>, 32> disp;
-			for (auto i = 1U; i < numThreads; i++) {
-				auto ff = [i, &f]() { f(i); };
-				disp[i] = std::unique_ptr<ConcurrentDispatch>(
-				  static_cast<ConcurrentDispatch *>(new FunctionDispatch<decltype(ff)>(ff)));
-				disp[i]->Start();
-			}
-			f(0);
-			for (auto i = 1U; i < numThreads; i++) {
-				disp[i]->Join();
-			}
+			ThreadPool::GetGlobalPool().ParallelFor(
+			  0, numThreads, 1, [&f](std::size_t i) { f(static_cast<unsigned int>(i)); });
 		}
 
 		template <class F> static void InvokeParallel2(F f) {
@@ -52,17 +43,9 @@ namespace spades {
 			numThreads = std::max(numThreads, 1U);
 			numThreads = std::min(numThreads, 32U);
 
-			std::array<std::unique_ptr<ConcurrentDispatch>, 32> disp;
-			for (auto i = 1U; i < numThreads; i++) {
-				auto ff = [i, &f, numThreads]() { f(i, numThreads); };
-				disp[i] = std::unique_ptr<ConcurrentDispatch>(
-				  static_cast<ConcurrentDispatch *>(new FunctionDispatch<decltype(ff)>(ff)));
-				disp[i]->Start();
-			}
-			f(0, numThreads);
-			for (auto i = 1U; i < numThreads; i++) {
-				disp[i]->Join();
-			}
+			ThreadPool::GetGlobalPool().ParallelFor(
+			  0, numThreads, 1,
+			  [&f, numThreads](std::size_t i) { f(static_cast<unsigned int>(i), numThreads); });
 		}
 
 		static inline PURE int ToFixed8(float v) {
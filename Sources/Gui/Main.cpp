@@ -37,11 +37,15 @@
 #include <Client/Client.h>
 #include <Client/Fonts.h>
 #include <Client/GameMap.h>
+#include <Client/NetDemo.h>
+#include <Client/PlayerPredictionSelfTest.h>
 #include <Core/ConcurrentDispatch.h>
 #include <Core/CpuID.h>
 #include <Core/Debug.h>
 #include <Core/DirectoryFileSystem.h>
 #include <Core/FileManager.h>
+#include <Core/MappedFile.h>
+#include <Core/MappedZipFileSystem.h>
 #include <Core/ServerAddress.h>
 #include <Core/Settings.h>
 #include <Core/Strings.h>
@@ -53,7 +57,9 @@
 #include <OpenSpades.h>
 
 #include <Core/VoxelModel.h>
+#include <Draw/AmbientShadowVolumeSelfTest.h>
 #include <Draw/GLOptimizedVoxelModel.h>
+#include <Draw/SWKernelSelfTest.h>
 
 #include <ScriptBindings/ScriptManager.h>
 
@@ -67,6 +73,7 @@ FILE __iob_func[3] = {*stdin, *stdout, *stderr};
 #endif
 
 DEFINE_SPADES_SETTING(cl_showStartupWindow, "1");
+DEFINE_SPADES_SETTING(core_mappedPaks, "1");
 
 #ifdef WIN32
 // windows.h must be included before DbgHelp.h and shlobj.h.
@@ -184,9 +191,14 @@ namespace {
 
 	bool g_printVersion = false;
 	bool g_printHelp = false;
+	bool g_selfTest = false;
+
+	bool g_playDemo = false;
+	std::string g_playDemoPath;
 
 	void printHelp(char *binaryName) {
-		printf("usage: %s [server_address] [v=protocol_version] [-h|--help] [-v|--version] \n",
+		printf("usage: %s [server_address] [v=protocol_version] [--play-demo demo_file] "
+		       "[-h|--help] [-v|--version] [--self-test] \n",
 		       binaryName);
 	}
 
@@ -218,6 +230,15 @@ namespace {
 				g_printHelp = true;
 				return ++i;
 			}
+			if (!strcasecmp(a, "--self-test")) {
+				g_selfTest = true;
+				return ++i;
+			}
+			if (!strcasecmp(a, "--play-demo") && i + 1 < argc) {
+				g_playDemo = true;
+				g_playDemoPath = argv[i + 1];
+				return i += 2;
+			}
 		}
 
 		return 0;
@@ -246,6 +267,38 @@ namespace spades {
 		ConcreteRunner runner(addr);
 		runner.RunProtected();
 	}
+	/**
+	 * Replays a demo without a window and prints the statistics to the standard output.
+	 * Returns the exit code of the program.
+	 */
+	int PlayDemoHeadless(const std::string &path) {
+		SPADES_MARK_FUNCTION();
+
+		try {
+			auto file = MappedFile::Open(path);
+			client::NetDemoPlayer player{file->GetData(), file->GetSize()};
+			client::NetDemoPlayer::Statistics stats = player.Run();
+
+			printf("Packets:         %llu (%.1f MB)\n",
+			       static_cast<unsigned long long>(stats.numPackets), stats.numBytes / 1048576.0);
+			printf("Demo duration:   %.1f s\n", stats.demoDuration);
+			printf("Wall time:       %.3f s (%.1fx real time)\n", stats.wallTime,
+			       stats.demoDuration / std::max(stats.wallTime, 1.0e-6));
+			printf("Map load:        %.3f s\n", stats.mapLoadTime);
+			printf("Packet handlers: %.3f s\n", stats.packetTime);
+			printf("World::Advance:  %.3f s (%llu frames, %.3f ms/frame)\n", stats.advanceTime,
+			       static_cast<unsigned long long>(stats.numFrames),
+			       stats.advanceTime * 1000.0 / std::max<double>(stats.numFrames, 1.0));
+			printf("World digest:    %016llx\n",
+			       static_cast<unsigned long long>(stats.worldDigest));
+			return 0;
+		} catch (const std::exception &ex) {
+			SPLog("Demo playback failed: %s", ex.what());
+			fprintf(stderr, "Demo playback failed: %s\n", ex.what());
+			return 1;
+		}
+	}
+
 	void StartMainScreen() {
 		class ConcreteRunner : public spades::gui::Runner {
 		protected:
@@ -264,6 +317,19 @@ namespace spades {
 	}
 } // namespace spades
 
+static uLong computeCrc32ForBytes(const char *data, size_t size) {
+	uLong crc = crc32(0L, Z_NULL, 0);
+
+	while (size > 0) {
+		auto chunk = static_cast<uInt>(std::min<size_t>(size, 1 << 30));
+		crc = crc32(crc, reinterpret_cast<const Bytef *>(data), chunk);
+		data += chunk;
+		size -= chunk;
+	}
+
+	return crc;
+}
+
 static uLong computeCrc32ForStream(spades::IStream *s) {
 	uLong crc = crc32(0L, Z_NULL, 0);
 
@@ -332,6 +398,21 @@ int main(int argc, char **argv) {
 		return 0;
 	}
 
+	if (g_selfTest) {
+		// Runs the checks that don't need the game window or resources, and reports the
+		// result through the exit code (used by CTest)
+		try {
+			spades::reflection::Backtrace::StartBacktrace();
+			bool passed = spades::draw::RunSWKernelSelfTest();
+			passed = spades::client::RunPlayerPredictionSelfTest() && passed;
+			passed = spades::draw::RunAmbientShadowVolumeSelfTest() && passed;
+			return passed ? 0 : 1;
+		} catch (const std::exception &ex) {
+			printf("Self-test failed: %s\n", ex.what());
+			return 1;
+		}
+	}
+
 	std::unique_ptr<spades::SplashWindow> splashWindow;
 
 	try {
@@ -340,11 +421,17 @@ int main(int argc, char **argv) {
 		spades::reflection::Backtrace::StartBacktrace();
 		SPADES_MARK_FUNCTION();
 
-		// show splash window
+		// show splash window (unless running headless)
 		// NOTE: splash window uses image loader, which assumes backtrace is already initialized.
-		splashWindow.reset(new spades::SplashWindow());
+		if (!g_playDemo) {
+			splashWindow.reset(new spades::SplashWindow());
+		}
 		auto showSplashWindowTime = SDL_GetTicks();
-		auto pumpEvents = [&splashWindow] { splashWindow->PumpEvents(); };
+		auto pumpEvents = [&splashWindow] {
+			if (splashWindow) {
+				splashWindow->PumpEvents();
+			}
+		};
 
 		// initialize threads
 		spades::Thread::InitThreadSystem();
@@ -480,7 +567,8 @@ int main(int argc, char **argv) {
 			  "OpenSpades will continue to run, but any critical events are not logged.",
 			  ex.what());
 			if (SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_WARNING, "OpenSpades Log System Failure",
-			                             msg.c_str(), splashWindow->GetWindow())) {
+			                             msg.c_str(),
+			                             splashWindow ? splashWindow->GetWindow() : nullptr)) {
 				// showing dialog failed.
 			}
 		}
@@ -578,12 +666,26 @@ int main(int argc, char **argv) {
 				}
 
 				if (spades::FileManager::FileExists(name.c_str())) {
-					auto stream = spades::FileManager::OpenForReading(name.c_str());
-					uLong crc = computeCrc32ForStream(stream.get());
+					spades::IFileSystem *fs = nullptr;
+					uLong crc = 0;
+					if (core_mappedPaks) {
+						try {
+							auto mapped = spades::FileManager::OpenMapped(name.c_str());
+							crc = computeCrc32ForBytes(mapped->GetData(), mapped->GetSize());
+							fs = new spades::MappedZipFileSystem(std::move(mapped));
+						} catch (const std::exception &ex) {
+							SPLog("Failed to map %s (falling back to the unzip library): %s",
+							      name.c_str(), ex.what());
+						}
+					}
+					if (!fs) {
+						auto stream = spades::FileManager::OpenForReading(name.c_str());
+						crc = computeCrc32ForStream(stream.get());
 
-					stream->SetPosition(0);
+						stream->SetPosition(0);
 
-					spades::ZipFileSystem *fs = new spades::ZipFileSystem(stream.release());
+						fs = new spades::ZipFileSystem(stream.release());
+					}
 					if (name[0] == '_' && false) { // last resort for #198
 						SPLog("Pak registered: %s: %08lx (marked as 'important')", name.c_str(),
 						      static_cast<unsigned long>(crc));
@@ -610,6 +712,12 @@ int main(int argc, char **argv) {
 		_Tr("Main", "Localization System Loaded");
 		pumpEvents();
 
+		if (g_playDemo) {
+			int exitCode = spades::PlayDemoHeadless(g_playDemoPath);
+			spades::FileManager::Close();
+			return exitCode;
+		}
+
 		// parse args
 
 		// initialize AngelScript
@@ -0,0 +1,341 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "ScriptBytecodeCache.h"
+#include <Core/Debug.h>
+#include <Core/Exception.h>
+#include <Core/FileManager.h>
+#include <Core/IStream.h>
+#include <Core/MappedFile.h>
+#include <Core/Settings.h>
+
+DEFINE_SPADES_SETTING(core_scriptCache, "1");
+
+namespace spades {
+	namespace {
+		// Bump the version when the file format changes
+		const char Magic[8] = {'S', 'P', 'A', 'S', 'B', 'C', '0', '1'};
+
+		// 64-bit FNV-1a
+		constexpr std::uint64_t HashInitialValue = 0xcbf29ce484222325ULL;
+		constexpr std::uint64_t HashPrime = 0x100000001b3ULL;
+
+		class Hasher {
+		public:
+			Hasher() : hash{HashInitialValue} {}
+
+			void Update(const void *bytes, std::size_t numBytes) {
+				const auto *p = static_cast<const std::uint8_t *>(bytes);
+				std::uint64_t h = hash;
+				for (std::size_t i = 0; i < numBytes; ++i) {
+					h = (h ^ p[i]) * HashPrime;
+				}
+				hash = h;
+			}
+
+			/** Hashes a string including its terminator so adjacent strings don't mix. */
+			void Update(const char *str) {
+				if (!str) {
+					str = "";
+				}
+				Update(str, std::strlen(str) + 1);
+			}
+
+			void Update(std::uint64_t value) { Update(&value, sizeof(value)); }
+
+			std::uint64_t GetHash() const { return hash; }
+
+		private:
+			std::uint64_t hash;
+		};
+
+		class BytecodeWriter : public asIBinaryStream {
+		public:
+			explicit BytecodeWriter(std::string &out) : out{out} {}
+
+			void Read(void *, asUINT) override { SPAssert(false); }
+			void Write(const void *ptr, asUINT size) override {
+				out.append(static_cast<const char *>(ptr), size);
+			}
+
+		private:
+			std::string &out;
+		};
+
+		class BytecodeReader : public asIBinaryStream {
+		public:
+			BytecodeReader(const char *data, std::size_t size)
+			    : data{data}, size{size}, position{0} {}
+
+			void Read(void *ptr, asUINT numBytes) override {
+				// AngelScript can't handle errors here; the data is verified beforehand
+				std::size_t available = std::min<std::size_t>(numBytes, size - position);
+				std::memcpy(ptr, data + position, available);
+				std::memset(static_cast<char *>(ptr) + available, 0, numBytes - available);
+				position += available;
+			}
+			void Write(const void *, asUINT) override { SPAssert(false); }
+
+		private:
+			const char *data;
+			std::size_t size;
+			std::size_t position;
+		};
+
+		/** Reads the fields of a cache file. Throws an exception if the file is truncated. */
+		class FileReader {
+		public:
+			FileReader(const char *data, std::size_t size) : data{data}, size{size}, position{0} {}
+
+			const char *ReadBytes(std::size_t numBytes) {
+				if (numBytes > size - position) {
+					SPRaise("Unexpected end of file");
+				}
+				const char *p = data + position;
+				position += numBytes;
+				return p;
+			}
+
+			template <class T> T Read() {
+				T value;
+				std::memcpy(&value, ReadBytes(sizeof(T)), sizeof(T));
+				return value;
+			}
+
+		private:
+			const char *data;
+			std::size_t size;
+			std::size_t position;
+		};
+
+		template <class T> void Append(std::string &out, T value) {
+			out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+		}
+
+		void HashFunction(Hasher &hasher, asIScriptFunction *func) {
+			hasher.Update(func ? func->GetDeclaration(true, true, true) : "");
+		}
+
+		void HashType(Hasher &hasher, asITypeInfo *type) {
+			hasher.Update(type->GetNamespace());
+			hasher.Update(type->GetName());
+			hasher.Update(static_cast<std::uint64_t>(type->GetFlags()));
+			hasher.Update(static_cast<std::uint64_t>(type->GetSize()));
+			for (asUINT i = 0; i < type->GetFactoryCount(); ++i) {
+				HashFunction(hasher, type->GetFactoryByIndex(i));
+			}
+			for (asUINT i = 0; i < type->GetBehaviourCount(); ++i) {
+				asEBehaviours behaviour;
+				HashFunction(hasher, type->GetBehaviourByIndex(i, &behaviour));
+				hasher.Update(static_cast<std::uint64_t>(behaviour));
+			}
+			for (asUINT i = 0; i < type->GetMethodCount(); ++i) {
+				HashFunction(hasher, type->GetMethodByIndex(i));
+			}
+			for (asUINT i = 0; i < type->GetPropertyCount(); ++i) {
+				hasher.Update(type->GetPropertyDeclaration(i, true));
+			}
+		}
+	} // namespace
+
+	ScriptBytecodeCache::ScriptBytecodeCache(asIScriptEngine &engine,
+	                                         const std::string &configuration) {
+		SPADES_MARK_FUNCTION();
+
+		Hasher hasher;
+		hasher.Update(ANGELSCRIPT_VERSION_STRING);
+		hasher.Update(asGetLibraryOptions());
+		hasher.Update(configuration.c_str());
+
+		for (int i = 0; i < asEP_LAST_PROPERTY; ++i) {
+			hasher.Update(
+			  static_cast<std::uint64_t>(engine.GetEngineProperty(static_cast<asEEngineProp>(i))));
+		}
+
+		for (asUINT i = 0; i < engine.GetObjectTypeCount(); ++i) {
+			HashType(hasher, engine.GetObjectTypeByIndex(i));
+		}
+		for (asUINT i = 0; i < engine.GetGlobalFunctionCount(); ++i) {
+			HashFunction(hasher, engine.GetGlobalFunctionByIndex(i));
+		}
+		for (asUINT i = 0; i < engine.GetGlobalPropertyCount(); ++i) {
+			const char *name, *nameSpace;
+			int typeId;
+			bool isConst;
+			engine.GetGlobalPropertyByIndex(i, &name, &nameSpace, &typeId, &isConst);
+			hasher.Update(nameSpace);
+			hasher.Update(name);
+			hasher.Update(engine.GetTypeDeclaration(typeId, true));
+			hasher.Update(static_cast<std::uint64_t>(isConst));
+		}
+		for (asUINT i = 0; i < engine.GetEnumCount(); ++i) {
+			asITypeInfo *type = engine.GetEnumByIndex(i);
+			HashType(hasher, type);
+			for (asUINT k = 0; k < type->GetEnumValueCount(); ++k) {
+				int value;
+				hasher.Update(type->GetEnumValueByIndex(k, &value));
+				hasher.Update(static_cast<std::uint64_t>(value));
+			}
+		}
+		for (asUINT i = 0; i < engine.GetFuncdefCount(); ++i) {
+			HashFunction(hasher, engine.GetFuncdefByIndex(i)->GetFuncdefSignature());
+		}
+		for (asUINT i = 0; i < engine.GetTypedefCount(); ++i) {
+			asITypeInfo *type = engine.GetTypedefByIndex(i);
+			HashType(hasher, type);
+			hasher.Update(engine.GetTypeDeclaration(type->GetTypedefTypeId(), true));
+		}
+
+		configurationHash = hasher.GetHash();
+	}
+
+	std::uint64_t ScriptBytecodeCache::HashSection(const std::string &contents) {
+		Hasher hasher;
+		hasher.Update(contents.data(), contents.size());
+		return hasher.GetHash();
+	}
+
+	std::string ScriptBytecodeCache::GetCachePath(asIScriptModule &module) {
+		return std::string("ScriptCache/") + module.GetName() + ".asbc";
+	}
+
+	// A cache file consists of the following fields:
+	//
+	//  - The magic number (`Magic`)
+	//  - The configuration hash
+	//  - The number of sections, followed by the name length, name, and hash of each section
+	//  - The size and hash of the bytecode, followed by the bytecode
+	bool ScriptBytecodeCache::Load(asIScriptModule &module) {
+		SPADES_MARK_FUNCTION();
+
+		if (!core_scriptCache) {
+			return false;
+		}
+
+		std::string path = GetCachePath(module);
+		if (!FileManager::FileExists(path.c_str())) {
+			SPLog("Script bytecode cache not found (%s)", path.c_str());
+			return false;
+		}
+
+		try {
+			auto file = FileManager::OpenMapped(path.c_str());
+			FileReader reader{file->GetData(), file->GetSize()};
+
+			if (std::memcmp(reader.ReadBytes(sizeof(Magic)), Magic, sizeof(Magic)) != 0) {
+				SPLog("Script bytecode cache has an unknown format (%s)", path.c_str());
+				return false;
+			}
+			if (reader.Read<std::uint64_t>() != configurationHash) {
+				SPLog("Script bytecode cache is outdated: the engine configuration has changed");
+				return false;
+			}
+
+			auto numSections = reader.Read<std::uint32_t>();
+			for (std::uint32_t i = 0; i < numSections; ++i) {
+				auto nameLength = reader.Read<std::uint32_t>();
+				std::string name{reader.ReadBytes(nameLength), nameLength};
+				auto hash = reader.Read<std::uint64_t>();
+
+				std::string contents;
+				try {
+					contents = FileManager::ReadAllBytes(("Scripts" + name).c_str());
+				} catch (const std::exception &) {
+					SPLog("Script bytecode cache is outdated: '%s' was removed", name.c_str());
+					return false;
+				}
+				if (HashSection(contents) != hash) {
+					SPLog("Script bytecode cache is outdated: '%s' was modified", name.c_str());
+					return false;
+				}
+			}
+
+			auto size = reader.Read<std::uint64_t>();
+			auto hash = reader.Read<std::uint64_t>();
+			const char *bytecode = reader.ReadBytes(static_cast<std::size_t>(size));
+
+			Hasher hasher;
+			hasher.Update(bytecode, static_cast<std::size_t>(size));
+			if (hasher.GetHash() != hash) {
+				SPLog("Script bytecode cache is corrupted (%s)", path.c_str());
+				return false;
+			}
+
+			BytecodeReader stream{bytecode, static_cast<std::size_t>(size)};
+			int ret = module.LoadByteCode(&stream);
+			if (ret < 0) {
+				SPLog("Failed to load the script bytecode cache (%s): error %d", path.c_str(),
+				      ret);
+				return false;
+			}
+		} catch (const std::exception &ex) {
+			SPLog("Failed to read the script bytecode cache (%s): %s", path.c_str(), ex.what());
+			return false;
+		}
+
+		return true;
+	}
+
+	void ScriptBytecodeCache::Store(asIScriptModule &module,
+	                                const std::vector<Section> &sections) {
+		SPADES_MARK_FUNCTION();
+
+		if (!core_scriptCache) {
+			return;
+		}
+
+		std::string bytecode;
+		BytecodeWriter stream{bytecode};
+		int ret = module.SaveByteCode(&stream);
+		if (ret < 0) {
+			SPLog("Failed to save the script bytecode: error %d", ret);
+			return;
+		}
+
+		std::string data{Magic, sizeof(Magic)};
+		Append(data, configurationHash);
+		Append(data, static_cast<std::uint32_t>(sections.size()));
+		for (const Section &section : sections) {
+			Append(data, static_cast<std::uint32_t>(section.name.size()));
+			data += section.name;
+			Append(data, section.hash);
+		}
+
+		Hasher hasher;
+		hasher.Update(bytecode.data(), bytecode.size());
+		Append(data, static_cast<std::uint64_t>(bytecode.size()));
+		Append(data, hasher.GetHash());
+		data += bytecode;
+
+		std::string path = GetCachePath(module);
+		try {
+			FileManager::OpenForWriting(path.c_str())->Write(data);
+		} catch (const std::exception &ex) {
+			SPLog("Failed to write the script bytecode cache (%s): %s", path.c_str(), ex.what());
+			return;
+		}
+
+		SPLog("Stored the script bytecode cache (%s, %d sections, %.1f KB)", path.c_str(),
+		      static_cast<int>(sections.size()), data.size() / 1024.0);
+	}
+} // namespace spades
@@ -0,0 +1,69 @@
+/*
+ Copyright (c) 2021 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <AngelScript/include/angelscript.h>
+
+namespace spades {
+	/**
+	 * A persistent cache of compiled script modules, located in the user resource directory.
+	 *
+	 * Each module is stored with the list of the script files it was built from and a hash
+	 * of the engine configuration (the AngelScript version and every registered API). A cached
+	 * module is only used if all of them are unchanged, so a warm start loads the bytecode
+	 * without preprocessing or compiling any scripts. Disabled by `core_scriptCache`.
+	 */
+	class ScriptBytecodeCache {
+	public:
+		/** A script file included in a module. */
+		struct Section {
+			/** The path relative to `Scripts`, e.g., `/Main.as`. */
+			std::string name;
+			std::uint64_t hash;
+		};
+
+		/**
+		 * @param configuration Additional options affecting the build, such as the
+		 *                      preprocessor words defined by the script builder.
+		 */
+		ScriptBytecodeCache(asIScriptEngine &engine, const std::string &configuration);
+
+		static std::uint64_t HashSection(const std::string &contents);
+
+		/**
+		 * Loads the cached bytecode of the specified (empty) module. Returns `false` if there
+		 * is no usable cache entry, in which case the module must be discarded and built from
+		 * the source.
+		 */
+		bool Load(asIScriptModule &);
+
+		/** Stores the bytecode of a module built from the specified sections. */
+		void Store(asIScriptModule &, const std::vector<Section> &);
+
+	private:
+		std::uint64_t configurationHash;
+
+		static std::string GetCachePath(asIScriptModule &);
+	};
+} // namespace spades
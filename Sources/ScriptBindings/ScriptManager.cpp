@@ -19,12 +19,14 @@
  */
 
 #include "ScriptManager.h"
+#include "ScriptBytecodeCache.h"
 #include <Core/Debug.h>
 #include <vector>
 #include <sstream>
 #include <Core/Exception.h>
 #include <Core/FileManager.h>
 #include <Core/IStream.h>
+#include <Core/Stopwatch.h>
 
 namespace spades {
 	
@@ -68,8 +70,12 @@ namespace spades {
 			}
 			
 			SPLog("Loading script '%s'", filename);
+			sections.push_back({filename, ScriptBytecodeCache::HashSection(data)});
 			return ProcessScriptSection(data.c_str(), (unsigned int)(data.length()), filename, 0);
 		}
+	public:
+		/** The script files loaded so far, which make up the module. */
+		std::vector<ScriptBytecodeCache::Section> sections;
 	};
 	
 	
@@ -103,17 +109,27 @@ namespace spades {
 			
 			SPLog("Loading scripts");
 			engine->SetDefaultNamespace("");
-			ScriptBuilder builder;
-			if(builder.StartNewModule(engine, "Client") < 0){
-				SPRaise("Failed to create script module.");
-			}
-			builder.DefineWord("CLIENT");
-			if(builder.AddSectionFromFile("/Main.as") < 0){
-				SPRaise("Failed to load '/Main.as'.");
-			}
-			SPLog("Building");
-			if(builder.BuildModule() < 0){
-				SPRaise("Failed to build at least one of the scripts.");
+			Stopwatch sw;
+			ScriptBytecodeCache cache(*engine, "CLIENT");
+			asIScriptModule *module = engine->GetModule("Client", asGM_ALWAYS_CREATE);
+			if(module && cache.Load(*module)){
+				SPLog("Loaded scripts from the bytecode cache in %.1f ms", sw.GetTime() * 1000.0);
+			}else{
+				// the module may be partially loaded; ScriptBuilder recreates it
+				ScriptBuilder builder;
+				if(builder.StartNewModule(engine, "Client") < 0){
+					SPRaise("Failed to create script module.");
+				}
+				builder.DefineWord("CLIENT");
+				if(builder.AddSectionFromFile("/Main.as") < 0){
+					SPRaise("Failed to load '/Main.as'.");
+				}
+				SPLog("Building");
+				if(builder.BuildModule() < 0){
+					SPRaise("Failed to build at least one of the scripts.");
+				}
+				SPLog("Built scripts in %.1f ms", sw.GetTime() * 1000.0);
+				cache.Store(*builder.GetModule(), builder.sections);
 			}
 			
 		}catch(...){
@@ -43,6 +43,9 @@
 
             cmakeFlags = [ "-DOPENSPADES_INSTALL_BINARY=bin" ];
 
+            # Runs the CTest tests (`openspades --self-test`)
+            doCheck = true;
+
             inherit notoFontPak;
           
             # Used by `downloadpak.sh`. Instructs the script to copy the